@@ -0,0 +1,352 @@
+// Load generator for HttpServer. Starts the server in-process with synthetic
+// handlers (no MySQL, no model provider) and drives it over loopback from
+// keep-alive client connections, one thread each, then reports throughput
+// and latency percentiles.
+//
+//   closed loop: every connection sends its next request as soon as the
+//                previous response arrived; measures peak throughput.
+//   open loop:   requests are scheduled at --rate per second across all
+//                connections and latency is measured from the scheduled
+//                time, so a stalled server shows up as queueing delay
+//                instead of silently lowering the offered load.
+//
+//   g++ -std=c++17 -O2 -Iinclude -o bench_http bench/bench_http.cpp src/http/*.cpp
+//       src/utils/{string_utils,compression,metrics,timer_wheel}.cpp -lpthread -lz -lbrotlienc -lssl -lcrypto
+//   ./bench_http --path health --connections 64 --duration 10
+//   ./bench_http --mode open --rate 20000 --path echo
+//   ./bench_http --target 127.0.0.1:8080 --path health   # an already running server
+//
+// Paths: health (GET /api/health), echo (POST /api/echo, JSON round trip),
+// file (GET /api/file, --file-size bytes sent with sendfile).
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "app_config.h"
+#include "http/http_server.h"
+#include "http/router.h"
+#include "logger.h"
+#include "utils/unique_fd.h"
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+  std::string mode = "closed";
+  std::string path = "health";
+  std::string target;  // host:port of an external server; empty starts one in-process
+  std::uint16_t port = 18090;
+  std::size_t connections = 32;
+  double duration_seconds = 10;
+  double warmup_seconds = 1;
+  double rate = 10000;  // open loop, requests per second across all connections
+  std::size_t server_threads = 4;
+  std::size_t shards = 1;
+  std::size_t file_size = 64 * 1024;
+};
+
+[[noreturn]] void Usage() {
+  std::fprintf(stderr,
+               "usage: bench_http [--mode closed|open] [--path health|echo|file] [--connections N]\n"
+               "                  [--duration S] [--warmup S] [--rate R] [--server-threads N] [--shards N]\n"
+               "                  [--file-size BYTES] [--port P] [--target HOST:PORT]\n");
+  std::exit(2);
+}
+
+Options ParseOptions(int argc, char* argv[]) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      Usage();
+    }
+    const std::string value = argv[++i];
+    if (arg == "--mode") {
+      options.mode = value;
+    } else if (arg == "--path") {
+      options.path = value;
+    } else if (arg == "--target") {
+      options.target = value;
+    } else if (arg == "--port") {
+      options.port = static_cast<std::uint16_t>(std::stoul(value));
+    } else if (arg == "--connections") {
+      options.connections = std::max<std::size_t>(1, std::stoul(value));
+    } else if (arg == "--duration") {
+      options.duration_seconds = std::stod(value);
+    } else if (arg == "--warmup") {
+      options.warmup_seconds = std::stod(value);
+    } else if (arg == "--rate") {
+      options.rate = std::stod(value);
+    } else if (arg == "--server-threads") {
+      options.server_threads = std::stoul(value);
+    } else if (arg == "--shards") {
+      options.shards = std::stoul(value);
+    } else if (arg == "--file-size") {
+      options.file_size = std::stoul(value);
+    } else {
+      Usage();
+    }
+  }
+  if ((options.mode != "closed" && options.mode != "open") ||
+      (options.path != "health" && options.path != "echo" && options.path != "file") || options.rate <= 0) {
+    Usage();
+  }
+  return options;
+}
+
+const std::string kEchoBody =
+    R"({"title":"Quarterly review","topic":"Revenue and hiring","pages":12,"style":"business",)"
+    R"("includeImages":true,"outline":[{"title":"Intro","keyPoints":["a","b","c"]}]})";
+
+void AddSyntheticRoutes(Router& router, const std::string& file_path, std::uint64_t file_size) {
+  router.AddRoute("GET", "/api/health", [](const HttpRequest&) {
+    return HttpResponse::Json(200, {{"status", "ok"}});
+  }, RouteOptions{false, 0, 10});
+  router.AddRoute("POST", "/api/echo", [](const HttpRequest& request) {
+    try {
+      return HttpResponse::Json(200, {{"echo", nlohmann::json::parse(request.body)}});
+    } catch (const std::exception&) {
+      return HttpResponse::Json(400, {{"message", "Invalid JSON"}});
+    }
+  });
+  router.AddRoute("GET", "/api/file", [file_path, file_size](const HttpRequest&) {
+    HttpResponse response;
+    auto fd = std::make_shared<UniqueFd>(::open(file_path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (!*fd) {
+      return HttpResponse::Json(500, {{"message", "File missing"}});
+    }
+    response.headers.Set(HeaderId::kContentType, "application/octet-stream");
+    response.body.clear();
+    response.file = FileBody{std::move(fd), 0, file_size};
+    return response;
+  });
+}
+
+std::string BuildRequest(const Options& options, const std::string& host) {
+  if (options.path == "echo") {
+    return "POST /api/echo HTTP/1.1\r\nHost: " + host + "\r\nContent-Type: application/json\r\nContent-Length: " +
+           std::to_string(kEchoBody.size()) + "\r\n\r\n" + kEchoBody;
+  }
+  return "GET /api/" + options.path + " HTTP/1.1\r\nHost: " + host + "\r\n\r\n";
+}
+
+UniqueFd Connect(const sockaddr_in& address) {
+  UniqueFd fd(::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  if (!fd || ::connect(fd.Get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+    return UniqueFd();
+  }
+  int nodelay = 1;
+  setsockopt(fd.Get(), IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+  return fd;
+}
+
+// Reads one response with a content-length body; false on error or a non-2xx status.
+bool ReadResponse(int fd, std::string& buffer) {
+  std::size_t header_end = std::string::npos;
+  std::size_t total = 0;
+  char chunk[16 * 1024];
+  while (true) {
+    if (header_end == std::string::npos) {
+      header_end = buffer.find("\r\n\r\n");
+      if (header_end != std::string::npos) {
+        const auto head = std::string_view(buffer).substr(0, header_end);
+        auto pos = head.find("content-length:");
+        if (pos == std::string_view::npos) {
+          pos = head.find("Content-Length:");
+        }
+        if (pos == std::string_view::npos) {
+          return false;
+        }
+        total = header_end + 4 + std::strtoull(buffer.c_str() + pos + 15, nullptr, 10);
+      }
+    }
+    if (header_end != std::string::npos && buffer.size() >= total) {
+      const bool ok = buffer.compare(0, 10, "HTTP/1.1 2") == 0;
+      buffer.erase(0, total);
+      return ok;
+    }
+    const ssize_t received = ::recv(fd, chunk, sizeof(chunk), 0);
+    if (received <= 0) {
+      return false;
+    }
+    buffer.append(chunk, static_cast<std::size_t>(received));
+  }
+}
+
+bool SendAll(int fd, const std::string& data) {
+  std::size_t sent = 0;
+  while (sent < data.size()) {
+    const ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) {
+      return false;
+    }
+    sent += static_cast<std::size_t>(n);
+  }
+  return true;
+}
+
+struct ClientStats {
+  std::vector<std::uint32_t> latencies_us;
+  std::uint64_t errors = 0;
+};
+
+void RunClient(const Options& options,
+               const sockaddr_in& address,
+               const std::string& request,
+               std::size_t index,
+               Clock::time_point start,
+               Clock::time_point measure_from,
+               Clock::time_point end,
+               ClientStats& stats) {
+  auto fd = Connect(address);
+  std::string buffer;
+  // Open loop: this connection's share of the rate, staggered so connections do not fire in lockstep.
+  const auto interval = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(static_cast<double>(options.connections) / options.rate));
+  auto scheduled = start + interval * index / options.connections;
+  while (true) {
+    auto now = Clock::now();
+    if (options.mode == "open") {
+      if (scheduled > now) {
+        std::this_thread::sleep_until(scheduled);
+      }
+    } else {
+      scheduled = now;
+    }
+    if (scheduled >= end) {
+      return;
+    }
+    if (!fd) {
+      fd = Connect(address);
+    }
+    const bool ok = fd && SendAll(fd.Get(), request) && ReadResponse(fd.Get(), buffer);
+    now = Clock::now();
+    if (scheduled >= measure_from) {
+      if (ok) {
+        stats.latencies_us.push_back(static_cast<std::uint32_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(now - scheduled).count()));
+      } else {
+        ++stats.errors;
+      }
+    }
+    if (!ok) {
+      fd.Reset();
+      buffer.clear();
+    }
+    scheduled += interval;
+  }
+}
+
+double Percentile(const std::vector<std::uint32_t>& sorted, double fraction) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  const auto rank = static_cast<std::size_t>(fraction * static_cast<double>(sorted.size() - 1) + 0.5);
+  return sorted[std::min(rank, sorted.size() - 1)] / 1000.0;
+}
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const auto options = ParseOptions(argc, argv);
+  Logger::SetLevel(Logger::Level::kWarn);
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  std::string host = "127.0.0.1";
+  std::uint16_t port = options.port;
+  if (!options.target.empty()) {
+    const auto colon = options.target.rfind(':');
+    if (colon == std::string::npos) {
+      Usage();
+    }
+    host = options.target.substr(0, colon);
+    port = static_cast<std::uint16_t>(std::stoul(options.target.substr(colon + 1)));
+  }
+  address.sin_port = htons(port);
+  if (::inet_pton(AF_INET, host.c_str(), &address.sin_addr) <= 0) {
+    std::fprintf(stderr, "invalid address: %s\n", host.c_str());
+    return 2;
+  }
+
+  Router router;
+  std::unique_ptr<HttpServer> server;
+  const std::string file_path = "/tmp/bench_http_" + std::to_string(::getpid()) + ".bin";
+  if (options.target.empty()) {
+    std::ofstream(file_path, std::ios::binary) << std::string(options.file_size, 'x');
+    AddSyntheticRoutes(router, file_path, options.file_size);
+    ServerConfig config;
+    config.host = host;
+    config.port = port;
+    config.thread_count = options.server_threads;
+    config.listener_shards = options.shards;
+    // Clients keep their connection for the whole run.
+    config.keep_alive_max_requests = UINT32_MAX;
+    server = std::make_unique<HttpServer>(config, router);
+    server->Start();
+  }
+
+  const auto start = Clock::now() + std::chrono::milliseconds(100);
+  const auto measure_from =
+      start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.warmup_seconds));
+  const auto end = measure_from +
+                   std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration_seconds));
+  const auto request = BuildRequest(options, host);
+  std::vector<ClientStats> stats(options.connections);
+  std::vector<std::thread> clients;
+  for (std::size_t i = 0; i < options.connections; ++i) {
+    clients.emplace_back(RunClient, std::cref(options), std::cref(address), std::cref(request), i, start, measure_from,
+                         end, std::ref(stats[i]));
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  const std::chrono::duration<double> measured = Clock::now() - measure_from;
+  if (server) {
+    server->Stop();
+    ::unlink(file_path.c_str());
+  }
+
+  std::vector<std::uint32_t> latencies;
+  std::uint64_t errors = 0;
+  for (auto& client : stats) {
+    latencies.insert(latencies.end(), client.latencies_us.begin(), client.latencies_us.end());
+    errors += client.errors;
+  }
+  std::sort(latencies.begin(), latencies.end());
+
+  std::printf("%s loop, %s, %zu connection(s)", options.mode.c_str(), options.path.c_str(), options.connections);
+  if (options.mode == "open") {
+    std::printf(", offered %.0f req/s", options.rate);
+  }
+  std::printf("\n");
+  std::printf("requests   %zu ok, %llu failed in %.2fs\n",
+              latencies.size(),
+              static_cast<unsigned long long>(errors),
+              measured.count());
+  std::printf("throughput %.0f req/s\n", static_cast<double>(latencies.size()) / measured.count());
+  std::printf("latency    p50 %.3f ms  p99 %.3f ms  p999 %.3f ms  max %.3f ms\n",
+              Percentile(latencies, 0.50),
+              Percentile(latencies, 0.99),
+              Percentile(latencies, 0.999),
+              latencies.empty() ? 0.0 : latencies.back() / 1000.0);
+  return errors == 0 ? 0 : 1;
+}
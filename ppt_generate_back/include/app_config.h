@@ -2,12 +2,75 @@
 
 #include <cstdint>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+// A token bucket: |burst| requests at once, refilled at |rate| per second.
+struct TokenBucketConfig {
+  double rate = 0;
+  std::uint32_t burst = 0;
+
+  bool enabled() const { return rate > 0 && burst > 0; }
+};
+
+// Per-route limits. Each request spends a token from its peer address's
+// bucket and, when it carries a bearer token, from that token's bucket too.
+struct RateLimitConfig {
+  TokenBucketConfig per_ip;
+  TokenBucketConfig per_token;
+
+  bool enabled() const { return per_ip.enabled() || per_token.enabled(); }
+};
+
 struct ServerConfig {
   std::string host = "0.0.0.0";
   std::uint16_t port = 8080;
   std::size_t thread_count = 4;
+  std::uint32_t keep_alive_timeout_seconds = 15;
+  std::uint32_t keep_alive_max_requests = 100;
+  // A request's headers, and then its body, must arrive within these limits;
+  // a blocked response write must make progress within write_timeout_seconds.
+  std::uint32_t header_timeout_seconds = 10;
+  std::uint32_t body_timeout_seconds = 30;
+  std::uint32_t write_timeout_seconds = 30;
+  // Listening sockets bound with SO_REUSEPORT, each with its own event loop; 0 = one per CPU.
+  std::size_t listener_shards = 1;
+  // Pin shard i's loop thread to CPU i (mod CPU count).
+  bool pin_shards = false;
+  // Requests waiting for a worker before new ones are answered with 503; 0 = unbounded.
+  std::size_t worker_queue_limit = 256;
+  // Normal-priority routes are shed once the average queue wait exceeds this
+  // (low-priority ones at half of it); 0 disables the wait check.
+  std::uint32_t queue_wait_target_ms = 1000;
+  // Built frontend (e.g. ppt_generate_front/dist) served for GET/HEAD
+  // requests that match no route; empty disables static serving.
+  std::string static_root;
+  // On SIGINT/SIGTERM, how long in-flight requests and generations may run
+  // on before they are cut off (generations are marked "interrupted").
+  std::uint32_t drain_timeout_seconds = 30;
+  // Unix socket through which a restarted process takes over the listeners
+  // of the running one, which then drains; empty disables the handoff.
+  std::string handoff_socket;
+  // Overrides the built-in rate limits, keyed "METHOD /route/pattern"; an
+  // entry without "ip" or "token" limits turns limiting off for that route.
+  std::unordered_map<std::string, RateLimitConfig> rate_limits;
+  // Buckets kept for all clients and routes together.
+  std::size_t rate_limit_buckets = 65536;
+  // Key per-IP buckets on the last X-Forwarded-For address, as set by a
+  // reverse proxy in front of the server, instead of the peer address.
+  bool trust_forwarded_for = false;
+  // PEM certificate chain and private key; with both set, the listeners
+  // speak HTTPS only. SIGHUP re-reads them.
+  std::string tls_certificate;
+  std::string tls_private_key;
+  // Let the kernel encrypt TLS records (kTLS) where it supports the cipher,
+  // so file downloads keep using sendfile.
+  bool tls_kernel_offload = true;
+  // Speak HTTP/2 to clients that ask for it: through ALPN "h2" over TLS, or
+  // with the connection preface in cleartext (prior knowledge).
+  bool http2 = true;
+
+  bool tls_enabled() const { return !tls_certificate.empty() && !tls_private_key.empty(); }
 };
 
 struct DatabaseConfig {
@@ -56,6 +119,12 @@ struct GenerationConfig {
   std::string python_binary = "python3";
   std::string builder_script = "scripts/libreoffice_ppt_builder.py";
   std::string soffice_binary = "soffice";
+  // Threads running asynchronous generations, and how many may wait for one.
+  std::size_t worker_threads = 2;
+  std::size_t max_pending = 32;
+  // Generations in progress at once when they run as coroutines (C++20
+  // builds); the pool above then only runs their blocking steps.
+  std::size_t max_concurrent = 1000;
 };
 
 struct S3Config {
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "http/http_server.h"
+#include "http/http_types.h"
+#include "http/router.h"
+#include "services/auth_service.h"
+
+// POST /api/batch: answers several GET requests in one round trip. The body
+// is {"requests": [{"path": "/api/templates?q=..."}, ...]} and the reply is
+// {"responses": [{"status": 200, "body": ...}, ...]} in the same order. The
+// parts run through the ordinary routes, in parallel on the server's worker
+// pool, and share one bearer-token check.
+class BatchController {
+ public:
+  static constexpr std::size_t kMaxRequests = 16;
+
+  // |priority| is the batch route's RouteOptions::priority; helper workers
+  // only take the queue room admission control grants it.
+  BatchController(const Router& router, HttpServer& server, std::shared_ptr<AuthService> auth_service, int priority);
+
+  HttpResponse Handle(const HttpRequest& request);
+
+ private:
+  std::string ExtractToken(const HttpRequest& request) const;
+
+  const Router& router_;
+  HttpServer& server_;
+  std::shared_ptr<AuthService> auth_service_;
+  int priority_;
+};
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <memory>
+#include <string>
 
 #include <nlohmann/json.hpp>
 
+#include "http/conditional.h"
 #include "http/http_types.h"
 #include "services/model_service.h"
 
@@ -12,9 +14,13 @@ class ModelController {
   explicit ModelController(std::shared_ptr<ModelService> service);
 
   HttpResponse List(const HttpRequest& request);
+  ResponseValidators ListValidators() const { return {etag_, {}}; }
 
  private:
   static nlohmann::json ToJson(const GenerationModel& model);
 
   std::shared_ptr<ModelService> service_;
+  // The catalog is fixed after startup, so the listing is serialized once.
+  std::string payload_;
+  std::string etag_;
 };
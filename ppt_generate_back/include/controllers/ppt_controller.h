@@ -1,7 +1,14 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_set>
+#include <vector>
 #include <nlohmann/json.hpp>
 
 #include "app_config.h"
@@ -9,9 +16,12 @@
 #include "services/auth_service.h"
 #include "services/model_service.h"
 #include "services/ppt_service.h"
+#include "services/progress_hub.h"
 #include "services/qwen_client.h"
 #include "services/s3_client.h"
 #include "services/template_service.h"
+#include "utils/task.h"
+#include "utils/thread_pool.h"
 
 class PptController {
  public:
@@ -21,20 +31,98 @@ class PptController {
                 std::shared_ptr<TemplateService> template_service,
                 GenerationConfig generation_config,
                 std::shared_ptr<QwenClient> qwen_client,
-                std::shared_ptr<S3Client> s3_client);
+                std::shared_ptr<S3Client> s3_client,
+                std::shared_ptr<ProgressHub> progress_hub);
 
+  // Synchronous by default (201 with the finished deck). With "Prefer:
+  // respond-async" or ?async=1 it answers 202 at once and the pipeline runs on
+  // the generation pool; either way progress is published to Events().
   HttpResponse Generate(const HttpRequest& request);
+#if PPT_HAVE_COROUTINES
+  // Generate() as a coroutine handler on the event loop: the model calls
+  // and the renderer process are awaited instead of holding a thread, and
+  // background generations run as coroutines too (up to
+  // generation.max_concurrent). The generation pool only runs the blocking
+  // steps: database, payload files and S3 upload.
+  Task<HttpResponse> GenerateAsync(const HttpRequest& request);
+#endif
+  // GET /api/ppt/{id}/events: Server-Sent Events for a generation's stages.
+  HttpResponse Events(const HttpRequest& request);
   HttpResponse History(const HttpRequest& request);
   HttpResponse AdminHistory(const HttpRequest& request);
   HttpResponse AdminMetrics(const HttpRequest& request);
+  // Streams the (optionally ?q= filtered) history of every user as CSV.
+  HttpResponse AdminExport(const HttpRequest& request);
   HttpResponse Delete(const HttpRequest& request);
   HttpResponse Download(const HttpRequest& request);
   HttpResponse Preview(const HttpRequest& request);
   HttpResponse Outline(const HttpRequest& request);
 
+  // Refuses new generations with 503 and waits for the running ones, logging
+  // progress once a second. Whatever is still running or queued at
+  // |deadline| is marked "interrupted" and its event stream ends, so clients
+  // can retry instead of waiting on a row stuck in "processing". Returns the
+  // number of generations interrupted.
+  std::size_t Drain(std::chrono::steady_clock::time_point deadline);
+
  private:
+  struct GenerationJob {
+    std::shared_ptr<User> user;
+    PptRequestInput input;
+    RemoteTemplate template_info;
+    std::string template_prompt;
+    PptRequest ppt_request;
+  };
+
+  struct RenderPlan {
+    std::string template_file;
+    std::string output_path;
+  };
+
+  // Authenticates, validates and records a new generation into |job|, or
+  // returns the response refusing it. Blocks on the database.
+  std::optional<HttpResponse> PrepareJob(const HttpRequest& request, GenerationJob& job);
+  HttpResponse Accepted(const GenerationJob& job) const;
+  // Fails a created job that there is no capacity for and returns the 503.
+  HttpResponse RejectJob(GenerationJob& job);
+  bool UsesModel(const GenerationJob& job) const;
+  // Outline, slides, render and upload for an already created request,
+  // publishing each stage. Returns the response payload.
+  nlohmann::json RunGeneration(GenerationJob& job);
+  // Outline and slide content from the model, with the outline-based fallbacks.
+  bool GenerateContent(GenerationJob& job,
+                       std::vector<OutlineItem>& outline,
+                       std::vector<SlideContent>& slides,
+                       std::string& qwen_error);
+#if PPT_HAVE_COROUTINES
+  Task<nlohmann::json> RunGenerationAsync(GenerationJob& job);
+  Task<void> RunInBackground(std::shared_ptr<GenerationJob> job);
+  Task<bool> GenerateContentAsync(GenerationJob& job,
+                                  std::vector<OutlineItem>& outline,
+                                  std::vector<SlideContent>& slides,
+                                  std::string& qwen_error);
+#endif
+  void PublishSlides(const GenerationJob& job,
+                     const std::vector<OutlineItem>& outline,
+                     const std::vector<SlideContent>& slides,
+                     nlohmann::json& payload);
+  // Where the deck goes; nullopt, with the request marked failed, if the template file is unusable.
+  std::optional<RenderPlan> PlanRender(GenerationJob& job, nlohmann::json& payload);
+  // Records the render's outcome and uploads the deck.
+  void FinishRender(GenerationJob& job,
+                    const std::vector<OutlineItem>& outline,
+                    const std::string& output_path,
+                    bool rendered,
+                    const std::string& render_error,
+                    nlohmann::json& payload);
+  // Registers a created request until RunGeneration() returns (or Drain() gives up on it).
+  void TrackJob(std::uint64_t request_id);
+  void UntrackJob(std::uint64_t request_id);
+  std::size_t ActiveJobs();
   std::shared_ptr<User> Authenticate(const HttpRequest& request, std::string& error_message) const;
   std::uint64_t ParseId(const std::string& str) const;
+  // Reads the id from the "{id}" path segment, falling back to the legacy ?id= query.
+  std::uint64_t RequestIdFrom(const HttpRequest& request) const;
 
   std::shared_ptr<AuthService> auth_service_;
   std::shared_ptr<PptService> ppt_service_;
@@ -43,4 +131,13 @@ class PptController {
   GenerationConfig generation_config_;
   std::shared_ptr<QwenClient> qwen_client_;
   std::shared_ptr<S3Client> s3_client_;
+  std::shared_ptr<ProgressHub> progress_hub_;
+  std::atomic<bool> draining_{false};
+  // Set once Drain() gave up; queued jobs that have not started are skipped.
+  std::atomic<bool> interrupted_{false};
+  std::mutex jobs_mutex_;
+  // Ids of every created generation not yet finished.
+  std::unordered_set<std::uint64_t> active_jobs_;
+  // Declared last so running jobs finish before the members they use go away.
+  std::unique_ptr<ThreadPool> generation_pool_;
 };
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <memory>
+#include <string>
 
 #include <nlohmann/json.hpp>
 
+#include "http/conditional.h"
 #include "http/http_types.h"
 #include "services/template_service.h"
 
@@ -13,9 +15,23 @@ class TemplateController {
 
   HttpResponse List(const HttpRequest& request);
   HttpResponse Download(const HttpRequest& request);
+  // Catalog version for conditional GETs of List(); searches are covered
+  // too, since they only filter the same fixed catalog.
+  ResponseValidators ListValidators() const { return {catalog_.etag, {}}; }
 
  private:
+  // Serialized catalog in every supported encoding.
+  struct EncodedCatalog {
+    std::string identity;
+    std::string gzip;
+    std::string brotli;
+    std::string etag;
+  };
+
   static nlohmann::json ToJson(const RemoteTemplate& item);
+  static nlohmann::json ToListPayload(const std::vector<RemoteTemplate>& items);
 
   std::shared_ptr<TemplateService> service_;
+  // The unfiltered listing is fixed after startup, so it is encoded once.
+  EncodedCatalog catalog_;
 };
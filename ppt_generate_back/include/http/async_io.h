@@ -0,0 +1,134 @@
+#pragma once
+
+#include "utils/task.h"
+
+#if PPT_HAVE_COROUTINES
+
+#include <curl/curl.h>
+
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "http/event_loop.h"
+#include "utils/thread_pool.h"
+
+// Awaitables for coroutine route handlers (Router::AddAsyncRoute). They must
+// be awaited on an event loop thread and resume the coroutine on that same
+// loop, so a handler stays on one thread from start to finish while the
+// waits in between hold none. Calls that can only block (MySQL, file writes)
+// go to a pool through Offload() instead.
+namespace async_io {
+
+// The loop running on the calling thread; throws std::logic_error elsewhere.
+EventLoop& CurrentLoop();
+
+class SleepAwaiter {
+ public:
+  explicit SleepAwaiter(std::chrono::milliseconds delay) : delay_(delay) {}
+  bool await_ready() const noexcept { return delay_.count() <= 0; }
+  void await_suspend(std::coroutine_handle<> handle) {
+    CurrentLoop().RunAfter(delay_, [handle]() { handle.resume(); });
+  }
+  void await_resume() const noexcept {}
+
+ private:
+  std::chrono::milliseconds delay_;
+};
+
+// Resumes after |delay|, at the loop's timer resolution (EventLoop::kTimerTick).
+inline SleepAwaiter Sleep(std::chrono::milliseconds delay) {
+  return SleepAwaiter(delay);
+}
+
+template <typename Work>
+class OffloadAwaiter {
+ public:
+  using Result = std::invoke_result_t<Work&>;
+
+  OffloadAwaiter(ThreadPool& pool, Work work) : pool_(pool), work_(std::move(work)) {}
+
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> handle) {
+    // The server may stop, and free its loops, while |work| still runs.
+    std::weak_ptr<EventLoop> weak_loop = CurrentLoop().weak_from_this();
+    pool_.EnqueueDetached([this, handle, weak_loop]() {
+      try {
+        if constexpr (std::is_void_v<Result>) {
+          work_();
+        } else {
+          result_.emplace(work_());
+        }
+      } catch (...) {
+        error_ = std::current_exception();
+      }
+      // With the loop gone the coroutine is abandoned rather than resumed.
+      if (auto loop = weak_loop.lock()) {
+        loop->Post([handle]() { handle.resume(); });
+      }
+    });
+  }
+  Result await_resume() {
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    if constexpr (!std::is_void_v<Result>) {
+      return std::move(*result_);
+    }
+  }
+
+ private:
+  ThreadPool& pool_;
+  Work work_;
+  std::optional<std::conditional_t<std::is_void_v<Result>, bool, Result>> result_;
+  std::exception_ptr error_;
+};
+
+// Runs |work| on |pool| and resumes with its result (or exception) back on
+// the loop. |work| may reference the coroutine's locals: they outlive it.
+// If the loop has been destroyed by the time |work| returns, the coroutine
+// is never resumed (its frame is leaked, which only happens at shutdown).
+template <typename Work>
+OffloadAwaiter<Work> Offload(ThreadPool& pool, Work work) {
+  return OffloadAwaiter<Work>(pool, std::move(work));
+}
+
+class CurlMulti;
+
+class TransferAwaiter {
+ public:
+  explicit TransferAwaiter(CURL* easy) : easy_(easy) {}
+  bool await_ready() const noexcept { return false; }
+  // False (not suspending) if the transfer could not even be started.
+  bool await_suspend(std::coroutine_handle<> handle);
+  CURLcode await_resume() const noexcept { return result_; }
+
+ private:
+  friend class CurlMulti;
+
+  CURL* easy_;
+  CURLcode result_ = CURLE_OK;
+  std::coroutine_handle<> handle_;
+};
+
+// Runs the transfer set up on |easy| through the loop's curl multi handle,
+// whose sockets and timeouts the loop watches, and resumes with its result.
+// The caller keeps owning |easy|.
+inline TransferAwaiter Perform(CURL* easy) {
+  return TransferAwaiter(easy);
+}
+
+// Runs |argv| without a shell (argv[0] is looked up in PATH) and resumes
+// once it exits, with its exit status; -1 if it could not be started or was
+// killed by a signal. The child shares our stdout and stderr.
+Task<int> RunProcess(std::vector<std::string> argv);
+
+}
+
+#endif
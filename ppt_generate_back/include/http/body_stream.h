@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+// Response body produced while it is being sent. A producer (any thread)
+// Write()s data and finally Close()s or Abort()s the stream; the connection's
+// event loop drains it into HTTP/1.1 chunks or HTTP/2 DATA frames. Write()
+// blocks once |high_water| bytes are waiting, so a fast producer is paced by
+// the client.
+class BodyStream {
+ public:
+  enum class TakeResult { kData, kPending, kFinished, kFailed };
+
+  BodyStream(std::size_t high_water, std::chrono::milliseconds stall_timeout);
+
+  BodyStream(const BodyStream&) = delete;
+  BodyStream& operator=(const BodyStream&) = delete;
+
+  // Producer side. Write() returns false once the client is gone, or when the
+  // consumer has not drained anything for |stall_timeout|; stop producing then.
+  bool Write(std::string_view data);
+  // Non-blocking Write() for producers that must not stall (event fan-out):
+  // returns false instead of waiting when |high_water| bytes are unsent.
+  bool TryWrite(std::string_view data);
+  // Ends the body normally.
+  void Close();
+  // Ends the body abnormally: the connection is dropped, so the client sees
+  // a truncated response rather than a complete one.
+  void Abort();
+  bool cancelled() const;
+
+  // Consumer side (event loop). |notify| runs on the producer's thread
+  // whenever data or the end of the stream becomes available after a Take().
+  void SetNotify(std::function<void()> notify);
+  // Appends what is buffered to |out|, framed as a chunk when |chunked|, plus
+  // the last-chunk marker once the stream is closed.
+  TakeResult Take(std::string& out, bool chunked);
+  // The client went away; unblocks and fails the producer.
+  void Cancel();
+
+ private:
+  // Called with |mutex_| held; returns the callback to run after unlocking.
+  std::function<void()> ArmNotify();
+
+  const std::size_t high_water_;
+  const std::chrono::milliseconds stall_timeout_;
+  mutable std::mutex mutex_;
+  std::condition_variable drained_;
+  std::string buffer_;
+  std::function<void()> notify_;
+  bool notified_ = false;
+  bool closed_ = false;
+  bool aborted_ = false;
+  bool cancelled_ = false;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "http/http_types.h"
+
+// Validators for conditional requests (RFC 9110 section 13): a handler, or a
+// route's RouteOptions::validators, describes the current representation and
+// a client that already holds it is answered with 304 and no body.
+struct ResponseValidators {
+  std::string etag;
+  // HTTP-date; empty when unknown.
+  std::string last_modified;
+};
+
+// True if an If-None-Match value lists |etag| or is "*". Uses the weak
+// comparison RFC 9110 prescribes for If-None-Match, so W/ prefixes are ignored.
+bool EtagMatches(std::string_view if_none_match, std::string_view etag);
+
+// True if |request| is a GET or HEAD whose preconditions show the client's
+// copy is current. If-None-Match wins when present; otherwise
+// If-Modified-Since must repeat our Last-Modified exactly, which is what
+// browsers send back.
+bool IsNotModified(const HttpRequest& request, const ResponseValidators& validators);
+HttpResponse NotModifiedResponse(const ResponseValidators& validators);
+// Sets ETag and Last-Modified on |response| unless the handler already did.
+void ApplyValidators(const ResponseValidators& validators, HttpResponse& response);
+
+// Weak ETag over |content|, for generated bodies (such as a catalog listing)
+// that may be sent in several encodings. Stable across restarts.
+std::string VersionEtag(std::string_view content);
+// ETag and Last-Modified from a file's modification time and size; false if
+// it cannot be stat()ed. |weak| suits files served in several encodings.
+bool FileValidators(const std::string& path, bool weak, ResponseValidators& validators);
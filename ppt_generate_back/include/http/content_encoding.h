@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+#include "http/http_types.h"
+#include "utils/compression.h"
+
+namespace content_encoding {
+
+// Picks the best encoding from an Accept-Encoding value among those compiled
+// in, honouring q-values and "*". Brotli wins ties with gzip.
+compression_utils::Encoding Negotiate(std::string_view accept_encoding);
+// Same, but choosing among |*_available| encodings, e.g. the precompressed
+// copies that exist for a static file.
+compression_utils::Encoding Negotiate(std::string_view accept_encoding, bool gzip_available, bool brotli_available);
+
+// Compresses |response.body| in place when the client accepts an encoding,
+// the body is at least |min_size| bytes of a textual type, and the handler
+// has not already encoded it. Adds "vary: accept-encoding" either way.
+// CPU-bound: call from the worker pool, never from the event loop.
+void EncodeResponse(std::string_view accept_encoding, std::size_t min_size, int level, HttpResponse& response);
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "utils/timer_wheel.h"
+
+// Single-threaded epoll reactor. Every fd callback runs on the thread that
+// calls Run(); other threads hand work over through Post(). Timers live in a
+// TimerWheel with kTimerTick resolution and also fire on the loop thread.
+// Owned through a shared_ptr, so work finishing on another thread can hold a
+// weak_ptr and skip the Post() once the loop is gone.
+class EventLoop : public std::enable_shared_from_this<EventLoop> {
+ public:
+  using IoCallback = std::function<void(std::uint32_t events)>;
+  using Task = std::function<void()>;
+  using TimerId = TimerWheel::TimerId;
+
+  static constexpr std::chrono::milliseconds kTimerTick{100};
+
+  EventLoop();
+  ~EventLoop();
+
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+
+  // Registration is only valid from the loop thread (or before Run()).
+  void Add(int fd, std::uint32_t events, IoCallback callback);
+  void Modify(int fd, std::uint32_t events);
+  void Remove(int fd);
+
+  // Thread-safe: queues |task| and wakes the loop.
+  void Post(Task task);
+
+  // Runs |task| on the loop thread once |delay| has passed. Loop thread only
+  // (or before Run()), like fd registration.
+  TimerId RunAfter(std::chrono::milliseconds delay, Task task);
+  // Returns false if the timer already fired or was cancelled.
+  bool CancelTimer(TimerId id);
+
+  void Run();
+  // Makes Run() return, or return at once if it has not started yet; a
+  // stopped loop is not run again.
+  void Stop();
+  bool IsInLoopThread() const;
+  // The loop whose Run() is executing on the calling thread, or nullptr.
+  static EventLoop* Current();
+
+ private:
+  void RunPending();
+
+  int epoll_fd_ = -1;
+  int wake_fd_ = -1;
+  // Never reset, so a Stop() that lands before Run() starts is not lost.
+  std::atomic<bool> stop_requested_{false};
+  std::atomic<std::thread::id> loop_thread_id_{};
+  std::unordered_map<int, IoCallback> callbacks_;
+  std::mutex pending_mutex_;
+  std::vector<Task> pending_;
+  TimerWheel timers_{kTimerTick};
+};
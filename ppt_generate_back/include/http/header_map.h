@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "utils/small_vector.h"
+
+// Header fields the server and controllers look at. The parser tags each
+// request header with its id once, so later lookups compare a byte instead
+// of strings; anything else is kOther and matched by name.
+enum class HeaderId : std::uint8_t {
+  kOther,
+  kAcceptEncoding,
+  kAcceptRanges,
+  kAuthorization,
+  kCacheControl,
+  kConnection,
+  kContentDisposition,
+  kContentEncoding,
+  kContentLength,
+  kContentRange,
+  kContentType,
+  kETag,
+  kExpect,
+  kHost,
+  kIfModifiedSince,
+  kIfNoneMatch,
+  kIfRange,
+  kLastEventId,
+  kLastModified,
+  kPrefer,
+  kRange,
+  kRetryAfter,
+  kTransferEncoding,
+  kVary,
+};
+
+// Case-insensitive; kOther for names without an id.
+HeaderId LookupHeaderId(std::string_view name);
+// Lower-case wire name of a well-known header; empty for kOther.
+std::string_view HeaderName(HeaderId id);
+
+// Response headers: a short list of (id, value) pairs kept inline, since a
+// response rarely carries more than a handful. Names are only stored for
+// headers without an id. Setting a header replaces any earlier value.
+class HeaderMap {
+ public:
+  struct Entry {
+    HeaderId id = HeaderId::kOther;
+    std::string name;  // only for kOther
+    std::string value;
+
+    std::string_view Name() const { return id == HeaderId::kOther ? std::string_view(name) : HeaderName(id); }
+  };
+
+  void Set(HeaderId id, std::string value);
+  void Set(std::string_view name, std::string value);
+  const std::string* Find(HeaderId id) const;
+  const std::string* Find(std::string_view name) const;
+  bool Contains(HeaderId id) const { return Find(id) != nullptr; }
+  bool Erase(HeaderId id);
+
+  const Entry* begin() const { return entries_.begin(); }
+  const Entry* end() const { return entries_.end(); }
+  std::size_t size() const { return entries_.size(); }
+  bool empty() const { return entries_.empty(); }
+  void clear() { entries_.clear(); }
+
+ private:
+  Entry* FindEntry(HeaderId id, std::string_view name);
+  const Entry* FindEntry(HeaderId id, std::string_view name) const;
+
+  SmallVector<Entry, 8> entries_;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// HPACK (RFC 7541) header compression for HTTP/2. Each direction of a
+// connection has its own dynamic table, so a connection owns one Decoder for
+// the header blocks it receives and one Encoder for those it sends; neither
+// is thread-safe.
+namespace hpack {
+
+struct HeaderField {
+  std::string name;
+  std::string value;
+};
+
+// Header names and values as they appear on the wire (names lower-case).
+// Entries cost their length plus 32 bytes against the table size.
+class DynamicTable {
+ public:
+  explicit DynamicTable(std::size_t max_size) : max_size_(max_size) {}
+
+  void Add(std::string_view name, std::string_view value);
+  // Evicts the oldest entries until the table fits |max_size|.
+  void SetMaxSize(std::size_t max_size);
+  // 0 is the newest entry; nullptr past the end.
+  const HeaderField* Get(std::size_t index) const;
+  std::size_t entries() const { return entries_.size(); }
+  std::size_t max_size() const { return max_size_; }
+
+ private:
+  void Evict(std::size_t max_size);
+
+  std::deque<HeaderField> entries_;
+  std::size_t size_ = 0;
+  std::size_t max_size_;
+};
+
+class Decoder {
+ public:
+  enum class Status {
+    kOk,
+    // The fields add up to more than the caller's limit; the table is still
+    // up to date, so only the request is refused, not the connection.
+    kTooLarge,
+    // A compression error: the connection's tables can no longer be trusted.
+    kError,
+  };
+
+  // |max_table_size| is our SETTINGS_HEADER_TABLE_SIZE.
+  explicit Decoder(std::size_t max_table_size = 4096) : max_table_size_(max_table_size), table_(max_table_size) {}
+
+  // Decodes one complete header block, appending its fields to |fields|.
+  // Name and value lengths plus 32 per field are counted against
+  // |max_list_size| (SETTINGS_MAX_HEADER_LIST_SIZE).
+  Status Decode(std::string_view block, std::size_t max_list_size, std::vector<HeaderField>& fields);
+
+ private:
+  const std::size_t max_table_size_;
+  DynamicTable table_;
+};
+
+class Encoder {
+ public:
+  Encoder() : table_(4096) {}
+
+  // The peer's SETTINGS_HEADER_TABLE_SIZE; takes effect, with the size
+  // update the peer expects, at the start of the next block.
+  void SetMaxTableSize(std::size_t size);
+  // Starts a header block in |out|.
+  void BeginBlock(std::string& out);
+  // Appends one field. Repeated fields become one-byte references to the
+  // static or dynamic table; |sensitive| values (credentials) are never indexed.
+  void Encode(std::string_view name, std::string_view value, std::string& out, bool sensitive = false);
+
+ private:
+  DynamicTable table_;
+  std::size_t pending_max_size_ = 4096;
+  std::size_t smallest_pending_size_ = 4096;
+  bool size_update_pending_ = false;
+};
+
+// Huffman coding of string literals (RFC 7541 Appendix B).
+std::size_t HuffmanEncodedSize(std::string_view input);
+void HuffmanEncode(std::string_view input, std::string& out);
+// False on a malformed encoding: bad padding or the EOS symbol.
+bool HuffmanDecode(std::string_view input, std::string& out);
+
+}
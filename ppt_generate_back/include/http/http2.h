@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "http/hpack.h"
+#include "http/http_types.h"
+
+// The HTTP/2 (RFC 9113) side of one server connection, independent of the
+// socket: the server feeds it what it reads and sends what it produces.
+// Each stream's request arrives as a Request that maps onto the same
+// HttpRequest the HTTP/1.1 parser produces, and its HttpResponse goes back
+// through Respond(), so handlers cannot tell the protocols apart. Response
+// bodies of all streams are interleaved frame by frame within both the
+// connection's and each stream's flow-control window. Loop thread only.
+class Http2Session {
+ public:
+  using HeaderFields = std::vector<std::pair<std::string_view, std::string_view>>;
+
+  // A stream whose headers and body have all arrived. |request| views into
+  // the fields and body stored alongside it, so it stays valid for as long
+  // as the Request does, wherever the stream itself has got to.
+  struct Request {
+    std::uint32_t stream_id = 0;
+    HttpRequest request;
+    std::vector<hpack::HeaderField> fields;
+    std::string body;
+  };
+
+  // "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n": how a client with prior knowledge
+  // opens a cleartext HTTP/2 connection.
+  static constexpr std::string_view kPreface{"PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"};
+
+  // |max_body| bounds a request body; |response_headers| are added to every
+  // response and must outlive the session.
+  Http2Session(std::size_t max_body, const HeaderFields& response_headers);
+  ~Http2Session();
+
+  Http2Session(const Http2Session&) = delete;
+  Http2Session& operator=(const Http2Session&) = delete;
+
+  // Consumes |input|, beginning with the client preface, and appends the
+  // requests it completes to |requests|. Returns false on a connection error;
+  // the GOAWAY explaining it is then queued and the connection should close
+  // once that is sent.
+  bool Receive(std::string_view input, std::vector<std::shared_ptr<Request>>& requests);
+  // Queues the response to a stream handed out by Receive(); dropped (and
+  // its body stream cancelled) if the client has reset the stream since.
+  void Respond(std::uint32_t stream_id, HttpResponse response);
+
+  // The next bytes to send, generating DATA frames as the flow-control
+  // windows allow; empty when there is nothing to send right now.
+  std::string_view PendingOutput();
+  // |count| bytes of PendingOutput() were sent.
+  void ConsumeOutput(std::size_t count);
+
+  // Sends GOAWAY: streams already opened are still answered, later ones ignored.
+  void GoAway();
+  // Either side sent GOAWAY, or the connection failed: close once Idle().
+  bool closing() const { return goaway_sent_ || peer_goaway_; }
+  // No stream is open and all output has been sent.
+  bool Idle() const { return streams_.empty() && output_sent_ == output_.size(); }
+  // Output is waiting for the client: unsent bytes, or a body held back by
+  // a flow-control window only the client can reopen.
+  bool WaitingOnPeer() const { return output_sent_ < output_.size() || window_blocked_; }
+  // The connection is going away: fails every body stream still being produced.
+  void CancelStreams();
+
+ private:
+  struct Stream;
+
+  bool ProcessFrame(std::uint8_t type, std::uint8_t flags, std::uint32_t stream_id, std::string_view payload,
+                    std::vector<std::shared_ptr<Request>>& requests);
+  bool OnHeaders(std::uint8_t flags, std::uint32_t stream_id, std::string_view payload,
+                 std::vector<std::shared_ptr<Request>>& requests);
+  bool OnHeaderBlock(std::vector<std::shared_ptr<Request>>& requests);
+  bool OnData(std::uint8_t flags, std::uint32_t stream_id, std::string_view payload,
+              std::vector<std::shared_ptr<Request>>& requests);
+  bool OnSettings(std::uint8_t flags, std::uint32_t stream_id, std::string_view payload);
+  bool OnWindowUpdate(std::uint32_t stream_id, std::string_view payload);
+  void OnRstStream(std::uint32_t stream_id);
+  // Turns |stream|'s fields and body into a Request, or answers it directly if malformed.
+  void CompleteRequest(Stream& stream, std::vector<std::shared_ptr<Request>>& requests);
+  // Queues a response the session makes itself (e.g. 413) for a stream no handler will see.
+  void Reject(Stream& stream, int status, std::string_view message);
+
+  void WriteFrameHeader(std::size_t length, std::uint8_t type, std::uint8_t flags, std::uint32_t stream_id);
+  // HEADERS, plus CONTINUATION frames if |block| exceeds one frame.
+  void WriteHeaders(std::uint32_t stream_id, std::string_view block, bool end_stream);
+  void WriteData(Stream& stream, std::string_view data, bool end_stream);
+  void WriteSettings();
+  void WriteWindowUpdate(std::uint32_t stream_id, std::uint32_t increment);
+  void WriteRstStream(std::uint32_t stream_id, std::uint32_t error_code);
+  // Queues GOAWAY with |error_code| and stops processing input.
+  bool ConnectionError(std::uint32_t error_code);
+  // Resets one stream, forgetting it; the connection carries on.
+  void StreamError(std::uint32_t stream_id, std::uint32_t error_code);
+  void CloseStream(std::uint32_t stream_id);
+  // |stream|'s response has been sent in full (or failed): ends the stream.
+  void FinishStream(Stream& stream);
+
+  // Appends DATA frames to |output_| round-robin across the streams with a
+  // body to send, until the windows close or enough is buffered.
+  void Produce();
+  // Appends |stream|'s next DATA frame of at most |limit| bytes; false if
+  // its body stream has nothing to send yet.
+  bool ProduceData(Stream& stream, std::size_t limit);
+
+  const std::size_t max_body_;
+  const HeaderFields& response_headers_;
+  hpack::Decoder decoder_;
+  hpack::Encoder encoder_;
+  std::unordered_map<std::uint32_t, std::unique_ptr<Stream>> streams_;
+  // Streams with response body left to send, in round-robin order.
+  std::deque<std::uint32_t> sending_;
+
+  // Input that does not yet form a whole frame.
+  std::string input_;
+  bool preface_received_ = false;
+  // A header block spread over CONTINUATION frames is collected here.
+  std::string header_block_;
+  std::uint32_t header_stream_ = 0;
+  std::uint8_t header_flags_ = 0;
+  // Set while the block is incomplete; nothing but CONTINUATION may follow.
+  bool expect_continuation_ = false;
+  std::uint32_t last_stream_id_ = 0;
+
+  std::string output_;
+  std::size_t output_sent_ = 0;
+
+  // Flow control, in bytes we may send / the peer may still send us.
+  std::int64_t send_window_ = 65535;
+  std::int64_t peer_initial_window_ = 65535;
+  std::int64_t receive_window_;
+  // Received connection-level bytes not yet returned with WINDOW_UPDATE.
+  std::uint32_t receive_unacked_ = 0;
+  bool window_blocked_ = false;
+
+  bool goaway_sent_ = false;
+  bool peer_goaway_ = false;
+  bool failed_ = false;
+};
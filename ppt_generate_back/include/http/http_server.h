@@ -1,33 +1,181 @@
 #pragma once
 
+#include <netinet/in.h>
+
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <optional>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "app_config.h"
+#include "http/event_loop.h"
+#include "http/http2.h"
 #include "http/http_types.h"
+#include "http/rate_limiter.h"
 #include "http/router.h"
+#include "http/tls.h"
+#include "http/static_files.h"
 #include "utils/thread_pool.h"
+#include "utils/unique_fd.h"
 
+// Non-blocking HTTP/1.1 server. Each listener shard runs an epoll loop that
+// owns its sockets and parses requests incrementally; only complete requests
+// reach the shared worker pool, so handler threads never wait on the network.
+// Connections are kept alive between requests and pipelined requests are
+// answered in order. Header, body, write and idle deadlines live in each
+// loop's timer wheel, so slow or silent clients cannot pin connections.
+// With a static root configured, the built frontend is served from memory
+// alongside the API. Routes with a rate limit answer clients over it with
+// 429 on the loop thread, before any handler work. With a certificate
+// configured, every connection is TLS, handshaken on its loop thread; kTLS
+// keeps file bodies on sendfile where the kernel supports it. Clients that
+// negotiate HTTP/2 (ALPN "h2", or the cleartext preface) multiplex their
+// requests as streams of one connection instead; each stream goes through
+// the same routing, limits and worker pool as an HTTP/1.1 request. Routes
+// with a coroutine handler skip the pool: they run on the connection's loop
+// and hold no thread while they wait. Drain() lets a shutdown finish the
+// work it already took on before Stop() tears the loops down.
 class HttpServer {
  public:
+  struct ShardStats {
+    std::size_t index = 0;
+    std::uint64_t accepted = 0;
+    std::uint64_t open_connections = 0;
+    std::uint64_t requests = 0;
+  };
+
   HttpServer(const ServerConfig& config, Router& router);
   ~HttpServer();
 
-  void Start();
+  // Binds one listener per shard, or adopts |inherited| listeners (taken
+  // over from a previous process) with one shard each when they are bound to
+  // the configured port.
+  void Start(std::vector<UniqueFd> inherited = {});
+  // Closes the listeners (after accepting whatever the kernel already
+  // queued), turns keep-alive off and closes idle connections. Requests
+  // already received are still answered. Thread-safe; idempotent.
+  void StopAccepting();
+  // StopAccepting(), then waits until every request has been answered and
+  // every connection closed, logging progress once a second. Returns false
+  // if |deadline| passed first; Stop() then drops whatever is left.
+  bool Drain(std::chrono::steady_clock::time_point deadline);
   void Stop();
+  // Re-reads the TLS certificate and key for connections accepted from now
+  // on. Returns false, keeping the current ones, if TLS is off or loading fails.
+  bool ReloadTls();
+
+  // The listening fds, for handing them to a replacement process; empty once
+  // stopping or draining.
+  std::vector<int> ListenerFds() const;
+
+  // Thread-safe snapshot of the per-shard counters; empty while stopped.
+  std::vector<ShardStats> GetShardStats() const;
+
+  // The pool handlers run on, for handlers that fan out work of their own
+  // (see ThreadPool::ParallelFor); nullptr unless started.
+  ThreadPool* WorkerPool() const { return thread_pool_.get(); }
+  // The queue depth work of |priority| may fill under admission control
+  // right now; 0 when it would be shed (or the server is not started).
+  std::size_t QueueDepthLimit(int priority) const;
 
  private:
-  void AcceptLoop();
-  void HandleClient(int client_fd);
-  bool ParseRequest(int client_fd, HttpRequest& request);
-  void SendResponse(int client_fd, const HttpResponse& response);
+  struct Shard;
+  struct Connection;
+  struct OutgoingResponse;
+  enum class WriteStatus { kDone, kBlocked, kError };
+  // What a connection is currently waiting on, each with its own timeout.
+  enum class Deadline { kNone, kIdle, kHeader, kBody, kWrite };
+
+  static int OpenListener(const sockaddr_in& address, bool reuse_port);
+  void OnAcceptable(Shard& shard);
+  void OnConnectionEvent(Shard& shard, int fd, std::uint32_t events);
+  // Returns true once |connection|'s TLS handshake is complete; closes it on failure.
+  bool ContinueHandshake(const std::shared_ptr<Connection>& connection);
+  void ReadFromConnection(const std::shared_ptr<Connection>& connection);
+  void ProcessInput(const std::shared_ptr<Connection>& connection);
+  // Returns true if the request went to the worker pool, false if it was answered inline.
+  bool Dispatch(const std::shared_ptr<Connection>& connection);
+  // Runs |route|'s handler for |request| on a worker thread, hands the
+  // response to |deliver| (which posts it to the loop) and then runs its
+  // stream producer, if any.
+  template <typename Deliver>
+  void RunRequest(const Router::Route* route, HttpRequest& request, Deliver&& deliver);
+  // HTTP/2 counterparts of ProcessInput(), Dispatch() and FlushConnection().
+  void ProcessHttp2Input(const std::shared_ptr<Connection>& connection);
+  void DispatchStream(const std::shared_ptr<Connection>& connection,
+                      std::shared_ptr<Http2Session::Request> request);
+  void RespondToStream(const std::shared_ptr<Connection>& connection, std::uint32_t stream_id, HttpResponse response);
+  void FlushHttp2(const std::shared_ptr<Connection>& connection);
+  // Admission control: sets the queue depth |priority| may fill and the
+  // Retry-After hint, and returns false if the request should be shed now.
+  bool Admit(int priority, std::size_t& depth_limit, std::uint32_t& retry_after_seconds) const;
+  // Runs |route|'s handler for |request|, which must stay valid until
+  // |deliver| has been called: a coroutine handler starts right here on the
+  // loop thread, any other goes to the worker pool. False if it was shed.
+  bool StartRequest(const Router::Route* route,
+                    HttpRequest& request,
+                    std::function<void(HttpResponse)> deliver,
+                    std::uint32_t& retry_after_seconds);
+#if PPT_HAVE_COROUTINES
+  // The coroutine counterpart of RunRequest(); counted in flight until it finishes.
+  Task<void> RunAsync(const Router::Route* route, const HttpRequest& request, std::function<void(HttpResponse)> deliver);
+#endif
+  // Admits and queues |task| for |route|, counting it in flight; false if it was shed.
+  bool Submit(const Router::Route* route, std::function<void()> task, std::uint32_t& retry_after_seconds);
+  // Spends |request|'s tokens for |route|; returns the 429 to send if a bucket is empty.
+  std::optional<HttpResponse> CheckRateLimit(const Connection& connection,
+                                             const Router::Route* route,
+                                             const HttpRequest& request) const;
+  // Clears refilled rate-limit buckets a shard at a time, from |shard|'s loop.
+  void ScheduleRateLimitSweep(Shard& shard);
+  void FinishRequest(const std::shared_ptr<Connection>& connection,
+                     OutgoingResponse outgoing,
+                     bool keep_alive);
+  void QueueResponse(const std::shared_ptr<Connection>& connection,
+                     OutgoingResponse outgoing,
+                     bool keep_alive);
+  void FlushConnection(const std::shared_ptr<Connection>& connection);
+  void CloseConnection(const std::shared_ptr<Connection>& connection);
+  // Re-arms |connection|'s deadline timer when its phase changed (or, for a
+  // blocked write, whenever |write_progress| is set). Loop thread only.
+  void UpdateDeadline(const std::shared_ptr<Connection>& connection, bool write_progress);
+  void OnDeadline(const std::shared_ptr<Connection>& connection, Deadline deadline);
+  bool WantsKeepAlive(const Connection& connection, const HttpRequest& request) const;
+
+  // Writes the status line and headers into one of |connection|'s reusable
+  // head buffers. Loop thread only.
+  OutgoingResponse SerializeResponse(Connection& connection,
+                                     HttpResponse response,
+                                     bool keep_alive,
+                                     bool head_request) const;
+  static WriteStatus WriteOutgoing(Connection& connection, OutgoingResponse& outgoing);
+  static WriteStatus WriteStream(Connection& connection, OutgoingResponse& outgoing);
+  // One send() or TLS write of |data|; |sent| is the progress on kDone.
+  static WriteStatus Send(Connection& connection, const char* data, std::size_t size, std::size_t& sent);
+  static bool AwaitingProducer(const OutgoingResponse& outgoing);
+  // Has |stream|'s producer wake the loop to flush |connection| as output arrives.
+  void WatchStream(const std::shared_ptr<Connection>& connection, BodyStream& stream);
 
   ServerConfig config_;
   Router& router_;
+  // "connection: keep-alive" plus the advertised timeout, built once.
+  const std::string keep_alive_headers_;
   std::unique_ptr<ThreadPool> thread_pool_;
+  // Set when config.static_root is; answers unmatched GET/HEADs on the loop thread.
+  std::unique_ptr<StaticFiles> static_files_;
+  std::unique_ptr<RateLimiter> rate_limiter_;
+  // Set when config.tls_enabled(); every accepted connection then gets a TlsSession.
+  std::unique_ptr<TlsContext> tls_;
   std::atomic<bool> running_{false};
-  int server_fd_ = -1;
-  std::thread accept_thread_;
+  std::atomic<bool> draining_{false};
+  // Shards whose listener is still open; a drain is not done before this is 0.
+  std::atomic<std::size_t> accepting_shards_{0};
+  // Requests handed to the worker pool whose handler (or stream producer) has not returned.
+  std::atomic<std::size_t> in_flight_{0};
+  std::vector<std::unique_ptr<Shard>> shards_;
 };
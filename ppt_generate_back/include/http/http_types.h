@@ -1,56 +1,183 @@
 #pragma once
 
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <array>
 #include <cstdint>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
 #include <nlohmann/json.hpp>
 
+#include "http/body_stream.h"
+#include "http/header_map.h"
+#include "utils/small_vector.h"
 #include "utils/string_utils.h"
+#include "utils/unique_fd.h"
 
 namespace detail {
 inline std::string ReasonPhrase(int status) {
   switch (status) {
+    case 100: return "Continue";
     case 200: return "OK";
     case 201: return "Created";
     case 206: return "Partial Content";
     case 204: return "No Content";
+    case 304: return "Not Modified";
     case 400: return "Bad Request";
     case 401: return "Unauthorized";
     case 403: return "Forbidden";
     case 404: return "Not Found";
+    case 408: return "Request Timeout";
     case 409: return "Conflict";
+    case 413: return "Payload Too Large";
     case 416: return "Range Not Satisfiable";
     case 422: return "Unprocessable Entity";
+    case 429: return "Too Many Requests";
+    case 431: return "Request Header Fields Too Large";
     case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
     default: return "OK";
   }
 }
 }
 
+enum class HttpMethod : std::uint8_t { kGet, kHead, kPost, kPut, kDelete, kPatch, kOptions, kUnknown };
+constexpr std::size_t kHttpMethodCount = static_cast<std::size_t>(HttpMethod::kUnknown);
+
+inline HttpMethod ParseHttpMethod(std::string_view method) {
+  static constexpr std::array<std::string_view, kHttpMethodCount> kNames{
+      "GET", "HEAD", "POST", "PUT", "DELETE", "PATCH", "OPTIONS"};
+  for (std::size_t i = 0; i < kNames.size(); ++i) {
+    if (string_utils::EqualsIgnoreCase(method, kNames[i])) {
+      return static_cast<HttpMethod>(i);
+    }
+  }
+  return HttpMethod::kUnknown;
+}
+
+// "{name}" segments captured by the router, stored inline.
+struct PathParams {
+  static constexpr std::size_t kMaxParams = 4;
+
+  std::array<std::string_view, kMaxParams> names{};
+  std::array<std::string_view, kMaxParams> values{};
+  std::size_t size = 0;
+
+  std::string_view Get(std::string_view name) const {
+    for (std::size_t i = 0; i < size; ++i) {
+      if (names[i] == name) {
+        return values[i];
+      }
+    }
+    return {};
+  }
+};
+
+struct HttpHeader {
+  HeaderId id = HeaderId::kOther;
+  std::string_view name;
+  std::string_view value;
+};
+
+// A parsed request. Every view points into the connection's receive buffer,
+// which stays untouched until the response has been queued; owned strings
+// are only created when a handler asks for them. Typical requests fit their
+// headers in the inline slots, so parsing one allocates nothing.
 struct HttpRequest {
-  std::string method;
-  std::string target;
-  std::string path;
-  std::unordered_map<std::string, std::string> headers;
-  std::unordered_map<std::string, std::string> query_params;
-  std::string body;
-
-  std::string Header(const std::string& key) const {
-    auto lower_key = string_utils::ToLower(key);
-    if (auto it = headers.find(lower_key); it != headers.end()) {
-      return it->second;
+  std::string_view method;
+  std::string_view target;
+  std::string_view path;
+  std::string_view query_string;
+  std::string_view version;
+  SmallVector<HttpHeader, 16> headers;
+  std::string_view body;
+  PathParams path_params;
+  // Request-scoped memory: while the handler runs, the server points it at
+  // the worker thread's RequestArena, which is reset once the handler (and
+  // any stream producer) returns. Nothing allocated from it may be kept past
+  // the handler; outside a worker it is the plain heap.
+  std::pmr::memory_resource* arena = std::pmr::new_delete_resource();
+
+  std::string_view HeaderView(HeaderId id) const {
+    for (const auto& header : headers) {
+      if (header.id == id) {
+        return header.value;
+      }
+    }
+    return {};
+  }
+
+  std::string_view HeaderView(std::string_view name) const {
+    if (const auto id = LookupHeaderId(name); id != HeaderId::kOther) {
+      return HeaderView(id);
+    }
+    for (const auto& header : headers) {
+      if (header.id == HeaderId::kOther && string_utils::EqualsIgnoreCase(header.name, name)) {
+        return header.value;
+      }
     }
     return {};
   }
+
+  std::string Header(HeaderId id) const { return std::string(HeaderView(id)); }
+  std::string Header(std::string_view name) const { return std::string(HeaderView(name)); }
+
+  std::string_view PathParam(std::string_view name) const { return path_params.Get(name); }
+
+  std::optional<std::string> Query(std::string_view key) const {
+    return string_utils::FindQueryParam(query_string, key);
+  }
+
+  // Allocated from |arena|, so it must not outlive the request.
+  string_utils::QueryMap QueryParams() const {
+    return string_utils::ParseQuery(query_string, arena);
+  }
+
+  void Clear() {
+    method = target = path = query_string = version = body = {};
+    headers.clear();
+    path_params.size = 0;
+    arena = std::pmr::new_delete_resource();
+  }
+};
+
+// Response body served straight from an open file with sendfile(2).
+struct FileBody {
+  std::shared_ptr<UniqueFd> fd;
+  std::uint64_t offset = 0;
+  std::uint64_t length = 0;
+};
+
+// Response body that lives in memory owned elsewhere, such as a mapped file
+// in a cache; |owner| keeps |data| valid until the response is sent.
+struct SharedBody {
+  std::shared_ptr<const void> owner;
+  std::string_view data;
 };
 
 struct HttpResponse {
   int status_code = 200;
   std::string status_message = "OK";
-  std::unordered_map<std::string, std::string> headers{
-      {"content-type", "application/json"}};
+  // Without a content-type the response is sent as application/json.
+  HeaderMap headers;
   std::string body = "{}";
+  std::optional<FileBody> file;
+  // Replaces |body| when set.
+  std::optional<SharedBody> shared_body;
+  // Body sent as it is produced (chunked over HTTP/1.1); see Stream().
+  std::shared_ptr<BodyStream> stream;
+  // Fills |stream| on the worker thread once the head is queued. It keeps
+  // that worker busy until it returns, and must not touch the request.
+  std::function<void(BodyStream&)> stream_producer;
 
   static HttpResponse Json(int status, const nlohmann::json& payload) {
     HttpResponse response;
@@ -60,18 +187,60 @@ struct HttpResponse {
     return response;
   }
 
+  // Any other nlohmann::basic_json, e.g. an ArenaJson built from the request's arena.
+  template <typename BasicJson, typename = std::enable_if_t<nlohmann::detail::is_basic_json<BasicJson>::value>>
+  static HttpResponse Json(int status, const BasicJson& payload) {
+    HttpResponse response;
+    response.status_code = status;
+    response.status_message = detail::ReasonPhrase(status);
+    response.body = payload.dump();
+    return response;
+  }
+
   static HttpResponse Text(int status, const std::string& message) {
     HttpResponse response;
     response.status_code = status;
     response.status_message = detail::ReasonPhrase(status);
-    response.headers["content-type"] = "text/plain; charset=utf-8";
+    response.headers.Set(HeaderId::kContentType, "text/plain; charset=utf-8");
     response.body = message;
     return response;
   }
 
-  void ApplyCors() {
-    headers["access-control-allow-origin"] = "*";
-    headers["access-control-allow-headers"] = "Content-Type, Authorization, ngrok-skip-browser-warning";
-    headers["access-control-allow-methods"] = "GET, POST, DELETE, OPTIONS, HEAD";
+  // A streamed response whose body |producer| writes incrementally; returning
+  // closes the stream and throwing aborts it.
+  static HttpResponse Stream(int status, const std::string& content_type, std::function<void(BodyStream&)> producer) {
+    HttpResponse response;
+    response.status_code = status;
+    response.status_message = detail::ReasonPhrase(status);
+    response.headers.Set(HeaderId::kContentType, content_type);
+    response.body.clear();
+    response.stream_producer = std::move(producer);
+    return response;
+  }
+
+  // Opens |path| for a file body and sets |size| from the opened file, so a
+  // size used for Content-Length or ranges describes the bytes that will
+  // actually be sent even if the path is replaced meanwhile. nullptr if it
+  // cannot be opened.
+  static std::shared_ptr<UniqueFd> OpenFile(const std::string& path, std::uint64_t& size) {
+    UniqueFd fd(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    struct stat info {};
+    if (!fd || ::fstat(fd.Get(), &info) != 0 || !S_ISREG(info.st_mode)) {
+      return nullptr;
+    }
+    size = static_cast<std::uint64_t>(info.st_size);
+    return std::make_shared<UniqueFd>(std::move(fd));
+  }
+
+  // Sends bytes [offset, offset + length) of |fd|, whose size OpenFile()
+  // reported as |size|, without reading them into memory. Returns false if
+  // the range does not fit the file.
+  bool SetFileBody(std::shared_ptr<UniqueFd> fd, std::uint64_t size, std::uint64_t offset, std::uint64_t length) {
+    if (!fd || offset > size || length > size - offset) {
+      return false;
+    }
+    file = FileBody{std::move(fd), offset, length};
+    body.clear();
+    return true;
   }
 };
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/unique_fd.h"
+
+// Hands the HTTP listening sockets from a running process to its replacement
+// over a Unix socket, so a restart never refuses a connection:
+//
+//   1. The new process calls Receive() on the handoff path. The old process
+//      answers with duplicates of its listeners (SCM_RIGHTS).
+//   2. The new process starts accepting on them and calls Acknowledge().
+//   3. The old process runs |on_handed_off| (which starts its drain) and
+//      stops answering on the path; the new process then serves it.
+//
+// Both processes accept from the same kernel queues in between, so nothing
+// queued is lost. Only processes running as the same user may connect.
+class ListenerHandoff {
+ public:
+  struct Inherited {
+    // Kept open for Acknowledge().
+    UniqueFd channel;
+    std::vector<UniqueFd> listeners;
+  };
+
+  // Takes over the listeners of the process serving |path|. Returns an empty
+  // Inherited (no listeners) when nobody serves it, e.g. on a first start.
+  static Inherited Receive(const std::string& path);
+  // Tells the previous process its sockets are being accepted on.
+  static void Acknowledge(Inherited& inherited);
+
+  // Serves |path| on a background thread. |listeners| is called for the fds
+  // to hand over; |on_handed_off| runs once a replacement acknowledged them.
+  // Throws std::runtime_error if the path cannot be bound.
+  ListenerHandoff(std::string path,
+                  std::function<std::vector<int>()> listeners,
+                  std::function<void()> on_handed_off);
+  ~ListenerHandoff();
+
+  ListenerHandoff(const ListenerHandoff&) = delete;
+  ListenerHandoff& operator=(const ListenerHandoff&) = delete;
+
+ private:
+  void ServeLoop();
+  // Sends the listeners to one connected replacement; true once it acknowledged.
+  bool HandOff(int channel);
+
+  const std::string path_;
+  std::function<std::vector<int>()> listeners_;
+  std::function<void()> on_handed_off_;
+  UniqueFd listen_fd_;
+  UniqueFd wake_fd_;
+  // Inode bound at |path_|; the file is only unlinked while it is still ours.
+  ino_t inode_ = 0;
+  std::atomic<bool> stop_{false};
+  std::thread thread_;
+};
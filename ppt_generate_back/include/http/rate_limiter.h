@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+#include "app_config.h"
+
+// Token buckets for every (route, client) pair, shared by all loop threads
+// without a lock. The table is split into shards of open-addressed slots;
+// a slot holds a key hash and the time its bucket will be full again, which
+// is the whole token-bucket state: tokens are never stored, only derived
+// from how far that time lies ahead (lazy refill), so spending one is a
+// single compare-and-swap. A bucket that has refilled is the same as no
+// bucket, so its slot may be reused by the next new key and is cleared by
+// Sweep(), one shard per call.
+//
+// Counting is approximate only where a slot changes owner while in use,
+// which can gain or lose a single token. When every slot near a key is held
+// by a bucket that is still refilling, the request is let through.
+class RateLimiter {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Decision {
+    bool allowed = true;
+    // Until a token is available again; set when not allowed.
+    std::uint32_t retry_after_seconds = 0;
+  };
+
+  // Room for about |capacity| buckets at once.
+  explicit RateLimiter(std::size_t capacity);
+
+  RateLimiter(const RateLimiter&) = delete;
+  RateLimiter& operator=(const RateLimiter&) = delete;
+
+  // Spends one token from the bucket of |key| (see Key()), creating it full.
+  Decision Acquire(std::uint64_t key, const TokenBucketConfig& limit, Clock::time_point now = Clock::now());
+  // Forgets the refilled buckets of the next shard, round-robin.
+  void Sweep(Clock::time_point now = Clock::now());
+
+  // Hashes |client| within |scope| (such as a route plus the kind of client
+  // key) into a bucket key; never 0.
+  static std::uint64_t Key(std::uint64_t scope, std::string_view client);
+
+ private:
+  static constexpr std::size_t kShards = 64;
+  // Slots tried for one key; eight slots are two cache lines.
+  static constexpr std::size_t kProbeLength = 8;
+
+  struct alignas(16) Slot {
+    std::atomic<std::uint64_t> key{0};
+    // Microseconds since |epoch_| at which the bucket is full; 0 = full.
+    std::atomic<std::uint64_t> full_at{0};
+  };
+
+  std::uint64_t Micros(Clock::time_point now) const;
+  // The slot holding |key|, claiming a free or refilled one if needed; nullptr when none is left.
+  Slot* FindOrClaim(std::uint64_t key, std::uint64_t now);
+
+  const Clock::time_point epoch_;
+  std::size_t shard_mask_ = 0;
+  std::unique_ptr<Slot[]> slots_;
+  std::atomic<std::size_t> sweep_cursor_{0};
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+#include "http/http_types.h"
+
+// Resumable HTTP/1.x request parser. Call Parse() with the whole receive
+// buffer every time more bytes arrive; it remembers how far it got, so each
+// byte is scanned once. Positions are kept as offsets while the buffer may
+// still grow, and only turned into views once the request is complete.
+class HttpRequestParser {
+ public:
+  enum class Status { kIncomplete, kComplete, kError };
+
+  explicit HttpRequestParser(std::size_t max_body_size, std::size_t max_header_size = 64 * 1024);
+
+  // On kComplete, |request| views into |buffer| and consumed() is the number
+  // of leading bytes that belong to it.
+  Status Parse(std::string_view buffer, HttpRequest& request);
+
+  std::size_t consumed() const { return consumed_; }
+  // Status code to answer with after kError (400, 413, 431 or 501).
+  int error_status() const { return error_status_; }
+  // True once the headers are parsed and the client sent "Expect: 100-continue".
+  bool ExpectsContinue() const { return state_ == State::kBody && expects_continue_; }
+  // True once the request line and headers are parsed, even if the body is still arriving.
+  bool HeadersComplete() const { return state_ == State::kBody || state_ == State::kDone; }
+  std::size_t content_length() const { return content_length_; }
+  // Fills the request line and header views of |request| once HeadersComplete();
+  // the body is left empty. Lets the server vet a route before the body arrives.
+  void PeekHead(std::string_view buffer, HttpRequest& request) const;
+  // Prepares for the next request on the same connection.
+  void Reset();
+
+ private:
+  enum class State { kRequestLine, kHeaders, kBody, kDone, kError };
+
+  struct Span {
+    std::size_t offset = 0;
+    std::size_t length = 0;
+
+    std::string_view In(std::string_view buffer) const { return buffer.substr(offset, length); }
+  };
+
+  struct HeaderSpan {
+    HeaderId id = HeaderId::kOther;
+    Span name;
+    Span value;
+  };
+
+  bool ParseRequestLine(std::string_view buffer, std::size_t begin, std::size_t end);
+  bool ParseHeaderLine(std::string_view buffer, std::size_t begin, std::size_t end);
+  bool FinishHeaders(std::string_view buffer);
+  Status Fail(int status);
+  void FillHead(std::string_view buffer, HttpRequest& request) const;
+
+  std::size_t max_body_size_;
+  std::size_t max_header_size_;
+
+  State state_ = State::kRequestLine;
+  std::size_t scan_offset_ = 0;
+  std::size_t request_start_ = 0;
+  std::size_t body_offset_ = 0;
+  std::size_t content_length_ = 0;
+  std::size_t consumed_ = 0;
+  int error_status_ = 400;
+  bool expects_continue_ = false;
+  Span method_;
+  Span target_;
+  Span version_;
+  std::vector<HeaderSpan> headers_;
+};
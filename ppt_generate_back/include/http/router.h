@@ -1,21 +1,108 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <functional>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
+#include "app_config.h"
+#include "http/conditional.h"
 #include "http/http_types.h"
-#include "utils/string_utils.h"
+#include "utils/metrics.h"
+#include "utils/task.h"
 
+// Per-route metadata consulted by HttpServer before the handler runs.
+struct RouteOptions {
+  // Reject requests that carry no bearer token (header or ?token=) with 401.
+  bool auth_required = false;
+  // Largest accepted request body in bytes; 0 keeps the server-wide limit.
+  std::size_t body_limit = 0;
+  // Higher values are shed last when the server is overloaded.
+  int priority = 0;
+  // Bodies at least this large are gzip/brotli encoded when the client
+  // accepts it; 0 disables compression for the route.
+  std::size_t compress_min_size = 0;
+  // 1 (fastest) to 9 (smallest).
+  int compress_level = 6;
+  // Describes the response the handler would produce, without producing it.
+  // When set, a GET/HEAD whose If-None-Match / If-Modified-Since already
+  // matches is answered with 304 before the handler runs, and successful
+  // responses are stamped with the validators. Runs on the worker pool.
+  std::function<std::optional<ResponseValidators>(const HttpRequest&)> validators = nullptr;
+  // Token buckets per client IP and bearer token; requests over the limit
+  // get 429 before the handler (or the worker pool) sees them.
+  RateLimitConfig rate_limit{};
+};
+
+// Radix tree keyed on the request path. Static path fragments are stored as
+// compressed edges, "{name}" segments capture one path segment into
+// HttpRequest::path_params, and each node keeps one route slot per method.
+// Routes must be registered before the server starts; matching is read-only
+// and does not allocate.
 class Router {
  public:
   using Handler = std::function<HttpResponse(const HttpRequest&)>;
+#if PPT_HAVE_COROUTINES
+  // A coroutine handler: started on the connection's event loop, it waits
+  // through http/async_io.h awaitables instead of holding a worker thread.
+  // The request stays valid until the returned Task finishes.
+  using AsyncHandler = std::function<Task<HttpResponse>(const HttpRequest&)>;
+#endif
+
+  struct Route {
+    std::string method;
+    std::string pattern;
+    Handler handler;
+#if PPT_HAVE_COROUTINES
+    // Set instead of |handler| for routes added with AddAsyncRoute().
+    AsyncHandler async_handler;
+#endif
+    RouteOptions options;
+    // Registered in AddRoute so Invoke only touches atomics.
+    metrics::Counter* requests = nullptr;
+    metrics::Histogram* latency = nullptr;
+  };
+
+  Router();
+  ~Router();
 
-  void AddRoute(const std::string& method, const std::string& path, Handler handler);
-  HttpResponse Handle(const HttpRequest& request) const;
+  // Throws std::invalid_argument for malformed patterns or conflicting parameters.
+  void AddRoute(const std::string& method, const std::string& path, Handler handler, RouteOptions options = {});
+#if PPT_HAVE_COROUTINES
+  // Like AddRoute(); |options| may not set validators or compress_min_size,
+  // which would run on the loop thread.
+  void AddAsyncRoute(const std::string& method, const std::string& path, AsyncHandler handler,
+                     RouteOptions options = {});
+#endif
+  // Replaces the rate limits of the routes named by |limits| ("METHOD /pattern").
+  // Throws std::invalid_argument for a route that was never added.
+  void ApplyRateLimits(const std::unordered_map<std::string, RateLimitConfig>& limits);
+
+  // Resolves |method| and |path|; on success |params| views into |path| and the route table.
+  const Route* Match(std::string_view method, std::string_view path, PathParams& params) const;
+
+  // Matches, then runs the handler. Answers OPTIONS preflights and unknown routes itself.
+  HttpResponse Handle(HttpRequest& request) const;
+  HttpResponse Invoke(const Route* route, const HttpRequest& request) const;
+#if PPT_HAVE_COROUTINES
+  // Runs |route|'s async_handler; latency is measured until it finishes.
+  Task<HttpResponse> InvokeAsync(const Route* route, const HttpRequest& request) const;
+#endif
 
  private:
-  std::string BuildKey(const std::string& method, const std::string& path) const;
+  struct Node;
+
+  Route& NewRoute(const std::string& method, const std::string& path, RouteOptions options);
+
+  static void Insert(Node& node, std::string_view pattern, const Route* route,
+                     HttpMethod method, std::size_t param_count);
+  static const Node* Find(const Node& node, std::string_view path, HttpMethod method, PathParams& params);
 
-  std::unordered_map<std::string, Handler> routes_;
+  std::unique_ptr<Node> root_;
+  std::vector<std::unique_ptr<Route>> routes_;
 };
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+#include "http/http_types.h"
+#include "utils/unique_fd.h"
+
+// Serves a built single-page app (the frontend's dist/ directory) straight
+// from memory. Each file is read once, together with any .br/.gz copy the
+// build produced, and answered from the copy until inotify reports that it
+// changed; files over 1 MiB are sent from an open descriptor instead. Misses
+// are remembered the same way, so probes for missing files stay off the
+// disk. Responses carry an ETag and honour If-None-Match; fingerprinted
+// bundler output ("assets/.../name-<hash>.js") is marked immutable,
+// everything else must be revalidated. Extensionless paths fall back to
+// index.html so client-side routes survive a reload.
+//
+// Serve() is thread-safe and never blocks on other callers for longer than a
+// map lookup; only the first request for a path touches the disk.
+class StaticFiles {
+ public:
+  // Throws std::runtime_error if |root| is not a directory.
+  explicit StaticFiles(std::string root);
+  ~StaticFiles();
+
+  StaticFiles(const StaticFiles&) = delete;
+  StaticFiles& operator=(const StaticFiles&) = delete;
+
+  // Answers a GET or HEAD for a file under the root; nullopt when there is
+  // none, so the caller can fall through to its own 404.
+  std::optional<HttpResponse> Serve(const HttpRequest& request);
+
+ private:
+  struct CachedFile;
+  struct Entry;
+
+  std::shared_ptr<const Entry> Lookup(const std::string& relative);
+  std::shared_ptr<const Entry> Load(const std::string& relative) const;
+  void Invalidate(const std::string& relative, bool directory);
+
+  void WatchLoop();
+  void WatchTree(const std::string& relative);
+  void Unwatch(const std::string& relative);
+  void HandleEvents();
+
+  const std::string root_;
+  std::shared_mutex mutex_;
+  // Null entries are misses; |miss_count_| of them, at most kMaxMisses.
+  std::unordered_map<std::string, std::shared_ptr<const Entry>> entries_;
+  std::size_t miss_count_ = 0;
+  // Bumped on every invalidation, so a load that raced with one is dropped.
+  std::uint64_t generation_ = 0;
+
+  // Watcher thread only.
+  UniqueFd inotify_fd_;
+  UniqueFd wake_fd_;
+  std::unordered_map<int, std::string> watched_dirs_;
+  bool root_watched_ = false;
+  std::atomic<bool> stop_{false};
+  std::thread watcher_;
+};
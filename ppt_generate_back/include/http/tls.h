@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+typedef struct ssl_st SSL;
+typedef struct ssl_ctx_st SSL_CTX;
+
+// One TLS connection on a non-blocking socket. Every call makes as much
+// progress as the socket allows and reports what it is waiting for; the
+// caller retries on the next epoll event. Loop thread only.
+class TlsSession {
+ public:
+  enum class Status { kOk, kWantRead, kWantWrite, kClosed, kError };
+
+  explicit TlsSession(SSL* ssl);
+  ~TlsSession();
+
+  TlsSession(const TlsSession&) = delete;
+  TlsSession& operator=(const TlsSession&) = delete;
+
+  // Advances the server handshake; kOk once it is complete.
+  Status Handshake();
+  bool established() const { return established_; }
+  // Valid once established.
+  bool resumed() const;
+  // The kernel encrypts what we send (kTLS), so files go out with sendfile.
+  bool kernel_send() const;
+  // The protocol ALPN settled on ("h2", "http/1.1"); empty if none.
+  std::string_view alpn() const;
+
+  // kOk with |count| > 0, or a reason nothing was transferred.
+  Status Read(char* buffer, std::size_t size, std::size_t& count);
+  Status Write(const char* data, std::size_t size, std::size_t& count);
+  // Sends up to |size| bytes of |file_fd| from |offset|: zero-copy with kTLS,
+  // otherwise through a buffer that a retry after kWantWrite continues from.
+  Status SendFile(int file_fd, std::uint64_t offset, std::size_t size, std::size_t& count);
+  // Sends close_notify if the handshake completed; never blocks.
+  void Shutdown();
+
+  // OpenSSL's reason for the last kError.
+  static std::string LastError();
+
+ private:
+  Status Result(int ret) const;
+
+  SSL* ssl_;
+  bool established_ = false;
+  std::string file_buffer_;
+  std::size_t file_buffer_sent_ = 0;
+};
+
+// Server certificate, session ticket keys and protocol settings for the
+// listeners. Reload() swaps in a fresh certificate and key without touching
+// established connections; the ticket keys survive it, so clients resume
+// their sessions across reloads. Thread-safe.
+class TlsContext {
+ public:
+  // Throws std::runtime_error if the certificate or key cannot be loaded.
+  // ALPN offers "h2" ahead of "http/1.1" when |http2| is set.
+  TlsContext(std::string certificate_path, std::string private_key_path, bool kernel_tls, bool http2);
+
+  TlsContext(const TlsContext&) = delete;
+  TlsContext& operator=(const TlsContext&) = delete;
+
+  // Re-reads the certificate and key; on failure the current ones stay in use.
+  bool Reload(std::string& error);
+  // A session for an accepted socket, or nullptr if OpenSSL cannot create one.
+  std::unique_ptr<TlsSession> Accept(int fd) const;
+
+ private:
+  std::shared_ptr<SSL_CTX> Build(std::string& error) const;
+
+  const std::string certificate_path_;
+  const std::string private_key_path_;
+  const bool kernel_tls_;
+  const bool http2_;
+  std::array<unsigned char, 80> ticket_keys_{};
+  mutable std::mutex mutex_;
+  std::shared_ptr<SSL_CTX> context_;
+};
@@ -33,8 +33,30 @@ class AuthService {
 
   bool Logout(const std::string& token, std::string& error_message);
 
+  // Answered from the innermost TokenScope on this thread when it covers |token|.
   std::optional<User> GetUserFromToken(const std::string& token, std::string& error_message) const;
 
+  // The outcome of one GetUserFromToken() call.
+  struct TokenLookup {
+    std::string token;
+    std::optional<User> user;
+    std::string error;
+  };
+
+  // While alive, GetUserFromToken(lookup.token) on the constructing thread
+  // returns |lookup| instead of querying MySQL, so the sub-requests of one
+  // batch share a single token check. |lookup| must outlive the scope.
+  class TokenScope {
+   public:
+    explicit TokenScope(const TokenLookup& lookup) : previous_(current_lookup_) { current_lookup_ = &lookup; }
+    ~TokenScope() { current_lookup_ = previous_; }
+    TokenScope(const TokenScope&) = delete;
+    TokenScope& operator=(const TokenScope&) = delete;
+
+   private:
+    const TokenLookup* previous_;
+  };
+
   bool RequestPasswordReset(const std::string& email, std::string& error_message);
   bool ResetPassword(const std::string& email,
                      const std::string& code,
@@ -76,4 +98,5 @@ class AuthService {
   std::unordered_set<std::string> admin_usernames_;
   std::unordered_set<std::string> admin_emails_;
   std::shared_ptr<EmailService> email_service_;
+  static inline thread_local const TokenLookup* current_lookup_ = nullptr;
 };
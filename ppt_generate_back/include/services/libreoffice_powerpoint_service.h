@@ -34,6 +34,8 @@ public:
 
     bool Save(const std::string& ppt_path) override;
 
+    bool PrepareSave(const std::string& ppt_path, std::vector<std::string>& command) override;
+
 private:
     bool EnsurePathsReady(std::string& error) const;
 
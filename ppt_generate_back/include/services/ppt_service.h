@@ -1,5 +1,6 @@
 #pragma once
 
+#include <functional>
 #include <memory>
 #include <string>
 #include <vector>
@@ -28,6 +29,12 @@ class PptService {
   // Get all PPT generation history for admin
   std::vector<PptRequest> GetAdminHistory(const std::string& query, std::string& error);
 
+  // Walk every matching request, newest first, a page at a time; |visit|
+  // returns false to stop early. Filters like GetAdminHistory.
+  bool ExportAdminHistory(const std::string& query,
+                          const std::function<bool(const PptRequest&)>& visit,
+                          std::string& error);
+
   struct AdminMetricsSeries {
     std::string name;
     std::vector<int> values;
@@ -58,8 +65,13 @@ class PptService {
   // Delete a PPT generation request record
   bool DeleteRequest(std::uint64_t user_id, std::uint64_t request_id, std::string& error);
 
-  // Get a single PPT generation request
-  bool GetRequest(std::uint64_t user_id, std::uint64_t request_id, PptRequest& out_request, std::string& error);
+  // Get a single PPT generation request; |any_user| (for admins) skips the
+  // check that it belongs to |user_id|
+  bool GetRequest(std::uint64_t user_id,
+                  std::uint64_t request_id,
+                  PptRequest& out_request,
+                  std::string& error,
+                  bool any_user = false);
 
   // Update output path and status for a request
   bool UpdateRequestOutput(std::uint64_t request_id,
@@ -68,6 +80,10 @@ class PptService {
                           const std::string& status,
                           std::string& error);
 
+  // Mark requests that are still "processing" as "interrupted" (e.g. on
+  // shutdown); requests that already reached another status are left alone
+  bool MarkInterrupted(const std::vector<std::uint64_t>& request_ids, std::string& error);
+
   // Set PowerPoint service factory
   void SetPowerPointServiceFactory(std::shared_ptr<IPowerPointServiceFactory> factory);
 
@@ -76,8 +92,23 @@ class PptService {
                        const std::vector<SlideContent>& slides,
                        const std::string& output_path,
                        std::string& error);
+  // Same as GeneratePptxFile(), except that a renderer which finishes in an
+  // external process leaves that to the caller: |command| is then the argv
+  // to run, and empty when the file has already been written.
+  bool PreparePptxFile(const std::string& template_path,
+                       const std::vector<SlideContent>& slides,
+                       const std::string& output_path,
+                       std::vector<std::string>& command,
+                       std::string& error);
 
  private:
+  // Creates the presentation from the template with the theme and slides
+  // applied, ready to save; nullptr (with |error| set) on failure.
+  std::unique_ptr<IPowerPointService> BuildPresentation(const std::string& template_path,
+                                                        const std::vector<SlideContent>& slides,
+                                                        const std::string& output_path,
+                                                        std::string& error);
+
   std::shared_ptr<MySQLConnectionPool> pool_;
   std::shared_ptr<IPowerPointServiceFactory> powerpoint_factory_;
 };
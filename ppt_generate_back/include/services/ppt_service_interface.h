@@ -49,6 +49,18 @@ public:
      * @param ppt_path PowerPoint文件路径
      */
     virtual bool Save(const std::string& ppt_path) = 0;
+
+    /**
+     * 准备保存所需的一切，但把最后的外部命令交给调用方执行
+     * （例如在事件循环上等待子进程，而不是阻塞线程）
+     * @param ppt_path PowerPoint文件路径
+     * @param command 输出：需执行的命令行（argv）；为空表示该实现在进程内保存，应改为调用Save
+     */
+    virtual bool PrepareSave(const std::string& ppt_path, std::vector<std::string>& command) {
+        (void)ppt_path;
+        command.clear();
+        return true;
+    }
 };
 
 // 抽象工厂接口，用于创建PowerPoint服务实例
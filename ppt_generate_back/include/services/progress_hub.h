@@ -0,0 +1,71 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "http/body_stream.h"
+
+// Fans generation progress out to Server-Sent Events subscribers. Each
+// request id has an ordered event log, so a subscriber that connects late
+// (or reconnects with Last-Event-ID) is replayed what it missed before
+// following live events. Publishing never blocks: a subscriber that falls a
+// full stream buffer behind is dropped and can reconnect. Finished logs are
+// kept for |retention| so a client can still pick up the outcome.
+class ProgressHub {
+ public:
+  enum class SubscribeResult { kSubscribed, kUnknown, kForbidden };
+
+  explicit ProgressHub(std::chrono::seconds retention = std::chrono::minutes(10),
+                       std::chrono::seconds heartbeat = std::chrono::seconds(15));
+  ~ProgressHub();
+
+  ProgressHub(const ProgressHub&) = delete;
+  ProgressHub& operator=(const ProgressHub&) = delete;
+
+  // Opens the event log for |request_id|, owned by |user_id|.
+  void Begin(std::uint64_t request_id, std::uint64_t user_id);
+  void Publish(std::uint64_t request_id, const std::string& event, const nlohmann::json& data);
+  // Publishes the last event and ends every subscriber's stream.
+  void Finish(std::uint64_t request_id, const std::string& event, const nlohmann::json& data);
+
+  // Replays events after |last_event_id| into |stream| and keeps it attached
+  // until the request finishes. Admins may watch any request.
+  SubscribeResult Subscribe(std::uint64_t request_id,
+                            std::uint64_t user_id,
+                            bool is_admin,
+                            std::uint64_t last_event_id,
+                            const std::shared_ptr<BodyStream>& stream);
+
+  // One SSE frame: "id: ...\nevent: ...\ndata: ...\n\n" (id omitted when 0).
+  static std::string FormatEvent(std::uint64_t id, const std::string& event, const nlohmann::json& data);
+
+ private:
+  struct Channel {
+    std::uint64_t user_id = 0;
+    std::vector<std::string> events;  // event i has id i + 1
+    std::vector<std::shared_ptr<BodyStream>> subscribers;
+    bool finished = false;
+    std::chrono::steady_clock::time_point finished_at;
+  };
+
+  // Called with |mutex_| held.
+  void Append(Channel& channel, const std::string& event, const nlohmann::json& data);
+  void HeartbeatLoop();
+
+  const std::chrono::seconds retention_;
+  const std::chrono::seconds heartbeat_;
+  std::mutex mutex_;
+  std::condition_variable stop_condition_;
+  bool stop_ = false;
+  std::unordered_map<std::uint64_t, Channel> channels_;
+  std::thread heartbeat_thread_;
+};
@@ -6,6 +6,7 @@
 
 #include "models/outline_item.h"
 #include "models/slide_content.h"
+#include "utils/task.h"
 
 class QwenClient {
  public:
@@ -32,6 +33,30 @@ class QwenClient {
                                  std::vector<SlideContent>& out_slides,
                                  std::string& error_message) const;
 
+#if PPT_HAVE_COROUTINES
+  // The same calls for coroutine handlers: the model request goes through
+  // the event loop (async_io::Perform) instead of blocking the thread.
+  // Arguments must outlive the returned Task.
+  Task<bool> GenerateSlidesAsync(const std::string& topic,
+                                 int slide_count,
+                                 const std::string& template_hint,
+                                 bool include_images,
+                                 std::vector<SlideContent>& out_slides,
+                                 std::string& error_message) const;
+
+  Task<bool> GenerateOutlineAsync(const std::string& topic,
+                                  int slide_count,
+                                  const std::string& template_hint,
+                                  std::vector<OutlineItem>& out_outline,
+                                  std::string& error_message) const;
+
+  Task<bool> GenerateSlidesFromOutlineAsync(const std::string& topic,
+                                            const std::vector<OutlineItem>& outline,
+                                            bool include_images,
+                                            std::vector<SlideContent>& out_slides,
+                                            std::string& error_message) const;
+#endif
+
  private:
   std::string api_key_;
 };
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace compression_utils {
+
+enum class Encoding { kIdentity, kGzip, kBrotli };
+
+// Content-Encoding token ("gzip", "br"); empty for identity.
+std::string_view EncodingName(Encoding encoding);
+// True when the encoder for |encoding| was compiled in. Brotli is optional.
+bool IsSupported(Encoding encoding);
+
+// |level| is a zlib-style 1-9 knob; brotli maps it onto its 0-11 quality scale.
+bool Compress(Encoding encoding, std::string_view input, int level, std::string& output);
+
+// "<source>.gz" / "<source>.br"; returns |source| for identity.
+std::string SidecarPath(const std::string& source, Encoding encoding);
+// True if the sidecar exists and is not older than |source|.
+bool SidecarIsFresh(const std::string& source, Encoding encoding);
+// Writes a maximally compressed sidecar of |contents| next to |source| for
+// every supported encoding. Each file is written under a temporary name and
+// renamed into place, so readers never see a partial sidecar.
+bool WriteSidecars(const std::string& source, std::string_view contents, std::string& error);
+
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <initializer_list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Process-wide metrics in the Prometheus text exposition format. Series are
+// created once (usually at startup or through a function-local static) and
+// handed out by reference; updating them afterwards is a relaxed atomic
+// operation with no locking. Only registration and Render() take the mutex.
+namespace metrics {
+
+class Metric {
+ public:
+  virtual ~Metric() = default;
+  virtual void Render(std::string& out, const std::string& name, const std::string& labels) const = 0;
+};
+
+class Counter : public Metric {
+ public:
+  void Increment(std::uint64_t amount = 1) { value_.fetch_add(amount, std::memory_order_relaxed); }
+  std::uint64_t Value() const { return value_.load(std::memory_order_relaxed); }
+  void Render(std::string& out, const std::string& name, const std::string& labels) const override;
+
+ private:
+  std::atomic<std::uint64_t> value_{0};
+};
+
+class Gauge : public Metric {
+ public:
+  void Set(std::int64_t value) { value_.store(value, std::memory_order_relaxed); }
+  void Add(std::int64_t delta) { value_.fetch_add(delta, std::memory_order_relaxed); }
+  std::int64_t Value() const { return value_.load(std::memory_order_relaxed); }
+  void Render(std::string& out, const std::string& name, const std::string& labels) const override;
+
+ private:
+  std::atomic<std::int64_t> value_{0};
+};
+
+// HDR-style log-linear histogram of durations. Every power of two (in
+// microseconds) is split into 8 linear sub-buckets, so quantiles (reported
+// as bucket midpoints) are within 6.25% of the true value over 1us .. ~12
+// days. Rendered as a Prometheus summary (p50/p90/p99, sum and count, in
+// seconds).
+class Histogram : public Metric {
+ public:
+  static constexpr int kSubBucketBits = 3;
+  static constexpr std::size_t kSubBuckets = std::size_t{1} << kSubBucketBits;
+  static constexpr std::size_t kBucketCount = kSubBuckets * 38;
+
+  void Record(std::chrono::nanoseconds duration);
+  void RecordMicros(std::uint64_t micros);
+  std::uint64_t Count() const { return count_.load(std::memory_order_relaxed); }
+  // Midpoint of the bucket holding quantile |q| (0..1), in microseconds.
+  std::uint64_t QuantileMicros(double q) const;
+  void Render(std::string& out, const std::string& name, const std::string& labels) const override;
+
+  static std::size_t BucketIndex(std::uint64_t micros);
+  static std::uint64_t BucketUpperBound(std::size_t index);
+
+ private:
+  std::array<std::atomic<std::uint64_t>, kBucketCount> buckets_{};
+  std::atomic<std::uint64_t> count_{0};
+  std::atomic<std::uint64_t> sum_micros_{0};
+};
+
+class Registry {
+ public:
+  static Registry& Instance();
+
+  // Returns the series for |name| + |labels|, creating it on first use.
+  // |labels| is a preformatted label list such as FormatLabels() returns.
+  // Throws std::logic_error if |name| was registered with another type.
+  Counter& GetCounter(const std::string& name, const std::string& help, const std::string& labels = {});
+  Gauge& GetGauge(const std::string& name, const std::string& help, const std::string& labels = {});
+  Histogram& GetHistogram(const std::string& name, const std::string& help, const std::string& labels = {});
+
+  std::string Render() const;
+
+ private:
+  enum class Type { kCounter, kGauge, kSummary };
+
+  struct Family {
+    Type type;
+    std::string help;
+    std::map<std::string, std::unique_ptr<Metric>> series;
+  };
+
+  template <typename T>
+  T& GetOrCreate(const std::string& name, const std::string& help, const std::string& labels, Type type);
+
+  mutable std::mutex mutex_;
+  std::map<std::string, Family> families_;
+};
+
+// Formats {"method", "GET"}, {"route", "/api"} as method="GET",route="/api",
+// escaping values as the exposition format requires.
+std::string FormatLabels(std::initializer_list<std::pair<std::string_view, std::string_view>> labels);
+
+// Records the lifetime of the scope into |histogram|.
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(Histogram& histogram)
+      : histogram_(histogram), started_(std::chrono::steady_clock::now()) {}
+  ~ScopedTimer() { histogram_.Record(std::chrono::steady_clock::now() - started_); }
+
+  ScopedTimer(const ScopedTimer&) = delete;
+  ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+ private:
+  Histogram& histogram_;
+  std::chrono::steady_clock::time_point started_;
+};
+
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+// Bump allocator for everything one request builds: it hands out memory from
+// an inline block and then from geometrically growing chunks, never frees
+// individual allocations, and gives it all back at once in Reset(). The
+// server keeps one per worker thread and resets it after every request, so
+// the memory is reused by each request the worker handles. Not thread-safe;
+// one request uses it at a time.
+class RequestArena {
+ public:
+  static constexpr std::size_t kInlineSize = 8 * 1024;
+  static constexpr std::size_t kMaxPooledChunk = 256 * 1024;
+
+  RequestArena() = default;
+  RequestArena(const RequestArena&) = delete;
+  RequestArena& operator=(const RequestArena&) = delete;
+
+  std::pmr::memory_resource* resource() { return &resource_; }
+  // Invalidates everything allocated so far.
+  void Reset() { resource_.release(); }
+
+  // The arena ArenaAllocator draws from on this thread, or nullptr; set by Scope.
+  static RequestArena* Current() { return current_; }
+
+  // Makes |arena| the current one on this thread for the scope's lifetime.
+  class Scope {
+   public:
+    explicit Scope(RequestArena& arena) : previous_(current_) { current_ = &arena; }
+    ~Scope() { current_ = previous_; }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+   private:
+    RequestArena* previous_;
+  };
+
+ private:
+  alignas(std::max_align_t) std::array<std::byte, kInlineSize> inline_{};
+  // Keeps the chunks Reset() gives back, so a warmed-up arena stops touching
+  // the global heap; chunks above the largest pool block still go to it.
+  std::pmr::unsynchronized_pool_resource chunks_{std::pmr::pool_options{0, kMaxPooledChunk}};
+  std::pmr::monotonic_buffer_resource resource_{inline_.data(), inline_.size(), &chunks_};
+  static inline thread_local RequestArena* current_ = nullptr;
+};
+
+// Stateless allocator for containers that cannot carry a resource pointer,
+// such as nlohmann::basic_json. Allocates from the thread's current
+// RequestArena (the heap outside a Scope) and records the source in a small
+// header, so a block is always returned to where it came from. Anything it
+// allocated inside a Scope must be destroyed before that arena is reset.
+template <typename T>
+class ArenaAllocator {
+ public:
+  using value_type = T;
+
+  ArenaAllocator() noexcept = default;
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>&) noexcept {}
+
+  T* allocate(std::size_t count) {
+    static_assert(alignof(T) <= kHeaderSize, "ArenaAllocator cannot align T");
+    auto* arena = RequestArena::Current();
+    auto* resource = arena ? arena->resource() : std::pmr::new_delete_resource();
+    auto* block = static_cast<std::byte*>(resource->allocate(kHeaderSize + count * sizeof(T), kHeaderSize));
+    *reinterpret_cast<std::pmr::memory_resource**>(block) = resource;
+    return reinterpret_cast<T*>(block + kHeaderSize);
+  }
+
+  void deallocate(T* pointer, std::size_t count) noexcept {
+    auto* block = reinterpret_cast<std::byte*>(pointer) - kHeaderSize;
+    auto* resource = *reinterpret_cast<std::pmr::memory_resource**>(block);
+    resource->deallocate(block, kHeaderSize + count * sizeof(T), kHeaderSize);
+  }
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U>&) const noexcept { return true; }
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U>&) const noexcept { return false; }
+
+ private:
+  static constexpr std::size_t kHeaderSize = alignof(std::max_align_t);
+};
+
+// nlohmann::json whose objects and arrays live in the current RequestArena.
+// For response payloads built and serialized within one handler call;
+// HttpResponse::Json() accepts it like nlohmann::json.
+using ArenaJson = nlohmann::basic_json<std::map, std::vector, std::string, bool, std::int64_t, std::uint64_t, double,
+                                       ArenaAllocator>;
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Vector that keeps its first |N| elements inline and only moves to the heap
+// once it outgrows them. Elements must be default-constructible; unused
+// inline slots hold default values. clear() keeps a spilled buffer, so an
+// object reused across requests allocates at most once.
+template <typename T, std::size_t N>
+class SmallVector {
+ public:
+  using value_type = T;
+  using iterator = T*;
+  using const_iterator = const T*;
+
+  SmallVector() = default;
+  SmallVector(const SmallVector&) = default;
+  SmallVector& operator=(const SmallVector&) = default;
+  // A moved-from vector is empty and usable again.
+  SmallVector(SmallVector&& other) noexcept(std::is_nothrow_move_assignable_v<T>) { *this = std::move(other); }
+  SmallVector& operator=(SmallVector&& other) noexcept(std::is_nothrow_move_assignable_v<T>) {
+    if (this != &other) {
+      clear();
+      if (other.spilled_) {
+        heap_ = std::move(other.heap_);
+        spilled_ = true;
+      } else {
+        spilled_ = false;
+        heap_.clear();
+        for (std::size_t i = 0; i < other.size_; ++i) {
+          inline_[i] = std::move(other.inline_[i]);
+        }
+      }
+      size_ = other.size_;
+      // Resets the moved-from slots to default values; a spilled vector's
+      // inline slots already hold them.
+      other.clear();
+      other.heap_.clear();
+      other.spilled_ = false;
+    }
+    return *this;
+  }
+
+  T* begin() { return data(); }
+  T* end() { return data() + size_; }
+  const T* begin() const { return data(); }
+  const T* end() const { return data() + size_; }
+
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  T& operator[](std::size_t index) { return data()[index]; }
+  const T& operator[](std::size_t index) const { return data()[index]; }
+  T& back() { return data()[size_ - 1]; }
+
+  void push_back(T value) {
+    if (!spilled_ && size_ < N) {
+      inline_[size_++] = std::move(value);
+      return;
+    }
+    if (!spilled_) {
+      Spill(N * 2);
+    }
+    heap_.push_back(std::move(value));
+    ++size_;
+  }
+
+  void reserve(std::size_t capacity) {
+    if (spilled_) {
+      heap_.reserve(capacity);
+    } else if (capacity > N) {
+      Spill(capacity);
+    }
+  }
+
+  // Removes |position|, shifting the later elements down.
+  void erase(T* position) {
+    for (auto* it = position; it + 1 != end(); ++it) {
+      *it = std::move(*(it + 1));
+    }
+    if (spilled_) {
+      heap_.pop_back();
+    } else {
+      inline_[size_ - 1] = T{};
+    }
+    --size_;
+  }
+
+  void clear() {
+    if (spilled_) {
+      heap_.clear();
+    } else {
+      for (std::size_t i = 0; i < size_; ++i) {
+        inline_[i] = T{};
+      }
+    }
+    size_ = 0;
+  }
+
+ private:
+  T* data() { return spilled_ ? heap_.data() : inline_.data(); }
+  const T* data() const { return spilled_ ? heap_.data() : inline_.data(); }
+
+  void Spill(std::size_t capacity) {
+    heap_.reserve(capacity);
+    for (std::size_t i = 0; i < size_; ++i) {
+      heap_.push_back(std::move(inline_[i]));
+      inline_[i] = T{};
+    }
+    spilled_ = true;
+  }
+
+  std::array<T, N> inline_{};
+  std::vector<T> heap_;
+  std::size_t size_ = 0;
+  bool spilled_ = false;
+};
@@ -1,13 +1,23 @@
 #pragma once
 
+#include <memory_resource>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 
 namespace string_utils {
 
 std::string Trim(const std::string& input);
+std::string_view TrimView(std::string_view input);
 std::string ToLower(std::string value);
-std::string UrlDecode(const std::string& value);
-std::unordered_map<std::string, std::string> ParseQuery(const std::string& query_string);
+bool EqualsIgnoreCase(std::string_view lhs, std::string_view rhs);
+std::string UrlDecode(std::string_view value);
+using QueryMap = std::pmr::unordered_map<std::pmr::string, std::pmr::string>;
+// Decodes every parameter into a map allocated from |resource|.
+QueryMap ParseQuery(std::string_view query_string,
+                    std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+// Looks up a single parameter without materializing the whole query map.
+std::optional<std::string> FindQueryParam(std::string_view query_string, std::string_view key);
 
 }
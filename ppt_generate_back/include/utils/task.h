@@ -0,0 +1,156 @@
+#pragma once
+
+// Coroutine handlers need C++20. A C++17 build leaves everything below out
+// (PPT_HAVE_COROUTINES stays undefined) and every route runs synchronously
+// on the worker pool, as before.
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define PPT_HAVE_COROUTINES 1
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+template <typename T = void>
+class Task;
+
+namespace task_detail {
+
+struct PromiseBase {
+  // The coroutine awaiting this one.
+  std::coroutine_handle<> continuation;
+  // Set by whichever comes second of the awaiter suspending and this
+  // coroutine finishing; that side resumes the awaiter. A task that
+  // finishes without suspending thus continues its awaiter in a loop rather
+  // than a nested call, so long runs of such awaits do not grow the stack.
+  std::atomic<bool> ready{false};
+  std::exception_ptr exception;
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+    template <typename Promise>
+    void await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+      auto& promise = handle.promise();
+      if (promise.ready.exchange(true, std::memory_order_acq_rel)) {
+        promise.continuation.resume();
+      }
+    }
+    void await_resume() noexcept {}
+  };
+  FinalAwaiter final_suspend() noexcept { return {}; }
+
+  void unhandled_exception() { exception = std::current_exception(); }
+};
+
+template <typename T>
+struct Promise : PromiseBase {
+  std::optional<T> value;
+
+  Task<T> get_return_object();
+  template <typename U>
+  void return_value(U&& result) {
+    value.emplace(std::forward<U>(result));
+  }
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+  Task<void> get_return_object();
+  void return_void() {}
+};
+
+// Runs a Task to completion with nobody awaiting it; the frame frees itself.
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    // Spawn() documents that its task must not throw.
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+}
+
+// A lazily started coroutine producing a T. Nothing runs until the Task is
+// co_awaited; the awaiting coroutine resumes when it finishes, with its
+// result or its exception. Awaitables that suspend (see http/async_io.h)
+// decide which thread it continues on. Move-only; destroying a Task that
+// has not finished destroys the coroutine frame with it.
+template <typename T>
+class [[nodiscard]] Task {
+ public:
+  using promise_type = task_detail::Promise<T>;
+
+  Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, {})) {}
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      if (handle_) {
+        handle_.destroy();
+      }
+      handle_ = std::exchange(other.handle_, {});
+    }
+    return *this;
+  }
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+  ~Task() {
+    if (handle_) {
+      handle_.destroy();
+    }
+  }
+
+  bool await_ready() const noexcept { return false; }
+  // Runs the task up to its first suspension; false if it finished already.
+  bool await_suspend(std::coroutine_handle<> awaiting) noexcept {
+    auto& promise = handle_.promise();
+    promise.continuation = awaiting;
+    handle_.resume();
+    return !promise.ready.exchange(true, std::memory_order_acq_rel);
+  }
+  T await_resume() {
+    auto& promise = handle_.promise();
+    if (promise.exception) {
+      std::rethrow_exception(promise.exception);
+    }
+    if constexpr (!std::is_void_v<T>) {
+      return std::move(*promise.value);
+    }
+  }
+
+ private:
+  friend promise_type;
+  explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+
+  std::coroutine_handle<promise_type> handle_;
+};
+
+namespace task_detail {
+
+template <typename T>
+Task<T> Promise<T>::get_return_object() {
+  return Task<T>(std::coroutine_handle<Promise<T>>::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() {
+  return Task<void>(std::coroutine_handle<Promise<void>>::from_promise(*this));
+}
+
+inline Detached RunDetached(Task<void> task) {
+  co_await std::move(task);
+}
+
+}
+
+// Starts |task| on the calling thread and lets it run to completion on its
+// own. It must catch its own exceptions; one that escapes terminates.
+inline void Spawn(Task<void> task) {
+  task_detail::RunDetached(std::move(task));
+}
+
+#endif
@@ -1,19 +1,44 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
+#include <exception>
 #include <functional>
 #include <future>
+#include <limits>
+#include <memory>
 #include <mutex>
 #include <queue>
+#include <string>
 #include <stdexcept>
 #include <thread>
 #include <type_traits>
 #include <vector>
 
+#include "utils/metrics.h"
+
+// Fixed-size worker pool. The queue is unbounded for Enqueue/EnqueueDetached;
+// TryEnqueue enforces |max_queue| (0 = unbounded) plus a caller-supplied depth
+// limit, so admission control can refuse work instead of queueing it. The
+// pool also tracks an exponentially weighted average of how long tasks wait
+// in the queue before a worker picks them up. A non-empty |metrics_name|
+// exports queue depth and wait time labelled pool="<metrics_name>".
 class ThreadPool {
  public:
-  explicit ThreadPool(std::size_t thread_count = std::thread::hardware_concurrency())
-      : stop_(false) {
+  explicit ThreadPool(std::size_t thread_count = std::thread::hardware_concurrency(),
+                      std::size_t max_queue = 0,
+                      const std::string& metrics_name = {})
+      : max_queue_(max_queue == 0 ? std::numeric_limits<std::size_t>::max() : max_queue), stop_(false) {
+    if (!metrics_name.empty()) {
+      const auto labels = metrics::FormatLabels({{"pool", metrics_name}});
+      auto& registry = metrics::Registry::Instance();
+      depth_gauge_ = &registry.GetGauge("worker_pool_queue_depth", "Tasks waiting for a worker thread.", labels);
+      wait_histogram_ = &registry.GetHistogram(
+          "worker_pool_queue_wait_seconds", "Time tasks spent queued before a worker picked them up.", labels);
+    }
     if (thread_count == 0) {
       thread_count = 1;
     }
@@ -50,7 +75,8 @@ class ThreadPool {
       if (stop_) {
         throw std::runtime_error("ThreadPool has been stopped");
       }
-      tasks_.emplace([task]() { (*task)(); });
+      tasks_.push(QueuedTask{[task]() { (*task)(); }, std::chrono::steady_clock::now()});
+      PublishDepth();
     }
     condition_.notify_one();
     return result;
@@ -62,15 +88,93 @@ class ThreadPool {
       if (stop_) {
         throw std::runtime_error("ThreadPool has been stopped");
       }
-      tasks_.emplace(std::move(task));
+      tasks_.push(QueuedTask{std::move(task), std::chrono::steady_clock::now()});
+      PublishDepth();
     }
     condition_.notify_one();
   }
 
+  // Queues |task| only if fewer than min(|depth_limit|, max_queue) tasks are
+  // waiting. Returns false (and drops |task|) otherwise or after shutdown.
+  bool TryEnqueue(std::function<void()> task, std::size_t depth_limit = std::numeric_limits<std::size_t>::max()) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (stop_ || tasks_.size() >= std::min(depth_limit, max_queue_)) {
+        return false;
+      }
+      tasks_.push(QueuedTask{std::move(task), std::chrono::steady_clock::now()});
+      PublishDepth();
+    }
+    condition_.notify_one();
+    return true;
+  }
+
+  // Runs job(0) .. job(count - 1) and returns once every call has returned.
+  // The calling thread claims indices too, and idle workers join in only if
+  // TryEnqueue(|depth_limit|) has room, so when the pool is busy (the caller
+  // may well be one of its workers) the jobs just run serially rather than
+  // deadlock, and never take queue room reserved for other work.
+  // Rethrows the first exception a job threw, after all of them finished.
+  template <typename Job>
+  void ParallelFor(std::size_t count, const Job& job,
+                   std::size_t depth_limit = std::numeric_limits<std::size_t>::max()) {
+    struct Shared {
+      std::atomic<std::size_t> next{0};
+      std::size_t count = 0;
+      std::size_t finished = 0;
+      std::exception_ptr error;
+      std::mutex mutex;
+      std::condition_variable done;
+    };
+    auto shared = std::make_shared<Shared>();
+    shared->count = count;
+    // Helpers may start after we returned; they only touch |job| for an
+    // index they claimed, and we wait for every claimed index.
+    auto claim = [shared, &job]() {
+      for (auto index = shared->next.fetch_add(1); index < shared->count; index = shared->next.fetch_add(1)) {
+        std::exception_ptr error;
+        try {
+          job(index);
+        } catch (...) {
+          error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        if (error && !shared->error) {
+          shared->error = error;
+        }
+        if (++shared->finished == shared->count) {
+          shared->done.notify_all();
+        }
+      }
+    };
+    const auto helpers = count > 1 ? std::min(count - 1, workers_.size()) : 0;
+    for (std::size_t i = 0; i < helpers && TryEnqueue(claim, depth_limit); ++i) {
+    }
+    claim();
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->done.wait(lock, [&shared]() { return shared->finished == shared->count; });
+    if (shared->error) {
+      std::rethrow_exception(shared->error);
+    }
+  }
+
+  std::size_t thread_count() const { return workers_.size(); }
+  std::size_t max_queue() const { return max_queue_; }
+  // Lock-free snapshots for admission decisions; may be momentarily stale.
+  std::size_t QueueDepth() const { return depth_.load(std::memory_order_relaxed); }
+  std::chrono::microseconds AverageQueueWait() const {
+    return std::chrono::microseconds(wait_ewma_us_.load(std::memory_order_relaxed));
+  }
+
  private:
+  struct QueuedTask {
+    std::function<void()> run;
+    std::chrono::steady_clock::time_point queued_at;
+  };
+
   void WorkerLoop() {
     while (true) {
-      std::function<void()> task;
+      QueuedTask task;
       {
         std::unique_lock<std::mutex> lock(mutex_);
         condition_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
@@ -79,13 +183,39 @@ class ThreadPool {
         }
         task = std::move(tasks_.front());
         tasks_.pop();
+        PublishDepth();
       }
-      task();
+      RecordQueueWait(std::chrono::steady_clock::now() - task.queued_at);
+      task.run();
+    }
+  }
+
+  // Called with |mutex_| held.
+  void PublishDepth() {
+    depth_.store(tasks_.size(), std::memory_order_relaxed);
+    if (depth_gauge_) {
+      depth_gauge_->Set(static_cast<std::int64_t>(tasks_.size()));
+    }
+  }
+
+  void RecordQueueWait(std::chrono::steady_clock::duration waited) {
+    if (wait_histogram_) {
+      wait_histogram_->Record(waited);
     }
+    // EWMA with weight 1/8 for the newest sample; concurrent updates may
+    // occasionally drop a sample, which is fine for a load signal.
+    const auto sample = std::chrono::duration_cast<std::chrono::microseconds>(waited).count();
+    const auto previous = wait_ewma_us_.load(std::memory_order_relaxed);
+    wait_ewma_us_.store(previous + (sample - previous) / 8, std::memory_order_relaxed);
   }
 
   std::vector<std::thread> workers_;
-  std::queue<std::function<void()>> tasks_;
+  std::queue<QueuedTask> tasks_;
+  const std::size_t max_queue_;
+  std::atomic<std::size_t> depth_{0};
+  std::atomic<std::int64_t> wait_ewma_us_{0};
+  metrics::Gauge* depth_gauge_ = nullptr;
+  metrics::Histogram* wait_histogram_ = nullptr;
   std::mutex mutex_;
   std::condition_variable condition_;
   bool stop_;
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <vector>
+
+// Hierarchical timing wheel: four levels of 64 slots, each level 64 times
+// coarser than the one below. Scheduling and cancelling are O(1); a timer is
+// moved down a level at most three times before it fires, so tens of
+// thousands of pending timers cost next to nothing per tick. Timers fire
+// with |tick| granularity, never early.
+//
+// Not thread-safe: owned and driven by a single thread (e.g. an EventLoop).
+class TimerWheel {
+ public:
+  using Clock = std::chrono::steady_clock;
+  // 0 is never a valid id, so it can mean "no timer".
+  using TimerId = std::uint64_t;
+  using Callback = std::function<void()>;
+
+  explicit TimerWheel(std::chrono::milliseconds tick, Clock::time_point now = Clock::now());
+
+  TimerWheel(const TimerWheel&) = delete;
+  TimerWheel& operator=(const TimerWheel&) = delete;
+
+  // Runs |callback| once |delay| has elapsed (rounded up to whole ticks).
+  TimerId Schedule(std::chrono::milliseconds delay, Callback callback);
+  // Returns false if |id| already fired or was cancelled.
+  bool Cancel(TimerId id);
+
+  // Fires every timer due at |now|. Callbacks may schedule or cancel timers.
+  // Returns the number of callbacks run.
+  std::size_t Advance(Clock::time_point now);
+
+  // How long until Advance() next has work to do; nullopt when empty. May
+  // undershoot when the next step only moves timers between levels.
+  std::optional<std::chrono::milliseconds> TimeUntilNext(Clock::time_point now) const;
+
+  std::size_t size() const { return active_; }
+  bool empty() const { return active_ == 0; }
+
+ private:
+  static constexpr int kSlotBits = 6;
+  static constexpr std::size_t kSlots = std::size_t{1} << kSlotBits;
+  static constexpr std::size_t kLevels = 4;
+  static constexpr std::uint32_t kNil = UINT32_MAX;
+
+  struct Node {
+    Callback callback;
+    std::uint64_t expires = 0;  // absolute tick
+    std::uint32_t prev = kNil;
+    std::uint32_t next = kNil;
+    std::uint32_t generation = 0;
+    std::uint32_t* head = nullptr;  // slot list the node is linked into
+  };
+
+  void Place(std::uint32_t index);
+  void Link(std::uint32_t index, std::uint32_t& head);
+  void Unlink(std::uint32_t index);
+  void Release(std::uint32_t index);
+  void Cascade(std::size_t level);
+  std::size_t Step();
+
+  std::chrono::milliseconds tick_;
+  Clock::time_point origin_;
+  std::uint64_t current_ = 0;
+  std::size_t active_ = 0;
+  std::vector<Node> nodes_;
+  std::vector<std::uint32_t> free_;
+  std::array<std::array<std::uint32_t, kSlots>, kLevels> slots_;
+};
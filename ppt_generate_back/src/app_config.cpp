@@ -1,5 +1,6 @@
 #include "app_config.h"
 
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 #include <stdexcept>
@@ -7,6 +8,17 @@
 #include <nlohmann/json.hpp>
 
 namespace {
+TokenBucketConfig ParseTokenBucket(const nlohmann::json& json) {
+  TokenBucketConfig cfg;
+  if (auto it = json.find("rate"); it != json.end() && it->is_number() && it->get<double>() > 0) {
+    cfg.rate = it->get<double>();
+  }
+  if (auto it = json.find("burst"); it != json.end() && it->is_number_unsigned()) {
+    cfg.burst = it->get<std::uint32_t>();
+  }
+  return cfg;
+}
+
 ServerConfig ParseServer(const nlohmann::json& json) {
   ServerConfig cfg;
   if (auto it = json.find("host"); it != json.end() && it->is_string()) {
@@ -18,9 +30,82 @@ ServerConfig ParseServer(const nlohmann::json& json) {
   if (auto it = json.find("thread_count"); it != json.end() && it->is_number_unsigned()) {
     cfg.thread_count = static_cast<std::size_t>(it->get<std::uint32_t>());
   }
+  if (auto it = json.find("keep_alive_timeout_seconds"); it != json.end() && it->is_number_unsigned()) {
+    cfg.keep_alive_timeout_seconds = it->get<std::uint32_t>();
+  }
+  if (auto it = json.find("keep_alive_max_requests"); it != json.end() && it->is_number_unsigned()) {
+    cfg.keep_alive_max_requests = it->get<std::uint32_t>();
+  }
+  if (auto it = json.find("header_timeout_seconds"); it != json.end() && it->is_number_unsigned()) {
+    cfg.header_timeout_seconds = it->get<std::uint32_t>();
+  }
+  if (auto it = json.find("body_timeout_seconds"); it != json.end() && it->is_number_unsigned()) {
+    cfg.body_timeout_seconds = it->get<std::uint32_t>();
+  }
+  if (auto it = json.find("write_timeout_seconds"); it != json.end() && it->is_number_unsigned()) {
+    cfg.write_timeout_seconds = it->get<std::uint32_t>();
+  }
+  if (auto it = json.find("listener_shards"); it != json.end() && it->is_number_unsigned()) {
+    cfg.listener_shards = static_cast<std::size_t>(it->get<std::uint32_t>());
+  }
+  if (auto it = json.find("worker_queue_limit"); it != json.end() && it->is_number_unsigned()) {
+    cfg.worker_queue_limit = static_cast<std::size_t>(it->get<std::uint32_t>());
+  }
+  if (auto it = json.find("queue_wait_target_ms"); it != json.end() && it->is_number_unsigned()) {
+    cfg.queue_wait_target_ms = it->get<std::uint32_t>();
+  }
+  if (auto it = json.find("pin_shards"); it != json.end() && it->is_boolean()) {
+    cfg.pin_shards = it->get<bool>();
+  }
+  if (auto it = json.find("static_root"); it != json.end() && it->is_string()) {
+    cfg.static_root = *it;
+  }
+  if (auto it = json.find("drain_timeout_seconds"); it != json.end() && it->is_number_unsigned()) {
+    cfg.drain_timeout_seconds = it->get<std::uint32_t>();
+  }
+  if (auto it = json.find("handoff_socket"); it != json.end() && it->is_string()) {
+    cfg.handoff_socket = *it;
+  }
+  if (auto it = json.find("rate_limits"); it != json.end() && it->is_object()) {
+    for (const auto& entry : it->items()) {
+      const auto& limits = entry.value();
+      RateLimitConfig limit;
+      if (auto ip = limits.find("ip"); ip != limits.end() && ip->is_object()) {
+        limit.per_ip = ParseTokenBucket(*ip);
+      }
+      if (auto token = limits.find("token"); token != limits.end() && token->is_object()) {
+        limit.per_token = ParseTokenBucket(*token);
+      }
+      cfg.rate_limits[entry.key()] = limit;
+    }
+  }
+  if (auto it = json.find("rate_limit_buckets"); it != json.end() && it->is_number_unsigned()) {
+    cfg.rate_limit_buckets = static_cast<std::size_t>(it->get<std::uint32_t>());
+  }
+  if (auto it = json.find("trust_forwarded_for"); it != json.end() && it->is_boolean()) {
+    cfg.trust_forwarded_for = it->get<bool>();
+  }
+  if (auto it = json.find("tls_certificate"); it != json.end() && it->is_string()) {
+    cfg.tls_certificate = *it;
+  }
+  if (auto it = json.find("tls_private_key"); it != json.end() && it->is_string()) {
+    cfg.tls_private_key = *it;
+  }
+  if (auto it = json.find("tls_kernel_offload"); it != json.end() && it->is_boolean()) {
+    cfg.tls_kernel_offload = it->get<bool>();
+  }
+  if (auto it = json.find("http2"); it != json.end() && it->is_boolean()) {
+    cfg.http2 = it->get<bool>();
+  }
   if (cfg.thread_count == 0) {
     cfg.thread_count = 1;
   }
+  if (cfg.keep_alive_max_requests == 0) {
+    cfg.keep_alive_max_requests = 1;
+  }
+  cfg.header_timeout_seconds = std::max<std::uint32_t>(cfg.header_timeout_seconds, 1);
+  cfg.body_timeout_seconds = std::max<std::uint32_t>(cfg.body_timeout_seconds, 1);
+  cfg.write_timeout_seconds = std::max<std::uint32_t>(cfg.write_timeout_seconds, 1);
   return cfg;
 }
 
@@ -160,6 +245,15 @@ GenerationConfig ParseGeneration(const nlohmann::json& json, const std::filesyst
   if (auto it = json.find("soffice_binary"); it != json.end() && it->is_string()) {
     cfg.soffice_binary = *it;
   }
+  if (auto it = json.find("worker_threads"); it != json.end() && it->is_number_unsigned()) {
+    cfg.worker_threads = std::max<std::size_t>(1, it->get<std::uint32_t>());
+  }
+  if (auto it = json.find("max_pending"); it != json.end() && it->is_number_unsigned()) {
+    cfg.max_pending = static_cast<std::size_t>(it->get<std::uint32_t>());
+  }
+  if (auto it = json.find("max_concurrent"); it != json.end() && it->is_number_unsigned()) {
+    cfg.max_concurrent = std::max<std::size_t>(1, it->get<std::uint32_t>());
+  }
 
   auto make_absolute = [&](const std::string& value) {
     if (value.empty()) {
@@ -3,25 +3,26 @@
 #include <nlohmann/json.hpp>
 
 #include "logger.h"
+#include "utils/request_arena.h"
 #include "utils/string_utils.h"
 
 namespace {
 std::string ExtractToken(const HttpRequest& request) {
-  auto header = request.Header("authorization");
+  auto header = request.Header(HeaderId::kAuthorization);
   if (header.rfind("Bearer ", 0) == 0 || header.rfind("bearer ", 0) == 0) {
     return header.substr(7);
   }
   if (!header.empty()) {
     return header;
   }
-  if (auto it = request.query_params.find("token"); it != request.query_params.end()) {
-    return it->second;
+  if (auto token = request.Query("token")) {
+    return *token;
   }
   return {};
 }
 
-nlohmann::json UserToJson(const User& user) {
-  nlohmann::json payload = {
+ArenaJson UserToJson(const User& user) {
+  ArenaJson payload = {
       {"id", user.id},
       {"username", user.username},
       {"email", user.email},
@@ -65,8 +66,8 @@ HttpResponse AdminController::ListUsers(const HttpRequest& request) {
   }
 
   std::string query;
-  if (auto it = request.query_params.find("q"); it != request.query_params.end()) {
-    query = string_utils::Trim(it->second);
+  if (auto q = request.Query("q")) {
+    query = string_utils::Trim(*q);
   }
 
   auto users = auth_service_->ListUsers(query, error);
@@ -74,10 +75,10 @@ HttpResponse AdminController::ListUsers(const HttpRequest& request) {
     return HttpResponse::Json(500, {{"message", error}});
   }
 
-  nlohmann::json payload;
-  payload["items"] = nlohmann::json::array();
+  ArenaJson payload;
+  auto& items = payload["items"] = ArenaJson::array();
   for (const auto& user : users) {
-    payload["items"].push_back(UserToJson(user));
+    items.push_back(UserToJson(user));
   }
   return HttpResponse::Json(200, payload);
 }
@@ -90,7 +91,7 @@ HttpResponse AdminController::UpdateUserStatus(const HttpRequest& request) {
   }
 
   try {
-    auto body = nlohmann::json::parse(request.body);
+    auto body = ArenaJson::parse(request.body);
     std::uint64_t user_id = 0;
     if (body.contains("userId")) {
       user_id = body["userId"].get<std::uint64_t>();
@@ -1,10 +1,11 @@
 #include "controllers/auth_controller.h"
 
 #include "logger.h"
+#include "utils/request_arena.h"
 
 namespace {
-nlohmann::json UserJson(const User& user) {
-  nlohmann::json payload = {
+ArenaJson UserJson(const User& user) {
+  ArenaJson payload = {
       {"id", user.id},
       {"username", user.username},
       {"email", user.email},
@@ -24,7 +25,7 @@ AuthController::AuthController(std::shared_ptr<AuthService> service) : service_(
 
 HttpResponse AuthController::Register(const HttpRequest& request) {
   try {
-    auto body = nlohmann::json::parse(request.body);
+    auto body = ArenaJson::parse(request.body);
     if (!body.contains("username") || !body.contains("email") || !body.contains("password")) {
       return HttpResponse::Json(400, {{"message", "Missing required fields"}});
     }
@@ -36,7 +37,7 @@ HttpResponse AuthController::Register(const HttpRequest& request) {
       return HttpResponse::Json(400, {{"message", error.empty() ? "Registration failed" : error}});
     }
 
-    nlohmann::json payload{{"token", token}, {"user", UserJson(user)}};
+    ArenaJson payload{{"token", token}, {"user", UserJson(user)}};
     HttpResponse response = HttpResponse::Json(201, payload);
     response.status_message = "Created";
     return response;
@@ -48,7 +49,7 @@ HttpResponse AuthController::Register(const HttpRequest& request) {
 
 HttpResponse AuthController::Login(const HttpRequest& request) {
   try {
-    auto body = nlohmann::json::parse(request.body);
+    auto body = ArenaJson::parse(request.body);
     if (!body.contains("username") || !body.contains("password")) {
       return HttpResponse::Json(400, {{"message", "Username or password missing"}});
     }
@@ -60,7 +61,7 @@ HttpResponse AuthController::Login(const HttpRequest& request) {
       return HttpResponse::Json(401, {{"message", error.empty() ? "Login failed" : error}});
     }
 
-    return HttpResponse::Json(200, {{"token", token}, {"user", UserJson(user)}});
+    return HttpResponse::Json(200, ArenaJson{{"token", token}, {"user", UserJson(user)}});
   } catch (const std::exception& ex) {
     Logger::Error(std::string("Failed to parse login request: ") + ex.what());
     return HttpResponse::Json(400, {{"message", "Invalid JSON"}});
@@ -93,12 +94,12 @@ HttpResponse AuthController::CurrentUser(const HttpRequest& request) {
     return HttpResponse::Json(401, {{"message", error.empty() ? "Invalid token" : error}});
   }
 
-  return HttpResponse::Json(200, {{"user", UserJson(*user)}});
+  return HttpResponse::Json(200, ArenaJson{{"user", UserJson(*user)}});
 }
 
 HttpResponse AuthController::RequestPasswordReset(const HttpRequest& request) {
   try {
-    auto body = nlohmann::json::parse(request.body);
+    auto body = ArenaJson::parse(request.body);
     if (!body.contains("email") || !body["email"].is_string()) {
       return HttpResponse::Json(400, {{"message", "Email required"}});
     }
@@ -115,7 +116,7 @@ HttpResponse AuthController::RequestPasswordReset(const HttpRequest& request) {
 
 HttpResponse AuthController::ConfirmPasswordReset(const HttpRequest& request) {
   try {
-    auto body = nlohmann::json::parse(request.body);
+    auto body = ArenaJson::parse(request.body);
     if (!body.contains("email") || !body.contains("code") || !body.contains("password")) {
       return HttpResponse::Json(400, {{"message", "Missing required fields"}});
     }
@@ -134,7 +135,7 @@ HttpResponse AuthController::ConfirmPasswordReset(const HttpRequest& request) {
 }
 
 std::string AuthController::ExtractToken(const HttpRequest& request) const {
-  auto header = request.Header("authorization");
+  auto header = request.Header(HeaderId::kAuthorization);
   if (header.rfind("Bearer ", 0) == 0 || header.rfind("bearer ", 0) == 0) {
     return header.substr(7);
   }
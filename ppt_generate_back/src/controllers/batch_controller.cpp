@@ -0,0 +1,172 @@
+#include "controllers/batch_controller.h"
+
+#include <string_view>
+#include <vector>
+
+#include "logger.h"
+#include "utils/request_arena.h"
+
+namespace {
+// One part of a batch; |request| views into |target| and |authorization|.
+struct Part {
+  std::string target;
+  std::string authorization;
+  HttpRequest request;
+  const Router::Route* route = nullptr;
+  HttpResponse response;
+};
+
+HttpResponse ErrorResponse(int status, const std::string& message) {
+  return HttpResponse::Json(status, {{"message", message}});
+}
+
+// Sets up |part| for the GET |item| describes, or its error response; true if it should run.
+bool PreparePart(const Router& router, const ArenaJson& item, Part& part) {
+  if (!item.is_object() || !item.contains("path") || !item["path"].is_string()) {
+    part.response = ErrorResponse(400, "Each request needs a path");
+    return false;
+  }
+  if (auto method = item.find("method"); method != item.end() &&
+                                         (!method->is_string() || method->get<std::string>() != "GET")) {
+    part.response = ErrorResponse(400, "Only GET requests can be batched");
+    return false;
+  }
+  part.target = item["path"].get<std::string>();
+  if (part.target.empty() || part.target.front() != '/') {
+    part.response = ErrorResponse(400, "Path must start with /");
+    return false;
+  }
+
+  auto& request = part.request;
+  request.method = "GET";
+  request.version = "HTTP/1.1";
+  request.target = part.target;
+  const auto query = request.target.find('?');
+  request.path = request.target.substr(0, query);
+  if (query != std::string_view::npos) {
+    request.query_string = request.target.substr(query + 1);
+  }
+  part.route = router.Match(request.method, request.path, request.path_params);
+  if (!part.route) {
+    part.response = ErrorResponse(404, "Route not found");
+    return false;
+  }
+  // Coroutine handlers need a loop thread, and rate-limited routes would
+  // otherwise be a way around their buckets.
+  if (!part.route->handler || part.route->options.rate_limit.enabled()) {
+    part.response = ErrorResponse(400, "Route cannot be batched");
+    return false;
+  }
+  return true;
+}
+
+// The body as JSON when it is JSON, as a string otherwise; false for
+// streamed or file bodies, which a batch cannot carry.
+bool BodyJson(const HttpResponse& response, ArenaJson& out) {
+  if (response.stream || response.stream_producer || response.file ||
+      response.headers.Contains(HeaderId::kContentEncoding)) {
+    return false;
+  }
+  const std::string_view body = response.shared_body ? response.shared_body->data : std::string_view(response.body);
+  const auto* type = response.headers.Find(HeaderId::kContentType);
+  if (!type || type->find("json") != std::string::npos) {
+    out = ArenaJson::parse(body.begin(), body.end(), nullptr, false);
+    if (!out.is_discarded()) {
+      return true;
+    }
+  }
+  out = std::string(body);
+  return true;
+}
+}  // namespace
+
+BatchController::BatchController(const Router& router,
+                                 HttpServer& server,
+                                 std::shared_ptr<AuthService> auth_service,
+                                 int priority)
+    : router_(router), server_(server), auth_service_(std::move(auth_service)), priority_(priority) {}
+
+HttpResponse BatchController::Handle(const HttpRequest& request) {
+  ArenaJson body;
+  try {
+    body = ArenaJson::parse(request.body);
+  } catch (const std::exception& ex) {
+    Logger::Error(std::string("Failed to parse batch request: ") + ex.what());
+    return ErrorResponse(400, "Invalid JSON");
+  }
+  const auto requests = body.find("requests");
+  if (requests == body.end() || !requests->is_array()) {
+    return ErrorResponse(400, "requests must be an array");
+  }
+  if (requests->size() > kMaxRequests) {
+    return ErrorResponse(400, "At most " + std::to_string(kMaxRequests) + " requests per batch");
+  }
+
+  // Sized once: every part's request views into its own strings.
+  std::vector<Part> parts(requests->size());
+  std::vector<std::size_t> runnable;
+  bool needs_user = false;
+  for (std::size_t i = 0; i < parts.size(); ++i) {
+    if (PreparePart(router_, (*requests)[i], parts[i])) {
+      runnable.push_back(i);
+      needs_user = needs_user || parts[i].route->options.auth_required;
+    }
+  }
+
+  AuthService::TokenLookup lookup;
+  lookup.token = ExtractToken(request);
+  if (!lookup.token.empty()) {
+    if (needs_user) {
+      lookup.user = auth_service_->GetUserFromToken(lookup.token, lookup.error);
+    }
+    for (auto index : runnable) {
+      auto& part = parts[index];
+      part.authorization = "Bearer " + lookup.token;
+      part.request.headers.push_back({HeaderId::kAuthorization, "authorization", part.authorization});
+    }
+  }
+
+  auto run = [this, &parts, &runnable, &lookup](std::size_t k) {
+    auto& part = parts[runnable[k]];
+    if (part.route->options.auth_required && lookup.token.empty()) {
+      part.response = ErrorResponse(401, "Token not provided");
+      return;
+    }
+    AuthService::TokenScope scope(lookup);
+    try {
+      part.response = router_.Invoke(part.route, part.request);
+    } catch (const std::exception& ex) {
+      Logger::Error("Batched " + part.target + " failed: " + ex.what());
+      part.response = ErrorResponse(500, "Internal server error");
+    }
+  };
+  if (auto* pool = server_.WorkerPool()) {
+    pool->ParallelFor(runnable.size(), run, server_.QueueDepthLimit(priority_));
+  } else {
+    for (std::size_t k = 0; k < runnable.size(); ++k) {
+      run(k);
+    }
+  }
+
+  ArenaJson responses = ArenaJson::array();
+  for (const auto& part : parts) {
+    ArenaJson entry{{"status", part.response.status_code}};
+    if (!BodyJson(part.response, entry["body"])) {
+      entry["status"] = 400;
+      entry["body"] = ArenaJson{{"message", "Response cannot be batched"}};
+    }
+    responses.push_back(std::move(entry));
+  }
+  return HttpResponse::Json(200, ArenaJson{{"responses", std::move(responses)}});
+}
+
+std::string BatchController::ExtractToken(const HttpRequest& request) const {
+  auto header = request.Header(HeaderId::kAuthorization);
+  if (header.rfind("Bearer ", 0) == 0 || header.rfind("bearer ", 0) == 0) {
+    return header.substr(7);
+  }
+  if (!header.empty()) {
+    return header;
+  }
+  return request.Query("token").value_or(std::string());
+}
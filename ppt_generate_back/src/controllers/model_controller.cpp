@@ -1,9 +1,7 @@
 #include "controllers/model_controller.h"
 
 ModelController::ModelController(std::shared_ptr<ModelService> service)
-    : service_(std::move(service)) {}
-
-HttpResponse ModelController::List(const HttpRequest& /*request*/) {
+    : service_(std::move(service)) {
   auto list = service_->GetAll();
   nlohmann::json payload;
   payload["items"] = nlohmann::json::array();
@@ -17,6 +15,13 @@ HttpResponse ModelController::List(const HttpRequest& /*request*/) {
     itemJson["default"] = false; // 默认没有预设模型
     payload["items"].push_back(itemJson);
   }
-  return HttpResponse::Json(200, payload);
+  payload_ = payload.dump();
+  etag_ = VersionEtag(payload_);
+}
+
+HttpResponse ModelController::List(const HttpRequest& /*request*/) {
+  HttpResponse response;
+  response.body = payload_;
+  return response;
 }
 
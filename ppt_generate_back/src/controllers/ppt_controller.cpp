@@ -1,16 +1,27 @@
 #include "controllers/ppt_controller.h"
 
+#include <algorithm>
 #include <cctype>
+#include <chrono>
 #include <ctime>
 #include <filesystem>
 #include <fstream>
+#include <iterator>
 #include <optional>
 #include <random>
 #include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
 #include <vector>
 
+#include "http/async_io.h"
+#include "http/conditional.h"
+#include "http/content_encoding.h"
 #include "logger.h"
 #include "models/outline_item.h"
+#include "utils/compression.h"
+#include "utils/request_arena.h"
 
 namespace {
 
@@ -34,6 +45,52 @@ std::string FormatTimestamp(std::uint64_t seconds) {
   return buffer;
 }
 
+constexpr std::size_t kExportFlushBytes = 64 * 1024;
+constexpr std::size_t kEventStreamHighWater = 256 * 1024;
+// Event streams are only written with TryWrite, which never waits.
+constexpr std::chrono::milliseconds kEventStreamStallTimeout{0};
+
+// Asynchronous generation is opt-in: "Prefer: respond-async" or ?async=1.
+bool WantsAsync(const HttpRequest& request) {
+  if (request.HeaderView(HeaderId::kPrefer).find("respond-async") != std::string_view::npos) {
+    return true;
+  }
+  const auto value = request.Query("async");
+  return value && (*value == "1" || *value == "true");
+}
+
+void AppendCsvField(std::string& out, std::string_view value) {
+  if (value.find_first_of(",\"\r\n") == std::string_view::npos) {
+    out.append(value);
+    return;
+  }
+  out.push_back('"');
+  for (const char ch : value) {
+    if (ch == '"') {
+      out.push_back('"');
+    }
+    out.push_back(ch);
+  }
+  out.push_back('"');
+}
+
+void AppendCsvRow(std::string& out, const PptRequest& item) {
+  const std::string fields[] = {
+      std::to_string(item.id),   std::to_string(item.user_id),       item.user_name,
+      item.user_email,           item.title,                         item.topic,
+      std::to_string(item.pages), item.style,                        item.model_name,
+      item.template_name,        item.status,                        FormatTimestamp(item.created_at),
+      FormatTimestamp(item.updated_at),
+  };
+  for (std::size_t i = 0; i < std::size(fields); ++i) {
+    if (i > 0) {
+      out.push_back(',');
+    }
+    AppendCsvField(out, fields[i]);
+  }
+  out.append("\r\n");
+}
+
 std::string SanitizeFilenamePart(const std::string& value, std::size_t max_len) {
   std::string result;
   result.reserve(value.size());
@@ -62,9 +119,12 @@ std::string SanitizeFilenamePart(const std::string& value, std::size_t max_len)
   return result;
 }
 
-nlohmann::json RequestToJson(const PptRequest& request, const std::string& download_url = {}) {
+// Json is nlohmann::json for payloads that outlive the request (progress
+// events) and ArenaJson for those serialized straight into a response.
+template <typename Json = nlohmann::json>
+Json RequestToJson(const PptRequest& request, const std::string& download_url = {}) {
   const bool has_file = !request.output_path.empty();
-  nlohmann::json result = {
+  Json result = {
       {"id", request.id},
       {"userId", request.user_id},
       {"title", request.title},
@@ -90,7 +150,7 @@ nlohmann::json RequestToJson(const PptRequest& request, const std::string& downl
   }
   if (has_file) {
     result["downloadUrl"] = download_url.empty()
-                                ? "/api/ppt/file?id=" + std::to_string(request.id)
+                                ? "/api/ppt/" + std::to_string(request.id) + "/file"
                                 : download_url;
   }
   return result;
@@ -155,11 +215,17 @@ void AppendOutlineToPreviewJson(const std::string& output_path,
     return;
   }
   payload["outline"] = OutlineToJson(outline);
-  std::ofstream output(preview_path);
-  if (!output.is_open()) {
-    return;
+  const auto payload_text = payload.dump();
+  {
+    std::ofstream output(preview_path);
+    if (!output.is_open()) {
+      return;
+    }
+    output << payload_text;
+  }
+  if (std::string error; !compression_utils::WriteSidecars(preview_path.string(), payload_text, error)) {
+    Logger::Warn("Cannot precompress preview: " + error);
   }
-  output << payload.dump();
 }
 
 nlohmann::json SlideToJson(const SlideContent& slide,
@@ -207,15 +273,15 @@ nlohmann::json SlideToJson(const SlideContent& slide,
 }
 
 std::string ExtractToken(const HttpRequest& request) {
-  auto header = request.Header("authorization");
+  auto header = request.Header(HeaderId::kAuthorization);
   if (header.rfind("Bearer ", 0) == 0 || header.rfind("bearer ", 0) == 0) {
     return header.substr(7);
   }
   if (!header.empty()) {
     return header;
   }
-  if (auto it = request.query_params.find("token"); it != request.query_params.end()) {
-    return it->second;
+  if (auto token = request.Query("token")) {
+    return *token;
   }
   return {};
 }
@@ -394,22 +460,78 @@ PptController::PptController(std::shared_ptr<AuthService> auth_service,
                            std::shared_ptr<TemplateService> template_service,
                            GenerationConfig generation_config,
                            std::shared_ptr<QwenClient> qwen_client,
-                           std::shared_ptr<S3Client> s3_client)
+                           std::shared_ptr<S3Client> s3_client,
+                           std::shared_ptr<ProgressHub> progress_hub)
     : auth_service_(std::move(auth_service)),
       ppt_service_(std::move(ppt_service)),
       model_service_(std::move(model_service)),
       template_service_(std::move(template_service)),
       generation_config_(std::move(generation_config)),
       qwen_client_(std::move(qwen_client)),
-      s3_client_(std::move(s3_client)) {}
+      s3_client_(std::move(s3_client)),
+      progress_hub_(std::move(progress_hub)),
+      generation_pool_(std::make_unique<ThreadPool>(generation_config_.worker_threads,
+                                                    generation_config_.max_pending,
+                                                    "generation")) {}
 
 HttpResponse PptController::Generate(const HttpRequest& request) {
+  auto job = std::make_shared<GenerationJob>();
+  if (auto rejection = PrepareJob(request, *job)) {
+    return std::move(*rejection);
+  }
+  if (!WantsAsync(request)) {
+    return HttpResponse::Json(201, RunGeneration(*job));
+  }
+
+  const bool queued = generation_pool_->TryEnqueue([this, job]() {
+    if (interrupted_.load()) {
+      // Drain() already marked the row and ended its stream.
+      return;
+    }
+    try {
+      RunGeneration(*job);
+    } catch (const std::exception& ex) {
+      Logger::Error(std::string("Background PPT generation failed: ") + ex.what());
+    }
+  });
+  if (!queued) {
+    return RejectJob(*job);
+  }
+  return Accepted(*job);
+}
+
+#if PPT_HAVE_COROUTINES
+Task<HttpResponse> PptController::GenerateAsync(const HttpRequest& request) {
+  auto job = std::make_shared<GenerationJob>();
+  auto rejection = co_await async_io::Offload(*generation_pool_, [&]() { return PrepareJob(request, *job); });
+  if (rejection) {
+    co_return std::move(*rejection);
+  }
+  if (ActiveJobs() > generation_config_.max_concurrent) {
+    co_return co_await async_io::Offload(*generation_pool_, [&]() { return RejectJob(*job); });
+  }
+  if (!WantsAsync(request)) {
+    auto payload = co_await RunGenerationAsync(*job);
+    co_return HttpResponse::Json(201, payload);
+  }
+  Spawn(RunInBackground(job));
+  co_return Accepted(*job);
+}
+#endif
+
+std::optional<HttpResponse> PptController::PrepareJob(const HttpRequest& request, GenerationJob& job) {
   std::string error;
   auto user = Authenticate(request, error);
   if (!user) {
     return HttpResponse::Json(401, {{"message", error.empty() ? "Unauthorized" : error}});
   }
 
+  if (draining_.load()) {
+    auto response = HttpResponse::Json(503, {{"message", "Server is restarting, please retry shortly"}});
+    response.headers.Set(HeaderId::kRetryAfter, "30");
+    return response;
+  }
+
   auto model = model_service_->FindById("qwen-turbo");
   if (!model) {
     return HttpResponse::Json(500, {{"message", "Model not found"}});
@@ -429,8 +551,8 @@ HttpResponse PptController::Generate(const HttpRequest& request) {
     }
 
     std::string template_id;
-    if (auto it = request.query_params.find("template"); it != request.query_params.end() && !it->second.empty()) {
-      template_id = it->second;
+    if (auto value = request.Query("template"); value && !value->empty()) {
+      template_id = *value;
     } else if (!input.template_id.empty()) {
       template_id = input.template_id;
     }
@@ -451,115 +573,360 @@ HttpResponse PptController::Generate(const HttpRequest& request) {
 
     input.template_id = template_info_opt->id;
 
-    std::string template_prompt = template_info_opt->prompt.empty()
-                                      ? template_info_opt->description
-                                      : template_info_opt->prompt;
-
-    PptRequest ppt_request;
-    if (!ppt_service_->CreateRequest(input, user->id, model->name, template_info_opt->name, ppt_request, error)) {
+    job.user = user;
+    job.template_info = *template_info_opt;
+    job.template_prompt = template_info_opt->prompt.empty() ? template_info_opt->description
+                                                            : template_info_opt->prompt;
+    if (!ppt_service_->CreateRequest(input, user->id, model->name, template_info_opt->name, job.ppt_request, error)) {
       return HttpResponse::Json(500, {{"message", error.empty() ? "Generation failed" : error}});
     }
+    job.input = std::move(input);
+  } catch (const std::exception& ex) {
+    Logger::Error(std::string("Failed to parse PPT request: ") + ex.what());
+    return HttpResponse::Json(400, {{"message", "Invalid JSON"}});
+  }
 
-    nlohmann::json payload{{"request", RequestToJson(ppt_request)}};
-    if (input.model_id == "qwen-turbo" && qwen_client_ && qwen_client_->IsEnabled()) {
-      std::vector<OutlineItem> outline = input.outline;
-      if (!outline.empty() && static_cast<int>(outline.size()) > input.pages) {
-        outline.resize(static_cast<std::size_t>(input.pages));
-      }
+  const auto request_id = job.ppt_request.id;
+  TrackJob(request_id);
+  progress_hub_->Begin(request_id, user->id);
+  progress_hub_->Publish(request_id, "created", {{"request", RequestToJson(job.ppt_request)}});
+  return std::nullopt;
+}
 
-      std::vector<SlideContent> slides;
-      std::string qwen_error;
-      bool generated = false;
+HttpResponse PptController::Accepted(const GenerationJob& job) const {
+  const auto request_id = job.ppt_request.id;
+  return HttpResponse::Json(202,
+                            {{"request", RequestToJson(job.ppt_request)},
+                             {"eventsUrl", "/api/ppt/" + std::to_string(request_id) + "/events"}});
+}
 
-      if (outline.empty()) {
-        std::string outline_error;
-        if (!qwen_client_->GenerateOutline(input.topic, input.pages, template_prompt, outline, outline_error)) {
-          Logger::Warn("PPT outline generation failed: " + outline_error);
-        }
-      }
+HttpResponse PptController::RejectJob(GenerationJob& job) {
+  const auto request_id = job.ppt_request.id;
+  UntrackJob(request_id);
+  std::string update_error;
+  job.ppt_request.status = "failed";
+  ppt_service_->UpdateRequestOutput(request_id, job.user->id, "", "failed", update_error);
+  progress_hub_->Finish(request_id, "error", {{"message", "Generation queue is full"}});
+  auto response = HttpResponse::Json(503, {{"message", "Too many generations in progress, please retry later"}});
+  response.headers.Set(HeaderId::kRetryAfter, "30");
+  return response;
+}
 
-      if (!outline.empty()) {
-        if (qwen_client_->GenerateSlidesFromOutline(input.topic, outline, input.include_images, slides, qwen_error)) {
-          generated = true;
-        } else {
-          Logger::Warn("PPT content generation from outline failed: " + qwen_error);
-          slides = BuildSlidesFromOutline(outline, input.topic, input.include_images);
-          generated = !slides.empty();
-        }
-      }
+bool PptController::UsesModel(const GenerationJob& job) const {
+  return job.input.model_id == "qwen-turbo" && qwen_client_ && qwen_client_->IsEnabled();
+}
 
-      if (!generated) {
-        if (qwen_client_->GenerateSlides(input.topic, input.pages, template_prompt, input.include_images, slides, qwen_error)) {
-          generated = true;
+nlohmann::json PptController::RunGeneration(GenerationJob& job) {
+  const auto request_id = job.ppt_request.id;
+  // The stream must end whatever happens, or subscribers would wait forever.
+  try {
+    nlohmann::json payload{{"request", RequestToJson(job.ppt_request)}};
+    if (UsesModel(job)) {
+      std::vector<OutlineItem> outline;
+      std::vector<SlideContent> slides;
+      std::string qwen_error;
+      if (GenerateContent(job, outline, slides, qwen_error)) {
+        PublishSlides(job, outline, slides, payload);
+        if (const auto plan = PlanRender(job, payload)) {
+          progress_hub_->Publish(request_id, "render", {{"state", "started"}});
+          std::string generate_error;
+          const bool rendered =
+              ppt_service_->GeneratePptxFile(plan->template_file, slides, plan->output_path, generate_error);
+          FinishRender(job, outline, plan->output_path, rendered, generate_error, payload);
         }
+      } else {
+        Logger::Warn("Qwen slide generation failed: " + qwen_error);
       }
+    }
+    // Same body the synchronous call answers with.
+    progress_hub_->Finish(request_id, "done", payload);
+    UntrackJob(request_id);
+    return payload;
+  } catch (const std::exception& ex) {
+    progress_hub_->Finish(request_id, "error", {{"message", ex.what()}});
+    UntrackJob(request_id);
+    throw;
+  }
+}
 
-      if (generated) {
-        payload["preview"] = nlohmann::json::array();
-        if (!outline.empty()) {
-          payload["outline"] = OutlineToJson(outline);
-        }
-        const auto& layouts = template_info_opt->layouts;
-        const auto* theme = &template_info_opt->theme;
-        for (size_t i = 0; i < slides.size(); ++i) {
-          const TemplateLayout* layout = layouts.empty() ? nullptr : &layouts[i % layouts.size()];
-          payload["preview"].push_back(SlideToJson(slides[i], layout, theme));
-        }
-
-        const auto template_file = template_service_->GetLocalFile(template_info_opt->id);
-        if (!template_file) {
-          Logger::Warn("Template file missing or invalid for id: " + template_info_opt->id +
-                       ", local=" + template_info_opt->local_file_path);
-          std::string update_error;
-          ppt_request.status = "failed";
-          ppt_service_->UpdateRequestOutput(ppt_request.id, ppt_request.user_id, "", "failed", update_error);
-          payload["request"] = RequestToJson(ppt_request);
-          payload["fileError"] = "Template file missing or invalid";
-        } else {
-          std::string output_path = BuildOutputPath(generation_config_, ppt_request.id, input.title, user->email);
-          Logger::Info("Generating PPT: " + output_path);
+#if PPT_HAVE_COROUTINES
+Task<nlohmann::json> PptController::RunGenerationAsync(GenerationJob& job) {
+  const auto request_id = job.ppt_request.id;
+  // Drain() has already failed the job once it gave up; no further stage
+  // may start, least of all an offload racing the server's shutdown.
+  auto stop_if_interrupted = [this]() {
+    if (interrupted_.load()) {
+      throw std::runtime_error("Generation interrupted by a server restart");
+    }
+  };
+  try {
+    nlohmann::json payload{{"request", RequestToJson(job.ppt_request)}};
+    if (UsesModel(job)) {
+      std::vector<OutlineItem> outline;
+      std::vector<SlideContent> slides;
+      std::string qwen_error;
+      if (co_await GenerateContentAsync(job, outline, slides, qwen_error)) {
+        stop_if_interrupted();
+        PublishSlides(job, outline, slides, payload);
+        auto& pool = *generation_pool_;
+        const auto plan = co_await async_io::Offload(pool, [&]() { return PlanRender(job, payload); });
+        stop_if_interrupted();
+        if (plan) {
+          progress_hub_->Publish(request_id, "render", {{"state", "started"}});
+          std::vector<std::string> command;
           std::string generate_error;
-          if (ppt_service_->GeneratePptxFile(*template_file, slides, output_path, generate_error)) {
-            std::string update_error;
-            ppt_request.output_path = output_path;
-            ppt_request.status = "completed";
-            ppt_service_->UpdateRequestOutput(ppt_request.id, ppt_request.user_id, output_path, "completed", update_error);
-            if (!outline.empty()) {
-              AppendOutlineToPreviewJson(output_path, outline);
-            }
-            std::string signed_url;
-            if (s3_client_ && s3_client_->IsEnabled()) {
-              const auto object_key = BuildObjectKey(generation_config_, output_path);
-              if (!object_key.empty()) {
-                std::string upload_error;
-                if (s3_client_->UploadFile(output_path, object_key, upload_error)) {
-                  signed_url = s3_client_->PresignGetUrl(object_key);
-                  Logger::Info("S3 upload success: key=" + object_key);
-                } else {
-                  Logger::Warn("S3 upload failed: " + upload_error);
-                }
-              }
-            }
-            payload["request"] = RequestToJson(ppt_request, signed_url);
-          } else {
-            Logger::Warn("PPTX generation failed: " + generate_error);
-            std::string update_error;
-            ppt_request.status = "failed";
-            ppt_service_->UpdateRequestOutput(ppt_request.id, ppt_request.user_id, "", "failed", update_error);
-            payload["request"] = RequestToJson(ppt_request);
+          bool rendered = co_await async_io::Offload(pool, [&]() {
+            return ppt_service_->PreparePptxFile(plan->template_file, slides, plan->output_path, command,
+                                                 generate_error);
+          });
+          stop_if_interrupted();
+          // The renderer script runs for seconds; wait for it on the loop.
+          if (rendered && !command.empty() && co_await async_io::RunProcess(std::move(command)) != 0) {
+            Logger::Warn("PPT生成脚本执行失败");
+            generate_error = "无法保存PowerPoint文件";
+            rendered = false;
           }
+          stop_if_interrupted();
+          co_await async_io::Offload(pool, [&]() {
+            FinishRender(job, outline, plan->output_path, rendered, generate_error, payload);
+          });
         }
       } else {
         Logger::Warn("Qwen slide generation failed: " + qwen_error);
       }
     }
-    return HttpResponse::Json(201, payload);
+    progress_hub_->Finish(request_id, "done", payload);
+    UntrackJob(request_id);
+    co_return payload;
   } catch (const std::exception& ex) {
-    Logger::Error(std::string("Failed to parse PPT request: ") + ex.what());
-    return HttpResponse::Json(400, {{"message", "Invalid JSON"}});
+    progress_hub_->Finish(request_id, "error", {{"message", ex.what()}});
+    UntrackJob(request_id);
+    throw;
   }
 }
 
+Task<void> PptController::RunInBackground(std::shared_ptr<GenerationJob> job) {
+  if (interrupted_.load()) {
+    co_return;
+  }
+  try {
+    co_await RunGenerationAsync(*job);
+  } catch (const std::exception& ex) {
+    Logger::Error(std::string("Background PPT generation failed: ") + ex.what());
+  }
+}
+#endif
+
+bool PptController::GenerateContent(GenerationJob& job,
+                                    std::vector<OutlineItem>& outline,
+                                    std::vector<SlideContent>& slides,
+                                    std::string& qwen_error) {
+  const auto& input = job.input;
+  outline = input.outline;
+  if (!outline.empty() && static_cast<int>(outline.size()) > input.pages) {
+    outline.resize(static_cast<std::size_t>(input.pages));
+  }
+
+  if (outline.empty()) {
+    std::string outline_error;
+    if (!qwen_client_->GenerateOutline(input.topic, input.pages, job.template_prompt, outline, outline_error)) {
+      Logger::Warn("PPT outline generation failed: " + outline_error);
+    }
+  }
+  if (!outline.empty()) {
+    progress_hub_->Publish(job.ppt_request.id, "outline", {{"outline", OutlineToJson(outline)}});
+    if (qwen_client_->GenerateSlidesFromOutline(input.topic, outline, input.include_images, slides, qwen_error)) {
+      return true;
+    }
+    Logger::Warn("PPT content generation from outline failed: " + qwen_error);
+    slides = BuildSlidesFromOutline(outline, input.topic, input.include_images);
+    if (!slides.empty()) {
+      return true;
+    }
+  }
+  return qwen_client_->GenerateSlides(input.topic, input.pages, job.template_prompt, input.include_images, slides,
+                                      qwen_error);
+}
+
+#if PPT_HAVE_COROUTINES
+Task<bool> PptController::GenerateContentAsync(GenerationJob& job,
+                                               std::vector<OutlineItem>& outline,
+                                               std::vector<SlideContent>& slides,
+                                               std::string& qwen_error) {
+  const auto& input = job.input;
+  outline = input.outline;
+  if (!outline.empty() && static_cast<int>(outline.size()) > input.pages) {
+    outline.resize(static_cast<std::size_t>(input.pages));
+  }
+
+  if (outline.empty()) {
+    std::string outline_error;
+    if (!co_await qwen_client_->GenerateOutlineAsync(input.topic, input.pages, job.template_prompt, outline,
+                                                     outline_error)) {
+      Logger::Warn("PPT outline generation failed: " + outline_error);
+    }
+  }
+  if (!outline.empty()) {
+    progress_hub_->Publish(job.ppt_request.id, "outline", {{"outline", OutlineToJson(outline)}});
+    if (co_await qwen_client_->GenerateSlidesFromOutlineAsync(input.topic, outline, input.include_images, slides,
+                                                              qwen_error)) {
+      co_return true;
+    }
+    Logger::Warn("PPT content generation from outline failed: " + qwen_error);
+    slides = BuildSlidesFromOutline(outline, input.topic, input.include_images);
+    if (!slides.empty()) {
+      co_return true;
+    }
+  }
+  co_return co_await qwen_client_->GenerateSlidesAsync(input.topic, input.pages, job.template_prompt,
+                                                       input.include_images, slides, qwen_error);
+}
+#endif
+
+void PptController::PublishSlides(const GenerationJob& job,
+                                  const std::vector<OutlineItem>& outline,
+                                  const std::vector<SlideContent>& slides,
+                                  nlohmann::json& payload) {
+  payload["preview"] = nlohmann::json::array();
+  if (!outline.empty()) {
+    payload["outline"] = OutlineToJson(outline);
+  }
+  const auto& layouts = job.template_info.layouts;
+  const auto* theme = &job.template_info.theme;
+  for (size_t i = 0; i < slides.size(); ++i) {
+    const TemplateLayout* layout = layouts.empty() ? nullptr : &layouts[i % layouts.size()];
+    payload["preview"].push_back(SlideToJson(slides[i], layout, theme));
+    progress_hub_->Publish(job.ppt_request.id, "slide",
+                           {{"index", i}, {"total", slides.size()}, {"slide", payload["preview"].back()}});
+  }
+}
+
+std::optional<PptController::RenderPlan> PptController::PlanRender(GenerationJob& job, nlohmann::json& payload) {
+  const auto& template_info = job.template_info;
+  auto& ppt_request = job.ppt_request;
+  const auto template_file = template_service_->GetLocalFile(template_info.id);
+  if (!template_file) {
+    Logger::Warn("Template file missing or invalid for id: " + template_info.id +
+                 ", local=" + template_info.local_file_path);
+    std::string update_error;
+    ppt_request.status = "failed";
+    ppt_service_->UpdateRequestOutput(ppt_request.id, ppt_request.user_id, "", "failed", update_error);
+    payload["request"] = RequestToJson(ppt_request);
+    payload["fileError"] = "Template file missing or invalid";
+    return std::nullopt;
+  }
+  RenderPlan plan{*template_file, BuildOutputPath(generation_config_, ppt_request.id, job.input.title, job.user->email)};
+  Logger::Info("Generating PPT: " + plan.output_path);
+  return plan;
+}
+
+void PptController::FinishRender(GenerationJob& job,
+                                 const std::vector<OutlineItem>& outline,
+                                 const std::string& output_path,
+                                 bool rendered,
+                                 const std::string& render_error,
+                                 nlohmann::json& payload) {
+  auto& ppt_request = job.ppt_request;
+  const auto request_id = ppt_request.id;
+  if (!rendered) {
+    Logger::Warn("PPTX generation failed: " + render_error);
+    progress_hub_->Publish(request_id, "render", {{"state", "failed"}});
+    std::string update_error;
+    ppt_request.status = "failed";
+    ppt_service_->UpdateRequestOutput(ppt_request.id, ppt_request.user_id, "", "failed", update_error);
+    payload["request"] = RequestToJson(ppt_request);
+    return;
+  }
+
+  progress_hub_->Publish(request_id, "render", {{"state", "finished"}});
+  std::string update_error;
+  ppt_request.output_path = output_path;
+  ppt_request.status = "completed";
+  ppt_service_->UpdateRequestOutput(ppt_request.id, ppt_request.user_id, output_path, "completed", update_error);
+  if (!outline.empty()) {
+    AppendOutlineToPreviewJson(output_path, outline);
+  }
+  std::string signed_url;
+  if (s3_client_ && s3_client_->IsEnabled()) {
+    const auto object_key = BuildObjectKey(generation_config_, output_path);
+    if (!object_key.empty()) {
+      std::string upload_error;
+      if (s3_client_->UploadFile(output_path, object_key, upload_error)) {
+        signed_url = s3_client_->PresignGetUrl(object_key);
+        Logger::Info("S3 upload success: key=" + object_key);
+        progress_hub_->Publish(request_id, "upload", {{"state", "done"}, {"url", signed_url}});
+      } else {
+        Logger::Warn("S3 upload failed: " + upload_error);
+        progress_hub_->Publish(request_id, "upload", {{"state", "failed"}});
+      }
+    }
+  }
+  payload["request"] = RequestToJson(ppt_request, signed_url);
+}
+
+std::size_t PptController::ActiveJobs() {
+  std::lock_guard<std::mutex> lock(jobs_mutex_);
+  return active_jobs_.size();
+}
+
+void PptController::TrackJob(std::uint64_t request_id) {
+  std::lock_guard<std::mutex> lock(jobs_mutex_);
+  active_jobs_.insert(request_id);
+}
+
+void PptController::UntrackJob(std::uint64_t request_id) {
+  std::lock_guard<std::mutex> lock(jobs_mutex_);
+  active_jobs_.erase(request_id);
+}
+
+std::size_t PptController::Drain(std::chrono::steady_clock::time_point deadline) {
+  draining_.store(true);
+  auto next_report = std::chrono::steady_clock::now();
+  while (true) {
+    std::size_t active = 0;
+    {
+      std::lock_guard<std::mutex> lock(jobs_mutex_);
+      active = active_jobs_.size();
+    }
+    if (active == 0) {
+      Logger::Info("Generation drain complete");
+      return 0;
+    }
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      break;
+    }
+    if (now >= next_report) {
+      const auto left = std::chrono::ceil<std::chrono::seconds>(deadline - now).count();
+      Logger::Info("Draining generations: " + std::to_string(active) + " unfinished (" +
+                   std::to_string(generation_pool_->QueueDepth()) + " queued), " + std::to_string(left) + "s left");
+      next_report = now + std::chrono::seconds(1);
+    }
+    std::this_thread::sleep_for(
+        std::min<std::chrono::steady_clock::duration>(std::chrono::milliseconds(100), deadline - now));
+  }
+
+  interrupted_.store(true);
+  std::vector<std::uint64_t> request_ids;
+  {
+    std::lock_guard<std::mutex> lock(jobs_mutex_);
+    request_ids.assign(active_jobs_.begin(), active_jobs_.end());
+    active_jobs_.clear();
+  }
+  std::string id_list;
+  for (const auto request_id : request_ids) {
+    id_list += (id_list.empty() ? "" : ", ") + std::to_string(request_id);
+    progress_hub_->Finish(request_id, "error", {{"message", "Generation interrupted by a server restart"}});
+  }
+  // Only rows still "processing" change, so a render that finished meanwhile keeps its outcome.
+  std::string update_error;
+  if (!ppt_service_->MarkInterrupted(request_ids, update_error)) {
+    Logger::Error("Failed to mark interrupted generations: " + update_error);
+  }
+  Logger::Warn("Generation drain deadline passed; interrupted request(s) " + id_list);
+  return request_ids.size();
+}
+
 HttpResponse PptController::History(const HttpRequest& request) {
   std::string error;
   auto user = Authenticate(request, error);
@@ -568,8 +935,8 @@ HttpResponse PptController::History(const HttpRequest& request) {
   }
 
   std::string query;
-  if (auto it = request.query_params.find("q"); it != request.query_params.end()) {
-    query = Trim(it->second);
+  if (auto q = request.Query("q")) {
+    query = Trim(*q);
   }
 
   auto list = ppt_service_->GetHistory(user->id, query, error);
@@ -577,8 +944,8 @@ HttpResponse PptController::History(const HttpRequest& request) {
     return HttpResponse::Json(500, {{"message", error}});
   }
 
-  nlohmann::json payload;
-  payload["items"] = nlohmann::json::array();
+  ArenaJson payload;
+  auto& items = payload["items"] = ArenaJson::array();
   for (const auto& item : list) {
     std::string signed_url;
     if (s3_client_ && s3_client_->IsEnabled() && !item.output_path.empty()) {
@@ -587,12 +954,58 @@ HttpResponse PptController::History(const HttpRequest& request) {
         signed_url = s3_client_->PresignGetUrl(object_key);
       }
     }
-    payload["items"].push_back(RequestToJson(item, signed_url));
+    items.push_back(RequestToJson<ArenaJson>(item, signed_url));
   }
 
   return HttpResponse::Json(200, payload);
 }
 
+HttpResponse PptController::Events(const HttpRequest& request) {
+  std::string error;
+  auto user = Authenticate(request, error);
+  if (!user) {
+    return HttpResponse::Json(401, {{"message", error.empty() ? "Unauthorized" : error}});
+  }
+  const auto request_id = RequestIdFrom(request);
+  if (request_id == 0) {
+    return HttpResponse::Json(400, {{"message", "Invalid request id"}});
+  }
+
+  // EventSource sends Last-Event-ID when it reconnects.
+  std::uint64_t last_event_id = 0;
+  if (auto header = request.HeaderView(HeaderId::kLastEventId); !header.empty()) {
+    last_event_id = ParseId(std::string(header));
+  }
+
+  auto stream = std::make_shared<BodyStream>(kEventStreamHighWater, kEventStreamStallTimeout);
+  switch (progress_hub_->Subscribe(request_id, user->id, user->is_admin, last_event_id, stream)) {
+    case ProgressHub::SubscribeResult::kSubscribed:
+      break;
+    case ProgressHub::SubscribeResult::kForbidden:
+      return HttpResponse::Json(404, {{"message", "Request not found"}});
+    case ProgressHub::SubscribeResult::kUnknown: {
+      // Not running here (finished long ago, or before a restart): report the stored state.
+      PptRequest record;
+      // Same visibility as Subscribe(): admins may follow anyone's request.
+      if (!ppt_service_->GetRequest(user->id, request_id, record, error, user->is_admin)) {
+        return HttpResponse::Json(404, {{"message", error.empty() ? "Request not found" : error}});
+      }
+      stream->TryWrite(ProgressHub::FormatEvent(0, "done", {{"request", RequestToJson(record)}}));
+      stream->Close();
+      break;
+    }
+  }
+
+  HttpResponse response;
+  response.headers.Set(HeaderId::kContentType, "text/event-stream; charset=utf-8");
+  response.headers.Set(HeaderId::kCacheControl, "no-cache");
+  // Keeps nginx-style proxies from buffering the stream.
+  response.headers.Set("x-accel-buffering", "no");
+  response.body.clear();
+  response.stream = std::move(stream);
+  return response;
+}
+
 HttpResponse PptController::AdminHistory(const HttpRequest& request) {
   std::string error;
   auto user = Authenticate(request, error);
@@ -604,8 +1017,8 @@ HttpResponse PptController::AdminHistory(const HttpRequest& request) {
   }
 
   std::string query;
-  if (auto it = request.query_params.find("q"); it != request.query_params.end()) {
-    query = Trim(it->second);
+  if (auto q = request.Query("q")) {
+    query = Trim(*q);
   }
 
   auto list = ppt_service_->GetAdminHistory(query, error);
@@ -613,8 +1026,8 @@ HttpResponse PptController::AdminHistory(const HttpRequest& request) {
     return HttpResponse::Json(500, {{"message", error}});
   }
 
-  nlohmann::json payload;
-  payload["items"] = nlohmann::json::array();
+  ArenaJson payload;
+  auto& items = payload["items"] = ArenaJson::array();
   for (const auto& item : list) {
     std::string signed_url;
     if (s3_client_ && s3_client_->IsEnabled() && !item.output_path.empty()) {
@@ -623,12 +1036,55 @@ HttpResponse PptController::AdminHistory(const HttpRequest& request) {
         signed_url = s3_client_->PresignGetUrl(object_key);
       }
     }
-    payload["items"].push_back(RequestToJson(item, signed_url));
+    items.push_back(RequestToJson<ArenaJson>(item, signed_url));
   }
 
   return HttpResponse::Json(200, payload);
 }
 
+HttpResponse PptController::AdminExport(const HttpRequest& request) {
+  std::string error;
+  auto user = Authenticate(request, error);
+  if (!user) {
+    return HttpResponse::Json(401, {{"message", error.empty() ? "Unauthorized" : error}});
+  }
+  if (!user->is_admin) {
+    return HttpResponse::Json(403, {{"message", "Forbidden"}});
+  }
+
+  std::string query;
+  if (auto q = request.Query("q")) {
+    query = Trim(*q);
+  }
+
+  // Rows are fetched a page at a time and streamed as they are formatted, so
+  // the export never has to fit in memory.
+  auto ppt_service = ppt_service_;
+  auto response = HttpResponse::Stream(200, "text/csv; charset=utf-8", [ppt_service, query](BodyStream& stream) {
+    // The BOM makes Excel read the UTF-8 titles correctly.
+    std::string batch =
+        "\xEF\xBB\xBF"
+        "id,user_id,username,email,title,topic,pages,style,model,template,status,created_at,updated_at\r\n";
+    std::string export_error;
+    const bool ok = ppt_service->ExportAdminHistory(query, [&](const PptRequest& item) {
+      AppendCsvRow(batch, item);
+      if (batch.size() < kExportFlushBytes) {
+        return true;
+      }
+      const bool client_alive = stream.Write(batch);
+      batch.clear();
+      return client_alive;
+    }, export_error);
+    if (!ok) {
+      throw std::runtime_error("PPT history export failed: " + export_error);
+    }
+    stream.Write(batch);
+  });
+  const auto date = FormatTimestamp(static_cast<std::uint64_t>(std::time(nullptr))).substr(0, 10);
+  response.headers.Set(HeaderId::kContentDisposition, "attachment; filename=\"ppt-history-" + date + ".csv\"");
+  return response;
+}
+
 HttpResponse PptController::AdminMetrics(const HttpRequest& request) {
   std::string error;
   auto user = Authenticate(request, error);
@@ -640,8 +1096,8 @@ HttpResponse PptController::AdminMetrics(const HttpRequest& request) {
   }
 
   std::string range = "week";
-  if (auto it = request.query_params.find("range"); it != request.query_params.end()) {
-    const auto value = Trim(it->second);
+  if (auto param = request.Query("range")) {
+    const auto value = Trim(*param);
     if (value == "day" || value == "week" || value == "month") {
       range = value;
     }
@@ -652,7 +1108,7 @@ HttpResponse PptController::AdminMetrics(const HttpRequest& request) {
     return HttpResponse::Json(500, {{"message", error.empty() ? "获取统计数据失败" : error}});
   }
 
-  nlohmann::json payload;
+  ArenaJson payload;
   payload["summary"] = {
       {"total", metrics.total},
       {"success", metrics.success},
@@ -667,12 +1123,12 @@ HttpResponse PptController::AdminMetrics(const HttpRequest& request) {
   };
   payload["generation"] = {
       {"labels", metrics.generation_labels},
-      {"series", nlohmann::json::array()},
+      {"series", ArenaJson::array()},
   };
   for (const auto& series : metrics.generation_series) {
     payload["generation"]["series"].push_back({{"name", series.name}, {"values", series.values}});
   }
-  payload["templateShare"] = nlohmann::json::array();
+  payload["templateShare"] = ArenaJson::array();
   for (size_t i = 0; i < metrics.template_labels.size(); ++i) {
     const int value = i < metrics.template_values.size() ? metrics.template_values[i] : 0;
     payload["templateShare"].push_back({{"name", metrics.template_labels[i]}, {"value", value}});
@@ -750,13 +1206,10 @@ HttpResponse PptController::Delete(const HttpRequest& request) {
     return HttpResponse::Json(401, {{"message", error.empty() ? "Unauthorized" : error}});
   }
 
-  std::uint64_t request_id = 0;
-  if (auto it = request.query_params.find("id"); it != request.query_params.end()) {
-    request_id = ParseId(it->second);
-  }
+  std::uint64_t request_id = RequestIdFrom(request);
   if (request_id == 0 && !request.body.empty()) {
     try {
-      const auto body = nlohmann::json::parse(request.body);
+      const auto body = ArenaJson::parse(request.body);
       if (body.contains("id")) {
         if (body["id"].is_number_unsigned()) {
           request_id = body["id"].get<std::uint64_t>();
@@ -810,6 +1263,9 @@ HttpResponse PptController::Delete(const HttpRequest& request) {
       std::filesystem::path payload_json(output_path);
       payload_json.replace_extension(".json");
       RemoveFileQuietly(payload_json);
+      for (const auto encoding : {compression_utils::Encoding::kGzip, compression_utils::Encoding::kBrotli}) {
+        RemoveFileQuietly(compression_utils::SidecarPath(payload_json.string(), encoding));
+      }
     }
   }
 
@@ -821,18 +1277,15 @@ HttpResponse PptController::Download(const HttpRequest& request) {
   auto user = Authenticate(request, error);
   if (!user) {
     const auto token = ExtractToken(request);
-    Logger::Warn("PPT download unauthorized: method=" + request.method +
-                 " path=" + request.target +
+    Logger::Warn("PPT download unauthorized: method=" + std::string(request.method) +
+                 " path=" + std::string(request.target) +
                  " has_token=" + std::string(token.empty() ? "0" : "1") +
                  " error=" + (error.empty() ? "unknown" : error));
     return HttpResponse::Json(401, {{"message", error.empty() ? "Unauthorized" : error}});
   }
-  const bool is_head = request.method == "HEAD" || request.method == "head";
+  const bool is_head = ParseHttpMethod(request.method) == HttpMethod::kHead;
 
-  std::uint64_t request_id = 0;
-  if (auto it = request.query_params.find("id"); it != request.query_params.end()) {
-    request_id = ParseId(it->second);
-  }
+  std::uint64_t request_id = RequestIdFrom(request);
   if (request_id == 0) {
     return HttpResponse::Json(400, {{"message", "Invalid request ID"}});
   }
@@ -849,17 +1302,24 @@ HttpResponse PptController::Download(const HttpRequest& request) {
     return HttpResponse::Json(404, {{"message", "PPT file not generated"}});
   }
 
-  std::error_code size_ec;
-  const auto file_size = std::filesystem::file_size(ppt_request.output_path, size_ec);
-  if (size_ec || file_size == 0) {
-    Logger::Warn("PPT download file missing: path=" + ppt_request.output_path +
-                 " error=" + size_ec.message());
+  // Sizes and ranges come from the file that is opened here and sent, so a
+  // deck regenerated meanwhile cannot make the declared length wrong.
+  std::uint64_t file_size = 0;
+  auto file = HttpResponse::OpenFile(ppt_request.output_path, file_size);
+  if (!file || file_size == 0) {
+    Logger::Warn("PPT download file missing: path=" + ppt_request.output_path);
     return HttpResponse::Json(404, {{"message", "PPT file is missing"}});
   }
+  // Checked after the ownership lookup, so a 304 never reveals someone else's deck.
+  ResponseValidators validators;
+  FileValidators(ppt_request.output_path, false, validators);
+  if (IsNotModified(request, validators)) {
+    return NotModifiedResponse(validators);
+  }
 
-  const auto range_header = request.Header("range");
+  const auto range_header = request.Header(HeaderId::kRange);
   const auto range = ParseRangeHeader(range_header, file_size);
-  Logger::Info("PPT download request: method=" + request.method +
+  Logger::Info("PPT download request: method=" + std::string(request.method) +
                " user_id=" + std::to_string(user->id) +
                " request_id=" + std::to_string(request_id) +
                " range=" + (range_header.empty() ? "none" : range_header) +
@@ -870,20 +1330,20 @@ HttpResponse PptController::Download(const HttpRequest& request) {
     if (!range_header.empty() && !range.valid) {
       response.status_code = 416;
       response.status_message = "Range Not Satisfiable";
-      response.headers["content-range"] = "bytes */" + std::to_string(file_size);
+      response.headers.Set(HeaderId::kContentRange, "bytes */" + std::to_string(file_size));
     } else if (range.valid) {
       response.status_code = 206;
       response.status_message = "Partial Content";
-      response.headers["content-range"] =
-          "bytes " + std::to_string(range.start) + "-" + std::to_string(range.end) + "/" +
-          std::to_string(file_size);
-      response.headers["content-length"] = std::to_string(range.end - range.start + 1);
+      response.headers.Set(HeaderId::kContentRange,
+                           "bytes " + std::to_string(range.start) + "-" + std::to_string(range.end) + "/" +
+                               std::to_string(file_size));
+      response.headers.Set(HeaderId::kContentLength, std::to_string(range.end - range.start + 1));
     } else {
       response.status_code = 200;
       response.status_message = "OK";
-      response.headers["content-length"] = std::to_string(file_size);
+      response.headers.Set(HeaderId::kContentLength, std::to_string(file_size));
     }
-    response.headers["content-type"] = "application/vnd.openxmlformats-officedocument.presentationml.presentation";
+    response.headers.Set(HeaderId::kContentType, "application/vnd.openxmlformats-officedocument.presentationml.presentation");
     std::string filename;
     if (!ppt_request.output_path.empty()) {
       std::filesystem::path stored_path(ppt_request.output_path);
@@ -892,9 +1352,9 @@ HttpResponse PptController::Download(const HttpRequest& request) {
     if (filename.empty()) {
       filename = BuildDownloadFilename(ppt_request, *user);
     }
-    response.headers["content-disposition"] =
-        std::string("inline") + "; filename=\"" + filename + "\"";
-    response.headers["accept-ranges"] = "bytes";
+    response.headers.Set(HeaderId::kContentDisposition, std::string("inline") + "; filename=\"" + filename + "\"");
+    response.headers.Set(HeaderId::kAcceptRanges, "bytes");
+    ApplyValidators(validators, response);
     response.body.clear();
     return response;
   }
@@ -903,43 +1363,31 @@ HttpResponse PptController::Download(const HttpRequest& request) {
     HttpResponse response;
     response.status_code = 416;
     response.status_message = "Range Not Satisfiable";
-    response.headers["content-range"] = "bytes */" + std::to_string(file_size);
-    response.headers["accept-ranges"] = "bytes";
+    response.headers.Set(HeaderId::kContentRange, "bytes */" + std::to_string(file_size));
+    response.headers.Set(HeaderId::kAcceptRanges, "bytes");
     response.body.clear();
     return response;
   }
 
-  std::ifstream input(ppt_request.output_path, std::ios::binary);
-  if (!input.is_open()) {
+  HttpResponse response;
+  const auto offset = range.valid ? range.start : 0;
+  const auto length = range.valid ? range.end - range.start + 1 : file_size;
+  if (!response.SetFileBody(std::move(file), file_size, offset, length)) {
     return HttpResponse::Json(404, {{"message", "PPT file is missing"}});
   }
 
-  std::string body;
-  if (range.valid) {
-    const auto length = static_cast<std::size_t>(range.end - range.start + 1);
-    body.resize(length);
-    input.seekg(static_cast<std::streamoff>(range.start), std::ios::beg);
-    input.read(body.data(), static_cast<std::streamsize>(length));
-    body.resize(static_cast<std::size_t>(input.gcount()));
-  } else {
-    std::ostringstream buffer;
-    buffer << input.rdbuf();
-    body = buffer.str();
-  }
-
-  HttpResponse response;
   if (range.valid) {
     response.status_code = 206;
     response.status_message = "Partial Content";
-    response.headers["content-range"] =
-        "bytes " + std::to_string(range.start) + "-" + std::to_string(range.end) + "/" +
-        std::to_string(file_size);
+    response.headers.Set(HeaderId::kContentRange,
+                         "bytes " + std::to_string(range.start) + "-" + std::to_string(range.end) + "/" +
+                             std::to_string(file_size));
   } else {
     response.status_code = 200;
     response.status_message = "OK";
   }
-  response.headers["content-type"] = "application/vnd.openxmlformats-officedocument.presentationml.presentation";
-  const bool inline_view = request.query_params.find("inline") != request.query_params.end();
+  response.headers.Set(HeaderId::kContentType, "application/vnd.openxmlformats-officedocument.presentationml.presentation");
+  const bool inline_view = request.Query("inline").has_value();
   std::string filename;
   if (!ppt_request.output_path.empty()) {
     std::filesystem::path stored_path(ppt_request.output_path);
@@ -948,11 +1396,10 @@ HttpResponse PptController::Download(const HttpRequest& request) {
   if (filename.empty()) {
     filename = BuildDownloadFilename(ppt_request, *user);
   }
-  response.headers["content-disposition"] =
-      std::string(inline_view ? "inline" : "attachment") +
-      "; filename=\"" + filename + "\"";
-  response.headers["accept-ranges"] = "bytes";
-  response.body = std::move(body);
+  response.headers.Set(HeaderId::kContentDisposition,
+                       std::string(inline_view ? "inline" : "attachment") + "; filename=\"" + filename + "\"");
+  response.headers.Set(HeaderId::kAcceptRanges, "bytes");
+  ApplyValidators(validators, response);
   return response;
 }
 
@@ -963,10 +1410,7 @@ HttpResponse PptController::Preview(const HttpRequest& request) {
     return HttpResponse::Json(401, {{"message", error.empty() ? "Unauthorized" : error}});
   }
 
-  std::uint64_t request_id = 0;
-  if (auto it = request.query_params.find("id"); it != request.query_params.end()) {
-    request_id = ParseId(it->second);
-  }
+  std::uint64_t request_id = RequestIdFrom(request);
   if (request_id == 0) {
     return HttpResponse::Json(400, {{"message", "Invalid request ID"}});
   }
@@ -989,6 +1433,39 @@ HttpResponse PptController::Preview(const HttpRequest& request) {
     return HttpResponse::Json(403, {{"message", "Preview not accessible"}});
   }
 
+  // Serve the precompressed sidecar straight from disk when the client
+  // accepts it. Previews are rewritten after generation (the outline is
+  // appended), so a sidecar is only used while SidecarIsFresh() finds it no
+  // older than the JSON. The tag is weak because the same preview goes out
+  // in several encodings.
+  const auto preview_file = preview_path.string();
+  ResponseValidators validators;
+  FileValidators(preview_file, true, validators);
+  if (IsNotModified(request, validators)) {
+    return NotModifiedResponse(validators);
+  }
+  const auto encoding = content_encoding::Negotiate(request.HeaderView(HeaderId::kAcceptEncoding));
+  auto serve_sidecar = [&]() -> std::optional<HttpResponse> {
+    const auto sidecar = compression_utils::SidecarPath(preview_file, encoding);
+    std::uint64_t size = 0;
+    auto file = HttpResponse::OpenFile(sidecar, size);
+    HttpResponse response;
+    if (!response.SetFileBody(std::move(file), size, 0, size)) {
+      return std::nullopt;
+    }
+    response.headers.Set(HeaderId::kContentType, "application/json");
+    response.headers.Set(HeaderId::kContentEncoding, std::string(compression_utils::EncodingName(encoding)));
+    response.headers.Set(HeaderId::kVary, "accept-encoding");
+    ApplyValidators(validators, response);
+    return response;
+  };
+  if (encoding != compression_utils::Encoding::kIdentity &&
+      compression_utils::SidecarIsFresh(preview_file, encoding)) {
+    if (auto response = serve_sidecar()) {
+      return std::move(*response);
+    }
+  }
+
   std::ifstream input(preview_path);
   if (!input.is_open()) {
     return HttpResponse::Json(404, {{"message", "Preview data not found"}});
@@ -996,11 +1473,23 @@ HttpResponse PptController::Preview(const HttpRequest& request) {
   std::ostringstream buffer;
   buffer << input.rdbuf();
 
+  if (encoding != compression_utils::Encoding::kIdentity) {
+    // Previews written before sidecars existed get them on first request.
+    if (compression_utils::WriteSidecars(preview_file, buffer.str(), error)) {
+      if (auto response = serve_sidecar()) {
+        return std::move(*response);
+      }
+    } else {
+      Logger::Warn("Cannot precompress preview: " + error);
+    }
+  }
+
   HttpResponse response;
   response.status_code = 200;
   response.status_message = "OK";
-  response.headers["content-type"] = "application/json";
+  response.headers.Set(HeaderId::kContentType, "application/json");
   response.body = buffer.str();
+  ApplyValidators(validators, response);
   return response;
 }
 
@@ -1027,3 +1516,13 @@ std::uint64_t PptController::ParseId(const std::string& str) const {
     return 0;
   }
 }
+
+std::uint64_t PptController::RequestIdFrom(const HttpRequest& request) const {
+  if (const auto id = request.PathParam("id"); !id.empty()) {
+    return ParseId(std::string(id));
+  }
+  if (auto id = request.Query("id")) {
+    return ParseId(*id);
+  }
+  return 0;
+}
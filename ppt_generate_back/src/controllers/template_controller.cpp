@@ -1,24 +1,52 @@
 #include "controllers/template_controller.h"
 
 #include <algorithm>
-#include <fstream>
-#include <sstream>
+#include <filesystem>
+#include <optional>
+
+#include "http/content_encoding.h"
+#include "utils/compression.h"
+#include "utils/string_utils.h"
 
 TemplateController::TemplateController(std::shared_ptr<TemplateService> service)
-    : service_(std::move(service)) {}
+    : service_(std::move(service)) {
+  catalog_.identity = ToListPayload(service_->GetAll()).dump();
+  catalog_.etag = VersionEtag(catalog_.identity);
+  compression_utils::Compress(compression_utils::Encoding::kGzip, catalog_.identity, 9, catalog_.gzip);
+  if (compression_utils::IsSupported(compression_utils::Encoding::kBrotli)) {
+    compression_utils::Compress(compression_utils::Encoding::kBrotli, catalog_.identity, 9, catalog_.brotli);
+  }
+}
 
 HttpResponse TemplateController::List(const HttpRequest& request) {
-  const auto it = request.query_params.find("q");
-  const auto query = (it != request.query_params.end()) ? it->second : std::string();
+  const auto query = request.Query("q").value_or(std::string());
+  if (!query.empty()) {
+    return HttpResponse::Json(200, ToListPayload(service_->Search(query)));
+  }
 
-  const auto results = service_->Search(query);
+  HttpResponse response;
+  response.headers.Set(HeaderId::kVary, "accept-encoding");
+  const auto encoding = content_encoding::Negotiate(request.HeaderView(HeaderId::kAcceptEncoding));
+  const auto& encoded = encoding == compression_utils::Encoding::kBrotli ? catalog_.brotli
+                        : encoding == compression_utils::Encoding::kGzip ? catalog_.gzip
+                                                                         : catalog_.identity;
+  if (encoding != compression_utils::Encoding::kIdentity && !encoded.empty()) {
+    response.body = encoded;
+    response.headers.Set(HeaderId::kContentEncoding, std::string(compression_utils::EncodingName(encoding)));
+  } else {
+    response.body = catalog_.identity;
+  }
+  return response;
+}
+
+nlohmann::json TemplateController::ToListPayload(const std::vector<RemoteTemplate>& items) {
   nlohmann::json payload;
   payload["items"] = nlohmann::json::array();
-  for (const auto& item : results) {
+  for (const auto& item : items) {
     payload["items"].push_back(ToJson(item));
   }
   payload["total"] = payload["items"].size();
-  return HttpResponse::Json(200, payload);
+  return payload;
 }
 
 nlohmann::json TemplateController::ToJson(const RemoteTemplate& item) {
@@ -49,17 +77,22 @@ nlohmann::json TemplateController::ToJson(const RemoteTemplate& item) {
         {"backgroundImage", layout.background_image}});
   }
   if (item.has_local_file) {
-    json_item["localDownloadUrl"] = "/api/templates/file?id=" + item.id;
+    json_item["localDownloadUrl"] = "/api/templates/" + item.id + "/file";
   }
   return json_item;
 }
 
 HttpResponse TemplateController::Download(const HttpRequest& request) {
-  const auto it = request.query_params.find("id");
-  if (it == request.query_params.end() || it->second.empty()) {
+  std::optional<std::string> id;
+  if (const auto segment = request.PathParam("id"); !segment.empty()) {
+    id = string_utils::UrlDecode(segment);
+  } else {
+    id = request.Query("id");
+  }
+  if (!id || id->empty()) {
     return HttpResponse::Json(400, {{"message", "Template ID missing"}});
   }
-  const auto template_info = service_->FindById(it->second);
+  const auto template_info = service_->FindById(*id);
   if (!template_info) {
     return HttpResponse::Json(404, {{"message", "Template file does not exist"}});
   }
@@ -67,18 +100,15 @@ HttpResponse TemplateController::Download(const HttpRequest& request) {
   if (!local_file) {
     return HttpResponse::Json(404, {{"message", "Template file is missing"}});  
   }
-  std::ifstream input(*local_file, std::ios::binary);
-  if (!input.is_open()) {
+  std::uint64_t file_size = 0;
+  auto file = HttpResponse::OpenFile(*local_file, file_size);
+  HttpResponse response;
+  if (!response.SetFileBody(std::move(file), file_size, 0, file_size)) {
     return HttpResponse::Json(500, {{"message", "Cannot read template file"}});  
   }
-  std::ostringstream buffer;
-  buffer << input.rdbuf();
-
-  HttpResponse response;
   response.status_code = 200;
   response.status_message = "OK";
-  response.headers["content-type"] = "application/vnd.openxmlformats-officedocument.presentationml.presentation";
-  response.headers["content-disposition"] = "attachment; filename=\"" + template_info->id + ".pptx\"";
-  response.body = buffer.str();
+  response.headers.Set(HeaderId::kContentType, "application/vnd.openxmlformats-officedocument.presentationml.presentation");
+  response.headers.Set(HeaderId::kContentDisposition, "attachment; filename=\"" + template_info->id + ".pptx\"");
   return response;
 }
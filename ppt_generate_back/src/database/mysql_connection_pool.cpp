@@ -4,6 +4,7 @@
 #include <utility>
 
 #include "logger.h"
+#include "utils/metrics.h"
 
 namespace {
 bool g_mysql_initialized = false;
@@ -18,6 +19,12 @@ void EnsureMysqlLibraryInitialized() {
     g_mysql_initialized = true;
   }
 }
+
+metrics::Gauge& IdleConnectionsGauge() {
+  static auto& gauge =
+      metrics::Registry::Instance().GetGauge("db_pool_idle_connections", "MySQL connections idle in the pool.");
+  return gauge;
+}
 }
 
 MySQLConnectionPool::MySQLConnectionPool(const DatabaseConfig& config) : config_(config) {
@@ -25,6 +32,7 @@ MySQLConnectionPool::MySQLConnectionPool(const DatabaseConfig& config) : config_
   for (std::size_t i = 0; i < config_.pool_size; ++i) {
     connections_.push(CreateConnection());
   }
+  IdleConnectionsGauge().Set(static_cast<std::int64_t>(connections_.size()));
   Logger::Info("MySQL connection pool initialized with size: " + std::to_string(config_.pool_size));
 }
 
@@ -61,10 +69,14 @@ MYSQL* MySQLConnectionPool::CreateConnection() {
 }
 
 MYSQL* MySQLConnectionPool::Acquire() {
+  static auto& wait_time = metrics::Registry::Instance().GetHistogram(
+      "db_pool_acquire_wait_seconds", "Time spent waiting for a pooled MySQL connection.");
+  metrics::ScopedTimer timer(wait_time);
   std::unique_lock<std::mutex> lock(mutex_);
   condition_.wait(lock, [this]() { return !connections_.empty(); });
   MYSQL* connection = connections_.front();
   connections_.pop();
+  IdleConnectionsGauge().Set(static_cast<std::int64_t>(connections_.size()));
   return connection;
 }
 
@@ -74,5 +86,6 @@ void MySQLConnectionPool::Release(MYSQL* connection) {
   }
   std::lock_guard<std::mutex> lock(mutex_);
   connections_.push(connection);
+  IdleConnectionsGauge().Set(static_cast<std::int64_t>(connections_.size()));
   condition_.notify_one();
 }
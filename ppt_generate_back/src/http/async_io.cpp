@@ -0,0 +1,247 @@
+#include "http/async_io.h"
+
+#if PPT_HAVE_COROUTINES
+
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "logger.h"
+#include "utils/unique_fd.h"
+
+extern char** environ;
+
+namespace async_io {
+
+// One per loop thread: the loop watches the sockets curl asks for and runs
+// its timeouts, and finished transfers resume their coroutines in place.
+class CurlMulti {
+ public:
+  explicit CurlMulti(EventLoop& loop) : loop_(loop), multi_(curl_multi_init()) {
+    if (!multi_) {
+      throw std::runtime_error("Failed to create curl multi handle");
+    }
+    curl_multi_setopt(multi_, CURLMOPT_SOCKETFUNCTION, &CurlMulti::OnSocket);
+    curl_multi_setopt(multi_, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(multi_, CURLMOPT_TIMERFUNCTION, &CurlMulti::OnTimer);
+    curl_multi_setopt(multi_, CURLMOPT_TIMERDATA, this);
+  }
+
+  // Runs at loop thread exit, after the loop has stopped: transfers still
+  // running are abandoned along with the coroutines waiting on them.
+  ~CurlMulti() {
+    stopped_ = true;
+    for (auto* easy : transfers_) {
+      curl_multi_remove_handle(multi_, easy);
+    }
+    curl_multi_cleanup(multi_);
+  }
+
+  CurlMulti(const CurlMulti&) = delete;
+  CurlMulti& operator=(const CurlMulti&) = delete;
+
+  static CurlMulti& ForCurrentLoop() {
+    thread_local std::unique_ptr<CurlMulti> multi;
+    auto& loop = CurrentLoop();
+    if (!multi || &multi->loop_ != &loop) {
+      multi = std::make_unique<CurlMulti>(loop);
+    }
+    return *multi;
+  }
+
+  bool Add(TransferAwaiter& transfer) {
+    curl_easy_setopt(transfer.easy_, CURLOPT_PRIVATE, &transfer);
+    curl_easy_setopt(transfer.easy_, CURLOPT_NOSIGNAL, 1L);
+    if (curl_multi_add_handle(multi_, transfer.easy_) != CURLM_OK) {
+      transfer.result_ = CURLE_FAILED_INIT;
+      return false;
+    }
+    transfers_.insert(transfer.easy_);
+    return true;
+  }
+
+ private:
+  static int OnSocket(CURL*, curl_socket_t socket, int what, void* user, void*) {
+    auto& self = *static_cast<CurlMulti*>(user);
+    if (self.stopped_) {
+      return 0;
+    }
+    if (what == CURL_POLL_REMOVE) {
+      if (self.watched_.erase(socket) > 0) {
+        self.loop_.Remove(socket);
+      }
+      return 0;
+    }
+    std::uint32_t events = 0;
+    if (what & CURL_POLL_IN) {
+      events |= EPOLLIN;
+    }
+    if (what & CURL_POLL_OUT) {
+      events |= EPOLLOUT;
+    }
+    if (!self.watched_.insert(socket).second) {
+      self.loop_.Modify(socket, events);
+      return 0;
+    }
+    try {
+      self.loop_.Add(socket, events, [&self, socket](std::uint32_t ready) { self.Act(socket, ready); });
+    } catch (const std::exception& ex) {
+      self.watched_.erase(socket);
+      Logger::Error(std::string("Failed to watch HTTP client socket: ") + ex.what());
+      return -1;
+    }
+    return 0;
+  }
+
+  static int OnTimer(CURLM*, long timeout_ms, void* user) {
+    auto& self = *static_cast<CurlMulti*>(user);
+    if (self.timer_ != 0) {
+      self.loop_.CancelTimer(self.timer_);
+      self.timer_ = 0;
+    }
+    // curl must not be re-entered from here, so even "now" waits for the loop.
+    if (timeout_ms >= 0 && !self.stopped_) {
+      self.timer_ = self.loop_.RunAfter(std::chrono::milliseconds(timeout_ms), [&self]() {
+        self.timer_ = 0;
+        self.Act(CURL_SOCKET_TIMEOUT, 0);
+      });
+    }
+    return 0;
+  }
+
+  void Act(curl_socket_t socket, std::uint32_t ready) {
+    int flags = 0;
+    if (ready & (EPOLLIN | EPOLLHUP)) {
+      flags |= CURL_CSELECT_IN;
+    }
+    if (ready & EPOLLOUT) {
+      flags |= CURL_CSELECT_OUT;
+    }
+    if (ready & EPOLLERR) {
+      flags |= CURL_CSELECT_ERR;
+    }
+    int running = 0;
+    curl_multi_socket_action(multi_, socket, flags, &running);
+
+    // Resumed only once curl is done with its message queue: a coroutine
+    // may well start its next transfer straight away.
+    std::vector<TransferAwaiter*> finished;
+    int queued = 0;
+    while (CURLMsg* message = curl_multi_info_read(multi_, &queued)) {
+      if (message->msg != CURLMSG_DONE) {
+        continue;
+      }
+      CURL* easy = message->easy_handle;
+      char* transfer = nullptr;
+      curl_easy_getinfo(easy, CURLINFO_PRIVATE, &transfer);
+      auto* awaiter = reinterpret_cast<TransferAwaiter*>(transfer);
+      awaiter->result_ = message->data.result;
+      curl_multi_remove_handle(multi_, easy);
+      transfers_.erase(easy);
+      finished.push_back(awaiter);
+    }
+    for (auto* awaiter : finished) {
+      awaiter->handle_.resume();
+    }
+  }
+
+  EventLoop& loop_;
+  CURLM* multi_;
+  std::unordered_set<curl_socket_t> watched_;
+  std::unordered_set<CURL*> transfers_;
+  EventLoop::TimerId timer_ = 0;
+  bool stopped_ = false;
+};
+
+namespace {
+
+class ReadableAwaiter {
+ public:
+  explicit ReadableAwaiter(int fd) : fd_(fd) {}
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> handle) {
+    auto& loop = CurrentLoop();
+    loop.Add(fd_, EPOLLIN, [&loop, fd = fd_, handle](std::uint32_t) {
+      loop.Remove(fd);
+      handle.resume();
+    });
+  }
+  void await_resume() const noexcept {}
+
+ private:
+  int fd_;
+};
+
+}
+
+EventLoop& CurrentLoop() {
+  auto* loop = EventLoop::Current();
+  if (!loop) {
+    throw std::logic_error("async_io awaited outside an event loop thread");
+  }
+  return *loop;
+}
+
+bool TransferAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  handle_ = handle;
+  return CurlMulti::ForCurrentLoop().Add(*this);
+}
+
+Task<int> RunProcess(std::vector<std::string> argv) {
+  if (argv.empty()) {
+    co_return -1;
+  }
+  std::vector<char*> args;
+  args.reserve(argv.size() + 1);
+  for (auto& arg : argv) {
+    args.push_back(arg.data());
+  }
+  args.push_back(nullptr);
+
+  pid_t pid = 0;
+  if (const int error = ::posix_spawnp(&pid, args[0], nullptr, nullptr, args.data(), environ); error != 0) {
+    Logger::Warn("Failed to start " + argv[0] + ": " + std::strerror(error));
+    co_return -1;
+  }
+
+  int status = 0;
+  UniqueFd pidfd(static_cast<int>(::syscall(SYS_pidfd_open, pid, 0)));
+  if (pidfd) {
+    // Readable once the child has exited.
+    co_await ReadableAwaiter(pidfd.Get());
+    pid_t waited = 0;
+    do {
+      waited = ::waitpid(pid, &status, 0);
+    } while (waited < 0 && errno == EINTR);
+    if (waited != pid) {
+      co_return -1;
+    }
+  } else {
+    // No pidfd (kernels before 5.3): poll at the timer tick instead.
+    while (true) {
+      const pid_t waited = ::waitpid(pid, &status, WNOHANG);
+      if (waited == pid) {
+        break;
+      }
+      if (waited < 0 && errno != EINTR) {
+        co_return -1;
+      }
+      co_await Sleep(EventLoop::kTimerTick);
+    }
+  }
+  co_return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+}
+
+#endif
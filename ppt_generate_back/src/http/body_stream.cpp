@@ -0,0 +1,142 @@
+#include "http/body_stream.h"
+
+#include <array>
+#include <charconv>
+
+BodyStream::BodyStream(std::size_t high_water, std::chrono::milliseconds stall_timeout)
+    : high_water_(high_water), stall_timeout_(stall_timeout) {}
+
+bool BodyStream::Write(std::string_view data) {
+  if (data.empty()) {
+    return !cancelled();
+  }
+  std::function<void()> notify;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!drained_.wait_for(lock, stall_timeout_, [this]() { return cancelled_ || buffer_.size() < high_water_; })) {
+      cancelled_ = true;
+    }
+    if (cancelled_ || closed_ || aborted_) {
+      return false;
+    }
+    buffer_.append(data);
+    notify = ArmNotify();
+  }
+  if (notify) {
+    notify();
+  }
+  return true;
+}
+
+bool BodyStream::TryWrite(std::string_view data) {
+  std::function<void()> notify;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (cancelled_ || closed_ || aborted_ || buffer_.size() >= high_water_) {
+      return false;
+    }
+    buffer_.append(data);
+    notify = ArmNotify();
+  }
+  if (notify) {
+    notify();
+  }
+  return true;
+}
+
+void BodyStream::Close() {
+  std::function<void()> notify;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_ || aborted_) {
+      return;
+    }
+    closed_ = true;
+    notify = ArmNotify();
+  }
+  if (notify) {
+    notify();
+  }
+}
+
+void BodyStream::Abort() {
+  std::function<void()> notify;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_ || aborted_) {
+      return;
+    }
+    aborted_ = true;
+    notify = ArmNotify();
+  }
+  if (notify) {
+    notify();
+  }
+}
+
+bool BodyStream::cancelled() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cancelled_;
+}
+
+void BodyStream::SetNotify(std::function<void()> notify) {
+  std::function<void()> pending;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    notify_ = std::move(notify);
+    // The producer may have run ahead of the consumer.
+    if (!buffer_.empty() || closed_ || aborted_) {
+      pending = ArmNotify();
+    }
+  }
+  if (pending) {
+    pending();
+  }
+}
+
+BodyStream::TakeResult BodyStream::Take(std::string& out, bool chunked) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  notified_ = false;
+  if (aborted_ || cancelled_) {
+    return TakeResult::kFailed;
+  }
+  const bool had_data = !buffer_.empty();
+  if (had_data) {
+    if (chunked) {
+      std::array<char, 16> size{};
+      const auto result = std::to_chars(size.data(), size.data() + size.size(), buffer_.size(), 16);
+      out.append(size.data(), static_cast<std::size_t>(result.ptr - size.data()));
+      out.append("\r\n");
+      out.append(buffer_);
+      out.append("\r\n");
+    } else {
+      out.append(buffer_);
+    }
+    buffer_.clear();
+    drained_.notify_all();
+  }
+  if (closed_) {
+    if (chunked) {
+      out.append("0\r\n\r\n");
+    }
+    return TakeResult::kFinished;
+  }
+  return had_data ? TakeResult::kData : TakeResult::kPending;
+}
+
+void BodyStream::Cancel() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    cancelled_ = true;
+    notify_ = nullptr;
+  }
+  drained_.notify_all();
+}
+
+std::function<void()> BodyStream::ArmNotify() {
+  if (notified_ || !notify_) {
+    return nullptr;
+  }
+  notified_ = true;
+  return notify_;
+}
@@ -0,0 +1,104 @@
+#include "http/conditional.h"
+
+#include <sys/stat.h>
+
+#include <array>
+#include <charconv>
+#include <ctime>
+
+namespace {
+std::string_view OpaqueTag(std::string_view tag) {
+  return tag.rfind("W/", 0) == 0 ? tag.substr(2) : tag;
+}
+
+std::string HttpDate(std::time_t value) {
+  std::tm tm_snapshot{};
+  gmtime_r(&value, &tm_snapshot);
+  char buffer[32];
+  const auto length = std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm_snapshot);
+  return std::string(buffer, length);
+}
+
+void AppendHex(std::string& out, std::uint64_t value) {
+  std::array<char, 16> buffer{};
+  const auto result = std::to_chars(buffer.data(), buffer.data() + buffer.size(), value, 16);
+  out.append(buffer.data(), static_cast<std::size_t>(result.ptr - buffer.data()));
+}
+}  // namespace
+
+bool EtagMatches(std::string_view if_none_match, std::string_view etag) {
+  const auto wanted = OpaqueTag(etag);
+  std::size_t start = 0;
+  while (start < if_none_match.size()) {
+    auto end = if_none_match.find(',', start);
+    if (end == std::string_view::npos) {
+      end = if_none_match.size();
+    }
+    const auto item = string_utils::TrimView(if_none_match.substr(start, end - start));
+    if (item == "*" || (!item.empty() && OpaqueTag(item) == wanted)) {
+      return true;
+    }
+    start = end + 1;
+  }
+  return false;
+}
+
+bool IsNotModified(const HttpRequest& request, const ResponseValidators& validators) {
+  const auto method = ParseHttpMethod(request.method);
+  if (method != HttpMethod::kGet && method != HttpMethod::kHead) {
+    return false;
+  }
+  if (const auto if_none_match = request.HeaderView(HeaderId::kIfNoneMatch); !if_none_match.empty()) {
+    return !validators.etag.empty() && EtagMatches(if_none_match, validators.etag);
+  }
+  const auto if_modified_since = request.HeaderView(HeaderId::kIfModifiedSince);
+  return !if_modified_since.empty() && if_modified_since == validators.last_modified;
+}
+
+HttpResponse NotModifiedResponse(const ResponseValidators& validators) {
+  HttpResponse response;
+  response.status_code = 304;
+  response.status_message = detail::ReasonPhrase(304);
+  response.body.clear();
+  ApplyValidators(validators, response);
+  return response;
+}
+
+void ApplyValidators(const ResponseValidators& validators, HttpResponse& response) {
+  if (!validators.etag.empty() && !response.headers.Contains(HeaderId::kETag)) {
+    response.headers.Set(HeaderId::kETag, validators.etag);
+  }
+  if (!validators.last_modified.empty() && !response.headers.Contains(HeaderId::kLastModified)) {
+    response.headers.Set(HeaderId::kLastModified, validators.last_modified);
+  }
+}
+
+std::string VersionEtag(std::string_view content) {
+  // FNV-1a: cheap, and unlike std::hash the same in every process.
+  std::uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const char ch : content) {
+    hash = (hash ^ static_cast<unsigned char>(ch)) * 0x100000001b3ULL;
+  }
+  std::string etag = "W/\"";
+  AppendHex(etag, hash);
+  etag.push_back('-');
+  AppendHex(etag, content.size());
+  etag.push_back('"');
+  return etag;
+}
+
+bool FileValidators(const std::string& path, bool weak, ResponseValidators& validators) {
+  struct stat info {};
+  if (::stat(path.c_str(), &info) != 0) {
+    return false;
+  }
+  validators.etag = weak ? "W/\"" : "\"";
+  AppendHex(validators.etag,
+            static_cast<std::uint64_t>(info.st_mtim.tv_sec) * 1000000000ULL +
+                static_cast<std::uint64_t>(info.st_mtim.tv_nsec));
+  validators.etag.push_back('-');
+  AppendHex(validators.etag, static_cast<std::uint64_t>(info.st_size));
+  validators.etag.push_back('"');
+  validators.last_modified = HttpDate(info.st_mtim.tv_sec);
+  return true;
+}
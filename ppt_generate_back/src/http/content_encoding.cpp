@@ -0,0 +1,127 @@
+#include "http/content_encoding.h"
+
+#include <string>
+
+#include "utils/string_utils.h"
+
+namespace {
+using compression_utils::Encoding;
+
+// Parses a qvalue ("1", "0.5", "0.125") into thousandths; -1 if malformed.
+int ParseQuality(std::string_view value) {
+  if (value.empty() || (value[0] != '0' && value[0] != '1')) {
+    return -1;
+  }
+  int quality = (value[0] - '0') * 1000;
+  if (value.size() == 1) {
+    return quality;
+  }
+  if (value[1] != '.' || value.size() > 5) {
+    return -1;
+  }
+  int scale = 100;
+  for (std::size_t i = 2; i < value.size(); ++i, scale /= 10) {
+    if (value[i] < '0' || value[i] > '9') {
+      return -1;
+    }
+    quality += (value[i] - '0') * scale;
+  }
+  return quality > 1000 ? -1 : quality;
+}
+
+bool IsCompressibleType(std::string_view content_type) {
+  return content_type.rfind("application/json", 0) == 0 || content_type.rfind("text/", 0) == 0 ||
+         content_type.rfind("application/javascript", 0) == 0 || content_type.rfind("image/svg+xml", 0) == 0 ||
+         content_type.rfind("application/xml", 0) == 0;
+}
+}  // namespace
+
+namespace content_encoding {
+
+compression_utils::Encoding Negotiate(std::string_view accept_encoding) {
+  return Negotiate(accept_encoding, true, compression_utils::IsSupported(Encoding::kBrotli));
+}
+
+compression_utils::Encoding Negotiate(std::string_view accept_encoding, bool gzip_available, bool brotli_available) {
+  int gzip = -1;
+  int brotli = -1;
+  int wildcard = -1;
+  std::size_t start = 0;
+  while (start < accept_encoding.size()) {
+    auto end = accept_encoding.find(',', start);
+    if (end == std::string_view::npos) {
+      end = accept_encoding.size();
+    }
+    auto item = string_utils::TrimView(accept_encoding.substr(start, end - start));
+    start = end + 1;
+
+    int quality = 1000;
+    if (const auto semicolon = item.find(';'); semicolon != std::string_view::npos) {
+      auto params = string_utils::TrimView(item.substr(semicolon + 1));
+      item = string_utils::TrimView(item.substr(0, semicolon));
+      if (params.size() >= 2 && (params[0] == 'q' || params[0] == 'Q') && params[1] == '=') {
+        quality = ParseQuality(params.substr(2));
+      }
+    }
+    if (quality < 0) {
+      continue;
+    }
+    if (string_utils::EqualsIgnoreCase(item, "gzip") || string_utils::EqualsIgnoreCase(item, "x-gzip")) {
+      gzip = quality;
+    } else if (string_utils::EqualsIgnoreCase(item, "br")) {
+      brotli = quality;
+    } else if (item == "*") {
+      wildcard = quality;
+    }
+  }
+
+  if (gzip < 0) {
+    gzip = wildcard;
+  }
+  if (brotli < 0) {
+    brotli = wildcard;
+  }
+  if (!gzip_available) {
+    gzip = -1;
+  }
+  if (!brotli_available) {
+    brotli = -1;
+  }
+  if (brotli > 0 && brotli >= gzip) {
+    return Encoding::kBrotli;
+  }
+  if (gzip > 0) {
+    return Encoding::kGzip;
+  }
+  return Encoding::kIdentity;
+}
+
+void EncodeResponse(std::string_view accept_encoding, std::size_t min_size, int level, HttpResponse& response) {
+  auto& headers = response.headers;
+  if (!headers.Contains(HeaderId::kVary)) {
+    headers.Set(HeaderId::kVary, "accept-encoding");
+  }
+  if (response.file || response.shared_body || response.stream || response.stream_producer || response.body.size() < min_size ||
+      headers.Contains(HeaderId::kContentEncoding) || response.status_code < 200 || response.status_code == 204 ||
+      response.status_code == 304) {
+    return;
+  }
+  const auto* type = headers.Find(HeaderId::kContentType);
+  if (type != nullptr && !IsCompressibleType(*type)) {
+    return;
+  }
+
+  const auto encoding = Negotiate(accept_encoding);
+  if (encoding == Encoding::kIdentity) {
+    return;
+  }
+  std::string compressed;
+  if (!compression_utils::Compress(encoding, response.body, level, compressed) ||
+      compressed.size() >= response.body.size()) {
+    return;
+  }
+  response.body = std::move(compressed);
+  headers.Set(HeaderId::kContentEncoding, std::string(compression_utils::EncodingName(encoding)));
+}
+
+}
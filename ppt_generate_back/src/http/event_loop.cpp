@@ -0,0 +1,161 @@
+#include "http/event_loop.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include "logger.h"
+
+namespace {
+constexpr int kMaxEventsPerWait = 256;
+
+thread_local EventLoop* current_loop = nullptr;
+}
+
+EventLoop::EventLoop() {
+  epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ < 0) {
+    throw std::runtime_error("Failed to create epoll instance: " + std::string(strerror(errno)));
+  }
+  wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wake_fd_ < 0) {
+    ::close(epoll_fd_);
+    throw std::runtime_error("Failed to create eventfd: " + std::string(strerror(errno)));
+  }
+  epoll_event event{};
+  event.events = EPOLLIN;
+  event.data.fd = wake_fd_;
+  if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event) < 0) {
+    ::close(wake_fd_);
+    ::close(epoll_fd_);
+    throw std::runtime_error("Failed to register eventfd: " + std::string(strerror(errno)));
+  }
+}
+
+EventLoop::~EventLoop() {
+  if (wake_fd_ >= 0) {
+    ::close(wake_fd_);
+  }
+  if (epoll_fd_ >= 0) {
+    ::close(epoll_fd_);
+  }
+}
+
+void EventLoop::Add(int fd, std::uint32_t events, IoCallback callback) {
+  epoll_event event{};
+  event.events = events;
+  event.data.fd = fd;
+  if (::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+    throw std::runtime_error("epoll_ctl(ADD) failed: " + std::string(strerror(errno)));
+  }
+  callbacks_[fd] = std::move(callback);
+}
+
+void EventLoop::Modify(int fd, std::uint32_t events) {
+  epoll_event event{};
+  event.events = events;
+  event.data.fd = fd;
+  if (::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) < 0) {
+    Logger::Warn("epoll_ctl(MOD) failed: " + std::string(strerror(errno)));
+  }
+}
+
+void EventLoop::Remove(int fd) {
+  ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  callbacks_.erase(fd);
+}
+
+void EventLoop::Post(Task task) {
+  {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    pending_.push_back(std::move(task));
+  }
+  const std::uint64_t one = 1;
+  // A full eventfd counter still leaves the loop readable, so EAGAIN is harmless.
+  [[maybe_unused]] const auto written = ::write(wake_fd_, &one, sizeof(one));
+}
+
+EventLoop::TimerId EventLoop::RunAfter(std::chrono::milliseconds delay, Task task) {
+  return timers_.Schedule(delay, std::move(task));
+}
+
+bool EventLoop::CancelTimer(TimerId id) {
+  return timers_.Cancel(id);
+}
+
+void EventLoop::Run() {
+  loop_thread_id_.store(std::this_thread::get_id());
+  current_loop = this;
+  std::array<epoll_event, kMaxEventsPerWait> events{};
+
+  while (!stop_requested_.load()) {
+    int timeout_ms = -1;
+    if (const auto next = timers_.TimeUntilNext(std::chrono::steady_clock::now())) {
+      timeout_ms = static_cast<int>(std::min<std::int64_t>(next->count(), std::numeric_limits<int>::max()));
+    }
+    const int ready = ::epoll_wait(epoll_fd_, events.data(), static_cast<int>(events.size()), timeout_ms);
+    if (ready < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      Logger::Error("epoll_wait failed: " + std::string(strerror(errno)));
+      break;
+    }
+
+    for (int i = 0; i < ready; ++i) {
+      const int fd = events[i].data.fd;
+      if (fd == wake_fd_) {
+        std::uint64_t counter = 0;
+        [[maybe_unused]] const auto read_bytes = ::read(wake_fd_, &counter, sizeof(counter));
+        continue;
+      }
+      auto it = callbacks_.find(fd);
+      if (it == callbacks_.end()) {
+        continue;
+      }
+      // Copy so the callback may safely Remove() its own fd.
+      auto callback = it->second;
+      callback(events[i].events);
+    }
+
+    RunPending();
+    timers_.Advance(std::chrono::steady_clock::now());
+  }
+
+  RunPending();
+  current_loop = nullptr;
+  loop_thread_id_.store(std::thread::id{});
+}
+
+void EventLoop::Stop() {
+  stop_requested_.store(true);
+  const std::uint64_t one = 1;
+  [[maybe_unused]] const auto written = ::write(wake_fd_, &one, sizeof(one));
+}
+
+bool EventLoop::IsInLoopThread() const {
+  return loop_thread_id_.load() == std::this_thread::get_id();
+}
+
+EventLoop* EventLoop::Current() {
+  return current_loop;
+}
+
+void EventLoop::RunPending() {
+  std::vector<Task> tasks;
+  {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    tasks.swap(pending_);
+  }
+  for (auto& task : tasks) {
+    task();
+  }
+}
@@ -0,0 +1,104 @@
+#include "http/header_map.h"
+
+#include <array>
+
+#include "utils/string_utils.h"
+
+namespace {
+// Indexed by HeaderId.
+constexpr std::array<std::string_view, 24> kHeaderNames{
+    "",
+    "accept-encoding",
+    "accept-ranges",
+    "authorization",
+    "cache-control",
+    "connection",
+    "content-disposition",
+    "content-encoding",
+    "content-length",
+    "content-range",
+    "content-type",
+    "etag",
+    "expect",
+    "host",
+    "if-modified-since",
+    "if-none-match",
+    "if-range",
+    "last-event-id",
+    "last-modified",
+    "prefer",
+    "range",
+    "retry-after",
+    "transfer-encoding",
+    "vary",
+};
+static_assert(kHeaderNames.size() == static_cast<std::size_t>(HeaderId::kVary) + 1,
+              "kHeaderNames must list every HeaderId");
+}  // namespace
+
+HeaderId LookupHeaderId(std::string_view name) {
+  // The length rules out almost every candidate before any byte is compared.
+  for (std::size_t i = 1; i < kHeaderNames.size(); ++i) {
+    if (kHeaderNames[i].size() == name.size() && string_utils::EqualsIgnoreCase(kHeaderNames[i], name)) {
+      return static_cast<HeaderId>(i);
+    }
+  }
+  return HeaderId::kOther;
+}
+
+std::string_view HeaderName(HeaderId id) {
+  return kHeaderNames[static_cast<std::size_t>(id)];
+}
+
+void HeaderMap::Set(HeaderId id, std::string value) {
+  if (auto* entry = FindEntry(id, {})) {
+    entry->value = std::move(value);
+    return;
+  }
+  entries_.push_back(Entry{id, {}, std::move(value)});
+}
+
+void HeaderMap::Set(std::string_view name, std::string value) {
+  const auto id = LookupHeaderId(name);
+  if (id != HeaderId::kOther) {
+    Set(id, std::move(value));
+    return;
+  }
+  if (auto* entry = FindEntry(id, name)) {
+    entry->value = std::move(value);
+    return;
+  }
+  entries_.push_back(Entry{id, std::string(name), std::move(value)});
+}
+
+const std::string* HeaderMap::Find(HeaderId id) const {
+  const auto* entry = FindEntry(id, {});
+  return entry == nullptr ? nullptr : &entry->value;
+}
+
+const std::string* HeaderMap::Find(std::string_view name) const {
+  const auto* entry = FindEntry(LookupHeaderId(name), name);
+  return entry == nullptr ? nullptr : &entry->value;
+}
+
+bool HeaderMap::Erase(HeaderId id) {
+  auto* entry = FindEntry(id, {});
+  if (entry == nullptr) {
+    return false;
+  }
+  entries_.erase(entry);
+  return true;
+}
+
+HeaderMap::Entry* HeaderMap::FindEntry(HeaderId id, std::string_view name) {
+  return const_cast<Entry*>(static_cast<const HeaderMap*>(this)->FindEntry(id, name));
+}
+
+const HeaderMap::Entry* HeaderMap::FindEntry(HeaderId id, std::string_view name) const {
+  for (const auto& entry : entries_) {
+    if (entry.id == id && (id != HeaderId::kOther || string_utils::EqualsIgnoreCase(entry.name, name))) {
+      return &entry;
+    }
+  }
+  return nullptr;
+}
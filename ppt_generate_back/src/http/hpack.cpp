@@ -0,0 +1,484 @@
+#include "http/hpack.h"
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+namespace hpack {
+namespace {
+// Per-entry overhead counted against the table size (RFC 7541 section 4.1).
+constexpr std::size_t kEntryOverhead = 32;
+// Our encoder never lets its table grow beyond the default.
+constexpr std::size_t kEncoderTableSize = 4096;
+// Longest prefixed integer we accept; bounds string lengths and indexes alike.
+constexpr int kMaxIntegerShift = 28;
+
+struct StaticEntry {
+  std::string_view name;
+  std::string_view value;
+};
+
+// RFC 7541 Appendix A; index 1 is the first entry.
+constexpr std::array<StaticEntry, 61> kStaticTable{{
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+}};
+
+// Values that differ from one response to the next would only churn the
+// dynamic table, so they are sent as literals without indexing.
+constexpr std::array<std::string_view, 7> kUnindexedNames{
+    "content-length", "content-range", "etag", "last-modified", "location", "retry-after", "date"};
+
+struct HuffmanCode {
+  std::uint32_t code;
+  std::uint8_t bits;
+};
+
+// RFC 7541 Appendix B, by symbol; 256 is EOS.
+constexpr std::array<HuffmanCode, 257> kHuffmanCodes{{
+    {0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28},
+    {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24},
+    {0x3ffffffc, 30}, {0xfffffe9, 28}, {0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28},
+    {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+    {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28}, {0xffffff4, 28},
+    {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+    {0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+    {0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10}, {0xf9, 8},
+    {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6}, {0x0, 5}, {0x1, 5}, {0x2, 5},
+    {0x19, 6}, {0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6}, {0x5c, 7},
+    {0xfb, 8}, {0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6},
+    {0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7}, {0x63, 7}, {0x64, 7},
+    {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7},
+    {0x6d, 7}, {0x6e, 7}, {0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7},
+    {0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6}, {0x7ffd, 15},
+    {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5},
+    {0x74, 7}, {0x75, 7}, {0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7},
+    {0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7}, {0x79, 7}, {0x7a, 7}, {0x7b, 7},
+    {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20},
+    {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20}, {0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22},
+    {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23},
+    {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23}, {0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22},
+    {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23},
+    {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23}, {0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23},
+    {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22},
+    {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21}, {0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22},
+    {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21},
+    {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21}, {0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23},
+    {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23},
+    {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23}, {0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20},
+    {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26},
+    {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27}, {0x7ffffdf, 27}, {0x3ffffe5, 26},
+    {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26},
+    {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+    {0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28},
+    {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20},
+    {0x1fffe6, 21}, {0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22},
+    {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24},
+    {0x3ffffea, 26}, {0x7ffff4, 23}, {0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26},
+    {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+    {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27}, {0x7ffffee, 27},
+    {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30},
+}};
+
+// Binary decoding tree over kHuffmanCodes, built once. Leaves carry the
+// symbol; the code is complete, so every internal node has both children.
+class HuffmanTree {
+ public:
+  struct Node {
+    std::array<std::int16_t, 2> children{{-1, -1}};
+    std::int16_t symbol = -1;
+  };
+
+  HuffmanTree() {
+    nodes_.emplace_back();
+    for (std::size_t symbol = 0; symbol < kHuffmanCodes.size(); ++symbol) {
+      const auto [code, bits] = kHuffmanCodes[symbol];
+      std::size_t node = 0;
+      for (int bit = bits - 1; bit >= 0; --bit) {
+        const auto branch = (code >> bit) & 1;
+        if (nodes_[node].children[branch] < 0) {
+          nodes_[node].children[branch] = static_cast<std::int16_t>(nodes_.size());
+          nodes_.emplace_back();
+        }
+        node = static_cast<std::size_t>(nodes_[node].children[branch]);
+      }
+      nodes_[node].symbol = static_cast<std::int16_t>(symbol);
+    }
+  }
+
+  const Node& operator[](std::size_t index) const { return nodes_[index]; }
+
+ private:
+  std::vector<Node> nodes_;
+};
+
+const HuffmanTree& Tree() {
+  static const HuffmanTree tree;
+  return tree;
+}
+
+void EncodeInteger(std::uint64_t value, int prefix_bits, std::uint8_t first_byte, std::string& out) {
+  const std::uint64_t max_prefix = (1u << prefix_bits) - 1;
+  if (value < max_prefix) {
+    out.push_back(static_cast<char>(first_byte | value));
+    return;
+  }
+  out.push_back(static_cast<char>(first_byte | max_prefix));
+  value -= max_prefix;
+  while (value >= 128) {
+    out.push_back(static_cast<char>(0x80 | (value & 0x7f)));
+    value >>= 7;
+  }
+  out.push_back(static_cast<char>(value));
+}
+
+bool DecodeInteger(std::string_view input, std::size_t& pos, int prefix_bits, std::uint64_t& value) {
+  const std::uint64_t max_prefix = (1u << prefix_bits) - 1;
+  value = static_cast<std::uint8_t>(input[pos++]) & max_prefix;
+  if (value < max_prefix) {
+    return true;
+  }
+  for (int shift = 0; pos < input.size() && shift <= kMaxIntegerShift; shift += 7) {
+    const auto byte = static_cast<std::uint8_t>(input[pos++]);
+    value += static_cast<std::uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void EncodeString(std::string_view value, std::string& out) {
+  const auto huffman_size = HuffmanEncodedSize(value);
+  if (huffman_size < value.size()) {
+    EncodeInteger(huffman_size, 7, 0x80, out);
+    HuffmanEncode(value, out);
+    return;
+  }
+  EncodeInteger(value.size(), 7, 0x00, out);
+  out.append(value);
+}
+
+bool DecodeString(std::string_view input, std::size_t& pos, std::string& out) {
+  if (pos >= input.size()) {
+    return false;
+  }
+  const bool huffman = (static_cast<std::uint8_t>(input[pos]) & 0x80) != 0;
+  std::uint64_t length = 0;
+  if (!DecodeInteger(input, pos, 7, length) || length > input.size() - pos) {
+    return false;
+  }
+  const auto data = input.substr(pos, static_cast<std::size_t>(length));
+  pos += data.size();
+  out.clear();
+  if (huffman) {
+    return HuffmanDecode(data, out);
+  }
+  out.assign(data);
+  return true;
+}
+}  // namespace
+
+void DynamicTable::Add(std::string_view name, std::string_view value) {
+  // |name| may refer to an entry that is about to be evicted.
+  HeaderField field{std::string(name), std::string(value)};
+  const auto size = field.name.size() + field.value.size() + kEntryOverhead;
+  if (size > max_size_) {
+    // Too large for any table: adding it just empties this one.
+    Evict(0);
+    return;
+  }
+  Evict(max_size_ - size);
+  entries_.push_front(std::move(field));
+  size_ += size;
+}
+
+void DynamicTable::SetMaxSize(std::size_t max_size) {
+  max_size_ = max_size;
+  Evict(max_size);
+}
+
+const HeaderField* DynamicTable::Get(std::size_t index) const {
+  return index < entries_.size() ? &entries_[index] : nullptr;
+}
+
+void DynamicTable::Evict(std::size_t max_size) {
+  while (size_ > max_size && !entries_.empty()) {
+    const auto& oldest = entries_.back();
+    size_ -= oldest.name.size() + oldest.value.size() + kEntryOverhead;
+    entries_.pop_back();
+  }
+}
+
+Decoder::Status Decoder::Decode(std::string_view block, std::size_t max_list_size, std::vector<HeaderField>& fields) {
+  std::size_t list_size = 0;
+  bool too_large = false;
+  bool fields_seen = false;
+  std::string name;
+  std::string value;
+  const auto emit = [&](std::string_view field_name, std::string_view field_value) {
+    list_size += field_name.size() + field_value.size() + kEntryOverhead;
+    if (list_size > max_list_size) {
+      // Keep decoding: the rest of the block may still change the table.
+      too_large = true;
+      return;
+    }
+    fields.push_back(HeaderField{std::string(field_name), std::string(field_value)});
+  };
+  // Static entries first, then the dynamic table from its newest entry.
+  const auto lookup = [&](std::uint64_t index) -> std::pair<const std::string_view*, const HeaderField*> {
+    if (index >= 1 && index <= kStaticTable.size()) {
+      return {&kStaticTable[index - 1].name, nullptr};
+    }
+    if (index > kStaticTable.size()) {
+      return {nullptr, table_.Get(static_cast<std::size_t>(index - kStaticTable.size() - 1))};
+    }
+    return {nullptr, nullptr};
+  };
+
+  std::size_t pos = 0;
+  while (pos < block.size()) {
+    const auto first = static_cast<std::uint8_t>(block[pos]);
+    std::uint64_t index = 0;
+    if (first & 0x80) {
+      // Indexed header field.
+      if (!DecodeInteger(block, pos, 7, index)) {
+        return Status::kError;
+      }
+      const auto [static_name, dynamic] = lookup(index);
+      if (static_name) {
+        emit(*static_name, kStaticTable[index - 1].value);
+      } else if (dynamic) {
+        emit(dynamic->name, dynamic->value);
+      } else {
+        return Status::kError;
+      }
+      fields_seen = true;
+      continue;
+    }
+    if ((first & 0xe0) == 0x20) {
+      // Dynamic table size update; only allowed before the first field.
+      if (fields_seen || !DecodeInteger(block, pos, 5, index) || index > max_table_size_) {
+        return Status::kError;
+      }
+      table_.SetMaxSize(static_cast<std::size_t>(index));
+      continue;
+    }
+
+    // Literal, with incremental indexing (01), without indexing (0000) or never indexed (0001).
+    const bool indexing = (first & 0x40) != 0;
+    if (!DecodeInteger(block, pos, indexing ? 6 : 4, index)) {
+      return Status::kError;
+    }
+    if (index == 0) {
+      if (!DecodeString(block, pos, name)) {
+        return Status::kError;
+      }
+    } else {
+      const auto [static_name, dynamic] = lookup(index);
+      if (static_name) {
+        name.assign(*static_name);
+      } else if (dynamic) {
+        name = dynamic->name;
+      } else {
+        return Status::kError;
+      }
+    }
+    if (!DecodeString(block, pos, value)) {
+      return Status::kError;
+    }
+    if (indexing) {
+      table_.Add(name, value);
+    }
+    emit(name, value);
+    fields_seen = true;
+  }
+  return too_large ? Status::kTooLarge : Status::kOk;
+}
+
+void Encoder::SetMaxTableSize(std::size_t size) {
+  size = std::min(size, kEncoderTableSize);
+  // A shrink followed by a grow still has to reach the peer as a shrink.
+  smallest_pending_size_ = size_update_pending_ ? std::min(smallest_pending_size_, size) : size;
+  pending_max_size_ = size;
+  size_update_pending_ = true;
+}
+
+void Encoder::BeginBlock(std::string& out) {
+  if (!size_update_pending_) {
+    return;
+  }
+  size_update_pending_ = false;
+  if (smallest_pending_size_ < pending_max_size_) {
+    table_.SetMaxSize(smallest_pending_size_);
+    EncodeInteger(smallest_pending_size_, 5, 0x20, out);
+  }
+  table_.SetMaxSize(pending_max_size_);
+  EncodeInteger(pending_max_size_, 5, 0x20, out);
+}
+
+void Encoder::Encode(std::string_view name, std::string_view value, std::string& out, bool sensitive) {
+  std::size_t name_index = 0;
+  for (std::size_t i = 0; i < kStaticTable.size(); ++i) {
+    if (kStaticTable[i].name != name) {
+      continue;
+    }
+    if (!sensitive && kStaticTable[i].value == value) {
+      EncodeInteger(i + 1, 7, 0x80, out);
+      return;
+    }
+    if (name_index == 0) {
+      name_index = i + 1;
+    }
+  }
+  for (std::size_t i = 0; i < table_.entries(); ++i) {
+    const auto* entry = table_.Get(i);
+    if (entry->name != name) {
+      continue;
+    }
+    if (!sensitive && entry->value == value) {
+      EncodeInteger(kStaticTable.size() + i + 1, 7, 0x80, out);
+      return;
+    }
+    if (name_index == 0) {
+      name_index = kStaticTable.size() + i + 1;
+    }
+  }
+
+  const bool indexing = !sensitive && std::find(kUnindexedNames.begin(), kUnindexedNames.end(), name) ==
+                                          kUnindexedNames.end();
+  if (indexing) {
+    EncodeInteger(name_index, 6, 0x40, out);
+  } else {
+    EncodeInteger(name_index, 4, sensitive ? 0x10 : 0x00, out);
+  }
+  if (name_index == 0) {
+    EncodeString(name, out);
+  }
+  EncodeString(value, out);
+  if (indexing) {
+    table_.Add(name, value);
+  }
+}
+
+std::size_t HuffmanEncodedSize(std::string_view input) {
+  std::size_t bits = 0;
+  for (const char c : input) {
+    bits += kHuffmanCodes[static_cast<std::uint8_t>(c)].bits;
+  }
+  return (bits + 7) / 8;
+}
+
+void HuffmanEncode(std::string_view input, std::string& out) {
+  std::uint64_t pending = 0;
+  int pending_bits = 0;
+  for (const char c : input) {
+    const auto [code, bits] = kHuffmanCodes[static_cast<std::uint8_t>(c)];
+    pending = (pending << bits) | code;
+    pending_bits += bits;
+    while (pending_bits >= 8) {
+      pending_bits -= 8;
+      out.push_back(static_cast<char>(pending >> pending_bits));
+    }
+    pending &= (std::uint64_t{1} << pending_bits) - 1;
+  }
+  if (pending_bits > 0) {
+    // Padded with the most significant bits of EOS, which are all ones.
+    out.push_back(static_cast<char>((pending << (8 - pending_bits)) | (0xffu >> pending_bits)));
+  }
+}
+
+bool HuffmanDecode(std::string_view input, std::string& out) {
+  const auto& tree = Tree();
+  std::size_t node = 0;
+  // Bits read since the last symbol, and whether they were all ones: only a
+  // prefix of EOS shorter than a byte is valid padding.
+  int partial_bits = 0;
+  bool partial_ones = true;
+  for (const char c : input) {
+    const auto byte = static_cast<std::uint8_t>(c);
+    for (int bit = 7; bit >= 0; --bit) {
+      const auto branch = (byte >> bit) & 1;
+      const auto next = tree[node].children[branch];
+      if (next < 0) {
+        return false;
+      }
+      node = static_cast<std::size_t>(next);
+      ++partial_bits;
+      partial_ones = partial_ones && branch == 1;
+      const auto symbol = tree[node].symbol;
+      if (symbol < 0) {
+        continue;
+      }
+      if (symbol == 256) {
+        return false;
+      }
+      out.push_back(static_cast<char>(symbol));
+      node = 0;
+      partial_bits = 0;
+      partial_ones = true;
+    }
+  }
+  return partial_bits <= 7 && partial_ones;
+}
+
+}
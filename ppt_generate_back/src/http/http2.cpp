@@ -0,0 +1,930 @@
+#include "http/http2.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <optional>
+
+#include "utils/string_utils.h"
+
+namespace {
+constexpr std::size_t kFrameHeaderSize = 9;
+// SETTINGS_MAX_FRAME_SIZE is left at its default, which every peer accepts,
+// so frames in both directions are at most this large.
+constexpr std::size_t kMaxFrameSize = 16384;
+constexpr std::uint32_t kMaxConcurrentStreams = 100;
+// Receive windows. Bodies are buffered whole before dispatch, so these only
+// decide how often WINDOW_UPDATE is sent, not how much memory a stream holds.
+constexpr std::uint32_t kStreamWindow = 256 * 1024;
+constexpr std::uint32_t kConnectionWindow = 1024 * 1024;
+constexpr std::uint32_t kDefaultWindow = 65535;
+constexpr std::int64_t kMaxWindow = 0x7fffffff;
+constexpr std::size_t kMaxHeaderListSize = 64 * 1024;
+// DATA frames are generated until this much output is waiting to be sent.
+constexpr std::size_t kOutputHighWater = 64 * 1024;
+// A client that keeps asking for replies (PING, SETTINGS) without reading them is cut off here.
+constexpr std::size_t kMaxPendingOutput = 1024 * 1024;
+
+enum FrameType : std::uint8_t {
+  kData = 0x0,
+  kHeaders = 0x1,
+  kPriority = 0x2,
+  kRstStream = 0x3,
+  kSettings = 0x4,
+  kPushPromise = 0x5,
+  kPing = 0x6,
+  kGoAway = 0x7,
+  kWindowUpdate = 0x8,
+  kContinuation = 0x9,
+};
+
+constexpr std::uint8_t kEndStream = 0x1;
+constexpr std::uint8_t kAck = 0x1;
+constexpr std::uint8_t kEndHeaders = 0x4;
+constexpr std::uint8_t kPadded = 0x8;
+constexpr std::uint8_t kPriorityFlag = 0x20;
+
+enum ErrorCode : std::uint32_t {
+  kNoError = 0x0,
+  kProtocolError = 0x1,
+  kInternalError = 0x2,
+  kFlowControlError = 0x3,
+  kStreamClosed = 0x5,
+  kFrameSizeError = 0x6,
+  kRefusedStream = 0x7,
+  kCompressionError = 0x9,
+  kEnhanceYourCalm = 0xb,
+};
+
+enum SettingId : std::uint16_t {
+  kHeaderTableSize = 0x1,
+  kEnablePush = 0x2,
+  kMaxConcurrentStreamsSetting = 0x3,
+  kInitialWindowSize = 0x4,
+  kMaxFrameSizeSetting = 0x5,
+  kMaxHeaderListSizeSetting = 0x6,
+};
+
+std::uint32_t ReadUint32(std::string_view data, std::size_t offset) {
+  const auto* bytes = reinterpret_cast<const std::uint8_t*>(data.data() + offset);
+  return (static_cast<std::uint32_t>(bytes[0]) << 24) | (static_cast<std::uint32_t>(bytes[1]) << 16) |
+         (static_cast<std::uint32_t>(bytes[2]) << 8) | bytes[3];
+}
+
+void AppendUint32(std::string& out, std::uint32_t value) {
+  out.push_back(static_cast<char>(value >> 24));
+  out.push_back(static_cast<char>(value >> 16));
+  out.push_back(static_cast<char>(value >> 8));
+  out.push_back(static_cast<char>(value));
+}
+
+void AppendSetting(std::string& out, std::uint16_t id, std::uint32_t value) {
+  out.push_back(static_cast<char>(id >> 8));
+  out.push_back(static_cast<char>(id));
+  AppendUint32(out, value);
+}
+
+// Hop-by-hop headers have no meaning in HTTP/2 and must not be sent.
+bool IsConnectionSpecific(std::string_view name) {
+  return string_utils::EqualsIgnoreCase(name, "connection") || string_utils::EqualsIgnoreCase(name, "keep-alive") ||
+         string_utils::EqualsIgnoreCase(name, "transfer-encoding") || string_utils::EqualsIgnoreCase(name, "upgrade") ||
+         string_utils::EqualsIgnoreCase(name, "proxy-connection");
+}
+
+bool HasUpperCase(std::string_view name) {
+  return std::any_of(name.begin(), name.end(), [](char c) { return c >= 'A' && c <= 'Z'; });
+}
+}  // namespace
+
+struct Http2Session::Stream {
+  std::uint32_t id = 0;
+
+  // Request side, until the request is handed out.
+  std::vector<hpack::HeaderField> fields;
+  std::string request_body;
+  std::int64_t receive_window = kStreamWindow;
+  std::uint32_t receive_unacked = 0;
+  // The client sent END_STREAM (or reset the stream): nothing more will arrive.
+  bool remote_closed = false;
+  // Handed to the caller, or answered by the session itself.
+  bool dispatched = false;
+  // Already answered (413, 431); the rest of the body is dropped.
+  bool discard_body = false;
+  bool head_request = false;
+  // Reset by the client while its handler runs; the entry is kept until the
+  // response arrives so the stream still counts against the concurrency limit.
+  bool reset = false;
+
+  // Response side, once Respond() has queued the HEADERS.
+  bool responded = false;
+  std::int64_t send_window = kDefaultWindow;
+  std::string body;
+  std::size_t body_sent = 0;
+  std::shared_ptr<const void> body_owner;
+  std::string_view shared_body;
+  std::optional<FileBody> file;
+  std::uint64_t file_sent = 0;
+  std::shared_ptr<BodyStream> stream;
+  std::string chunk;
+  std::size_t chunk_sent = 0;
+  bool stream_done = false;
+  // END_STREAM went out, or the body failed and the stream must be reset.
+  bool finished = false;
+  bool failed = false;
+
+  // Only an empty DATA frame with END_STREAM is left, which needs no window.
+  bool OnlyEndLeft() const { return stream && stream_done && chunk_sent == chunk.size(); }
+};
+
+Http2Session::Http2Session(std::size_t max_body, const HeaderFields& response_headers)
+    : max_body_(max_body), response_headers_(response_headers), receive_window_(kConnectionWindow) {
+  WriteSettings();
+}
+
+Http2Session::~Http2Session() = default;
+
+bool Http2Session::Receive(std::string_view input, std::vector<std::shared_ptr<Request>>& requests) {
+  if (failed_) {
+    return false;
+  }
+  std::string_view data = input;
+  if (!input_.empty()) {
+    input_.append(input);
+    data = input_;
+  }
+
+  std::size_t pos = 0;
+  if (!preface_received_) {
+    const auto prefix = data.substr(0, kPreface.size());
+    if (kPreface.substr(0, prefix.size()) != prefix) {
+      return ConnectionError(kProtocolError);
+    }
+    if (prefix.size() == kPreface.size()) {
+      preface_received_ = true;
+      pos = kPreface.size();
+    } else {
+      pos = data.size();
+    }
+  }
+
+  while (preface_received_ && data.size() - pos >= kFrameHeaderSize) {
+    const auto* header = reinterpret_cast<const std::uint8_t*>(data.data() + pos);
+    const std::size_t length = (static_cast<std::size_t>(header[0]) << 16) |
+                               (static_cast<std::size_t>(header[1]) << 8) | header[2];
+    if (length > kMaxFrameSize) {
+      return ConnectionError(kFrameSizeError);
+    }
+    if (data.size() - pos - kFrameHeaderSize < length) {
+      break;
+    }
+    const auto payload = data.substr(pos + kFrameHeaderSize, length);
+    const auto stream_id = ReadUint32(data, pos + 5) & 0x7fffffff;
+    pos += kFrameHeaderSize + length;
+    if (!ProcessFrame(header[3], header[4], stream_id, payload, requests)) {
+      return false;
+    }
+    if (output_.size() - output_sent_ > kMaxPendingOutput) {
+      return ConnectionError(kEnhanceYourCalm);
+    }
+  }
+
+  if (!preface_received_ && pos == data.size()) {
+    // Only part of the preface so far; keep it whole.
+    pos = 0;
+  }
+  if (data.data() == input_.data()) {
+    input_.erase(0, pos);
+  } else {
+    input_.assign(data.substr(pos));
+  }
+  return true;
+}
+
+bool Http2Session::ProcessFrame(std::uint8_t type, std::uint8_t flags, std::uint32_t stream_id,
+                                std::string_view payload, std::vector<std::shared_ptr<Request>>& requests) {
+  if (expect_continuation_ && (type != kContinuation || stream_id != header_stream_)) {
+    return ConnectionError(kProtocolError);
+  }
+  switch (type) {
+    case kData:
+      return OnData(flags, stream_id, payload, requests);
+    case kHeaders:
+      return OnHeaders(flags, stream_id, payload, requests);
+    case kContinuation:
+      if (!expect_continuation_) {
+        return ConnectionError(kProtocolError);
+      }
+      header_block_.append(payload);
+      if (header_block_.size() > kMaxHeaderListSize) {
+        return ConnectionError(kEnhanceYourCalm);
+      }
+      if (flags & kEndHeaders) {
+        expect_continuation_ = false;
+        return OnHeaderBlock(requests);
+      }
+      return true;
+    case kPriority:
+      if (stream_id == 0) {
+        return ConnectionError(kProtocolError);
+      }
+      if (payload.size() != 5) {
+        StreamError(stream_id, kFrameSizeError);
+      }
+      // Responses are interleaved round-robin; priorities are not used.
+      return true;
+    case kRstStream:
+      if (stream_id == 0 || stream_id > last_stream_id_) {
+        return ConnectionError(kProtocolError);
+      }
+      if (payload.size() != 4) {
+        return ConnectionError(kFrameSizeError);
+      }
+      OnRstStream(stream_id);
+      return true;
+    case kSettings:
+      return OnSettings(flags, stream_id, payload);
+    case kPushPromise:
+      // Clients never push, and we told them so.
+      return ConnectionError(kProtocolError);
+    case kPing:
+      if (stream_id != 0) {
+        return ConnectionError(kProtocolError);
+      }
+      if (payload.size() != 8) {
+        return ConnectionError(kFrameSizeError);
+      }
+      if (!(flags & kAck)) {
+        WriteFrameHeader(payload.size(), kPing, kAck, 0);
+        output_.append(payload);
+      }
+      return true;
+    case kGoAway:
+      if (stream_id != 0) {
+        return ConnectionError(kProtocolError);
+      }
+      peer_goaway_ = true;
+      return true;
+    case kWindowUpdate:
+      return OnWindowUpdate(stream_id, payload);
+    default:
+      // Unknown frame types are ignored (RFC 9113 section 4.1).
+      return true;
+  }
+}
+
+bool Http2Session::OnHeaders(std::uint8_t flags, std::uint32_t stream_id, std::string_view payload,
+                             std::vector<std::shared_ptr<Request>>& requests) {
+  if (stream_id == 0 || stream_id % 2 == 0) {
+    return ConnectionError(kProtocolError);
+  }
+  std::size_t start = 0;
+  std::size_t padding = 0;
+  if (flags & kPadded) {
+    if (payload.empty()) {
+      return ConnectionError(kProtocolError);
+    }
+    padding = static_cast<std::uint8_t>(payload[0]);
+    start = 1;
+  }
+  if (flags & kPriorityFlag) {
+    start += 5;
+  }
+  if (start + padding > payload.size()) {
+    return ConnectionError(kProtocolError);
+  }
+  header_block_.assign(payload.substr(start, payload.size() - start - padding));
+  header_stream_ = stream_id;
+  header_flags_ = flags;
+  if (flags & kEndHeaders) {
+    return OnHeaderBlock(requests);
+  }
+  expect_continuation_ = true;
+  return true;
+}
+
+bool Http2Session::OnHeaderBlock(std::vector<std::shared_ptr<Request>>& requests) {
+  const auto stream_id = header_stream_;
+  const bool end_stream = (header_flags_ & kEndStream) != 0;
+  std::vector<hpack::HeaderField> fields;
+  // Decoded even for streams that will be refused: the table must stay in step.
+  const auto status = decoder_.Decode(header_block_, kMaxHeaderListSize, fields);
+  header_block_.clear();
+  if (status == hpack::Decoder::Status::kError) {
+    return ConnectionError(kCompressionError);
+  }
+
+  if (const auto it = streams_.find(stream_id); it != streams_.end()) {
+    // Trailers: they end the request but carry nothing a handler reads.
+    Stream& stream = *it->second;
+    if (stream.remote_closed) {
+      if (!stream.reset) {
+        StreamError(stream_id, kStreamClosed);
+      }
+      return true;
+    }
+    if (!end_stream) {
+      StreamError(stream_id, kProtocolError);
+      return true;
+    }
+    stream.remote_closed = true;
+    if (!stream.dispatched) {
+      CompleteRequest(stream, requests);
+    }
+    return true;
+  }
+  if (stream_id <= last_stream_id_) {
+    return ConnectionError(kStreamClosed);
+  }
+  last_stream_id_ = stream_id;
+  if (goaway_sent_) {
+    return true;
+  }
+  if (streams_.size() >= kMaxConcurrentStreams) {
+    WriteRstStream(stream_id, kRefusedStream);
+    return true;
+  }
+
+  auto owned = std::make_unique<Stream>();
+  Stream& stream = *owned;
+  stream.id = stream_id;
+  stream.send_window = peer_initial_window_;
+  stream.fields = std::move(fields);
+  stream.remote_closed = end_stream;
+  streams_.emplace(stream_id, std::move(owned));
+  if (status == hpack::Decoder::Status::kTooLarge) {
+    Reject(stream, 431, "Request header fields too large");
+    return true;
+  }
+  if (end_stream) {
+    CompleteRequest(stream, requests);
+  }
+  return true;
+}
+
+bool Http2Session::OnData(std::uint8_t flags, std::uint32_t stream_id, std::string_view payload,
+                          std::vector<std::shared_ptr<Request>>& requests) {
+  if (stream_id == 0) {
+    return ConnectionError(kProtocolError);
+  }
+  // Flow control counts the whole payload, padding included.
+  const auto length = static_cast<std::uint32_t>(payload.size());
+  receive_window_ -= length;
+  if (receive_window_ < 0) {
+    return ConnectionError(kFlowControlError);
+  }
+  receive_unacked_ += length;
+  if (receive_unacked_ >= kConnectionWindow / 2) {
+    WriteWindowUpdate(0, receive_unacked_);
+    receive_window_ += receive_unacked_;
+    receive_unacked_ = 0;
+  }
+
+  std::string_view data = payload;
+  if (flags & kPadded) {
+    if (payload.empty() || 1u + static_cast<std::uint8_t>(payload[0]) > payload.size()) {
+      return ConnectionError(kProtocolError);
+    }
+    data = payload.substr(1, payload.size() - 1 - static_cast<std::uint8_t>(payload[0]));
+  }
+
+  const auto it = streams_.find(stream_id);
+  if (it == streams_.end()) {
+    if (stream_id > last_stream_id_) {
+      return ConnectionError(kProtocolError);
+    }
+    // A stream we already closed; the client may not have heard yet.
+    return true;
+  }
+  Stream& stream = *it->second;
+  if (stream.reset) {
+    return true;
+  }
+  if (stream.remote_closed) {
+    StreamError(stream_id, kStreamClosed);
+    return true;
+  }
+  stream.receive_window -= length;
+  if (stream.receive_window < 0) {
+    StreamError(stream_id, kFlowControlError);
+    return true;
+  }
+
+  stream.remote_closed = (flags & kEndStream) != 0;
+  if (!stream.discard_body) {
+    if (stream.request_body.size() + data.size() > max_body_) {
+      // May finish (and forget) the stream straight away.
+      Reject(stream, 413, "Request body too large");
+      return true;
+    }
+    stream.request_body.append(data);
+  }
+  if (stream.remote_closed) {
+    if (!stream.dispatched) {
+      CompleteRequest(stream, requests);
+    }
+    return true;
+  }
+  stream.receive_unacked += length;
+  if (stream.receive_unacked >= kStreamWindow / 2) {
+    WriteWindowUpdate(stream_id, stream.receive_unacked);
+    stream.receive_window += stream.receive_unacked;
+    stream.receive_unacked = 0;
+  }
+  return true;
+}
+
+bool Http2Session::OnSettings(std::uint8_t flags, std::uint32_t stream_id, std::string_view payload) {
+  if (stream_id != 0) {
+    return ConnectionError(kProtocolError);
+  }
+  if (flags & kAck) {
+    return payload.empty() || ConnectionError(kFrameSizeError);
+  }
+  if (payload.size() % 6 != 0) {
+    return ConnectionError(kFrameSizeError);
+  }
+  for (std::size_t offset = 0; offset < payload.size(); offset += 6) {
+    const auto id = static_cast<std::uint16_t>((static_cast<std::uint8_t>(payload[offset]) << 8) |
+                                               static_cast<std::uint8_t>(payload[offset + 1]));
+    const auto value = ReadUint32(payload, offset + 2);
+    switch (id) {
+      case kHeaderTableSize:
+        encoder_.SetMaxTableSize(value);
+        break;
+      case kEnablePush:
+        if (value > 1) {
+          return ConnectionError(kProtocolError);
+        }
+        break;
+      case kInitialWindowSize: {
+        if (value > kMaxWindow) {
+          return ConnectionError(kFlowControlError);
+        }
+        // Applies to every open stream, retroactively.
+        const auto delta = static_cast<std::int64_t>(value) - peer_initial_window_;
+        for (auto& [id, stream] : streams_) {
+          stream->send_window += delta;
+          if (stream->send_window > kMaxWindow) {
+            return ConnectionError(kFlowControlError);
+          }
+        }
+        peer_initial_window_ = value;
+        break;
+      }
+      case kMaxFrameSizeSetting:
+        if (value < kMaxFrameSize || value > 0xffffff) {
+          return ConnectionError(kProtocolError);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  WriteFrameHeader(0, kSettings, kAck, 0);
+  window_blocked_ = false;
+  return true;
+}
+
+bool Http2Session::OnWindowUpdate(std::uint32_t stream_id, std::string_view payload) {
+  if (payload.size() != 4) {
+    return ConnectionError(kFrameSizeError);
+  }
+  const auto increment = ReadUint32(payload, 0) & 0x7fffffff;
+  if (stream_id == 0) {
+    if (increment == 0) {
+      return ConnectionError(kProtocolError);
+    }
+    send_window_ += increment;
+    if (send_window_ > kMaxWindow) {
+      return ConnectionError(kFlowControlError);
+    }
+  } else {
+    const auto it = streams_.find(stream_id);
+    if (it == streams_.end()) {
+      return stream_id <= last_stream_id_ || ConnectionError(kProtocolError);
+    }
+    if (increment == 0) {
+      StreamError(stream_id, kProtocolError);
+      return true;
+    }
+    it->second->send_window += increment;
+    if (it->second->send_window > kMaxWindow) {
+      StreamError(stream_id, kFlowControlError);
+      return true;
+    }
+  }
+  // Produce() finds out whether that was enough.
+  window_blocked_ = false;
+  return true;
+}
+
+void Http2Session::OnRstStream(std::uint32_t stream_id) {
+  const auto it = streams_.find(stream_id);
+  if (it == streams_.end()) {
+    return;
+  }
+  Stream& stream = *it->second;
+  if (stream.dispatched && !stream.responded) {
+    stream.reset = true;
+    stream.remote_closed = true;
+    return;
+  }
+  CloseStream(stream_id);
+}
+
+void Http2Session::CompleteRequest(Stream& stream, std::vector<std::shared_ptr<Request>>& requests) {
+  stream.dispatched = true;
+  auto request = std::make_shared<Request>();
+  request->stream_id = stream.id;
+  request->fields = std::move(stream.fields);
+  request->body = std::move(stream.request_body);
+
+  // The views are taken only now that the strings have their final home.
+  auto& http = request->request;
+  std::string_view scheme;
+  std::string_view authority;
+  bool regular_seen = false;
+  bool malformed = false;
+  for (const auto& field : request->fields) {
+    const std::string_view name = field.name;
+    const std::string_view value = field.value;
+    if (!name.empty() && name[0] == ':') {
+      malformed = malformed || regular_seen;
+      if (name == ":method") {
+        http.method = value;
+      } else if (name == ":path") {
+        http.target = value;
+      } else if (name == ":scheme") {
+        scheme = value;
+      } else if (name == ":authority") {
+        authority = value;
+      } else {
+        malformed = true;
+      }
+      continue;
+    }
+    regular_seen = true;
+    if (HasUpperCase(name)) {
+      malformed = true;
+    }
+    if (IsConnectionSpecific(name)) {
+      continue;
+    }
+    http.headers.push_back(HttpHeader{LookupHeaderId(name), name, value});
+  }
+  if (malformed || http.method.empty() || http.target.empty() || scheme.empty()) {
+    StreamError(stream.id, kProtocolError);
+    return;
+  }
+  if (!authority.empty() && http.HeaderView(HeaderId::kHost).empty()) {
+    http.headers.push_back(HttpHeader{HeaderId::kHost, "host", authority});
+  }
+  http.path = http.target;
+  if (const auto query_sep = http.target.find('?'); query_sep != std::string_view::npos) {
+    http.path = http.target.substr(0, query_sep);
+    http.query_string = http.target.substr(query_sep + 1);
+  }
+  http.version = "HTTP/2";
+  http.body = request->body;
+  stream.head_request = ParseHttpMethod(http.method) == HttpMethod::kHead;
+  requests.push_back(std::move(request));
+}
+
+void Http2Session::Reject(Stream& stream, int status, std::string_view message) {
+  stream.dispatched = true;
+  stream.discard_body = true;
+  stream.fields.clear();
+  stream.request_body.clear();
+  Respond(stream.id, HttpResponse::Json(status, {{"message", std::string(message)}}));
+}
+
+void Http2Session::Respond(std::uint32_t stream_id, HttpResponse response) {
+  const auto it = streams_.find(stream_id);
+  if (it == streams_.end() || it->second->responded || it->second->reset) {
+    if (response.stream) {
+      response.stream->Cancel();
+    }
+    if (it != streams_.end() && it->second->reset) {
+      CloseStream(stream_id);
+    }
+    return;
+  }
+  Stream& stream = *it->second;
+  stream.responded = true;
+
+  std::string block;
+  encoder_.BeginBlock(block);
+  std::array<char, 8> status{};
+  const auto status_end = std::to_chars(status.data(), status.data() + status.size(), response.status_code).ptr;
+  encoder_.Encode(":status", std::string_view(status.data(), static_cast<std::size_t>(status_end - status.data())), block);
+  bool has_content_type = false;
+  bool has_content_length = false;
+  for (const auto& header : response.headers) {
+    const auto name = header.Name();
+    if (IsConnectionSpecific(name)) {
+      continue;
+    }
+    has_content_type = has_content_type || header.id == HeaderId::kContentType;
+    has_content_length = has_content_length || header.id == HeaderId::kContentLength;
+    if (HasUpperCase(name)) {
+      encoder_.Encode(string_utils::ToLower(std::string(name)), header.value, block);
+    } else {
+      encoder_.Encode(name, header.value, block);
+    }
+  }
+  if (!has_content_type) {
+    encoder_.Encode("content-type", "application/json", block);
+  }
+  if (!response.stream && !has_content_length && response.status_code != 304) {
+    const std::uint64_t length = response.file          ? response.file->length
+                                 : response.shared_body ? response.shared_body->data.size()
+                                                        : response.body.size();
+    std::array<char, 24> digits{};
+    const auto digits_end = std::to_chars(digits.data(), digits.data() + digits.size(), length).ptr;
+    encoder_.Encode("content-length", std::string_view(digits.data(), static_cast<std::size_t>(digits_end - digits.data())),
+                    block);
+  }
+  for (const auto& [name, value] : response_headers_) {
+    encoder_.Encode(name, value, block);
+  }
+
+  const bool bodyless = stream.head_request || response.status_code == 204 || response.status_code == 304;
+  if (bodyless) {
+    if (response.stream) {
+      response.stream->Cancel();
+    }
+  } else {
+    stream.body = std::move(response.body);
+    if (response.shared_body) {
+      stream.body_owner = std::move(response.shared_body->owner);
+      stream.shared_body = response.shared_body->data;
+    }
+    stream.file = std::move(response.file);
+    stream.stream = std::move(response.stream);
+  }
+  const bool has_body = stream.body_owner ? !stream.shared_body.empty() : !stream.body.empty();
+  const bool has_data = has_body || (stream.file && stream.file->length > 0) || stream.stream;
+  WriteHeaders(stream_id, block, !has_data);
+  if (has_data) {
+    sending_.push_back(stream_id);
+  } else {
+    stream.finished = true;
+    FinishStream(stream);
+  }
+}
+
+std::string_view Http2Session::PendingOutput() {
+  if (output_sent_ >= kOutputHighWater) {
+    output_.erase(0, output_sent_);
+    output_sent_ = 0;
+  }
+  if (!sending_.empty()) {
+    Produce();
+  }
+  return std::string_view(output_).substr(output_sent_);
+}
+
+void Http2Session::ConsumeOutput(std::size_t count) {
+  output_sent_ += count;
+  if (output_sent_ == output_.size()) {
+    output_.clear();
+    output_sent_ = 0;
+  }
+}
+
+void Http2Session::GoAway() {
+  if (goaway_sent_) {
+    return;
+  }
+  goaway_sent_ = true;
+  WriteFrameHeader(8, kGoAway, 0, 0);
+  AppendUint32(output_, last_stream_id_);
+  AppendUint32(output_, kNoError);
+}
+
+void Http2Session::CancelStreams() {
+  for (auto& [id, stream] : streams_) {
+    if (stream->stream) {
+      stream->stream->Cancel();
+    }
+  }
+}
+
+void Http2Session::Produce() {
+  window_blocked_ = false;
+  // Streams visited in a row without producing anything; once every stream
+  // has been, all of them are waiting for a window or a producer.
+  std::size_t idle_visits = 0;
+  while (!sending_.empty() && idle_visits < sending_.size() && output_.size() - output_sent_ < kOutputHighWater) {
+    const auto stream_id = sending_.front();
+    sending_.pop_front();
+    const auto it = streams_.find(stream_id);
+    if (it == streams_.end()) {
+      continue;
+    }
+    Stream& stream = *it->second;
+    const auto window = std::min(send_window_, stream.send_window);
+    if (window <= 0 && !stream.OnlyEndLeft()) {
+      window_blocked_ = true;
+      sending_.push_back(stream_id);
+      ++idle_visits;
+      continue;
+    }
+    const auto limit = static_cast<std::size_t>(std::clamp<std::int64_t>(window, 0, kMaxFrameSize));
+    if (!ProduceData(stream, limit)) {
+      sending_.push_back(stream_id);
+      ++idle_visits;
+      continue;
+    }
+    idle_visits = 0;
+    if (stream.finished) {
+      FinishStream(stream);
+    } else {
+      sending_.push_back(stream_id);
+    }
+  }
+}
+
+bool Http2Session::ProduceData(Stream& stream, std::size_t limit) {
+  const std::string_view body = stream.body_owner ? stream.shared_body : std::string_view(stream.body);
+  const bool file_left = stream.file && stream.file_sent < stream.file->length;
+  if (stream.body_sent < body.size()) {
+    const auto size = std::min(limit, body.size() - stream.body_sent);
+    const bool last = stream.body_sent + size == body.size() && !file_left && !stream.stream;
+    WriteData(stream, body.substr(stream.body_sent, size), last);
+    stream.body_sent += size;
+    return true;
+  }
+
+  if (file_left) {
+    const auto& file = *stream.file;
+    const auto size = static_cast<std::size_t>(std::min<std::uint64_t>(limit, file.length - stream.file_sent));
+    // The payload is read straight into the output, behind its frame header.
+    const auto frame_at = output_.size();
+    WriteFrameHeader(size, kData, 0, stream.id);
+    output_.resize(frame_at + kFrameHeaderSize + size);
+    ssize_t read = -1;
+    do {
+      read = ::pread(file.fd->Get(), output_.data() + frame_at + kFrameHeaderSize, size,
+                     static_cast<off_t>(file.offset + stream.file_sent));
+    } while (read < 0 && errno == EINTR);
+    if (read <= 0) {
+      // The file shrank or failed underneath us; the declared length cannot be honoured.
+      output_.resize(frame_at);
+      stream.failed = true;
+      return true;
+    }
+    const auto count = static_cast<std::size_t>(read);
+    output_.resize(frame_at + kFrameHeaderSize + count);
+    stream.file_sent += count;
+    const bool last = stream.file_sent == file.length && !stream.stream;
+    output_[frame_at] = static_cast<char>(count >> 16);
+    output_[frame_at + 1] = static_cast<char>(count >> 8);
+    output_[frame_at + 2] = static_cast<char>(count);
+    output_[frame_at + 4] = static_cast<char>(last ? kEndStream : 0);
+    send_window_ -= static_cast<std::int64_t>(count);
+    stream.send_window -= static_cast<std::int64_t>(count);
+    stream.finished = last;
+    return true;
+  }
+
+  if (!stream.stream) {
+    // Everything was sent without END_STREAM (a body followed by an empty file).
+    WriteData(stream, {}, true);
+    return true;
+  }
+  while (true) {
+    if (stream.chunk_sent < stream.chunk.size()) {
+      const auto size = std::min(limit, stream.chunk.size() - stream.chunk_sent);
+      if (size == 0) {
+        return false;
+      }
+      WriteData(stream, std::string_view(stream.chunk).substr(stream.chunk_sent, size), false);
+      stream.chunk_sent += size;
+      return true;
+    }
+    if (stream.stream_done) {
+      WriteData(stream, {}, true);
+      return true;
+    }
+    stream.chunk.clear();
+    stream.chunk_sent = 0;
+    switch (stream.stream->Take(stream.chunk, false)) {
+      case BodyStream::TakeResult::kData:
+        break;
+      case BodyStream::TakeResult::kFinished:
+        stream.stream_done = true;
+        break;
+      case BodyStream::TakeResult::kPending:
+        // The producer's next Write() notifies the loop, which flushes again.
+        return false;
+      case BodyStream::TakeResult::kFailed:
+        stream.failed = true;
+        return true;
+    }
+  }
+}
+
+void Http2Session::FinishStream(Stream& stream) {
+  const auto stream_id = stream.id;
+  if (stream.failed) {
+    WriteRstStream(stream_id, kInternalError);
+  } else if (!stream.remote_closed) {
+    // Answered before the request was complete (413): stop the upload.
+    WriteRstStream(stream_id, kNoError);
+  }
+  CloseStream(stream_id);
+}
+
+void Http2Session::CloseStream(std::uint32_t stream_id) {
+  const auto it = streams_.find(stream_id);
+  if (it == streams_.end()) {
+    return;
+  }
+  if (it->second->stream && !it->second->finished) {
+    it->second->stream->Cancel();
+  }
+  // Its id left in |sending_| is skipped by Produce().
+  streams_.erase(it);
+}
+
+void Http2Session::StreamError(std::uint32_t stream_id, std::uint32_t error_code) {
+  WriteRstStream(stream_id, error_code);
+  const auto it = streams_.find(stream_id);
+  if (it != streams_.end() && it->second->dispatched && !it->second->responded) {
+    // Its handler is still running; keep the entry until it answers.
+    it->second->reset = true;
+    it->second->remote_closed = true;
+    return;
+  }
+  CloseStream(stream_id);
+}
+
+bool Http2Session::ConnectionError(std::uint32_t error_code) {
+  failed_ = true;
+  input_.clear();
+  if (!goaway_sent_) {
+    goaway_sent_ = true;
+    WriteFrameHeader(8, kGoAway, 0, 0);
+    AppendUint32(output_, last_stream_id_);
+    AppendUint32(output_, error_code);
+  }
+  return false;
+}
+
+void Http2Session::WriteFrameHeader(std::size_t length, std::uint8_t type, std::uint8_t flags, std::uint32_t stream_id) {
+  output_.push_back(static_cast<char>(length >> 16));
+  output_.push_back(static_cast<char>(length >> 8));
+  output_.push_back(static_cast<char>(length));
+  output_.push_back(static_cast<char>(type));
+  output_.push_back(static_cast<char>(flags));
+  AppendUint32(output_, stream_id);
+}
+
+void Http2Session::WriteHeaders(std::uint32_t stream_id, std::string_view block, bool end_stream) {
+  std::uint8_t type = kHeaders;
+  do {
+    const auto size = std::min(block.size(), kMaxFrameSize);
+    std::uint8_t flags = size == block.size() ? kEndHeaders : 0;
+    if (type == kHeaders && end_stream) {
+      flags |= kEndStream;
+    }
+    WriteFrameHeader(size, type, flags, stream_id);
+    output_.append(block.substr(0, size));
+    block.remove_prefix(size);
+    type = kContinuation;
+  } while (!block.empty());
+}
+
+void Http2Session::WriteData(Stream& stream, std::string_view data, bool end_stream) {
+  WriteFrameHeader(data.size(), kData, end_stream ? kEndStream : 0, stream.id);
+  output_.append(data);
+  send_window_ -= static_cast<std::int64_t>(data.size());
+  stream.send_window -= static_cast<std::int64_t>(data.size());
+  stream.finished = end_stream;
+}
+
+void Http2Session::WriteSettings() {
+  std::string settings;
+  AppendSetting(settings, kMaxConcurrentStreamsSetting, kMaxConcurrentStreams);
+  AppendSetting(settings, kInitialWindowSize, kStreamWindow);
+  AppendSetting(settings, kEnablePush, 0);
+  AppendSetting(settings, kMaxHeaderListSizeSetting, kMaxHeaderListSize);
+  WriteFrameHeader(settings.size(), kSettings, 0, 0);
+  output_.append(settings);
+  // The connection window can only be raised by WINDOW_UPDATE.
+  WriteWindowUpdate(0, kConnectionWindow - kDefaultWindow);
+}
+
+void Http2Session::WriteWindowUpdate(std::uint32_t stream_id, std::uint32_t increment) {
+  WriteFrameHeader(4, kWindowUpdate, 0, stream_id);
+  AppendUint32(output_, increment);
+}
+
+void Http2Session::WriteRstStream(std::uint32_t stream_id, std::uint32_t error_code) {
+  WriteFrameHeader(4, kRstStream, 0, stream_id);
+  AppendUint32(output_, error_code);
+}
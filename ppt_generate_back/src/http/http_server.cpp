@@ -1,70 +1,467 @@
 #include "http/http_server.h"
 
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <array>
 #include <cerrno>
+#include <charconv>
+#include <chrono>
 #include <cstring>
-#include <sstream>
+#include <deque>
+#include <optional>
 #include <stdexcept>
+#include <unordered_map>
+#include <vector>
 
 #include <nlohmann/json.hpp>
 
+#include "http/content_encoding.h"
+#include "http/request_parser.h"
 #include "logger.h"
+#include "utils/metrics.h"
+#include "utils/request_arena.h"
 #include "utils/string_utils.h"
+#include "utils/unique_fd.h"
 
 namespace {
 constexpr std::size_t kMaxRequestSize = 1 * 1024 * 1024;  // 1 MB
+// Stop pulling from the socket once this much unparsed input is buffered.
+constexpr std::size_t kMaxBufferedInput = 2 * kMaxRequestSize;
+constexpr std::size_t kReadChunkSize = 16 * 1024;
+constexpr std::uint32_t kConnectionEvents = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+// Pipelined requests stop being dispatched while this many responses are unsent.
+constexpr std::size_t kMaxQueuedResponses = 4;
+constexpr std::size_t kMaxSendfileChunk = 1 << 20;
+// Largest TLS record payload; smaller responses are sent as one record.
+constexpr std::size_t kTlsRecordSize = 16 * 1024;
+constexpr std::int64_t kMaxRetryAfterSeconds = 30;
+// A streaming producer blocks once this much of its output is unsent.
+constexpr std::size_t kStreamHighWater = 256 * 1024;
+const std::string kContinueResponse = "HTTP/1.1 100 Continue\r\n\r\n";
+// Head buffers kept per connection for reuse; matches the outbox bound.
+constexpr std::size_t kMaxSpareHeadBuffers = kMaxQueuedResponses;
+constexpr std::string_view kCorsHeaders =
+    "access-control-allow-origin: *\r\n"
+    "access-control-allow-headers: Content-Type, Authorization, ngrok-skip-browser-warning\r\n"
+    "access-control-allow-methods: GET, POST, DELETE, OPTIONS, HEAD\r\n";
+constexpr std::string_view kCloseHeader = "connection: close\r\n";
+constexpr auto kDrainPollInterval = std::chrono::milliseconds(100);
+constexpr auto kDrainReportInterval = std::chrono::seconds(1);
+// One RateLimiter shard is swept per interval.
+constexpr auto kRateLimitSweepInterval = std::chrono::milliseconds(1000);
+
+void AppendNumber(std::string& out, std::uint64_t value) {
+  std::array<char, 24> digits{};
+  const auto result = std::to_chars(digits.data(), digits.data() + digits.size(), value);
+  out.append(digits.data(), static_cast<std::size_t>(result.ptr - digits.data()));
 }
 
-HttpServer::HttpServer(const ServerConfig& config, Router& router)
-    : config_(config), router_(router) {}
+void AppendHeader(std::string& out, std::string_view name, std::string_view value) {
+  out.append(name);
+  out.append(": ");
+  out.append(value);
+  out.append("\r\n");
+}
 
-HttpServer::~HttpServer() { Stop(); }
+// kCorsHeaders as HTTP/2 header fields, viewing into the same literal.
+const Http2Session::HeaderFields& CorsFields() {
+  static const auto fields = [] {
+    Http2Session::HeaderFields parsed;
+    std::string_view rest = kCorsHeaders;
+    while (!rest.empty()) {
+      const auto line = rest.substr(0, rest.find("\r\n"));
+      rest.remove_prefix(line.size() + 2);
+      const auto colon = line.find(':');
+      parsed.emplace_back(line.substr(0, colon), string_utils::TrimView(line.substr(colon + 1)));
+    }
+    return parsed;
+  }();
+  return fields;
+}
 
-void HttpServer::Start() {
-  if (running_.load()) {
+// One arena per worker: each task runs a single request, so this is a
+// per-request arena whose memory is bounded by the thread count rather than
+// by open connections or streams.
+RequestArena& WorkerArena() {
+  static thread_local RequestArena arena;
+  return arena;
+}
+
+HttpResponse ErrorResponse(int status, const std::string& message) {
+  return HttpResponse::Json(status, {{"message", message}});
+}
+
+// Case-insensitive search for |token| in a comma-separated header value.
+bool HeaderHasToken(std::string_view value, std::string_view token) {
+  std::size_t start = 0;
+  while (start <= value.size()) {
+    auto end = value.find(',', start);
+    if (end == std::string_view::npos) {
+      end = value.size();
+    }
+    if (string_utils::EqualsIgnoreCase(string_utils::TrimView(value.substr(start, end - start)), token)) {
+      return true;
+    }
+    start = end + 1;
+  }
+  return false;
+}
+
+// Status-code counters are created on first use and cached, so counting a
+// response is a relaxed load plus an atomic increment.
+void CountStatus(int status_code) {
+  static std::array<std::atomic<metrics::Counter*>, 600> counters{};
+  if (status_code < 100 || status_code >= static_cast<int>(counters.size())) {
     return;
   }
+  auto& slot = counters[static_cast<std::size_t>(status_code)];
+  auto* counter = slot.load(std::memory_order_acquire);
+  if (!counter) {
+    counter = &metrics::Registry::Instance().GetCounter(
+        "http_responses_total", "Responses sent, by status code.",
+        metrics::FormatLabels({{"code", std::to_string(status_code)}}));
+    slot.store(counter, std::memory_order_release);
+  }
+  counter->Increment();
+}
 
-  thread_pool_ = std::make_unique<ThreadPool>(config_.thread_count);
+metrics::Gauge& OpenConnectionsGauge() {
+  static auto& gauge = metrics::Registry::Instance().GetGauge("http_open_connections", "Client connections currently open.");
+  return gauge;
+}
 
-  server_fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
-  if (server_fd_ < 0) {
-    throw std::runtime_error("Failed to create socket");
+metrics::Gauge& InFlightGauge() {
+  static auto& gauge = metrics::Registry::Instance().GetGauge(
+      "http_requests_in_flight", "Requests on the worker pool whose handler has not returned.");
+  return gauge;
+}
+
+metrics::Counter& TimeoutCounter(std::string_view phase) {
+  return metrics::Registry::Instance().GetCounter(
+      "http_connection_timeouts_total", "Connections closed because a deadline expired, by phase.",
+      metrics::FormatLabels({{"phase", phase}}));
+}
+
+metrics::Counter& ShedRequestsCounter() {
+  static auto& counter = metrics::Registry::Instance().GetCounter(
+      "http_requests_shed_total", "Requests refused with 503 by admission control.");
+  return counter;
+}
+
+HttpResponse ServerBusy(std::uint32_t retry_after_seconds) {
+  auto response = ErrorResponse(503, "Server is busy, please retry later");
+  response.headers.Set(HeaderId::kRetryAfter, std::to_string(retry_after_seconds));
+  return response;
+}
+
+HttpResponse TooManyRequests(std::uint32_t retry_after_seconds) {
+  auto response = ErrorResponse(429, "Too many requests, please retry later");
+  response.headers.Set(HeaderId::kRetryAfter, std::to_string(retry_after_seconds));
+  return response;
+}
+
+metrics::Counter& TlsHandshakeCounter(std::string_view resumed) {
+  return metrics::Registry::Instance().GetCounter(
+      "tls_handshakes_total", "Completed TLS handshakes, by whether a session was resumed.",
+      metrics::FormatLabels({{"resumed", resumed}}));
+}
+
+metrics::Counter& RateLimitedCounter(std::string_view key) {
+  return metrics::Registry::Instance().GetCounter(
+      "http_requests_rate_limited_total", "Requests refused with 429, by the bucket that was empty.",
+      metrics::FormatLabels({{"key", key}}));
+}
+
+bool HasCredentials(const HttpRequest& request) {
+  if (!request.HeaderView(HeaderId::kAuthorization).empty()) {
+    return true;
   }
+  const auto token = string_utils::FindQueryParam(request.query_string, "token");
+  return token && !token->empty();
+}
 
-  int opt = 1;
-  setsockopt(server_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+// Applies the route's RouteOptions; returns the response to send instead of running the handler.
+std::optional<HttpResponse> CheckRoute(const Router::Route* route, const HttpRequest& request, std::size_t body_size) {
+  if (!route) {
+    return std::nullopt;
+  }
+  if (route->options.body_limit > 0 && body_size > route->options.body_limit) {
+    return ErrorResponse(413, "Request body too large");
+  }
+  if (route->options.auth_required && !HasCredentials(request)) {
+    return ErrorResponse(401, "Token not provided");
+  }
+  return std::nullopt;
+}
+}  // namespace
+
+// Status line and headers followed by an in-memory body (owned, or shared
+// with a cache), a file range or a stream drained chunk by chunk.
+struct HttpServer::OutgoingResponse {
+  std::string head;
+  std::string body;
+  // When set, |shared_body| is sent instead of |body| and |body_owner| keeps it alive.
+  std::shared_ptr<const void> body_owner;
+  std::string_view shared_body;
+  std::optional<FileBody> file;
+  std::shared_ptr<BodyStream> stream;
+  // Framed data taken from |stream| that is not fully sent yet.
+  std::string chunk;
+  std::size_t head_sent = 0;
+  std::size_t body_sent = 0;
+  std::uint64_t file_sent = 0;
+  std::size_t chunk_sent = 0;
+  // Without chunked framing (HTTP/1.0) the body ends when the connection closes.
+  bool chunked = true;
+  bool stream_done = false;
+};
+
+// One SO_REUSEPORT listener with its own event loop. Connections never move
+// between shards, so each shard's connection map is touched by its loop thread only.
+struct HttpServer::Shard {
+  std::size_t index = 0;
+  UniqueFd listen_fd;
+  std::shared_ptr<EventLoop> loop;
+  std::thread thread;
+  std::unordered_map<int, std::shared_ptr<Connection>> connections;
+  std::atomic<std::uint64_t> accepted{0};
+  std::atomic<std::uint64_t> open_connections{0};
+  std::atomic<std::uint64_t> requests{0};
+};
+
+struct HttpServer::Connection {
+  int fd = -1;
+  Shard* shard = nullptr;
+  // Receive buffer; |request| views into it, so it is only appended to or
+  // trimmed while no request is on the worker pool.
+  std::string input;
+  HttpRequestParser parser{kMaxRequestSize};
+  HttpRequest request;
+  std::deque<OutgoingResponse> outbox;
+  // Cleared head strings from sent responses; reusing them keeps their capacity.
+  std::vector<std::string> spare_heads;
+  // |request| is currently on the worker pool.
+  bool busy = false;
+  // The socket became readable while |input| could not be touched.
+  bool read_pending = false;
+  bool continue_sent = false;
+  // RouteOptions were already checked against the headers of the pending request.
+  bool head_checked = false;
+  // The request on the worker pool may be answered with chunked encoding.
+  bool accepts_chunked = true;
+  // The peer shut down its sending side; no more requests will arrive.
+  bool read_closed = false;
+  bool close_after_write = false;
+  bool closed = false;
+  std::uint32_t requests_served = 0;
+  // IPv4 address of the peer, in network byte order.
+  in_addr_t peer_address = 0;
+  // Set on TLS listeners; all reads and writes then go through it.
+  std::unique_ptr<TlsSession> tls;
+  // Set once the client chose HTTP/2; the fields above that track a single
+  // request (parser, request, outbox, busy) are then unused.
+  std::unique_ptr<Http2Session> h2;
+  // The running deadline, if any; see HttpServer::UpdateDeadline().
+  Deadline deadline = Deadline::kNone;
+  EventLoop::TimerId deadline_timer = 0;
+};
+
+HttpServer::HttpServer(const ServerConfig& config, Router& router)
+    : config_(config),
+      router_(router),
+      keep_alive_headers_("connection: keep-alive\r\nkeep-alive: timeout=" +
+                          std::to_string(config_.keep_alive_timeout_seconds) + "\r\n") {
+  if (!config_.static_root.empty()) {
+    static_files_ = std::make_unique<StaticFiles>(config_.static_root);
+  }
+  rate_limiter_ = std::make_unique<RateLimiter>(config_.rate_limit_buckets);
+  if (config_.tls_enabled()) {
+    tls_ = std::make_unique<TlsContext>(config_.tls_certificate,
+                                        config_.tls_private_key,
+                                        config_.tls_kernel_offload,
+                                        config_.http2);
+    Logger::Info("TLS enabled with certificate " + config_.tls_certificate);
+  }
+}
+
+HttpServer::~HttpServer() { Stop(); }
+
+void HttpServer::Start(std::vector<UniqueFd> inherited) {
+  if (running_.load()) {
+    return;
+  }
 
   sockaddr_in address{};
   address.sin_family = AF_INET;
   address.sin_port = htons(config_.port);
   if (config_.host == "0.0.0.0" || config_.host == "*") {
     address.sin_addr.s_addr = INADDR_ANY;
+  } else if (::inet_pton(AF_INET, config_.host.c_str(), &address.sin_addr) <= 0) {
+    throw std::runtime_error("Invalid host address: " + config_.host);
+  }
+
+  std::size_t shard_count = config_.listener_shards;
+  if (shard_count == 0) {
+    shard_count = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  for (const auto& fd : inherited) {
+    sockaddr_in bound{};
+    socklen_t bound_len = sizeof(bound);
+    if (::getsockname(fd.Get(), reinterpret_cast<sockaddr*>(&bound), &bound_len) < 0 || bound.sin_family != AF_INET ||
+        bound.sin_port != address.sin_port) {
+      Logger::Warn("Inherited listeners do not match port " + std::to_string(config_.port) + "; binding new ones");
+      inherited.clear();
+      break;
+    }
+  }
+
+  std::vector<std::unique_ptr<Shard>> shards;
+  if (!inherited.empty()) {
+    // The previous process's sockets keep their queues, so nothing queued
+    // during the restart is refused.
+    for (auto& fd : inherited) {
+      auto shard = std::make_unique<Shard>();
+      shard->index = shards.size();
+      shard->listen_fd = std::move(fd);
+      shards.push_back(std::move(shard));
+    }
   } else {
-    if (::inet_pton(AF_INET, config_.host.c_str(), &address.sin_addr) <= 0) {
-      ::close(server_fd_);
-      throw std::runtime_error("Invalid host address: " + config_.host);
+    for (std::size_t index = 0; index < shard_count; ++index) {
+      auto shard = std::make_unique<Shard>();
+      shard->index = index;
+      // Every shard binds its own socket; with SO_REUSEPORT the kernel hashes
+      // incoming connections across them.
+      shard->listen_fd.Reset(OpenListener(address, shard_count > 1));
+      shards.push_back(std::move(shard));
+    }
+  }
+
+  router_.ApplyRateLimits(config_.rate_limits);
+  thread_pool_ = std::make_unique<ThreadPool>(config_.thread_count, config_.worker_queue_limit, "http");
+  shards_ = std::move(shards);
+  const auto cpu_count = std::max(1u, std::thread::hardware_concurrency());
+  for (auto& shard_ptr : shards_) {
+    Shard& shard = *shard_ptr;
+    shard.loop = std::make_shared<EventLoop>();
+    shard.loop->Add(shard.listen_fd.Get(), EPOLLIN, [this, &shard](std::uint32_t) { OnAcceptable(shard); });
+  }
+  ScheduleRateLimitSweep(*shards_.front());
+
+  accepting_shards_.store(shards_.size());
+  running_.store(true);
+  for (auto& shard_ptr : shards_) {
+    Shard& shard = *shard_ptr;
+    shard.thread = std::thread([&shard]() { shard.loop->Run(); });
+    if (config_.pin_shards) {
+      cpu_set_t cpus;
+      CPU_ZERO(&cpus);
+      CPU_SET(shard.index % cpu_count, &cpus);
+      if (const int rc = pthread_setaffinity_np(shard.thread.native_handle(), sizeof(cpus), &cpus); rc != 0) {
+        Logger::Warn("Failed to pin listener shard " + std::to_string(shard.index) + ": " + strerror(rc));
+      }
     }
   }
+  Logger::Info(std::string(tls_ ? "HTTPS" : "HTTP") + " server listening on " + config_.host + ":" + std::to_string(config_.port) + " with " +
+               std::to_string(shards_.size()) + " listener shard(s)");
+}
 
-  if (::bind(server_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
-    ::close(server_fd_);
+int HttpServer::OpenListener(const sockaddr_in& address, bool reuse_port) {
+  UniqueFd fd(::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+  if (!fd) {
+    throw std::runtime_error("Failed to create socket");
+  }
+
+  int opt = 1;
+  setsockopt(fd.Get(), SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+  if (reuse_port && setsockopt(fd.Get(), SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+    throw std::runtime_error("Failed to enable SO_REUSEPORT: " + std::string(strerror(errno)));
+  }
+
+  if (::bind(fd.Get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
     throw std::runtime_error("Failed to bind socket: " + std::string(strerror(errno)));
   }
 
-  if (::listen(server_fd_, SOMAXCONN) < 0) {
-    ::close(server_fd_);
+  if (::listen(fd.Get(), SOMAXCONN) < 0) {
     throw std::runtime_error("Failed to listen on socket");
   }
+  return fd.Release();
+}
 
-  running_.store(true);
-  accept_thread_ = std::thread(&HttpServer::AcceptLoop, this);
-  Logger::Info("HTTP server listening on " + config_.host + ":" + std::to_string(config_.port));
+void HttpServer::StopAccepting() {
+  if (!running_.load() || draining_.exchange(true)) {
+    return;
+  }
+  for (auto& shard_ptr : shards_) {
+    Shard& shard = *shard_ptr;
+    shard.loop->Post([this, &shard]() {
+      // Connections that finished their handshake are already ours; serve
+      // them rather than resetting them with the listener.
+      OnAcceptable(shard);
+      shard.loop->Remove(shard.listen_fd.Get());
+      shard.listen_fd.Reset();
+      accepting_shards_.fetch_sub(1);
+
+      std::vector<std::shared_ptr<Connection>> idle;
+      std::vector<std::shared_ptr<Connection>> http2;
+      for (const auto& [fd, connection] : shard.connections) {
+        if (connection->h2) {
+          http2.push_back(connection);
+        } else if (connection->requests_served > 0 && !connection->busy && connection->outbox.empty() &&
+                   connection->input.empty()) {
+          idle.push_back(connection);
+        }
+      }
+      for (const auto& connection : idle) {
+        CloseConnection(connection);
+      }
+      // Sends GOAWAY, and closes those with no stream open.
+      for (const auto& connection : http2) {
+        FlushConnection(connection);
+      }
+    });
+  }
+  Logger::Info("HTTP server stopped accepting connections");
+}
+
+bool HttpServer::Drain(std::chrono::steady_clock::time_point deadline) {
+  StopAccepting();
+  auto next_report = std::chrono::steady_clock::now();
+  while (true) {
+    const auto in_flight = in_flight_.load();
+    std::uint64_t open = 0;
+    for (const auto& shard : shards_) {
+      open += shard->open_connections.load(std::memory_order_relaxed);
+    }
+    if (in_flight == 0 && open == 0 && accepting_shards_.load() == 0) {
+      Logger::Info("HTTP drain complete");
+      return true;
+    }
+    const auto progress = std::to_string(in_flight) + " request(s) in flight, " + std::to_string(open) +
+                          " connection(s) open";
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= deadline) {
+      Logger::Warn("HTTP drain deadline passed with " + progress);
+      return false;
+    }
+    if (now >= next_report) {
+      const auto left = std::chrono::ceil<std::chrono::seconds>(deadline - now).count();
+      Logger::Info("Draining HTTP: " + progress + ", " + std::to_string(left) + "s left");
+      next_report = now + kDrainReportInterval;
+    }
+    std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(kDrainPollInterval, deadline - now));
+  }
 }
 
 void HttpServer::Stop() {
@@ -72,194 +469,1121 @@ void HttpServer::Stop() {
     return;
   }
   running_.store(false);
-  if (server_fd_ >= 0) {
-    ::shutdown(server_fd_, SHUT_RDWR);
-    ::close(server_fd_);
-    server_fd_ = -1;
+  draining_.store(false);
+  for (auto& shard : shards_) {
+    shard->loop->Stop();
+  }
+  for (auto& shard : shards_) {
+    if (shard->thread.joinable()) {
+      shard->thread.join();
+    }
   }
-  if (accept_thread_.joinable()) {
-    accept_thread_.join();
+  // Release streaming producers still waiting for their client to drain them.
+  for (auto& shard : shards_) {
+    for (auto& [fd, connection] : shard->connections) {
+      for (auto& outgoing : connection->outbox) {
+        if (outgoing.stream) {
+          outgoing.stream->Cancel();
+        }
+      }
+      if (connection->h2) {
+        connection->h2->CancelStreams();
+      }
+    }
   }
+  // Finishes queued requests; their responses are posted to the stopped loops and dropped.
   thread_pool_.reset();
+
+  for (auto& shard : shards_) {
+    for (auto& [fd, connection] : shard->connections) {
+      connection->closed = true;
+      ::close(fd);
+    }
+    OpenConnectionsGauge().Add(-static_cast<std::int64_t>(shard->connections.size()));
+    shard->connections.clear();
+  }
+  shards_.clear();
+}
+
+bool HttpServer::ReloadTls() {
+  if (!tls_) {
+    Logger::Warn("TLS reload requested, but no certificate is configured");
+    return false;
+  }
+  std::string error;
+  if (!tls_->Reload(error)) {
+    Logger::Error(error + "; keeping the current certificate");
+    return false;
+  }
+  Logger::Info("Reloaded TLS certificate " + config_.tls_certificate);
+  return true;
 }
 
-void HttpServer::AcceptLoop() {
-  while (running_.load()) {
+std::vector<int> HttpServer::ListenerFds() const {
+  std::vector<int> fds;
+  if (!running_.load() || draining_.load()) {
+    return fds;
+  }
+  fds.reserve(shards_.size());
+  for (const auto& shard : shards_) {
+    fds.push_back(shard->listen_fd.Get());
+  }
+  return fds;
+}
+
+std::vector<HttpServer::ShardStats> HttpServer::GetShardStats() const {
+  std::vector<ShardStats> stats;
+  stats.reserve(shards_.size());
+  for (const auto& shard : shards_) {
+    stats.push_back(ShardStats{shard->index,
+                               shard->accepted.load(std::memory_order_relaxed),
+                               shard->open_connections.load(std::memory_order_relaxed),
+                               shard->requests.load(std::memory_order_relaxed)});
+  }
+  return stats;
+}
+
+void HttpServer::OnAcceptable(Shard& shard) {
+  while (true) {
     sockaddr_in client_addr{};
     socklen_t client_len = sizeof(client_addr);
-    int client_fd = ::accept(server_fd_, reinterpret_cast<sockaddr*>(&client_addr), &client_len);
+    const int client_fd = ::accept4(shard.listen_fd.Get(),
+                                    reinterpret_cast<sockaddr*>(&client_addr),
+                                    &client_len,
+                                    SOCK_NONBLOCK | SOCK_CLOEXEC);
     if (client_fd < 0) {
       if (errno == EINTR) {
         continue;
       }
-      if (!running_.load()) {
-        break;
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        Logger::Warn("Failed to accept connection: " + std::string(strerror(errno)));
       }
-      Logger::Warn("Failed to accept connection: " + std::string(strerror(errno)));
-      continue;
+      return;
     }
 
-    thread_pool_->EnqueueDetached([this, client_fd]() { HandleClient(client_fd); });
+    int nodelay = 1;
+    setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    auto connection = std::make_shared<Connection>();
+    if (tls_) {
+      connection->tls = tls_->Accept(client_fd);
+      if (!connection->tls) {
+        Logger::Warn("Failed to set up TLS for a connection: " + TlsSession::LastError());
+        ::close(client_fd);
+        continue;
+      }
+    }
+    connection->fd = client_fd;
+    connection->shard = &shard;
+    connection->peer_address = client_addr.sin_addr.s_addr;
+    shard.connections[client_fd] = connection;
+    shard.accepted.fetch_add(1, std::memory_order_relaxed);
+    shard.open_connections.fetch_add(1, std::memory_order_relaxed);
+    OpenConnectionsGauge().Add(1);
+    shard.loop->Add(client_fd, kConnectionEvents, [this, &shard, client_fd](std::uint32_t events) {
+      OnConnectionEvent(shard, client_fd, events);
+    });
+    UpdateDeadline(connection, false);
   }
 }
 
-void HttpServer::HandleClient(int client_fd) {
-  HttpRequest request;
-  if (!ParseRequest(client_fd, request)) {
-    HttpResponse response;
-    response.status_code = 400;
-    response.status_message = "Bad Request";
-    response.body = nlohmann::json{{"message", "Invalid HTTP request"}}.dump();
-    SendResponse(client_fd, response);
-    ::close(client_fd);
+void HttpServer::OnConnectionEvent(Shard& shard, int fd, std::uint32_t events) {
+  auto it = shard.connections.find(fd);
+  if (it == shard.connections.end()) {
     return;
   }
+  auto connection = it->second;
 
-  HttpResponse response;
-  try {
-    response = router_.Handle(request);
-  } catch (const std::exception& ex) {
-    Logger::Error(std::string("Unhandled exception while processing request: ") + ex.what());
-    response.status_code = 500;
-    response.status_message = "Internal Server Error";
-    response.body = nlohmann::json{{"message", "Internal server error"}}.dump();
+  if (connection->tls && !connection->tls->established()) {
+    if (!ContinueHandshake(connection)) {
+      return;
+    }
+    if (connection->tls->alpn() == "h2") {
+      connection->h2 = std::make_unique<Http2Session>(kMaxRequestSize, CorsFields());
+    }
+    // The first request may have arrived with the end of the handshake.
+    events |= EPOLLIN;
   }
+  if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+    ReadFromConnection(connection);
+  }
+  if (!connection->closed && (events & EPOLLOUT)) {
+    FlushConnection(connection);
+  }
+  // Edge-triggered EPOLLOUT means the peer drained some of the send buffer,
+  // so a blocked write is making progress.
+  UpdateDeadline(connection, (events & EPOLLOUT) != 0);
+}
 
-  SendResponse(client_fd, response);
-  ::close(client_fd);
+bool HttpServer::ContinueHandshake(const std::shared_ptr<Connection>& connection) {
+  auto& tls = *connection->tls;
+  switch (tls.Handshake()) {
+    case TlsSession::Status::kOk: {
+      static auto& full = TlsHandshakeCounter("false");
+      static auto& resumed = TlsHandshakeCounter("true");
+      (tls.resumed() ? resumed : full).Increment();
+      if (tls.kernel_send()) {
+        static auto& kernel = metrics::Registry::Instance().GetCounter(
+            "tls_kernel_offload_total", "TLS connections whose records the kernel encrypts (kTLS).");
+        kernel.Increment();
+      }
+      return true;
+    }
+    case TlsSession::Status::kWantRead:
+    case TlsSession::Status::kWantWrite:
+      // Still bounded by the header deadline set at accept.
+      return false;
+    case TlsSession::Status::kClosed:
+    case TlsSession::Status::kError:
+      break;
+  }
+  static auto& failures = metrics::Registry::Instance().GetCounter(
+      "tls_handshake_failures_total", "TLS handshakes that failed or were abandoned by the client.");
+  failures.Increment();
+  CloseConnection(connection);
+  return false;
 }
 
-bool HttpServer::ParseRequest(int client_fd, HttpRequest& request) {
-  std::string raw_data;
-  raw_data.reserve(4096);
-  std::array<char, 4096> buffer{};
-  ssize_t bytes_read = 0;
-  std::size_t header_end = std::string::npos;
-  std::size_t content_length = 0;
+void HttpServer::ReadFromConnection(const std::shared_ptr<Connection>& connection) {
+  // Its fd may already belong to a newly accepted connection.
+  if (connection->closed) {
+    return;
+  }
+  if (connection->busy) {
+    connection->read_pending = true;
+    return;
+  }
+  connection->read_pending = false;
 
-  while (true) {
-    bytes_read = ::recv(client_fd, buffer.data(), buffer.size(), 0);
-    if (bytes_read < 0) {
-      if (errno == EINTR) {
+  std::array<char, kReadChunkSize> buffer{};
+  while (!connection->read_closed) {
+    if (connection->input.size() >= kMaxBufferedInput) {
+      connection->read_pending = true;
+      break;
+    }
+    if (connection->tls) {
+      std::size_t bytes_read = 0;
+      const auto status = connection->tls->Read(buffer.data(), buffer.size(), bytes_read);
+      if (status == TlsSession::Status::kOk) {
+        connection->input.append(buffer.data(), bytes_read);
         continue;
       }
-      return false;
+      if (status == TlsSession::Status::kClosed) {
+        connection->read_closed = true;
+        break;
+      }
+      if (status == TlsSession::Status::kWantRead || status == TlsSession::Status::kWantWrite) {
+        break;
+      }
+      CloseConnection(connection);
+      return;
+    }
+    const ssize_t bytes_read = ::recv(connection->fd, buffer.data(), buffer.size(), 0);
+    if (bytes_read > 0) {
+      connection->input.append(buffer.data(), static_cast<std::size_t>(bytes_read));
+      continue;
     }
     if (bytes_read == 0) {
+      connection->read_closed = true;
+      break;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
       break;
     }
+    CloseConnection(connection);
+    return;
+  }
 
-    raw_data.append(buffer.data(), bytes_read);
+  ProcessInput(connection);
+}
 
-    if (raw_data.size() > kMaxRequestSize) {
-      return false;
+void HttpServer::ProcessInput(const std::shared_ptr<Connection>& connection) {
+  if (connection->closed) {
+    return;
+  }
+  if (connection->h2) {
+    ProcessHttp2Input(connection);
+    return;
+  }
+  if (config_.http2 && !connection->tls && connection->requests_served == 0) {
+    // No HTTP/1.1 request line looks like the HTTP/2 preface, so a client
+    // with prior knowledge is recognised by its first bytes.
+    const auto prefix = std::string_view(connection->input).substr(0, Http2Session::kPreface.size());
+    if (!prefix.empty() && Http2Session::kPreface.substr(0, prefix.size()) == prefix) {
+      if (prefix.size() == Http2Session::kPreface.size()) {
+        connection->h2 = std::make_unique<Http2Session>(kMaxRequestSize, CorsFields());
+        ProcessHttp2Input(connection);
+      } else if (connection->read_closed) {
+        CloseConnection(connection);
+      }
+      return;
     }
+  }
+  // Requests answered without the worker pool are handled inline, so keep
+  // going until one is dispatched or the buffer runs dry.
+  while (!connection->closed && !connection->busy && !connection->close_after_write &&
+         connection->outbox.size() < kMaxQueuedResponses) {
+    auto& parser = connection->parser;
+    const auto status = parser.Parse(connection->input, connection->request);
+    if (status == HttpRequestParser::Status::kComplete) {
+      if (Dispatch(connection)) {
+        return;
+      }
+      continue;
+    }
+    if (status == HttpRequestParser::Status::kError) {
+      connection->read_closed = true;
+      QueueResponse(connection,
+                    SerializeResponse(*connection, ErrorResponse(parser.error_status(), "Invalid HTTP request"), false, false),
+                    false);
+      return;
+    }
+    if (parser.HeadersComplete() && !connection->head_checked) {
+      // Vet the route before waiting for (or inviting, via 100-continue) the body.
+      connection->head_checked = true;
+      auto& request = connection->request;
+      parser.PeekHead(connection->input, request);
+      const auto* route = router_.Match(request.method, request.path, request.path_params);
+      auto rejection = CheckRoute(route, request, parser.content_length());
+      if (!rejection) {
+        rejection = CheckRateLimit(*connection, route, request);
+      }
+      if (rejection) {
+        // The body is never read, so the connection cannot carry another request.
+        connection->read_closed = true;
+        QueueResponse(connection, SerializeResponse(*connection, std::move(*rejection), false, false), false);
+        return;
+      }
+      request.Clear();
+    }
+    if (parser.ExpectsContinue() && !connection->continue_sent) {
+      connection->continue_sent = true;
+      OutgoingResponse interim;
+      interim.head = kContinueResponse;
+      QueueResponse(connection, std::move(interim), true);
+    }
+    if (connection->read_closed && connection->outbox.empty()) {
+      // Peer went away mid-request, or after its last response was flushed.
+      CloseConnection(connection);
+    }
+    return;
+  }
+}
 
-    if (header_end == std::string::npos) {
-      static const std::string delimiter = "\r\n\r\n";
-      header_end = raw_data.find(delimiter);
-      if (header_end != std::string::npos) {
-        const auto header_section = raw_data.substr(0, header_end);
-        std::istringstream header_stream(header_section);
-        std::string request_line;
-        if (!std::getline(header_stream, request_line)) {
-          return false;
-        }
-        if (!request_line.empty() && request_line.back() == '\r') {
-          request_line.pop_back();
-        }
-
-        std::istringstream request_line_stream(request_line);
-        request_line_stream >> request.method >> request.target;
-        std::string http_version;
-        request_line_stream >> http_version;
-        if (request.method.empty() || request.target.empty()) {
-          return false;
-        }
-        request.path = request.target;
+template <typename Deliver>
+void HttpServer::RunRequest(const Router::Route* route, HttpRequest& request, Deliver&& deliver) {
+  // Reset only after everything below (stream producer included) is gone.
+  auto& arena = WorkerArena();
+  struct ArenaReset {
+    RequestArena& arena;
+    ~ArenaReset() { arena.Reset(); }
+  } arena_reset{arena};
+  HttpResponse response;
+  try {
+    // The producer runs outside the scope, so a long stream does not grow the arena.
+    RequestArena::Scope scope(arena);
+    request.arena = arena.resource();
+    response = router_.Invoke(route, request);
+    if (route && route->options.compress_min_size > 0) {
+      content_encoding::EncodeResponse(request.HeaderView(HeaderId::kAcceptEncoding),
+                                       route->options.compress_min_size,
+                                       route->options.compress_level,
+                                       response);
+    }
+  } catch (const std::exception& ex) {
+    Logger::Error(std::string("Unhandled exception while processing request: ") + ex.what());
+    response = ErrorResponse(500, "Internal server error");
+  }
+  auto producer = std::move(response.stream_producer);
+  if (producer && !response.stream) {
+    response.stream = std::make_shared<BodyStream>(kStreamHighWater,
+                                                   std::chrono::seconds(config_.write_timeout_seconds));
+  }
+  auto stream = response.stream;
+  deliver(std::move(response));
+  if (producer) {
+    try {
+      producer(*stream);
+      stream->Close();
+    } catch (const std::exception& ex) {
+      Logger::Error(std::string("Streaming response failed: ") + ex.what());
+      stream->Abort();
+    }
+  }
+  in_flight_.fetch_sub(1);
+  InFlightGauge().Add(-1);
+}
 
-        const auto query_sep = request.target.find('?');
-        if (query_sep != std::string::npos) {
-          request.path = request.target.substr(0, query_sep);
-          const auto query_string = request.target.substr(query_sep + 1);
-          request.query_params = string_utils::ParseQuery(query_string);
-        }
+bool HttpServer::Dispatch(const std::shared_ptr<Connection>& connection) {
+  auto& request = connection->request;
+  ++connection->requests_served;
+  connection->shard->requests.fetch_add(1, std::memory_order_relaxed);
+  const bool keep_alive = WantsKeepAlive(*connection, request);
+  const bool head_request = ParseHttpMethod(request.method) == HttpMethod::kHead;
+  connection->accepts_chunked = request.version != "HTTP/1.0";
+  const auto* route = router_.Match(request.method, request.path, request.path_params);
+  if (!route && static_files_) {
+    // Cache hits are a map lookup, so they skip the worker pool entirely.
+    if (auto response = static_files_->Serve(request)) {
+      FinishRequest(connection,
+                    SerializeResponse(*connection, std::move(*response), keep_alive, head_request),
+                    keep_alive);
+      return false;
+    }
+  }
+  auto rejection = CheckRoute(route, request, request.body.size());
+  // A request vetted at its headers has already spent its tokens.
+  if (!rejection && !connection->head_checked) {
+    rejection = CheckRateLimit(*connection, route, request);
+  }
+  if (rejection) {
+    FinishRequest(connection,
+                  SerializeResponse(*connection, std::move(*rejection), keep_alive, head_request),
+                  keep_alive);
+    return false;
+  }
 
-        std::string header_line;
-        while (std::getline(header_stream, header_line)) {
-          if (!header_line.empty() && header_line.back() == '\r') {
-            header_line.pop_back();
+  auto deliver = [this, connection, keep_alive, head_request](HttpResponse response) {
+    // Serialized on the loop thread, which owns the connection's head buffers.
+    connection->shard->loop->Post(
+        [this, connection, keep_alive, head_request, response = std::move(response)]() mutable {
+          // Closed while the handler ran (write error, deadline, shutdown):
+          // release a stream producer instead of letting it stall.
+          if (connection->closed) {
+            if (response.stream) {
+              response.stream->Cancel();
+            }
+            return;
           }
-          if (header_line.empty()) {
-            break;
+          connection->busy = false;
+          // Without chunked framing only closing the connection can end a stream.
+          // A drain that began while the handler ran turns keep-alive off too.
+          const bool keep = keep_alive && (!response.stream || connection->accepts_chunked) && !draining_.load();
+          auto outgoing = SerializeResponse(*connection, std::move(response), keep, head_request);
+          if (outgoing.stream) {
+            WatchStream(connection, *outgoing.stream);
           }
-          const auto colon_pos = header_line.find(':');
-          if (colon_pos == std::string::npos) {
-            continue;
+          FinishRequest(connection, std::move(outgoing), keep);
+          if (connection->read_pending) {
+            ReadFromConnection(connection);
+          } else {
+            // Serve the next pipelined request, if one is already buffered.
+            ProcessInput(connection);
           }
-          const auto key = string_utils::ToLower(string_utils::Trim(header_line.substr(0, colon_pos)));
-          const auto value = string_utils::Trim(header_line.substr(colon_pos + 1));
-          request.headers[key] = value;
+          UpdateDeadline(connection, false);
+        });
+  };
+  std::uint32_t retry_after = 0;
+  if (!StartRequest(route, request, std::move(deliver), retry_after)) {
+    FinishRequest(connection,
+                  SerializeResponse(*connection, ServerBusy(retry_after), keep_alive, head_request),
+                  keep_alive);
+    return false;
+  }
+  connection->busy = true;
+  return true;
+}
+
+void HttpServer::ProcessHttp2Input(const std::shared_ptr<Connection>& connection) {
+  auto& session = *connection->h2;
+  std::vector<std::shared_ptr<Http2Session::Request>> requests;
+  if (!connection->input.empty()) {
+    if (!session.Receive(connection->input, requests)) {
+      // Only the GOAWAY saying why is still sent.
+      connection->close_after_write = true;
+    }
+    connection->input.clear();
+  }
+  for (auto& request : requests) {
+    DispatchStream(connection, std::move(request));
+  }
+  FlushConnection(connection);
+}
+
+void HttpServer::DispatchStream(const std::shared_ptr<Connection>& connection,
+                                std::shared_ptr<Http2Session::Request> request) {
+  ++connection->requests_served;
+  connection->shard->requests.fetch_add(1, std::memory_order_relaxed);
+  if (connection->requests_served >= config_.keep_alive_max_requests) {
+    // The HTTP/2 equivalent of ending keep-alive: this stream is the last.
+    connection->h2->GoAway();
+  }
+  const auto stream_id = request->stream_id;
+  auto& http = request->request;
+  const auto* route = router_.Match(http.method, http.path, http.path_params);
+  if (!route && static_files_) {
+    if (auto response = static_files_->Serve(http)) {
+      RespondToStream(connection, stream_id, std::move(*response));
+      return;
+    }
+  }
+  auto rejection = CheckRoute(route, http, http.body.size());
+  if (!rejection) {
+    rejection = CheckRateLimit(*connection, route, http);
+  }
+  if (rejection) {
+    RespondToStream(connection, stream_id, std::move(*rejection));
+    return;
+  }
+
+  // Streams of one connection run concurrently, each with its own request.
+  // Holds on to |request| until the handler is done with it.
+  auto deliver = [this, connection, stream_id, request = std::move(request)](HttpResponse response) {
+    connection->shard->loop->Post([this, connection, stream_id, response = std::move(response)]() mutable {
+      if (connection->closed) {
+        if (response.stream) {
+          response.stream->Cancel();
         }
+        return;
+      }
+      RespondToStream(connection, stream_id, std::move(response));
+      FlushConnection(connection);
+      UpdateDeadline(connection, false);
+    });
+  };
+  std::uint32_t retry_after = 0;
+  if (!StartRequest(route, http, std::move(deliver), retry_after)) {
+    RespondToStream(connection, stream_id, ServerBusy(retry_after));
+  }
+}
 
-        const auto content_length_it = request.headers.find("content-length");
-        if (content_length_it != request.headers.end()) {
-          content_length = static_cast<std::size_t>(std::stoul(content_length_it->second));
-          if (content_length > kMaxRequestSize) {
-            return false;
-          }
+void HttpServer::RespondToStream(const std::shared_ptr<Connection>& connection,
+                                 std::uint32_t stream_id,
+                                 HttpResponse response) {
+  CountStatus(response.status_code);
+  auto stream = response.stream;
+  connection->h2->Respond(stream_id, std::move(response));
+  if (stream) {
+    WatchStream(connection, *stream);
+  }
+}
+
+bool HttpServer::StartRequest(const Router::Route* route,
+                              HttpRequest& request,
+                              std::function<void(HttpResponse)> deliver,
+                              std::uint32_t& retry_after_seconds) {
+#if PPT_HAVE_COROUTINES
+  if (route && route->async_handler) {
+    // No worker is taken, but an overloaded server still sheds by priority.
+    std::size_t depth_limit = 0;
+    if (!Admit(route->options.priority, depth_limit, retry_after_seconds)) {
+      ShedRequestsCounter().Increment();
+      return false;
+    }
+    in_flight_.fetch_add(1);
+    InFlightGauge().Add(1);
+    Spawn(RunAsync(route, request, std::move(deliver)));
+    return true;
+  }
+#endif
+  return Submit(route,
+                [this, route, &request, deliver = std::move(deliver)]() { RunRequest(route, request, deliver); },
+                retry_after_seconds);
+}
+
+#if PPT_HAVE_COROUTINES
+Task<void> HttpServer::RunAsync(const Router::Route* route,
+                                const HttpRequest& request,
+                                std::function<void(HttpResponse)> deliver) {
+  HttpResponse response;
+  try {
+    response = co_await router_.InvokeAsync(route, request);
+    if (response.stream_producer) {
+      throw std::logic_error("stream_producer needs a worker thread");
+    }
+  } catch (const std::exception& ex) {
+    Logger::Error(std::string("Unhandled exception while processing request: ") + ex.what());
+    response = ErrorResponse(500, "Internal server error");
+  }
+  deliver(std::move(response));
+  in_flight_.fetch_sub(1);
+  InFlightGauge().Add(-1);
+}
+#endif
+
+bool HttpServer::Submit(const Router::Route* route, std::function<void()> task, std::uint32_t& retry_after_seconds) {
+  std::size_t depth_limit = 0;
+  bool admitted = Admit(route ? route->options.priority : 0, depth_limit, retry_after_seconds);
+  // Counted before the task can run, so it never sees the count go negative.
+  in_flight_.fetch_add(1);
+  InFlightGauge().Add(1);
+  admitted = admitted && thread_pool_->TryEnqueue(std::move(task), depth_limit);
+  if (!admitted) {
+    in_flight_.fetch_sub(1);
+    InFlightGauge().Add(-1);
+    ShedRequestsCounter().Increment();
+  }
+  return admitted;
+}
+
+bool HttpServer::Admit(int priority, std::size_t& depth_limit, std::uint32_t& retry_after_seconds) const {
+  const auto max_queue = thread_pool_->max_queue();
+  const auto target = std::chrono::microseconds(std::chrono::milliseconds(config_.queue_wait_target_ms));
+  // An empty queue means no wait, whatever the average still remembers.
+  const auto waited = thread_pool_->QueueDepth() == 0 ? std::chrono::microseconds(0)
+                                                      : thread_pool_->AverageQueueWait();
+  retry_after_seconds = static_cast<std::uint32_t>(
+      std::clamp<std::int64_t>(std::chrono::ceil<std::chrono::seconds>(std::max(waited, target)).count(),
+                               1,
+                               kMaxRetryAfterSeconds));
+
+  // Higher priorities may fill more of the queue and ignore the wait target;
+  // low-priority routes (generation) are shed first.
+  if (priority > 0) {
+    depth_limit = max_queue;
+    return true;
+  }
+  if (priority == 0) {
+    depth_limit = max_queue - max_queue / 4;
+    return config_.queue_wait_target_ms == 0 || waited <= target;
+  }
+  depth_limit = max_queue / 2;
+  return config_.queue_wait_target_ms == 0 || waited <= target / 2;
+}
+
+std::size_t HttpServer::QueueDepthLimit(int priority) const {
+  if (!thread_pool_) {
+    return 0;
+  }
+  std::size_t depth_limit = 0;
+  std::uint32_t retry_after_seconds = 0;
+  return Admit(priority, depth_limit, retry_after_seconds) ? depth_limit : 0;
+}
+
+std::optional<HttpResponse> HttpServer::CheckRateLimit(const Connection& connection,
+                                                       const Router::Route* route,
+                                                       const HttpRequest& request) const {
+  if (!route || !route->options.rate_limit.enabled()) {
+    return std::nullopt;
+  }
+  const auto& limit = route->options.rate_limit;
+  // Buckets are per route, and an IP never shares one with a token.
+  const auto scope = static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(route));
+  const auto now = RateLimiter::Clock::now();
+
+  if (limit.per_ip.enabled()) {
+    auto client = std::string_view(reinterpret_cast<const char*>(&connection.peer_address),
+                                   sizeof(connection.peer_address));
+    if (config_.trust_forwarded_for) {
+      // The proxy appends the address it saw; earlier entries are whatever the client sent.
+      const auto forwarded = request.HeaderView("X-Forwarded-For");
+      const auto last = string_utils::TrimView(forwarded.substr(forwarded.rfind(',') + 1));
+      if (!last.empty()) {
+        client = last;
+      }
+    }
+    const auto decision = rate_limiter_->Acquire(RateLimiter::Key(scope * 2, client), limit.per_ip, now);
+    if (!decision.allowed) {
+      static auto& counter = RateLimitedCounter("ip");
+      counter.Increment();
+      return TooManyRequests(decision.retry_after_seconds);
+    }
+  }
+
+  if (limit.per_token.enabled()) {
+    std::optional<std::string> query_token;
+    auto token = request.HeaderView(HeaderId::kAuthorization);
+    if (token.empty()) {
+      query_token = string_utils::FindQueryParam(request.query_string, "token");
+      if (query_token) {
+        token = *query_token;
+      }
+    } else if (token.size() > 7 && string_utils::EqualsIgnoreCase(token.substr(0, 7), "Bearer ")) {
+      token.remove_prefix(7);
+    }
+    if (!token.empty()) {
+      const auto decision = rate_limiter_->Acquire(RateLimiter::Key(scope * 2 + 1, token), limit.per_token, now);
+      if (!decision.allowed) {
+        static auto& counter = RateLimitedCounter("token");
+        counter.Increment();
+        return TooManyRequests(decision.retry_after_seconds);
+      }
+    }
+  }
+  return std::nullopt;
+}
+
+void HttpServer::ScheduleRateLimitSweep(Shard& shard) {
+  shard.loop->RunAfter(kRateLimitSweepInterval, [this, &shard]() {
+    rate_limiter_->Sweep();
+    ScheduleRateLimitSweep(shard);
+  });
+}
+
+void HttpServer::FinishRequest(const std::shared_ptr<Connection>& connection,
+                               OutgoingResponse outgoing,
+                               bool keep_alive) {
+  connection->input.erase(0, connection->parser.consumed());
+  connection->parser.Reset();
+  connection->request.Clear();
+  connection->continue_sent = false;
+  connection->head_checked = false;
+  QueueResponse(connection, std::move(outgoing), keep_alive);
+}
+
+void HttpServer::QueueResponse(const std::shared_ptr<Connection>& connection,
+                               OutgoingResponse outgoing,
+                               bool keep_alive) {
+  if (connection->closed) {
+    return;
+  }
+  if (!keep_alive) {
+    connection->close_after_write = true;
+  }
+  connection->outbox.push_back(std::move(outgoing));
+  FlushConnection(connection);
+}
+
+void HttpServer::FlushConnection(const std::shared_ptr<Connection>& connection) {
+  if (connection->h2) {
+    FlushHttp2(connection);
+    return;
+  }
+  const bool was_backlogged = connection->outbox.size() >= kMaxQueuedResponses;
+  while (!connection->outbox.empty()) {
+    const auto status = WriteOutgoing(*connection, connection->outbox.front());
+    if (status == WriteStatus::kBlocked) {
+      // Wait for EPOLLOUT.
+      return;
+    }
+    if (status == WriteStatus::kError) {
+      CloseConnection(connection);
+      return;
+    }
+    if (connection->spare_heads.size() < kMaxSpareHeadBuffers) {
+      auto& head = connection->outbox.front().head;
+      head.clear();
+      connection->spare_heads.push_back(std::move(head));
+    }
+    connection->outbox.pop_front();
+  }
+
+  // While draining, a connection with nothing left to answer is not kept for another request.
+  if (connection->close_after_write ||
+      (draining_.load() && connection->requests_served > 0 && !connection->busy && connection->input.empty())) {
+    CloseConnection(connection);
+    return;
+  }
+  if (was_backlogged) {
+    ProcessInput(connection);
+  }
+}
+
+void HttpServer::FlushHttp2(const std::shared_ptr<Connection>& connection) {
+  if (connection->closed) {
+    return;
+  }
+  auto& session = *connection->h2;
+  if (draining_.load()) {
+    session.GoAway();
+  }
+  while (true) {
+    const auto output = session.PendingOutput();
+    if (output.empty()) {
+      break;
+    }
+    std::size_t sent = 0;
+    const auto status = Send(*connection, output.data(), output.size(), sent);
+    if (status == WriteStatus::kBlocked) {
+      return;
+    }
+    if (status == WriteStatus::kError) {
+      CloseConnection(connection);
+      return;
+    }
+    session.ConsumeOutput(sent);
+  }
+  // A failed session closes as soon as its GOAWAY is out; one going away,
+  // or whose client stopped sending, once every open stream is answered.
+  if (connection->close_after_write || ((session.closing() || connection->read_closed) && session.Idle())) {
+    CloseConnection(connection);
+  }
+}
+
+HttpServer::WriteStatus HttpServer::Send(Connection& connection, const char* data, std::size_t size, std::size_t& sent) {
+  sent = 0;
+  if (connection.tls) {
+    switch (connection.tls->Write(data, size, sent)) {
+      case TlsSession::Status::kOk:
+        return WriteStatus::kDone;
+      case TlsSession::Status::kWantRead:
+      case TlsSession::Status::kWantWrite:
+        return WriteStatus::kBlocked;
+      case TlsSession::Status::kClosed:
+      case TlsSession::Status::kError:
+        return WriteStatus::kError;
+    }
+  }
+  while (true) {
+    const ssize_t written = ::send(connection.fd, data, size, MSG_NOSIGNAL);
+    if (written >= 0) {
+      sent = static_cast<std::size_t>(written);
+      return WriteStatus::kDone;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    return errno == EAGAIN || errno == EWOULDBLOCK ? WriteStatus::kBlocked : WriteStatus::kError;
+  }
+}
+
+HttpServer::WriteStatus HttpServer::WriteOutgoing(Connection& connection, OutgoingResponse& outgoing) {
+  // Head and in-memory body leave in one scatter-gather write (sendmsg rather
+  // than writev so MSG_NOSIGNAL applies); partial writes resume from the
+  // recorded offsets on the next EPOLLOUT. Over TLS a small response is
+  // gathered into one record instead.
+  const std::string_view body = outgoing.body_owner ? outgoing.shared_body : std::string_view(outgoing.body);
+  while (outgoing.head_sent < outgoing.head.size() || outgoing.body_sent < body.size()) {
+    std::array<iovec, 2> iov{};
+    int iov_count = 0;
+    if (outgoing.head_sent < outgoing.head.size()) {
+      iov[iov_count++] = iovec{outgoing.head.data() + outgoing.head_sent, outgoing.head.size() - outgoing.head_sent};
+    }
+    if (outgoing.body_sent < body.size()) {
+      iov[iov_count++] = iovec{const_cast<char*>(body.data()) + outgoing.body_sent, body.size() - outgoing.body_sent};
+    }
+    std::size_t sent = 0;
+    if (connection.tls) {
+      // A retry after kBlocked rebuilds the same bytes from the same offsets, as OpenSSL requires.
+      std::array<char, kTlsRecordSize> record;
+      const char* data = static_cast<const char*>(iov[0].iov_base);
+      std::size_t size = iov[0].iov_len;
+      if (iov_count == 2 && iov[0].iov_len + iov[1].iov_len <= record.size()) {
+        std::memcpy(record.data(), iov[0].iov_base, iov[0].iov_len);
+        std::memcpy(record.data() + iov[0].iov_len, iov[1].iov_base, iov[1].iov_len);
+        data = record.data();
+        size = iov[0].iov_len + iov[1].iov_len;
+      }
+      const auto status = Send(connection, data, size, sent);
+      if (status != WriteStatus::kDone) {
+        return status;
+      }
+    } else {
+      msghdr message{};
+      message.msg_iov = iov.data();
+      message.msg_iovlen = static_cast<std::size_t>(iov_count);
+      const ssize_t written = ::sendmsg(connection.fd, &message, MSG_NOSIGNAL);
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          return WriteStatus::kBlocked;
         }
+        return WriteStatus::kError;
       }
+      sent = static_cast<std::size_t>(written);
     }
+    auto remaining = sent;
+    const auto head_part = std::min(remaining, outgoing.head.size() - outgoing.head_sent);
+    outgoing.head_sent += head_part;
+    remaining -= head_part;
+    outgoing.body_sent += remaining;
+  }
 
-    if (header_end != std::string::npos) {
-      static const std::string delimiter = "\r\n\r\n";
-      const auto total_needed = header_end + delimiter.size() + content_length;
-      if (raw_data.size() >= total_needed) {
-        break;
+  if (outgoing.stream) {
+    return WriteStream(connection, outgoing);
+  }
+  if (!outgoing.file) {
+    return WriteStatus::kDone;
+  }
+
+  const auto& file = *outgoing.file;
+  while (outgoing.file_sent < file.length) {
+    off_t offset = static_cast<off_t>(file.offset + outgoing.file_sent);
+    const auto remaining = file.length - outgoing.file_sent;
+    const auto chunk = static_cast<std::size_t>(std::min<std::uint64_t>(remaining, kMaxSendfileChunk));
+    if (connection.tls) {
+      std::size_t sent = 0;
+      switch (connection.tls->SendFile(file.fd->Get(), static_cast<std::uint64_t>(offset), chunk, sent)) {
+        case TlsSession::Status::kOk:
+          outgoing.file_sent += sent;
+          continue;
+        case TlsSession::Status::kWantRead:
+        case TlsSession::Status::kWantWrite:
+          return WriteStatus::kBlocked;
+        case TlsSession::Status::kClosed:
+        case TlsSession::Status::kError:
+          return WriteStatus::kError;
       }
     }
+    const ssize_t sent = ::sendfile(connection.fd,
+                                    file.fd->Get(),
+                                    &offset,
+                                    chunk);
+    if (sent > 0) {
+      outgoing.file_sent += static_cast<std::uint64_t>(sent);
+      continue;
+    }
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return WriteStatus::kBlocked;
+    }
+    // sent == 0: the file shrank underneath us, so the declared length can no longer be honoured.
+    Logger::Warn("sendfile failed: " + std::string(sent == 0 ? "unexpected end of file" : strerror(errno)));
+    return WriteStatus::kError;
   }
+  return WriteStatus::kDone;
+}
 
-  if (raw_data.empty()) {
-    return false;
+bool HttpServer::AwaitingProducer(const OutgoingResponse& outgoing) {
+  return outgoing.stream && !outgoing.stream_done && outgoing.head_sent == outgoing.head.size() &&
+         outgoing.body_sent == outgoing.body.size() && outgoing.chunk_sent == outgoing.chunk.size();
+}
+
+HttpServer::WriteStatus HttpServer::WriteStream(Connection& connection, OutgoingResponse& outgoing) {
+  while (true) {
+    if (outgoing.chunk_sent < outgoing.chunk.size()) {
+      std::size_t sent = 0;
+      const auto status = Send(connection,
+                               outgoing.chunk.data() + outgoing.chunk_sent,
+                               outgoing.chunk.size() - outgoing.chunk_sent,
+                               sent);
+      if (status != WriteStatus::kDone) {
+        return status;
+      }
+      outgoing.chunk_sent += sent;
+      continue;
+    }
+    if (outgoing.stream_done) {
+      return WriteStatus::kDone;
+    }
+    outgoing.chunk.clear();
+    outgoing.chunk_sent = 0;
+    switch (outgoing.stream->Take(outgoing.chunk, outgoing.chunked)) {
+      case BodyStream::TakeResult::kData:
+        break;
+      case BodyStream::TakeResult::kFinished:
+        outgoing.stream_done = true;
+        break;
+      case BodyStream::TakeResult::kPending:
+        // The producer's next Write() notifies the loop, which flushes again.
+        return WriteStatus::kBlocked;
+      case BodyStream::TakeResult::kFailed:
+        return WriteStatus::kError;
+    }
   }
+}
 
-  if (header_end == std::string::npos) {
-    return false;
+void HttpServer::WatchStream(const std::shared_ptr<Connection>& connection, BodyStream& stream) {
+  EventLoop* loop = connection->shard->loop.get();
+  std::weak_ptr<Connection> weak = connection;
+  stream.SetNotify([this, loop, weak]() {
+    loop->Post([this, weak]() {
+      auto connection = weak.lock();
+      if (!connection || connection->closed) {
+        return;
+      }
+      FlushConnection(connection);
+      // New output from the producer counts as progress for the write deadline.
+      UpdateDeadline(connection, true);
+    });
+  });
+}
+
+void HttpServer::UpdateDeadline(const std::shared_ptr<Connection>& connection, bool write_progress) {
+  if (connection->closed) {
+    return;
+  }
+  // Header, body and idle deadlines cover the whole phase, so trickling bytes
+  // cannot extend them; the write deadline restarts whenever the peer reads.
+  Deadline next = Deadline::kNone;
+  if (connection->h2) {
+    // Streams waiting for their handler or producer are not the client's doing.
+    next = connection->h2->WaitingOnPeer() ? Deadline::kWrite
+           : connection->h2->Idle()        ? Deadline::kIdle
+                                           : Deadline::kNone;
+  } else if (!connection->outbox.empty()) {
+    // A stream that has sent everything it was given is waiting on its
+    // producer (e.g. an event feed), not on the client.
+    next = AwaitingProducer(connection->outbox.front()) ? Deadline::kNone : Deadline::kWrite;
+  } else if (connection->busy) {
+    next = Deadline::kNone;
+  } else if (connection->parser.HeadersComplete()) {
+    next = Deadline::kBody;
+  } else if (!connection->input.empty() || connection->requests_served == 0) {
+    next = Deadline::kHeader;
+  } else {
+    next = Deadline::kIdle;
+  }
+  if (next == connection->deadline && !(next == Deadline::kWrite && write_progress)) {
+    return;
   }
 
-  static const std::string delimiter = "\r\n\r\n";
-  const auto body_start = header_end + delimiter.size();
-  if (raw_data.size() >= body_start) {
-    request.body = raw_data.substr(body_start, content_length);
+  auto& loop = *connection->shard->loop;
+  if (connection->deadline_timer != 0) {
+    loop.CancelTimer(connection->deadline_timer);
+    connection->deadline_timer = 0;
+  }
+  connection->deadline = next;
+  std::uint32_t seconds = 0;
+  switch (next) {
+    case Deadline::kNone:
+      return;
+    case Deadline::kIdle:
+      seconds = config_.keep_alive_timeout_seconds;
+      break;
+    case Deadline::kHeader:
+      seconds = config_.header_timeout_seconds;
+      break;
+    case Deadline::kBody:
+      seconds = config_.body_timeout_seconds;
+      break;
+    case Deadline::kWrite:
+      seconds = config_.write_timeout_seconds;
+      break;
   }
+  std::weak_ptr<Connection> weak = connection;
+  connection->deadline_timer = loop.RunAfter(std::chrono::seconds(seconds), [this, weak, next]() {
+    if (auto expired = weak.lock()) {
+      OnDeadline(expired, next);
+    }
+  });
+}
 
-  return true;
+void HttpServer::OnDeadline(const std::shared_ptr<Connection>& connection, Deadline deadline) {
+  connection->deadline_timer = 0;
+  connection->deadline = Deadline::kNone;
+  if (connection->closed) {
+    return;
+  }
+  switch (deadline) {
+    case Deadline::kNone:
+      return;
+    case Deadline::kIdle: {
+      static auto& idle = TimeoutCounter("idle");
+      idle.Increment();
+      CloseConnection(connection);
+      return;
+    }
+    case Deadline::kWrite: {
+      static auto& write = TimeoutCounter("write");
+      write.Increment();
+      CloseConnection(connection);
+      return;
+    }
+    case Deadline::kHeader:
+    case Deadline::kBody: {
+      static auto& header = TimeoutCounter("header");
+      static auto& body = TimeoutCounter("body");
+      (deadline == Deadline::kHeader ? header : body).Increment();
+      if (connection->input.empty() && connection->requests_served == 0) {
+        // Connected but never sent a byte; there is nobody to explain 408 to.
+        CloseConnection(connection);
+        return;
+      }
+      // Stop reading, tell the client why, and close once that is flushed
+      // (bounded by the write deadline if the client stops reading too).
+      connection->read_closed = true;
+      FinishRequest(connection, SerializeResponse(*connection, ErrorResponse(408, "Request timeout"), false, false), false);
+      UpdateDeadline(connection, false);
+      return;
+    }
+  }
 }
 
-void HttpServer::SendResponse(int client_fd, const HttpResponse& original) {
-  HttpResponse response = original;
-  response.ApplyCors();
+bool HttpServer::WantsKeepAlive(const Connection& connection, const HttpRequest& request) const {
+  if (!running_.load() || draining_.load() || connection.read_closed ||
+      connection.requests_served >= config_.keep_alive_max_requests) {
+    return false;
+  }
+  const auto header = request.HeaderView(HeaderId::kConnection);
+  if (request.version == "HTTP/1.0") {
+    return HeaderHasToken(header, "keep-alive");
+  }
+  return !HeaderHasToken(header, "close");
+}
 
-  if (!response.headers.count("content-type")) {
-    response.headers["content-type"] = "application/json";
+void HttpServer::CloseConnection(const std::shared_ptr<Connection>& connection) {
+  if (connection->closed) {
+    return;
+  }
+  connection->closed = true;
+  Shard& shard = *connection->shard;
+  if (connection->deadline_timer != 0) {
+    shard.loop->CancelTimer(connection->deadline_timer);
+    connection->deadline_timer = 0;
   }
-  response.headers["connection"] = "close";
-  if (!response.headers.count("content-length")) {
-    response.headers["content-length"] = std::to_string(response.body.size());
+  shard.loop->Remove(connection->fd);
+  if (connection->tls) {
+    connection->tls->Shutdown();
   }
+  ::close(connection->fd);
+  for (auto& outgoing : connection->outbox) {
+    if (outgoing.stream) {
+      outgoing.stream->Cancel();
+    }
+  }
+  if (connection->h2) {
+    connection->h2->CancelStreams();
+  }
+  shard.connections.erase(connection->fd);
+  shard.open_connections.fetch_sub(1, std::memory_order_relaxed);
+  OpenConnectionsGauge().Add(-1);
+}
 
-  const std::string reason = response.status_message.empty() ? "OK" : response.status_message;
+HttpServer::OutgoingResponse HttpServer::SerializeResponse(Connection& connection,
+                                                           HttpResponse response,
+                                                           bool keep_alive,
+                                                           bool head_request) const {
+  CountStatus(response.status_code);
+  OutgoingResponse outgoing;
+  if (!connection.spare_heads.empty()) {
+    outgoing.head = std::move(connection.spare_heads.back());
+    connection.spare_heads.pop_back();
+  }
+  auto& head = outgoing.head;
+
+  head.append("HTTP/1.1 ");
+  AppendNumber(head, static_cast<std::uint64_t>(response.status_code));
+  head.push_back(' ');
+  head.append(response.status_message.empty() ? "OK" : response.status_message);
+  head.append("\r\n");
 
-  std::ostringstream stream;
-  stream << "HTTP/1.1 " << response.status_code << ' ' << reason << "\r\n";
-  for (const auto& [key, value] : response.headers) {
-    stream << key << ": " << value << "\r\n";
+  bool has_content_type = false;
+  bool has_content_length = false;
+  for (const auto& header : response.headers) {
+    has_content_type = has_content_type || header.id == HeaderId::kContentType;
+    has_content_length = has_content_length || header.id == HeaderId::kContentLength;
+    AppendHeader(head, header.Name(), header.value);
+  }
+  if (!has_content_type) {
+    AppendHeader(head, "content-type", "application/json");
   }
-  stream << "\r\n";
-  stream << response.body;
+  if (response.stream) {
+    if (connection.accepts_chunked) {
+      AppendHeader(head, "transfer-encoding", "chunked");
+    }
+  } else if (!has_content_length && response.status_code != 304) {
+    head.append("content-length: ");
+    AppendNumber(head,
+                 response.file          ? response.file->length
+                 : response.shared_body ? response.shared_body->data.size()
+                                        : response.body.size());
+    head.append("\r\n");
+  }
+  head.append(keep_alive ? std::string_view(keep_alive_headers_) : kCloseHeader);
+  head.append(kCorsHeaders);
+  head.append("\r\n");
 
-  const auto serialized = stream.str();
-  ::send(client_fd, serialized.data(), serialized.size(), 0);
+  if (head_request) {
+    if (response.stream) {
+      response.stream->Cancel();
+    }
+    return outgoing;
+  }
+  outgoing.body = std::move(response.body);
+  if (response.shared_body) {
+    outgoing.body_owner = std::move(response.shared_body->owner);
+    outgoing.shared_body = response.shared_body->data;
+  }
+  outgoing.file = std::move(response.file);
+  outgoing.stream = std::move(response.stream);
+  outgoing.chunked = connection.accepts_chunked;
+  return outgoing;
 }
@@ -0,0 +1,234 @@
+#include "http/listener_handoff.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include "logger.h"
+
+namespace {
+// Sent with the fds; guards against something else listening on the path.
+constexpr std::array<char, 4> kMagic{'P', 'P', 'T', 'L'};
+constexpr char kAck = 'A';
+constexpr std::size_t kMaxListeners = 64;
+// Covers the replacement's Start(), which only sets up its event loops.
+constexpr int kHandoffTimeoutSeconds = 10;
+
+struct HandoffHeader {
+  std::array<char, 4> magic;
+  std::uint32_t count;
+};
+
+bool MakeAddress(const std::string& path, sockaddr_un& address) {
+  address = sockaddr_un{};
+  address.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+    return false;
+  }
+  std::memcpy(address.sun_path, path.data(), path.size());
+  return true;
+}
+
+void SetTimeouts(int fd) {
+  timeval timeout{kHandoffTimeoutSeconds, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+}  // namespace
+
+ListenerHandoff::Inherited ListenerHandoff::Receive(const std::string& path) {
+  Inherited inherited;
+  sockaddr_un address{};
+  if (!MakeAddress(path, address)) {
+    throw std::runtime_error("Invalid handoff socket path: " + path);
+  }
+  UniqueFd channel(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  if (!channel) {
+    throw std::runtime_error("Failed to create handoff socket: " + std::string(strerror(errno)));
+  }
+  if (::connect(channel.Get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+    if (errno != ENOENT && errno != ECONNREFUSED) {
+      Logger::Warn("Listener handoff unavailable at " + path + ": " + strerror(errno));
+    }
+    return inherited;
+  }
+  SetTimeouts(channel.Get());
+
+  HandoffHeader header{};
+  iovec iov{&header, sizeof(header)};
+  alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(int) * kMaxListeners)> control{};
+  msghdr message{};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.data();
+  message.msg_controllen = control.size();
+  ssize_t received = -1;
+  do {
+    received = ::recvmsg(channel.Get(), &message, MSG_CMSG_CLOEXEC);
+  } while (received < 0 && errno == EINTR);
+
+  // Take ownership of whatever arrived first, so a rejected message leaks nothing.
+  std::vector<UniqueFd> listeners;
+  if (received > 0) {
+    for (auto* cmsg = CMSG_FIRSTHDR(&message); cmsg != nullptr; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+      if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        continue;
+      }
+      const auto count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      for (std::size_t i = 0; i < count; ++i) {
+        int fd = -1;
+        std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+        listeners.emplace_back(fd);
+      }
+    }
+  }
+  if (received != static_cast<ssize_t>(sizeof(header)) || header.magic != kMagic ||
+      (message.msg_flags & MSG_CTRUNC) != 0 || listeners.empty() || header.count != listeners.size()) {
+    Logger::Warn("Ignoring malformed listener handoff from " + path);
+    return inherited;
+  }
+
+  inherited.channel = std::move(channel);
+  inherited.listeners = std::move(listeners);
+  Logger::Info("Took over " + std::to_string(inherited.listeners.size()) +
+               " listening socket(s) from the previous process");
+  return inherited;
+}
+
+void ListenerHandoff::Acknowledge(Inherited& inherited) {
+  if (!inherited.channel) {
+    return;
+  }
+  if (::send(inherited.channel.Get(), &kAck, 1, MSG_NOSIGNAL) != 1) {
+    Logger::Warn("Failed to confirm listener handoff: " + std::string(strerror(errno)));
+  }
+  inherited.channel.Reset();
+}
+
+ListenerHandoff::ListenerHandoff(std::string path,
+                                 std::function<std::vector<int>()> listeners,
+                                 std::function<void()> on_handed_off)
+    : path_(std::move(path)), listeners_(std::move(listeners)), on_handed_off_(std::move(on_handed_off)) {
+  sockaddr_un address{};
+  if (!MakeAddress(path_, address)) {
+    throw std::runtime_error("Invalid handoff socket path: " + path_);
+  }
+  // A socket left at the path is stale, or belongs to the process we just
+  // took over from; anything else is not ours to remove.
+  struct stat existing {};
+  if (::lstat(path_.c_str(), &existing) == 0) {
+    if (!S_ISSOCK(existing.st_mode)) {
+      throw std::runtime_error("Handoff socket path exists and is not a socket: " + path_);
+    }
+    ::unlink(path_.c_str());
+  }
+
+  listen_fd_.Reset(::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+  wake_fd_.Reset(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+  if (!listen_fd_ || !wake_fd_) {
+    throw std::runtime_error("Failed to set up listener handoff: " + std::string(strerror(errno)));
+  }
+  if (::bind(listen_fd_.Get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0 ||
+      ::chmod(path_.c_str(), 0600) < 0 || ::listen(listen_fd_.Get(), 4) < 0) {
+    throw std::runtime_error("Failed to bind handoff socket " + path_ + ": " + strerror(errno));
+  }
+  struct stat bound {};
+  if (::stat(path_.c_str(), &bound) == 0) {
+    inode_ = bound.st_ino;
+  }
+  thread_ = std::thread([this]() { ServeLoop(); });
+}
+
+ListenerHandoff::~ListenerHandoff() {
+  stop_.store(true);
+  const std::uint64_t one = 1;
+  [[maybe_unused]] const auto written = ::write(wake_fd_.Get(), &one, sizeof(one));
+  if (thread_.joinable()) {
+    thread_.join();
+  }
+  // After a handoff the path belongs to the replacement.
+  struct stat current {};
+  if (inode_ != 0 && ::stat(path_.c_str(), &current) == 0 && current.st_ino == inode_) {
+    ::unlink(path_.c_str());
+  }
+}
+
+void ListenerHandoff::ServeLoop() {
+  while (!stop_.load()) {
+    std::array<pollfd, 2> fds{{{listen_fd_.Get(), POLLIN, 0}, {wake_fd_.Get(), POLLIN, 0}}};
+    const int ready = ::poll(fds.data(), fds.size(), -1);
+    if (ready < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      Logger::Error("Listener handoff failed: " + std::string(strerror(errno)));
+      return;
+    }
+    if (!(fds[0].revents & POLLIN)) {
+      continue;
+    }
+    UniqueFd channel(::accept4(listen_fd_.Get(), nullptr, nullptr, SOCK_CLOEXEC));
+    if (!channel) {
+      continue;
+    }
+    ucred peer{};
+    socklen_t peer_len = sizeof(peer);
+    if (getsockopt(channel.Get(), SOL_SOCKET, SO_PEERCRED, &peer, &peer_len) < 0 || peer.uid != ::geteuid()) {
+      Logger::Warn("Refused listener handoff to a process of another user");
+      continue;
+    }
+    SetTimeouts(channel.Get());
+    if (HandOff(channel.Get())) {
+      Logger::Info("Listening sockets handed to process " + std::to_string(peer.pid));
+      on_handed_off_();
+      return;
+    }
+  }
+}
+
+bool ListenerHandoff::HandOff(int channel) {
+  const auto fds = listeners_();
+  if (fds.empty() || fds.size() > kMaxListeners) {
+    Logger::Warn("No listening sockets to hand over");
+    return false;
+  }
+  HandoffHeader header{kMagic, static_cast<std::uint32_t>(fds.size())};
+  iovec iov{&header, sizeof(header)};
+  alignas(cmsghdr) std::array<char, CMSG_SPACE(sizeof(int) * kMaxListeners)> control{};
+  msghdr message{};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.data();
+  message.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+  auto* cmsg = CMSG_FIRSTHDR(&message);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+  std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+  if (::sendmsg(channel, &message, MSG_NOSIGNAL) != static_cast<ssize_t>(sizeof(header))) {
+    Logger::Warn("Failed to send listening sockets: " + std::string(strerror(errno)));
+    return false;
+  }
+
+  // Until the replacement confirms it is accepting, keep serving as before.
+  char ack = 0;
+  ssize_t received = -1;
+  do {
+    received = ::recv(channel, &ack, 1, 0);
+  } while (received < 0 && errno == EINTR);
+  if (received != 1 || ack != kAck) {
+    Logger::Warn("Replacement process did not confirm the listener handoff; still serving");
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,138 @@
+#include "http/rate_limiter.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "utils/metrics.h"
+
+namespace {
+constexpr std::uint64_t kMicrosPerSecond = 1000000;
+// A token takes at most a day to come back, which keeps the arithmetic below far from overflow.
+constexpr double kMaxIntervalMicros = 86400.0 * kMicrosPerSecond;
+constexpr double kMaxCapacityMicros = 1e18;
+
+metrics::Counter& TableFullCounter() {
+  static auto& counter = metrics::Registry::Instance().GetCounter(
+      "http_rate_limit_table_full_total", "Requests let through because no rate-limit bucket was free for them.");
+  return counter;
+}
+
+// splitmix64 finalizer: spreads the FNV state so both the shard (low bits)
+// and the position within it (high bits) are well mixed.
+std::uint64_t Mix(std::uint64_t value) {
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+  return value ^ (value >> 31);
+}
+}  // namespace
+
+RateLimiter::RateLimiter(std::size_t capacity) : epoch_(Clock::now()) {
+  std::size_t per_shard = 2 * kProbeLength;
+  while (per_shard * kShards < capacity) {
+    per_shard *= 2;
+  }
+  shard_mask_ = per_shard - 1;
+  slots_ = std::make_unique<Slot[]>(per_shard * kShards);
+}
+
+std::uint64_t RateLimiter::Key(std::uint64_t scope, std::string_view client) {
+  std::uint64_t hash = 0xcbf29ce484222325ULL ^ Mix(scope);
+  for (const char c : client) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ULL;
+  }
+  hash = Mix(hash);
+  return hash != 0 ? hash : 1;
+}
+
+std::uint64_t RateLimiter::Micros(Clock::time_point now) const {
+  return static_cast<std::uint64_t>(
+      std::max<std::int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(now - epoch_).count(), 0));
+}
+
+RateLimiter::Slot* RateLimiter::FindOrClaim(std::uint64_t key, std::uint64_t now) {
+  Slot* shard = &slots_[(key % kShards) * (shard_mask_ + 1)];
+  const auto start = static_cast<std::size_t>(key >> 32);
+  Slot* free_slot = nullptr;
+  Slot* refilled = nullptr;
+  std::uint64_t refilled_key = 0;
+  for (std::size_t i = 0; i < kProbeLength; ++i) {
+    Slot& slot = shard[(start + i) & shard_mask_];
+    const auto owner = slot.key.load(std::memory_order_acquire);
+    if (owner == key) {
+      return &slot;
+    }
+    if (owner == 0) {
+      if (!free_slot) {
+        free_slot = &slot;
+      }
+    } else if (!refilled && slot.full_at.load(std::memory_order_relaxed) <= now) {
+      refilled = &slot;
+      refilled_key = owner;
+    }
+  }
+
+  // A slot is only freed or reused once its bucket is full, so the new key
+  // starts with a full bucket without resetting anything. Losing the race
+  // to the same key is as good as winning it.
+  if (free_slot) {
+    std::uint64_t expected = 0;
+    if (free_slot->key.compare_exchange_strong(expected, key, std::memory_order_acq_rel) || expected == key) {
+      return free_slot;
+    }
+  }
+  if (refilled) {
+    std::uint64_t expected = refilled_key;
+    if (refilled->key.compare_exchange_strong(expected, key, std::memory_order_acq_rel) || expected == key) {
+      return refilled;
+    }
+  }
+  return nullptr;
+}
+
+RateLimiter::Decision RateLimiter::Acquire(std::uint64_t key, const TokenBucketConfig& limit, Clock::time_point now) {
+  if (!limit.enabled()) {
+    return {};
+  }
+  const auto now_us = Micros(now);
+  Slot* slot = FindOrClaim(key, now_us);
+  if (!slot) {
+    TableFullCounter().Increment();
+    return {};
+  }
+
+  // Each token pushes the refill time one interval further; a bucket holds
+  // |burst| intervals' worth, so a request that would push it beyond that
+  // finds the bucket empty.
+  const double interval_micros = std::min(kMicrosPerSecond / limit.rate, kMaxIntervalMicros);
+  const auto interval = static_cast<std::uint64_t>(std::max(interval_micros, 1.0));
+  const auto capacity =
+      static_cast<std::uint64_t>(std::min(static_cast<double>(interval) * limit.burst, kMaxCapacityMicros));
+  auto full_at = slot->full_at.load(std::memory_order_relaxed);
+  while (true) {
+    const auto next = std::max(full_at, now_us) + interval;
+    if (next - now_us > capacity) {
+      const auto wait = next - capacity - now_us;
+      Decision decision;
+      decision.allowed = false;
+      decision.retry_after_seconds = static_cast<std::uint32_t>(
+          std::clamp<std::uint64_t>((wait + kMicrosPerSecond - 1) / kMicrosPerSecond, 1, UINT32_MAX));
+      return decision;
+    }
+    if (slot->full_at.compare_exchange_weak(full_at, next, std::memory_order_relaxed)) {
+      return {};
+    }
+  }
+}
+
+void RateLimiter::Sweep(Clock::time_point now) {
+  const auto now_us = Micros(now);
+  const auto shard_index = sweep_cursor_.fetch_add(1, std::memory_order_relaxed) % kShards;
+  Slot* shard = &slots_[shard_index * (shard_mask_ + 1)];
+  for (std::size_t i = 0; i <= shard_mask_; ++i) {
+    Slot& slot = shard[i];
+    auto owner = slot.key.load(std::memory_order_acquire);
+    if (owner != 0 && slot.full_at.load(std::memory_order_relaxed) <= now_us) {
+      slot.key.compare_exchange_strong(owner, 0, std::memory_order_acq_rel);
+    }
+  }
+}
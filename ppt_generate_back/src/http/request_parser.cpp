@@ -0,0 +1,193 @@
+#include "http/request_parser.h"
+
+#include <charconv>
+
+#include "utils/string_utils.h"
+
+namespace {
+bool IsTokenChar(char ch) {
+  return (ch >= 'A' && ch <= 'Z') || (ch >= 'a' && ch <= 'z');
+}
+}  // namespace
+
+HttpRequestParser::HttpRequestParser(std::size_t max_body_size, std::size_t max_header_size)
+    : max_body_size_(max_body_size), max_header_size_(max_header_size) {}
+
+void HttpRequestParser::Reset() {
+  state_ = State::kRequestLine;
+  scan_offset_ = 0;
+  request_start_ = 0;
+  body_offset_ = 0;
+  content_length_ = 0;
+  consumed_ = 0;
+  error_status_ = 400;
+  expects_continue_ = false;
+  method_ = target_ = version_ = Span{};
+  headers_.clear();
+}
+
+HttpRequestParser::Status HttpRequestParser::Fail(int status) {
+  state_ = State::kError;
+  error_status_ = status;
+  return Status::kError;
+}
+
+HttpRequestParser::Status HttpRequestParser::Parse(std::string_view buffer, HttpRequest& request) {
+  if (state_ == State::kError) {
+    return Status::kError;
+  }
+
+  while (state_ == State::kRequestLine || state_ == State::kHeaders) {
+    const auto newline = buffer.find('\n', scan_offset_);
+    if (newline == std::string_view::npos) {
+      if (buffer.size() - request_start_ > max_header_size_) {
+        return Fail(431);
+      }
+      return Status::kIncomplete;
+    }
+
+    const auto line_begin = scan_offset_;
+    auto line_end = newline;
+    if (line_end > line_begin && buffer[line_end - 1] == '\r') {
+      --line_end;
+    }
+    scan_offset_ = newline + 1;
+    if (scan_offset_ - request_start_ > max_header_size_) {
+      return Fail(431);
+    }
+
+    if (state_ == State::kRequestLine) {
+      if (line_begin == line_end) {
+        // Tolerate stray CRLFs between pipelined requests.
+        request_start_ = scan_offset_;
+        continue;
+      }
+      if (!ParseRequestLine(buffer, line_begin, line_end)) {
+        return Fail(400);
+      }
+      state_ = State::kHeaders;
+    } else if (line_begin == line_end) {
+      if (!FinishHeaders(buffer)) {
+        return Status::kError;
+      }
+      body_offset_ = scan_offset_;
+      state_ = State::kBody;
+    } else if (!ParseHeaderLine(buffer, line_begin, line_end)) {
+      return Fail(400);
+    }
+  }
+
+  if (state_ == State::kBody) {
+    if (buffer.size() - body_offset_ < content_length_) {
+      return Status::kIncomplete;
+    }
+    consumed_ = body_offset_ + content_length_;
+    state_ = State::kDone;
+  }
+
+  FillHead(buffer, request);
+  request.body = buffer.substr(body_offset_, content_length_);
+  return Status::kComplete;
+}
+
+void HttpRequestParser::PeekHead(std::string_view buffer, HttpRequest& request) const {
+  if (HeadersComplete()) {
+    FillHead(buffer, request);
+  }
+}
+
+void HttpRequestParser::FillHead(std::string_view buffer, HttpRequest& request) const {
+  request.Clear();
+  request.method = method_.In(buffer);
+  request.target = target_.In(buffer);
+  request.version = version_.In(buffer);
+  request.path = request.target;
+  if (const auto query_sep = request.target.find('?'); query_sep != std::string_view::npos) {
+    request.path = request.target.substr(0, query_sep);
+    request.query_string = request.target.substr(query_sep + 1);
+  }
+  request.headers.reserve(headers_.size());
+  for (const auto& header : headers_) {
+    request.headers.push_back(HttpHeader{header.id, header.name.In(buffer), header.value.In(buffer)});
+  }
+}
+
+bool HttpRequestParser::ParseRequestLine(std::string_view buffer, std::size_t begin, std::size_t end) {
+  const auto line = buffer.substr(begin, end - begin);
+  const auto first_space = line.find(' ');
+  if (first_space == std::string_view::npos || first_space == 0) {
+    return false;
+  }
+  const auto second_space = line.find(' ', first_space + 1);
+  if (second_space == std::string_view::npos || second_space == first_space + 1) {
+    return false;
+  }
+  for (std::size_t i = 0; i < first_space; ++i) {
+    if (!IsTokenChar(line[i])) {
+      return false;
+    }
+  }
+  const auto version = line.substr(second_space + 1);
+  if (version.rfind("HTTP/1.", 0) != 0 || version.size() != 8) {
+    return false;
+  }
+
+  method_ = Span{begin, first_space};
+  target_ = Span{begin + first_space + 1, second_space - first_space - 1};
+  version_ = Span{begin + second_space + 1, version.size()};
+  return true;
+}
+
+bool HttpRequestParser::ParseHeaderLine(std::string_view buffer, std::size_t begin, std::size_t end) {
+  if (buffer[begin] == ' ' || buffer[begin] == '\t') {
+    // Obsolete line folding is not accepted (RFC 9112 section 5.2).
+    return false;
+  }
+  const auto line = buffer.substr(begin, end - begin);
+  const auto colon_pos = line.find(':');
+  if (colon_pos == std::string_view::npos) {
+    return false;
+  }
+  const auto name = string_utils::TrimView(line.substr(0, colon_pos));
+  if (name.empty()) {
+    return false;
+  }
+  const auto value = string_utils::TrimView(line.substr(colon_pos + 1));
+  auto offset_of = [&buffer](std::string_view view) {
+    return static_cast<std::size_t>(view.data() - buffer.data());
+  };
+  headers_.push_back(HeaderSpan{LookupHeaderId(name),
+                                Span{offset_of(name), name.size()},
+                                Span{value.empty() ? 0 : offset_of(value), value.size()}});
+  return true;
+}
+
+bool HttpRequestParser::FinishHeaders(std::string_view buffer) {
+  bool has_length = false;
+  for (const auto& header : headers_) {
+    const auto value = header.value.In(buffer);
+    if (header.id == HeaderId::kContentLength) {
+      std::size_t length = 0;
+      const auto* last = value.data() + value.size();
+      const auto result = std::from_chars(value.data(), last, length);
+      if (value.empty() || result.ec != std::errc() || result.ptr != last ||
+          (has_length && length != content_length_)) {
+        Fail(400);
+        return false;
+      }
+      content_length_ = length;
+      has_length = true;
+    } else if (header.id == HeaderId::kTransferEncoding) {
+      // Chunked request bodies are not supported; refuse rather than misframe.
+      Fail(501);
+      return false;
+    } else if (header.id == HeaderId::kExpect) {
+      expects_continue_ = string_utils::EqualsIgnoreCase(value, "100-continue");
+    }
+  }
+  if (content_length_ > max_body_size_) {
+    Fail(413);
+    return false;
+  }
+  return true;
+}
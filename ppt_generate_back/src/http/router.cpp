@@ -1,27 +1,225 @@
 #include "http/router.h"
 
+#include <algorithm>
+#include <stdexcept>
 #include <utility>
 
-void Router::AddRoute(const std::string& method, const std::string& path, Handler handler) {
-  routes_[BuildKey(method, path)] = std::move(handler);
+struct Router::Node {
+  // Static edge label; empty for the root and for parameter nodes.
+  std::string prefix;
+  // Static children; no two share a first byte.
+  std::vector<std::unique_ptr<Node>> children;
+  std::unique_ptr<Node> param_child;
+  std::string param_name;
+  std::uint8_t method_mask = 0;
+  std::array<const Route*, kHttpMethodCount> routes{};
+};
+
+Router::Router() : root_(std::make_unique<Node>()) {}
+
+Router::~Router() = default;
+
+void Router::AddRoute(const std::string& method, const std::string& path, Handler handler, RouteOptions options) {
+  NewRoute(method, path, std::move(options)).handler = std::move(handler);
+}
+
+#if PPT_HAVE_COROUTINES
+void Router::AddAsyncRoute(const std::string& method, const std::string& path, AsyncHandler handler,
+                           RouteOptions options) {
+  if (options.validators) {
+    throw std::invalid_argument("Async routes cannot have validators: " + path);
+  }
+  if (options.compress_min_size > 0) {
+    throw std::invalid_argument("Async routes cannot compress responses: " + path);
+  }
+  NewRoute(method, path, std::move(options)).async_handler = std::move(handler);
+}
+#endif
+
+Router::Route& Router::NewRoute(const std::string& method, const std::string& path, RouteOptions options) {
+  const auto parsed_method = ParseHttpMethod(method);
+  if (parsed_method == HttpMethod::kUnknown) {
+    throw std::invalid_argument("Unsupported HTTP method for route: " + method);
+  }
+  if (path.empty() || path.front() != '/') {
+    throw std::invalid_argument("Route path must start with '/': " + path);
+  }
+
+  auto entry = std::make_unique<Route>();
+  entry->method = method;
+  entry->pattern = path;
+  entry->options = std::move(options);
+  const auto labels = metrics::FormatLabels({{"method", method}, {"route", path}});
+  auto& registry = metrics::Registry::Instance();
+  entry->requests = &registry.GetCounter("http_route_requests_total", "Requests dispatched to each route.", labels);
+  entry->latency =
+      &registry.GetHistogram("http_route_duration_seconds", "Handler latency per route, excluding network I/O.", labels);
+  routes_.push_back(std::move(entry));
+  Insert(*root_, routes_.back()->pattern, routes_.back().get(), parsed_method, 0);
+  return *routes_.back();
+}
+
+void Router::ApplyRateLimits(const std::unordered_map<std::string, RateLimitConfig>& limits) {
+  for (const auto& [name, limit] : limits) {
+    const auto space = name.find(' ');
+    const auto method = name.substr(0, space);
+    const auto pattern = space == std::string::npos ? std::string() : name.substr(space + 1);
+    auto it = std::find_if(routes_.begin(), routes_.end(), [&](const std::unique_ptr<Route>& route) {
+      return route->pattern == pattern && ParseHttpMethod(route->method) == ParseHttpMethod(method);
+    });
+    if (it == routes_.end()) {
+      throw std::invalid_argument("Rate limit configured for unknown route: " + name);
+    }
+    (*it)->options.rate_limit = limit;
+  }
+}
+
+void Router::Insert(Node& node, std::string_view pattern, const Route* route,
+                    HttpMethod method, std::size_t param_count) {
+  if (pattern.empty()) {
+    const auto index = static_cast<std::size_t>(method);
+    const auto bit = static_cast<std::uint8_t>(1u << index);
+    if (node.method_mask & bit) {
+      throw std::invalid_argument("Duplicate route registration");
+    }
+    node.method_mask |= bit;
+    node.routes[index] = route;
+    return;
+  }
+
+  if (pattern.front() == '{') {
+    const auto close = pattern.find('}');
+    if (close == std::string_view::npos || close == 1) {
+      throw std::invalid_argument("Malformed route parameter in pattern");
+    }
+    const auto name = pattern.substr(1, close - 1);
+    const auto rest = pattern.substr(close + 1);
+    if (!rest.empty() && rest.front() != '/') {
+      throw std::invalid_argument("Route parameters must span a whole path segment");
+    }
+    if (param_count >= PathParams::kMaxParams) {
+      throw std::invalid_argument("Too many route parameters");
+    }
+    if (!node.param_child) {
+      node.param_child = std::make_unique<Node>();
+      node.param_child->param_name = std::string(name);
+    } else if (node.param_child->param_name != name) {
+      throw std::invalid_argument("Conflicting route parameter names at the same position");
+    }
+    Insert(*node.param_child, rest, route, method, param_count + 1);
+    return;
+  }
+
+  const auto brace = pattern.find('{');
+  const auto run = pattern.substr(0, brace);
+  if (brace != std::string_view::npos && run.back() != '/') {
+    throw std::invalid_argument("Route parameters must span a whole path segment");
+  }
+
+  for (auto& child : node.children) {
+    if (child->prefix.front() != run.front()) {
+      continue;
+    }
+    std::size_t common = 0;
+    while (common < child->prefix.size() && common < run.size() && child->prefix[common] == run[common]) {
+      ++common;
+    }
+    if (common < child->prefix.size()) {
+      // Split the edge so the shared part becomes its own node.
+      auto middle = std::make_unique<Node>();
+      middle->prefix = child->prefix.substr(0, common);
+      child->prefix.erase(0, common);
+      middle->children.push_back(std::move(child));
+      child = std::move(middle);
+    }
+    Insert(*child, pattern.substr(common), route, method, param_count);
+    return;
+  }
+
+  auto child = std::make_unique<Node>();
+  child->prefix = std::string(run);
+  node.children.push_back(std::move(child));
+  Insert(*node.children.back(), pattern.substr(run.size()), route, method, param_count);
+}
+
+const Router::Node* Router::Find(const Node& node, std::string_view path, HttpMethod method, PathParams& params) {
+  if (path.empty()) {
+    const auto bit = static_cast<std::uint8_t>(1u << static_cast<std::size_t>(method));
+    return (node.method_mask & bit) ? &node : nullptr;
+  }
+
+  for (const auto& child : node.children) {
+    if (child->prefix.front() != path.front()) {
+      continue;
+    }
+    if (path.compare(0, child->prefix.size(), child->prefix) == 0) {
+      if (const auto* found = Find(*child, path.substr(child->prefix.size()), method, params)) {
+        return found;
+      }
+    }
+    break;
+  }
+
+  if (node.param_child) {
+    const auto value = path.substr(0, path.find('/'));
+    if (!value.empty()) {
+      const auto slot = params.size;
+      params.names[slot] = node.param_child->param_name;
+      params.values[slot] = value;
+      params.size = slot + 1;
+      if (const auto* found = Find(*node.param_child, path.substr(value.size()), method, params)) {
+        return found;
+      }
+      params.size = slot;
+    }
+  }
+  return nullptr;
 }
 
-HttpResponse Router::Handle(const HttpRequest& request) const {
-  const auto method_lower = string_utils::ToLower(request.method);
-  if (method_lower == "options") {
+const Router::Route* Router::Match(std::string_view method, std::string_view path, PathParams& params) const {
+  params.size = 0;
+  const auto parsed_method = ParseHttpMethod(method);
+  if (parsed_method == HttpMethod::kUnknown) {
+    return nullptr;
+  }
+  const auto* node = Find(*root_, path, parsed_method, params);
+  return node ? node->routes[static_cast<std::size_t>(parsed_method)] : nullptr;
+}
+
+HttpResponse Router::Handle(HttpRequest& request) const {
+  return Invoke(Match(request.method, request.path, request.path_params), request);
+}
+
+HttpResponse Router::Invoke(const Route* route, const HttpRequest& request) const {
+  if (route) {
+    route->requests->Increment();
+    metrics::ScopedTimer timer(*route->latency);
+    std::optional<ResponseValidators> validators;
+    if (route->options.validators) {
+      validators = route->options.validators(request);
+      if (validators && IsNotModified(request, *validators)) {
+        return NotModifiedResponse(*validators);
+      }
+    }
+    auto response = route->handler(request);
+    if (validators && response.status_code == 200) {
+      ApplyValidators(*validators, response);
+    }
+    return response;
+  }
+
+  if (ParseHttpMethod(request.method) == HttpMethod::kOptions) {
     HttpResponse response;
     response.status_code = 204;
     response.status_message = "No Content";
     response.body.clear();
-    response.headers["content-length"] = "0";
+    response.headers.Set(HeaderId::kContentLength, "0");
     return response;
   }
 
-  const auto key = BuildKey(method_lower, request.path);
-  if (auto it = routes_.find(key); it != routes_.end()) {
-    return it->second(request);
-  }
-
+  static auto& unmatched =
+      metrics::Registry::Instance().GetCounter("http_unmatched_requests_total", "Requests that matched no route.");
+  unmatched.Increment();
   nlohmann::json payload{{"message", "Route not found"}};
   HttpResponse response;
   response.status_code = 404;
@@ -30,6 +228,10 @@ HttpResponse Router::Handle(const HttpRequest& request) const {
   return response;
 }
 
-std::string Router::BuildKey(const std::string& method, const std::string& path) const {
-  return string_utils::ToLower(method) + ":" + path;
+#if PPT_HAVE_COROUTINES
+Task<HttpResponse> Router::InvokeAsync(const Route* route, const HttpRequest& request) const {
+  route->requests->Increment();
+  metrics::ScopedTimer timer(*route->latency);
+  co_return co_await route->async_handler(request);
 }
+#endif
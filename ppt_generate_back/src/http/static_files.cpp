@@ -0,0 +1,490 @@
+#include "http/static_files.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+
+#include "http/conditional.h"
+#include "http/content_encoding.h"
+#include "logger.h"
+#include "utils/compression.h"
+#include "utils/metrics.h"
+
+namespace {
+using compression_utils::Encoding;
+
+// IN_MODIFY fires on the truncate that starts an in-place rewrite, so a
+// half-written file is dropped before its contents are served for long.
+constexpr std::uint32_t kWatchMask = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                     IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+// How often to look for the root again after it was removed or replaced.
+constexpr int kRootRetryMs = 1000;
+constexpr char kIndexFile[] = "index.html";
+constexpr char kImmutableCacheControl[] = "public, max-age=31536000, immutable";
+constexpr char kRevalidateCacheControl[] = "no-cache";
+constexpr std::size_t kVariantCount = 3;
+// Files up to this size are copied into memory; larger ones are sent from
+// the open descriptor, which copes with a file shrinking underneath it.
+constexpr std::size_t kMaxBufferedSize = 1024 * 1024;
+// Remembered misses, so repeated requests for a missing file skip the disk.
+constexpr std::size_t kMaxMisses = 1024;
+
+struct ContentType {
+  std::string_view extension;
+  std::string_view type;
+};
+
+constexpr std::array<ContentType, 19> kContentTypes{{
+    {"html", "text/html; charset=utf-8"},
+    {"js", "application/javascript; charset=utf-8"},
+    {"mjs", "application/javascript; charset=utf-8"},
+    {"css", "text/css; charset=utf-8"},
+    {"json", "application/json"},
+    {"map", "application/json"},
+    {"txt", "text/plain; charset=utf-8"},
+    {"xml", "application/xml"},
+    {"svg", "image/svg+xml"},
+    {"png", "image/png"},
+    {"jpg", "image/jpeg"},
+    {"jpeg", "image/jpeg"},
+    {"gif", "image/gif"},
+    {"webp", "image/webp"},
+    {"ico", "image/x-icon"},
+    {"woff", "font/woff"},
+    {"woff2", "font/woff2"},
+    {"ttf", "font/ttf"},
+    {"wasm", "application/wasm"},
+}};
+
+std::string_view ContentTypeFor(std::string_view relative) {
+  const auto dot = relative.rfind('.');
+  if (dot != std::string_view::npos) {
+    const auto extension = relative.substr(dot + 1);
+    for (const auto& entry : kContentTypes) {
+      if (string_utils::EqualsIgnoreCase(entry.extension, extension)) {
+        return entry.type;
+      }
+    }
+  }
+  return "application/octet-stream";
+}
+
+// The bundler (vite.config.js: assetsDir, [name]-[hash]) writes its output
+// under assets/ as "<name>-<hash>.<ext>", the hash being 8 base64url
+// characters by default or hex from other tools. Such a URL never changes
+// meaning, so clients may cache it forever.
+constexpr std::string_view kAssetsPrefix = "assets/";
+constexpr std::size_t kMinHashLength = 8;
+constexpr std::size_t kMaxHashLength = 32;
+
+bool IsFingerprinted(std::string_view relative) {
+  if (relative.rfind(kAssetsPrefix, 0) != 0) {
+    return false;
+  }
+  const auto filename = relative.substr(relative.rfind('/') + 1);
+  const auto dot = filename.find('.');
+  if (dot == std::string_view::npos) {
+    return false;
+  }
+  // A '-' inside the hash makes this undercount, which only costs caching.
+  const auto stem = filename.substr(0, dot);
+  const auto dash = stem.rfind('-');
+  if (dash == std::string_view::npos || dash == 0) {
+    return false;
+  }
+  const auto hash = stem.substr(dash + 1);
+  if (hash.size() < kMinHashLength || hash.size() > kMaxHashLength) {
+    return false;
+  }
+  for (const char ch : hash) {
+    if (!std::isalnum(static_cast<unsigned char>(ch)) && ch != '_') {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Maps a request path onto a file below the root, or nullopt if it may not
+// be served. Extensionless paths are client-side routes and get index.html.
+std::optional<std::string> ToRelative(std::string_view path) {
+  if (path.empty() || path[0] != '/' || path == "/api" || path.rfind("/api/", 0) == 0) {
+    return std::nullopt;
+  }
+  path.remove_prefix(1);
+  std::size_t start = 0;
+  while (start < path.size()) {
+    auto end = path.find('/', start);
+    if (end == std::string_view::npos) {
+      end = path.size();
+    }
+    const auto segment = path.substr(start, end - start);
+    // Rejects "..", dotfiles, empty segments and anything the OS would misread.
+    if (segment.empty() || segment[0] == '.' || segment.find_first_of(std::string_view("\\\0", 2)) != std::string_view::npos) {
+      return std::nullopt;
+    }
+    start = end + 1;
+  }
+  const auto slash = path.rfind('/');
+  const auto last = slash == std::string_view::npos ? path : path.substr(slash + 1);
+  if (last.find('.') == std::string_view::npos) {
+    return std::string(kIndexFile);
+  }
+  return std::string(path);
+}
+
+std::string StripSidecarSuffix(const std::string& relative) {
+  for (const auto encoding : {Encoding::kGzip, Encoding::kBrotli}) {
+    const auto suffix = compression_utils::SidecarPath("", encoding);
+    if (relative.size() > suffix.size() && relative.compare(relative.size() - suffix.size(), suffix.size(), suffix) == 0) {
+      return relative.substr(0, relative.size() - suffix.size());
+    }
+  }
+  return relative;
+}
+
+std::string JoinRelative(const std::string& directory, std::string_view name) {
+  return directory.empty() ? std::string(name) : directory + "/" + std::string(name);
+}
+
+// Strong validator from the file's identity: modification time and size.
+std::string MakeEtag(const struct stat& info, Encoding encoding) {
+  std::array<char, 48> buffer{};
+  auto* out = buffer.data();
+  *out++ = '"';
+  const auto mtime_ns = static_cast<std::uint64_t>(info.st_mtim.tv_sec) * 1000000000ULL +
+                        static_cast<std::uint64_t>(info.st_mtim.tv_nsec);
+  out = std::to_chars(out, buffer.data() + buffer.size(), mtime_ns, 16).ptr;
+  *out++ = '-';
+  out = std::to_chars(out, buffer.data() + buffer.size(), static_cast<std::uint64_t>(info.st_size), 16).ptr;
+  std::string etag(buffer.data(), out);
+  if (encoding != Encoding::kIdentity) {
+    // Each encoding is its own representation and needs its own strong tag.
+    etag.push_back('-');
+    etag.append(compression_utils::EncodingName(encoding));
+  }
+  etag.push_back('"');
+  return etag;
+}
+
+metrics::Counter& CacheLoadsCounter() {
+  static auto& counter = metrics::Registry::Instance().GetCounter(
+      "static_file_cache_loads_total", "Static files loaded into the cache.");
+  return counter;
+}
+
+metrics::Counter& CacheInvalidationsCounter() {
+  static auto& counter = metrics::Registry::Instance().GetCounter(
+      "static_file_cache_invalidations_total", "Static file cache entries dropped after a change on disk.");
+  return counter;
+}
+}  // namespace
+
+struct StaticFiles::CachedFile {
+  // The contents, or for files over kMaxBufferedSize the descriptor to send
+  // them from. Never a mapping: a file rewritten in place would turn reads
+  // past its new end into SIGBUS.
+  std::string data;
+  std::shared_ptr<UniqueFd> fd;
+  std::uint64_t size = 0;
+
+  // Reads a regular file; nullptr if it is missing, unreadable or changed
+  // size while being read.
+  static std::shared_ptr<const CachedFile> Open(const std::string& path, struct stat& info) {
+    auto fd = std::make_shared<UniqueFd>(::open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW));
+    if (!*fd || ::fstat(fd->Get(), &info) != 0 || !S_ISREG(info.st_mode)) {
+      return nullptr;
+    }
+    auto file = std::make_shared<CachedFile>();
+    file->size = static_cast<std::uint64_t>(info.st_size);
+    if (file->size > kMaxBufferedSize) {
+      file->fd = std::move(fd);
+      return file;
+    }
+    file->data.resize(file->size);
+    std::size_t read_so_far = 0;
+    while (read_so_far < file->data.size()) {
+      const ssize_t read = ::pread(fd->Get(), file->data.data() + read_so_far, file->data.size() - read_so_far,
+                                   static_cast<off_t>(read_so_far));
+      if (read < 0 && errno == EINTR) {
+        continue;
+      }
+      if (read <= 0) {
+        if (read < 0) {
+          Logger::Warn("Failed to read " + path + ": " + std::strerror(errno));
+        }
+        return nullptr;
+      }
+      read_so_far += static_cast<std::size_t>(read);
+    }
+    return file;
+  }
+};
+
+// One file and its precompressed copies, indexed by Encoding.
+struct StaticFiles::Entry {
+  std::string_view content_type;
+  std::string_view cache_control;
+  std::array<std::shared_ptr<const CachedFile>, kVariantCount> variants;
+  std::array<std::string, kVariantCount> etags;
+};
+
+StaticFiles::StaticFiles(std::string root) : root_(std::move(root)) {
+  std::error_code ec;
+  if (!std::filesystem::is_directory(root_, ec)) {
+    throw std::runtime_error("Static root is not a directory: " + root_);
+  }
+  inotify_fd_.Reset(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+  wake_fd_.Reset(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+  if (!inotify_fd_ || !wake_fd_) {
+    throw std::runtime_error(std::string("Failed to set up static file watcher: ") + std::strerror(errno));
+  }
+  // Watch before the first Serve() so no change can slip in unnoticed.
+  WatchTree("");
+  watcher_ = std::thread([this]() { WatchLoop(); });
+}
+
+StaticFiles::~StaticFiles() {
+  stop_.store(true);
+  const std::uint64_t one = 1;
+  [[maybe_unused]] const auto written = ::write(wake_fd_.Get(), &one, sizeof(one));
+  if (watcher_.joinable()) {
+    watcher_.join();
+  }
+}
+
+std::optional<HttpResponse> StaticFiles::Serve(const HttpRequest& request) {
+  const auto method = ParseHttpMethod(request.method);
+  if (method != HttpMethod::kGet && method != HttpMethod::kHead) {
+    return std::nullopt;
+  }
+  const auto relative = ToRelative(request.path);
+  if (!relative) {
+    return std::nullopt;
+  }
+  const auto entry = Lookup(*relative);
+  if (!entry) {
+    return std::nullopt;
+  }
+
+  const bool has_gzip = entry->variants[static_cast<std::size_t>(Encoding::kGzip)] != nullptr;
+  const bool has_brotli = entry->variants[static_cast<std::size_t>(Encoding::kBrotli)] != nullptr;
+  const auto encoding = content_encoding::Negotiate(request.HeaderView(HeaderId::kAcceptEncoding), has_gzip, has_brotli);
+  const auto index = static_cast<std::size_t>(encoding);
+
+  HttpResponse response;
+  response.body.clear();
+  response.headers.Set(HeaderId::kContentType, std::string(entry->content_type));
+  response.headers.Set(HeaderId::kCacheControl, std::string(entry->cache_control));
+  response.headers.Set(HeaderId::kETag, entry->etags[index]);
+  if (has_gzip || has_brotli) {
+    response.headers.Set(HeaderId::kVary, "accept-encoding");
+  }
+  if (EtagMatches(request.HeaderView(HeaderId::kIfNoneMatch), entry->etags[index])) {
+    response.status_code = 304;
+    response.status_message = detail::ReasonPhrase(304);
+    return response;
+  }
+  if (encoding != Encoding::kIdentity) {
+    response.headers.Set(HeaderId::kContentEncoding, std::string(compression_utils::EncodingName(encoding)));
+  }
+  const auto& file = entry->variants[index];
+  if (file->fd) {
+    response.SetFileBody(file->fd, file->size, 0, file->size);
+  } else {
+    response.shared_body = SharedBody{file, file->data};
+  }
+  return response;
+}
+
+std::shared_ptr<const StaticFiles::Entry> StaticFiles::Lookup(const std::string& relative) {
+  std::uint64_t generation = 0;
+  {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    // A null entry is a remembered miss.
+    if (auto it = entries_.find(relative); it != entries_.end()) {
+      return it->second;
+    }
+    generation = generation_;
+  }
+  auto entry = Load(relative);
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  if (generation != generation_) {
+    return entry;
+  }
+  if (!entry && miss_count_ >= kMaxMisses) {
+    // Cheaper than tracking age; misses are only an optimisation.
+    for (auto it = entries_.begin(); it != entries_.end();) {
+      it = it->second ? std::next(it) : entries_.erase(it);
+    }
+    miss_count_ = 0;
+  }
+  if (entries_.emplace(relative, entry).second && !entry) {
+    ++miss_count_;
+  }
+  return entry;
+}
+
+std::shared_ptr<const StaticFiles::Entry> StaticFiles::Load(const std::string& relative) const {
+  const auto path = root_ + "/" + relative;
+  struct stat info {};
+  auto identity = CachedFile::Open(path, info);
+  if (!identity) {
+    return nullptr;
+  }
+  auto entry = std::make_shared<Entry>();
+  entry->content_type = ContentTypeFor(relative);
+  entry->cache_control = IsFingerprinted(relative) ? kImmutableCacheControl : kRevalidateCacheControl;
+  entry->variants[static_cast<std::size_t>(Encoding::kIdentity)] = std::move(identity);
+  entry->etags[static_cast<std::size_t>(Encoding::kIdentity)] = MakeEtag(info, Encoding::kIdentity);
+  for (const auto encoding : {Encoding::kGzip, Encoding::kBrotli}) {
+    struct stat sidecar_info {};
+    if (auto sidecar = CachedFile::Open(compression_utils::SidecarPath(path, encoding), sidecar_info)) {
+      const auto index = static_cast<std::size_t>(encoding);
+      entry->variants[index] = std::move(sidecar);
+      entry->etags[index] = MakeEtag(sidecar_info, encoding);
+    }
+  }
+  CacheLoadsCounter().Increment();
+  return entry;
+}
+
+void StaticFiles::Invalidate(const std::string& relative, bool directory) {
+  std::unique_lock<std::shared_mutex> lock(mutex_);
+  ++generation_;
+  auto erase = [this](auto it) {
+    if (it->second) {
+      CacheInvalidationsCounter().Increment();
+    } else {
+      --miss_count_;
+    }
+    return entries_.erase(it);
+  };
+  if (!directory) {
+    if (auto it = entries_.find(relative); it != entries_.end()) {
+      erase(it);
+    }
+    return;
+  }
+  const auto prefix = relative.empty() ? relative : relative + "/";
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    it = it->first.rfind(prefix, 0) == 0 ? erase(it) : std::next(it);
+  }
+}
+
+void StaticFiles::WatchLoop() {
+  while (!stop_.load()) {
+    if (!root_watched_) {
+      WatchTree("");
+      if (root_watched_) {
+        Logger::Info("Static root is back: " + root_);
+        Invalidate("", true);
+      }
+    }
+    std::array<pollfd, 2> fds{{{inotify_fd_.Get(), POLLIN, 0}, {wake_fd_.Get(), POLLIN, 0}}};
+    const int ready = ::poll(fds.data(), fds.size(), root_watched_ ? -1 : kRootRetryMs);
+    if (ready < 0 && errno != EINTR) {
+      Logger::Error(std::string("Static file watcher failed: ") + std::strerror(errno));
+      return;
+    }
+    if (ready > 0 && (fds[0].revents & POLLIN)) {
+      HandleEvents();
+    }
+  }
+}
+
+void StaticFiles::WatchTree(const std::string& relative) {
+  const auto path = relative.empty() ? root_ : root_ + "/" + relative;
+  const int wd = ::inotify_add_watch(inotify_fd_.Get(), path.c_str(), kWatchMask);
+  if (wd < 0) {
+    return;
+  }
+  watched_dirs_[wd] = relative;
+  if (relative.empty()) {
+    root_watched_ = true;
+  }
+  std::error_code ec;
+  for (const auto& child : std::filesystem::directory_iterator(path, ec)) {
+    std::error_code type_ec;
+    if (child.is_directory(type_ec) && !child.is_symlink(type_ec)) {
+      WatchTree(JoinRelative(relative, child.path().filename().string()));
+    }
+  }
+}
+
+void StaticFiles::Unwatch(const std::string& relative) {
+  const auto prefix = relative + "/";
+  for (auto it = watched_dirs_.begin(); it != watched_dirs_.end();) {
+    if (it->second == relative || it->second.rfind(prefix, 0) == 0) {
+      ::inotify_rm_watch(inotify_fd_.Get(), it->first);
+      it = watched_dirs_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void StaticFiles::HandleEvents() {
+  alignas(inotify_event) std::array<char, 16 * 1024> buffer{};
+  for (;;) {
+    const ssize_t length = ::read(inotify_fd_.Get(), buffer.data(), buffer.size());
+    if (length <= 0) {
+      return;
+    }
+    for (const char* cursor = buffer.data(); cursor < buffer.data() + length;) {
+      const auto* event = reinterpret_cast<const inotify_event*>(cursor);
+      cursor += sizeof(inotify_event) + event->len;
+
+      if (event->mask & IN_Q_OVERFLOW) {
+        Invalidate("", true);
+        continue;
+      }
+      const auto dir = watched_dirs_.find(event->wd);
+      if (dir == watched_dirs_.end()) {
+        continue;
+      }
+      if (event->mask & IN_IGNORED) {
+        watched_dirs_.erase(dir);
+        continue;
+      }
+      if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+        if (dir->second.empty()) {
+          // The whole tree was removed or swapped out (e.g. a redeploy renamed
+          // a fresh build into place); start over once the root reappears.
+          Logger::Warn("Static root went away: " + root_);
+          for (const auto& [wd, relative] : watched_dirs_) {
+            ::inotify_rm_watch(inotify_fd_.Get(), wd);
+          }
+          watched_dirs_.clear();
+          root_watched_ = false;
+          Invalidate("", true);
+        }
+        continue;
+      }
+      const auto relative = JoinRelative(dir->second, event->len > 0 ? event->name : "");
+      if (event->mask & IN_ISDIR) {
+        if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+          Unwatch(relative);
+        }
+        if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+          WatchTree(relative);
+        }
+        Invalidate(relative, true);
+        continue;
+      }
+      Invalidate(StripSidecarSuffix(relative), false);
+    }
+  }
+}
@@ -0,0 +1,229 @@
+#include "http/tls.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <openssl/err.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+
+namespace {
+// What the non-kTLS SendFile path reads per step; four full TLS records.
+constexpr std::size_t kFileChunk = 64 * 1024;
+constexpr long kSessionLifetimeSeconds = 2 * 60 * 60;
+constexpr unsigned char kSessionContext[] = "ppt_generate_back";
+// Wire-format ALPN protocol lists, in order of preference.
+constexpr std::string_view kAlpnHttp2{"\x02h2\x08http/1.1"};
+constexpr std::string_view kAlpnHttp11{"\x08http/1.1"};
+
+// |arg| is the std::string_view of protocols we accept.
+int SelectAlpn(SSL*, const unsigned char** out, unsigned char* out_length,
+               const unsigned char* offered, unsigned int offered_length, void* arg) {
+  const auto* protocols = static_cast<const std::string_view*>(arg);
+  unsigned char* selected = nullptr;
+  if (SSL_select_next_proto(&selected, out_length, reinterpret_cast<const unsigned char*>(protocols->data()),
+                            static_cast<unsigned int>(protocols->size()), offered,
+                            offered_length) != OPENSSL_NPN_NEGOTIATED) {
+    // Nothing in common: carry on without ALPN rather than failing the handshake.
+    return SSL_TLSEXT_ERR_NOACK;
+  }
+  *out = selected;
+  return SSL_TLSEXT_ERR_OK;
+}
+}  // namespace
+
+TlsSession::TlsSession(SSL* ssl) : ssl_(ssl) {}
+
+TlsSession::~TlsSession() { SSL_free(ssl_); }
+
+TlsSession::Status TlsSession::Result(int ret) const {
+  switch (SSL_get_error(ssl_, ret)) {
+    case SSL_ERROR_WANT_READ:
+      return Status::kWantRead;
+    case SSL_ERROR_WANT_WRITE:
+      return Status::kWantWrite;
+    case SSL_ERROR_ZERO_RETURN:
+      return Status::kClosed;
+    default:
+      return Status::kError;
+  }
+}
+
+TlsSession::Status TlsSession::Handshake() {
+  ERR_clear_error();
+  const int ret = SSL_do_handshake(ssl_);
+  if (ret == 1) {
+    established_ = true;
+    return Status::kOk;
+  }
+  return Result(ret);
+}
+
+bool TlsSession::resumed() const { return SSL_session_reused(ssl_) == 1; }
+
+bool TlsSession::kernel_send() const { return BIO_get_ktls_send(SSL_get_wbio(ssl_)) > 0; }
+
+std::string_view TlsSession::alpn() const {
+  const unsigned char* protocol = nullptr;
+  unsigned int length = 0;
+  SSL_get0_alpn_selected(ssl_, &protocol, &length);
+  return protocol ? std::string_view(reinterpret_cast<const char*>(protocol), length) : std::string_view();
+}
+
+TlsSession::Status TlsSession::Read(char* buffer, std::size_t size, std::size_t& count) {
+  ERR_clear_error();
+  const int ret = SSL_read_ex(ssl_, buffer, size, &count);
+  return ret == 1 ? Status::kOk : Result(ret);
+}
+
+TlsSession::Status TlsSession::Write(const char* data, std::size_t size, std::size_t& count) {
+  count = 0;
+  if (size == 0) {
+    return Status::kOk;
+  }
+  ERR_clear_error();
+  const int ret = SSL_write_ex(ssl_, data, size, &count);
+  return ret == 1 ? Status::kOk : Result(ret);
+}
+
+TlsSession::Status TlsSession::SendFile(int file_fd, std::uint64_t offset, std::size_t size, std::size_t& count) {
+  count = 0;
+  if (kernel_send()) {
+    ERR_clear_error();
+    const auto sent = SSL_sendfile(ssl_, file_fd, static_cast<off_t>(offset), size, 0);
+    if (sent > 0) {
+      count = static_cast<std::size_t>(sent);
+      return Status::kOk;
+    }
+    return sent == 0 ? Status::kError : Result(static_cast<int>(sent));
+  }
+
+  // The buffered bytes are the ones at |offset|: the caller only moves on by what we report sent.
+  if (file_buffer_.empty()) {
+    file_buffer_.resize(std::min(size, kFileChunk));
+    ssize_t read = -1;
+    do {
+      read = ::pread(file_fd, file_buffer_.data(), file_buffer_.size(), static_cast<off_t>(offset));
+    } while (read < 0 && errno == EINTR);
+    if (read <= 0) {
+      file_buffer_.clear();
+      return Status::kError;
+    }
+    file_buffer_.resize(static_cast<std::size_t>(read));
+    file_buffer_sent_ = 0;
+  }
+  const auto status = Write(file_buffer_.data() + file_buffer_sent_, file_buffer_.size() - file_buffer_sent_, count);
+  if (status == Status::kOk) {
+    file_buffer_sent_ += count;
+    if (file_buffer_sent_ == file_buffer_.size()) {
+      file_buffer_.clear();
+    }
+  }
+  return status;
+}
+
+void TlsSession::Shutdown() {
+  if (!established_) {
+    return;
+  }
+  ERR_clear_error();
+  SSL_shutdown(ssl_);
+  ERR_clear_error();
+}
+
+std::string TlsSession::LastError() {
+  const auto code = ERR_get_error();
+  if (code == 0) {
+    return errno != 0 ? std::string(strerror(errno)) : std::string("connection closed during handshake");
+  }
+  char message[256];
+  ERR_error_string_n(code, message, sizeof(message));
+  ERR_clear_error();
+  return message;
+}
+
+TlsContext::TlsContext(std::string certificate_path, std::string private_key_path, bool kernel_tls, bool http2)
+    : certificate_path_(std::move(certificate_path)),
+      private_key_path_(std::move(private_key_path)),
+      kernel_tls_(kernel_tls),
+      http2_(http2) {
+  if (RAND_bytes(ticket_keys_.data(), static_cast<int>(ticket_keys_.size())) != 1) {
+    throw std::runtime_error("Failed to generate TLS session ticket keys");
+  }
+  std::string error;
+  context_ = Build(error);
+  if (!context_) {
+    throw std::runtime_error(error);
+  }
+}
+
+std::shared_ptr<SSL_CTX> TlsContext::Build(std::string& error) const {
+  std::shared_ptr<SSL_CTX> context(SSL_CTX_new(TLS_server_method()), SSL_CTX_free);
+  if (!context) {
+    error = "Failed to create TLS context: " + TlsSession::LastError();
+    return nullptr;
+  }
+  auto* ctx = context.get();
+  SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+  // HTTP delimits its own messages, so a peer closing without close_notify is just a close.
+  auto options = SSL_OP_NO_RENEGOTIATION | SSL_OP_CIPHER_SERVER_PREFERENCE | SSL_OP_IGNORE_UNEXPECTED_EOF;
+  if (kernel_tls_) {
+    options |= SSL_OP_ENABLE_KTLS;
+  }
+  SSL_CTX_set_options(ctx, options);
+  // Writes resume from the connection's own offsets, and idle keep-alive
+  // connections should not hold on to record buffers.
+  SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER | SSL_MODE_RELEASE_BUFFERS);
+
+  // Resumption: session IDs for TLS 1.2 clients that want them, tickets
+  // (encrypted with keys shared by every context we build) for the rest.
+  SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+  SSL_CTX_set_session_id_context(ctx, kSessionContext, sizeof(kSessionContext) - 1);
+  SSL_CTX_set_timeout(ctx, kSessionLifetimeSeconds);
+  SSL_CTX_set_tlsext_ticket_keys(ctx, const_cast<unsigned char*>(ticket_keys_.data()), ticket_keys_.size());
+  SSL_CTX_set_alpn_select_cb(ctx, SelectAlpn, const_cast<std::string_view*>(http2_ ? &kAlpnHttp2 : &kAlpnHttp11));
+
+  if (SSL_CTX_use_certificate_chain_file(ctx, certificate_path_.c_str()) != 1) {
+    error = "Failed to load TLS certificate " + certificate_path_ + ": " + TlsSession::LastError();
+    return nullptr;
+  }
+  if (SSL_CTX_use_PrivateKey_file(ctx, private_key_path_.c_str(), SSL_FILETYPE_PEM) != 1 ||
+      SSL_CTX_check_private_key(ctx) != 1) {
+    error = "Failed to load TLS private key " + private_key_path_ + ": " + TlsSession::LastError();
+    return nullptr;
+  }
+  return context;
+}
+
+bool TlsContext::Reload(std::string& error) {
+  auto context = Build(error);
+  if (!context) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  context_ = std::move(context);
+  return true;
+}
+
+std::unique_ptr<TlsSession> TlsContext::Accept(int fd) const {
+  std::shared_ptr<SSL_CTX> context;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    context = context_;
+  }
+  // The SSL holds its own reference to the context, so a reload can drop ours.
+  SSL* ssl = SSL_new(context.get());
+  if (!ssl) {
+    return nullptr;
+  }
+  if (SSL_set_fd(ssl, fd) != 1) {
+    SSL_free(ssl);
+    return nullptr;
+  }
+  SSL_set_accept_state(ssl);
+  return std::make_unique<TlsSession>(ssl);
+}
@@ -7,12 +7,15 @@
 #include "app_config.h"
 #include "controllers/auth_controller.h"
 #include "controllers/admin_controller.h"
+#include "controllers/batch_controller.h"
 #include "controllers/ppt_controller.h"
 #include "controllers/template_controller.h"
 #include "controllers/model_controller.h"
 #include "database/mysql_connection_pool.h"
 #include "http/http_server.h"
+#include "http/listener_handoff.h"
 #include "logger.h"
+#include "utils/metrics.h"
 #include "services/auth_service.h"
 #include "services/email_service.h"
 #include "services/ppt_service.h"
@@ -20,14 +23,49 @@
 #include "services/template_service.h"
 #include "services/ppt_service_interface.h"
 #include "services/libreoffice_powerpoint_service.h"
+#include "services/progress_hub.h"
 #include "services/s3_client.h"
 
 namespace {
 std::atomic<bool> g_should_stop{false};
+std::atomic<bool> g_should_reload{false};
 
 void SignalHandler(int) {
   g_should_stop.store(true);
 }
+
+void ReloadHandler(int) {
+  g_should_reload.store(true);
+}
+
+constexpr std::size_t kSmallBodyLimit = 16 * 1024;
+constexpr std::size_t kPromptBodyLimit = 256 * 1024;
+
+constexpr std::size_t kCompressMinSize = 1024;
+
+// {auth_required, body_limit, priority, compress_min_size, compress_level}
+const RouteOptions kProbeRoute{false, 0, 10};
+const RouteOptions kPublicRoute{false, kSmallBodyLimit, 5};
+const RouteOptions kUserRoute{true, kSmallBodyLimit, 0};
+// Every generation calls the model provider, and every credential check
+// hashes a password or sends mail, so these are rate limited by default;
+// server.rate_limits overrides the limits per route.
+// {per_ip {rate, burst}, per_token {rate, burst}}
+const RateLimitConfig kGenerationLimit{{0.5, 20}, {0.1, 5}};
+const RateLimitConfig kCredentialLimit{{0.2, 10}, {}};
+
+RouteOptions WithRateLimit(RouteOptions options, const RateLimitConfig& limit) {
+  options.rate_limit = limit;
+  return options;
+}
+
+const RouteOptions kCredentialRoute = WithRateLimit(kPublicRoute, kCredentialLimit);
+const RouteOptions kGenerationRoute = WithRateLimit({true, kPromptBodyLimit, -10}, kGenerationLimit);
+// JSON listings that are fetched often and compress well.
+const RouteOptions kPublicListingRoute{false, kSmallBodyLimit, 5, kCompressMinSize, 6};
+const RouteOptions kUserListingRoute{true, kSmallBodyLimit, 0, kCompressMinSize, 5};
+// Sub-requests carry their own auth checks, so the batch itself needs none.
+const RouteOptions kBatchRoute{false, kSmallBodyLimit, 0, kCompressMinSize, 5};
 }
 
 int main(int argc, char* argv[]) {
@@ -41,6 +79,7 @@ int main(int argc, char* argv[]) {
 
   std::signal(SIGINT, SignalHandler);
   std::signal(SIGTERM, SignalHandler);
+  std::signal(SIGHUP, ReloadHandler);
 #ifdef SIGPIPE
   std::signal(SIGPIPE, SIG_IGN);
 #endif
@@ -75,6 +114,8 @@ int main(int argc, char* argv[]) {
       qwen_client = std::make_shared<QwenClient>(config.providers().qwen_api_key);
     }
 
+    auto progress_hub = std::make_shared<ProgressHub>();
+
     Router router;
     AuthController auth_controller(auth_service);
     AdminController admin_controller(auth_service);
@@ -84,94 +125,183 @@ int main(int argc, char* argv[]) {
                                  template_service,
                                  config.generation(),
                                  qwen_client,
-                                 s3_client);
+                                 s3_client,
+                                 progress_hub);
     TemplateController template_controller(template_service);
     ModelController model_controller(model_service);
 
     Logger::Info("PPT output directory: " + config.generation().output_dir);
 
-    router.AddRoute("GET", "/api/health", [](const HttpRequest&) {
-      return HttpResponse::Json(200, {{"status", "ok"}});
-    });
+    // Routes may still be added after construction; Start() freezes them.
+    HttpServer server(config.server(), router);
+
+    router.AddRoute("GET", "/api/health", [&server](const HttpRequest&) {
+      nlohmann::json shards = nlohmann::json::array();
+      for (const auto& shard : server.GetShardStats()) {
+        shards.push_back({{"shard", shard.index},
+                          {"accepted", shard.accepted},
+                          {"open", shard.open_connections},
+                          {"requests", shard.requests}});
+      }
+      return HttpResponse::Json(200, {{"status", "ok"}, {"shards", shards}});
+    }, kProbeRoute);
+
+    router.AddRoute("GET", "/api/metrics", [](const HttpRequest&) {
+      HttpResponse response;
+      response.headers.Set(HeaderId::kContentType, "text/plain; version=0.0.4; charset=utf-8");
+      response.body = metrics::Registry::Instance().Render();
+      return response;
+    }, kProbeRoute);
 
     router.AddRoute("POST", "/api/auth/register", [&auth_controller](const HttpRequest& request) {
       return auth_controller.Register(request);
-    });
+    }, kCredentialRoute);
 
     router.AddRoute("POST", "/api/auth/login", [&auth_controller](const HttpRequest& request) {
       return auth_controller.Login(request);
-    });
+    }, kCredentialRoute);
 
     router.AddRoute("POST", "/api/auth/logout", [&auth_controller](const HttpRequest& request) {
       return auth_controller.Logout(request);
-    });
+    }, kUserRoute);
 
     router.AddRoute("POST", "/api/auth/password/reset/request", [&auth_controller](const HttpRequest& request) {
       return auth_controller.RequestPasswordReset(request);
-    });
+    }, kCredentialRoute);
     router.AddRoute("POST", "/api/auth/password/reset/confirm", [&auth_controller](const HttpRequest& request) {
       return auth_controller.ConfirmPasswordReset(request);
-    });
+    }, kCredentialRoute);
 
     router.AddRoute("GET", "/api/auth/user", [&auth_controller](const HttpRequest& request) {
       return auth_controller.CurrentUser(request);
-    });
+    }, kUserRoute);
 
+#if PPT_HAVE_COROUTINES
+    router.AddAsyncRoute("POST", "/api/ppt/generate", [&ppt_controller](const HttpRequest& request) {
+      return ppt_controller.GenerateAsync(request);
+    }, kGenerationRoute);
+#else
     router.AddRoute("POST", "/api/ppt/generate", [&ppt_controller](const HttpRequest& request) {
       return ppt_controller.Generate(request);
-    });
+    }, kGenerationRoute);
+#endif
+    router.AddRoute("POST", "/api/ppt/outline", [&ppt_controller](const HttpRequest& request) {
+      return ppt_controller.Outline(request);
+    }, kGenerationRoute);
 
     router.AddRoute("GET", "/api/ppt/history", [&ppt_controller](const HttpRequest& request) {
       return ppt_controller.History(request);
-    });
+    }, kUserListingRoute);
 
     router.AddRoute("GET", "/api/admin/ppt/history", [&ppt_controller](const HttpRequest& request) {
       return ppt_controller.AdminHistory(request);
-    });
+    }, kUserListingRoute);
+    router.AddRoute("GET", "/api/admin/ppt/export", [&ppt_controller](const HttpRequest& request) {
+      return ppt_controller.AdminExport(request);
+    }, kUserRoute);
     router.AddRoute("GET", "/api/admin/ppt/metrics", [&ppt_controller](const HttpRequest& request) {
       return ppt_controller.AdminMetrics(request);
-    });
+    }, kUserRoute);
     router.AddRoute("GET", "/api/admin/users", [&admin_controller](const HttpRequest& request) {
       return admin_controller.ListUsers(request);
-    });
+    }, kUserRoute);
     router.AddRoute("POST", "/api/admin/users/status", [&admin_controller](const HttpRequest& request) {
       return admin_controller.UpdateUserStatus(request);
-    });
+    }, kUserRoute);
 
+    router.AddRoute("DELETE", "/api/ppt/{id}", [&ppt_controller](const HttpRequest& request) {
+      return ppt_controller.Delete(request);
+    }, kUserRoute);
+    router.AddRoute("GET", "/api/ppt/{id}/file", [&ppt_controller](const HttpRequest& request) {
+      return ppt_controller.Download(request);
+    }, kUserRoute);
+    router.AddRoute("HEAD", "/api/ppt/{id}/file", [&ppt_controller](const HttpRequest& request) {
+      return ppt_controller.Download(request);
+    }, kUserRoute);
+    router.AddRoute("GET", "/api/ppt/{id}/events", [&ppt_controller](const HttpRequest& request) {
+      return ppt_controller.Events(request);
+    }, kUserRoute);
+    router.AddRoute("GET", "/api/ppt/{id}/preview", [&ppt_controller](const HttpRequest& request) {
+      return ppt_controller.Preview(request);
+    }, kUserListingRoute);
+
+    // Query-string forms kept for links issued before path parameters existed.
     router.AddRoute("DELETE", "/api/ppt/history", [&ppt_controller](const HttpRequest& request) {
       return ppt_controller.Delete(request);
-    });
+    }, kUserRoute);
     router.AddRoute("GET", "/api/ppt/file", [&ppt_controller](const HttpRequest& request) {
       return ppt_controller.Download(request);
-    });
+    }, kUserRoute);
     router.AddRoute("HEAD", "/api/ppt/file", [&ppt_controller](const HttpRequest& request) {
       return ppt_controller.Download(request);
-    });
+    }, kUserRoute);
     router.AddRoute("GET", "/api/ppt/preview", [&ppt_controller](const HttpRequest& request) {
       return ppt_controller.Preview(request);
-    });
+    }, kUserListingRoute);
 
+    // Catalogs are polled constantly but only change on restart.
+    auto template_list_route = kPublicListingRoute;
+    template_list_route.validators = [&template_controller](const HttpRequest&) {
+      return std::optional<ResponseValidators>(template_controller.ListValidators());
+    };
     router.AddRoute("GET", "/api/templates", [&template_controller](const HttpRequest& request) {
       return template_controller.List(request);
-    });
+    }, template_list_route);
+    router.AddRoute("GET", "/api/templates/{id}/file", [&template_controller](const HttpRequest& request) {
+      return template_controller.Download(request);
+    }, kPublicRoute);
     router.AddRoute("GET", "/api/templates/file", [&template_controller](const HttpRequest& request) {
       return template_controller.Download(request);
-    });
+    }, kPublicRoute);
 
+    auto model_list_route = kPublicRoute;
+    model_list_route.validators = [&model_controller](const HttpRequest&) {
+      return std::optional<ResponseValidators>(model_controller.ListValidators());
+    };
     router.AddRoute("GET", "/api/models", [&model_controller](const HttpRequest& request) {
       return model_controller.List(request);
-    });
-    router.AddRoute("POST", "/api/ppt/outline", [&ppt_controller](const HttpRequest& request) {
-      return ppt_controller.Outline(request);
-    });
+    }, model_list_route);
 
-    HttpServer server(config.server(), router);
-    server.Start();
+    // Page loads fetch the user, catalogs and history in one request.
+    BatchController batch_controller(router, server, auth_service, kBatchRoute.priority);
+    router.AddRoute("POST", "/api/batch", [&batch_controller](const HttpRequest& request) {
+      return batch_controller.Handle(request);
+    }, kBatchRoute);
+
+    // A process already serving the handoff socket gives us its listeners
+    // and drains once we accept on them.
+    const auto& handoff_path = config.server().handoff_socket;
+    ListenerHandoff::Inherited inherited;
+    if (!handoff_path.empty()) {
+      inherited = ListenerHandoff::Receive(handoff_path);
+    }
+    server.Start(std::move(inherited.listeners));
+    ListenerHandoff::Acknowledge(inherited);
+
+    std::unique_ptr<ListenerHandoff> handoff;
+    if (!handoff_path.empty()) {
+      handoff = std::make_unique<ListenerHandoff>(
+          handoff_path, [&server]() { return server.ListenerFds(); }, []() { g_should_stop.store(true); });
+    }
 
     while (!g_should_stop.load()) {
+      if (g_should_reload.exchange(false)) {
+        // New connections get the renewed certificate; open ones keep theirs.
+        server.ReloadTls();
+      }
       std::this_thread::sleep_for(std::chrono::milliseconds(200));
     }
+    // No handoff may race the listeners closing below.
+    handoff.reset();
 
+    // Stop taking work, give generations and open requests until the drain
+    // deadline to finish, and mark any generation cut short as interrupted.
+    Logger::Info("Shutting down; draining for up to " + std::to_string(config.server().drain_timeout_seconds) + "s");
+    const auto drain_deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(config.server().drain_timeout_seconds);
+    server.StopAccepting();
+    ppt_controller.Drain(drain_deadline);
+    server.Drain(drain_deadline);
     server.Stop();
   } catch (const std::exception& ex) {
     Logger::Error(std::string("后台服务启动失败: ") + ex.what());
@@ -176,6 +176,10 @@ bool AuthService::Logout(const std::string& token, std::string& error_message) {
 }
 
 std::optional<User> AuthService::GetUserFromToken(const std::string& token, std::string& error_message) const {
+  if (current_lookup_ && current_lookup_->token == token) {
+    error_message = current_lookup_->error;
+    return current_lookup_->user;
+  }
   auto connection = pool_->GetConnection();
   MYSQL* conn = connection.Get();
   auto user = FindUserByToken(conn, token);
@@ -9,6 +9,7 @@
 #include <nlohmann/json.hpp>
 
 #include "logger.h"
+#include "utils/compression.h"
 
 LibreOfficePowerPointService::LibreOfficePowerPointService(LibreOfficeRuntimeOptions options)
     : options_(std::move(options)) {}
@@ -40,7 +41,25 @@ bool LibreOfficePowerPointService::ApplyTheme(const std::string&,
   return true;
 }
 
-bool LibreOfficePowerPointService::Save(const std::string&) {
+bool LibreOfficePowerPointService::Save(const std::string& ppt_path) {
+  std::vector<std::string> command;
+  if (!PrepareSave(ppt_path, command)) {
+    return false;
+  }
+
+  std::ostringstream command_line;
+  for (std::size_t i = 0; i < command.size(); ++i) {
+    command_line << (i == 0 ? "" : " ") << '"' << command[i] << '"';
+  }
+  const int result = std::system(command_line.str().c_str());
+  if (result != 0) {
+    Logger::Warn("PPT生成脚本执行失败");
+    return false;
+  }
+  return true;
+}
+
+bool LibreOfficePowerPointService::PrepareSave(const std::string&, std::vector<std::string>& command) {
   std::string error;
   if (!EnsurePathsReady(error)) {
     Logger::Warn(error);
@@ -103,26 +122,27 @@ bool LibreOfficePowerPointService::Save(const std::string&) {
     payload["slides"].push_back(item);
   }
 
+  const auto payload_text = payload.dump();
   std::ofstream output(payload_path);
   if (!output.is_open()) {
     Logger::Warn("无法写入PPT生成数据文件");
     return false;
   }
-  output << payload.dump();
+  output << payload_text;
   output.close();
-
-  std::ostringstream command;
-  command << '"' << options_.python_binary << '"'
-          << " \"" << options_.builder_script << "\""
-          << " --template \"" << template_path_for_script << "\""
-          << " --output \"" << output_path_ << "\""
-          << " --data-json \"" << payload_path.string() << "\"";
-
-  const int result = std::system(command.str().c_str());
-  if (result != 0) {
-    Logger::Warn("PPT生成脚本执行失败");
-    return false;
+  // The same file backs /api/ppt/{id}/preview; precompress it once here.
+  if (std::string sidecar_error; !compression_utils::WriteSidecars(payload_path.string(), payload_text, sidecar_error)) {
+    Logger::Warn("预览数据压缩失败: " + sidecar_error);
   }
+
+  command = {options_.python_binary,
+             options_.builder_script,
+             "--template",
+             template_path_for_script,
+             "--output",
+             output_path_,
+             "--data-json",
+             payload_path.string()};
   return true;
 }
 
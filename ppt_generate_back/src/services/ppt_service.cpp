@@ -4,6 +4,8 @@
 #include <ctime>
 #include <sstream>
 #include <cstring>  // 添加cstring头文件
+#include <limits>
+#include <optional>
 #include <unordered_map>
 #include <mysql/mysql.h>
 #include "logger.h"  // 添加日志头文件
@@ -371,18 +373,8 @@ std::vector<PptRequest> PptService::GetHistory(std::uint64_t user_id,
   return result;
 }
 
-std::vector<PptRequest> PptService::GetAdminHistory(const std::string& query, std::string& error) {
-  std::vector<PptRequest> result;
-  auto connection = pool_->GetConnection();
-  MYSQL* conn = connection.Get();
-  if (!conn) {
-    error = "无法获取数据库连接";
-    return result;
-  }
-
-  const bool has_query = !query.empty();
-  const std::string sql = has_query
-                              ? R"(
+namespace {
+constexpr char kAdminHistorySelect[] = R"(
       SELECT r.id, r.user_id, u.username, u.email,
              r.title, r.topic, r.pages, r.style,
              r.include_images, r.include_charts, r.include_notes,
@@ -392,38 +384,37 @@ std::vector<PptRequest> PptService::GetAdminHistory(const std::string& query, st
              UNIX_TIMESTAMP(r.updated_at) AS updated_at
       FROM ppt_requests r
       INNER JOIN users u ON r.user_id = u.id
-      WHERE (r.title LIKE ? OR r.topic LIKE ? OR u.username LIKE ? OR u.email LIKE ?)
-      ORDER BY r.created_at DESC LIMIT 100
-    )"
-                              : R"(
-      SELECT r.id, r.user_id, u.username, u.email,
-             r.title, r.topic, r.pages, r.style,
-             r.include_images, r.include_charts, r.include_notes,
-             r.model_key, r.model_name, r.template_id, r.template_name,
-             r.status, r.output_path,
-             UNIX_TIMESTAMP(r.created_at) AS created_at,
-             UNIX_TIMESTAMP(r.updated_at) AS updated_at
-      FROM ppt_requests r
-      INNER JOIN users u ON r.user_id = u.id
-      ORDER BY r.created_at DESC LIMIT 100
     )";
-
+constexpr char kAdminHistoryFilter[] = "(r.title LIKE ? OR r.topic LIKE ? OR u.username LIKE ? OR u.email LIKE ?)";
+constexpr int kExportPageSize = 500;
+
+// Runs a kAdminHistorySelect query. Its placeholders are the four LIKE
+// patterns built from |query| (when non-empty), then |before_id| (if set).
+bool QueryAdminHistory(MYSQL* conn,
+                       const std::string& sql,
+                       const std::string& query,
+                       std::optional<std::uint64_t> before_id,
+                       std::vector<PptRequest>& out,
+                       std::string& error) {
+  const bool has_query = !query.empty();
   MYSQL_STMT* stmt = mysql_stmt_init(conn);
   if (!stmt) {
     error = "无法初始化SQL语句";
-    return result;
+    return false;
   }
 
   if (mysql_stmt_prepare(stmt, sql.c_str(), sql.length()) != 0) {
     mysql_stmt_close(stmt);
     error = "无法准备SQL语句";
-    return result;
+    return false;
   }
 
-  MYSQL_BIND params[4];
+  MYSQL_BIND params[5];
   memset(params, 0, sizeof(params));
   std::string like_query;
   unsigned long like_len = 0;
+  unsigned long long before = before_id.value_or(0);
+  unsigned int param_count = 0;
   if (has_query) {
     like_query = "%" + query + "%";
     like_len = static_cast<unsigned long>(like_query.size());
@@ -433,18 +424,25 @@ std::vector<PptRequest> PptService::GetAdminHistory(const std::string& query, st
       params[i].buffer_length = like_len;
       params[i].length = &like_len;
     }
+    param_count = 4;
+  }
+  if (before_id) {
+    params[param_count].buffer_type = MYSQL_TYPE_LONGLONG;
+    params[param_count].buffer = &before;
+    params[param_count].is_unsigned = 1;
+    ++param_count;
   }
 
-  if (has_query && mysql_stmt_bind_param(stmt, params) != 0) {
+  if (param_count > 0 && mysql_stmt_bind_param(stmt, params) != 0) {
     mysql_stmt_close(stmt);
     error = "参数绑定失败";
-    return result;
+    return false;
   }
 
   if (mysql_stmt_execute(stmt) != 0) {
     mysql_stmt_close(stmt);
     error = "无法执行SQL语句";
-    return result;
+    return false;
   }
 
   MYSQL_BIND result_bind[19];
@@ -559,13 +557,13 @@ std::vector<PptRequest> PptService::GetAdminHistory(const std::string& query, st
   if (mysql_stmt_bind_result(stmt, result_bind) != 0) {
     mysql_stmt_close(stmt);
     error = "结果绑定失败";
-    return result;
+    return false;
   }
 
   if (mysql_stmt_store_result(stmt) != 0) {
     mysql_stmt_close(stmt);
     error = "存储结果失败";
-    return result;
+    return false;
   }
 
   int fetch_status = 0;
@@ -590,7 +588,7 @@ std::vector<PptRequest> PptService::GetAdminHistory(const std::string& query, st
     req.output_path = std::string(output_path, output_path_len);
     req.created_at = created_at;
     req.updated_at = updated_at;
-    result.push_back(req);
+    out.push_back(std::move(req));
   }
 
   if (fetch_status != 0 && fetch_status != MYSQL_DATA_TRUNCATED && fetch_status != MYSQL_NO_DATA) {
@@ -599,10 +597,67 @@ std::vector<PptRequest> PptService::GetAdminHistory(const std::string& query, st
 
   mysql_stmt_free_result(stmt);
   mysql_stmt_close(stmt);
+  return error.empty();
 
+}
+}  // namespace
+
+std::vector<PptRequest> PptService::GetAdminHistory(const std::string& query, std::string& error) {
+  std::vector<PptRequest> result;
+  auto connection = pool_->GetConnection();
+  MYSQL* conn = connection.Get();
+  if (!conn) {
+    error = "无法获取数据库连接";
+    return result;
+  }
+
+  std::string sql = kAdminHistorySelect;
+  if (!query.empty()) {
+    sql += std::string(" WHERE ") + kAdminHistoryFilter;
+  }
+  sql += " ORDER BY r.created_at DESC LIMIT 100";
+  QueryAdminHistory(conn, sql, query, std::nullopt, result, error);
   return result;
 }
 
+bool PptService::ExportAdminHistory(const std::string& query,
+                                    const std::function<bool(const PptRequest&)>& visit,
+                                    std::string& error) {
+  // Keyset pagination on the primary key: each page starts below the last id seen.
+  std::string sql = std::string(kAdminHistorySelect) + " WHERE ";
+  if (!query.empty()) {
+    sql += std::string(kAdminHistoryFilter) + " AND ";
+  }
+  sql += "r.id < ? ORDER BY r.id DESC LIMIT " + std::to_string(kExportPageSize);
+
+  std::uint64_t before_id = std::numeric_limits<std::uint64_t>::max();
+  while (true) {
+    std::vector<PptRequest> page;
+    {
+      // Hold a connection only while fetching, never while |visit| waits on the client.
+      auto connection = pool_->GetConnection();
+      MYSQL* conn = connection.Get();
+      if (!conn) {
+        error = "无法获取数据库连接";
+        return false;
+      }
+      page.reserve(kExportPageSize);
+      if (!QueryAdminHistory(conn, sql, query, before_id, page, error)) {
+        return false;
+      }
+    }
+    for (const auto& item : page) {
+      if (!visit(item)) {
+        return true;
+      }
+    }
+    if (page.size() < static_cast<std::size_t>(kExportPageSize)) {
+      return true;
+    }
+    before_id = page.back().id;
+  }
+}
+
 bool PptService::DeleteRequest(std::uint64_t user_id,
                               std::uint64_t request_id,
                               std::string& error) {
@@ -667,7 +722,8 @@ bool PptService::DeleteRequest(std::uint64_t user_id,
 bool PptService::GetRequest(std::uint64_t user_id,
                             std::uint64_t request_id,
                             PptRequest& out_request,
-                            std::string& error) {
+                            std::string& error,
+                            bool any_user) {
   auto connection = pool_->GetConnection();
   MYSQL* conn = connection.Get();
   if (!conn) {
@@ -675,15 +731,15 @@ bool PptService::GetRequest(std::uint64_t user_id,
     return false;
   }
 
-  const std::string sql = R"(
+  const std::string sql = std::string(R"(
       SELECT id, user_id, title, topic, pages, style,
              include_images, include_charts, include_notes,
              model_key, model_name, template_id, template_name,
              status, output_path,
              UNIX_TIMESTAMP(created_at) AS created_at,
              UNIX_TIMESTAMP(updated_at) AS updated_at
-      FROM ppt_requests WHERE user_id = ? AND id = ? LIMIT 1
-    )";
+      FROM ppt_requests WHERE )") +
+                          (any_user ? "id = ?" : "user_id = ? AND id = ?") + " LIMIT 1";
 
   MYSQL_STMT* stmt = mysql_stmt_init(conn);
   if (!stmt) {
@@ -709,7 +765,8 @@ bool PptService::GetRequest(std::uint64_t user_id,
   params[1].buffer = &request_id_val;
   params[1].is_unsigned = 1;
 
-  if (mysql_stmt_bind_param(stmt, params) != 0) {
+  // Without the ownership check the statement only takes the request id.
+  if (mysql_stmt_bind_param(stmt, any_user ? params + 1 : params) != 0) {
     mysql_stmt_close(stmt);
     error = "参数绑定失败";
     return false;
@@ -926,6 +983,34 @@ bool PptService::UpdateRequestOutput(std::uint64_t request_id,
   return true;
 }
 
+bool PptService::MarkInterrupted(const std::vector<std::uint64_t>& request_ids, std::string& error) {
+  if (request_ids.empty()) {
+    return true;
+  }
+  auto connection = pool_->GetConnection();
+  MYSQL* conn = connection.Get();
+  if (!conn) {
+    error = "无法获取数据库连接";
+    return false;
+  }
+
+  std::string id_list;
+  for (const auto id : request_ids) {
+    if (!id_list.empty()) {
+      id_list += ',';
+    }
+    id_list += std::to_string(id);
+  }
+  const std::string sql =
+      "UPDATE ppt_requests SET status = 'interrupted', updated_at = CURRENT_TIMESTAMP "
+      "WHERE status = 'processing' AND id IN (" + id_list + ")";
+  if (mysql_query(conn, sql.c_str()) != 0) {
+    error = "无法标记中断的请求: " + std::string(mysql_error(conn));
+    return false;
+  }
+  return true;
+}
+
 void PptService::SetPowerPointServiceFactory(std::shared_ptr<IPowerPointServiceFactory> factory) {
     powerpoint_factory_ = factory;
 }
@@ -934,21 +1019,62 @@ bool PptService::GeneratePptxFile(const std::string& template_path,
                                  const std::vector<SlideContent>& slides,
                                  const std::string& output_path,
                                  std::string& error) {
+    auto service = BuildPresentation(template_path, slides, output_path, error);
+    if (!service) {
+        return false;
+    }
+
+    // 保存文件
+    if (!service->Save(output_path)) {
+        error = "无法保存PowerPoint文件";
+        return false;
+    }
+
+    return true;
+}
+
+bool PptService::PreparePptxFile(const std::string& template_path,
+                                 const std::vector<SlideContent>& slides,
+                                 const std::string& output_path,
+                                 std::vector<std::string>& command,
+                                 std::string& error) {
+    auto service = BuildPresentation(template_path, slides, output_path, error);
+    if (!service) {
+        return false;
+    }
+
+    if (!service->PrepareSave(output_path, command)) {
+        error = "无法保存PowerPoint文件";
+        return false;
+    }
+    // 该实现不依赖外部命令，直接保存
+    if (command.empty() && !service->Save(output_path)) {
+        error = "无法保存PowerPoint文件";
+        return false;
+    }
+
+    return true;
+}
+
+std::unique_ptr<IPowerPointService> PptService::BuildPresentation(const std::string& template_path,
+                                                                  const std::vector<SlideContent>& slides,
+                                                                  const std::string& output_path,
+                                                                  std::string& error) {
     if (!powerpoint_factory_) {
         error = "PowerPoint服务工厂未设置";
-        return false;
+        return nullptr;
     }
 
     auto service = powerpoint_factory_->CreateService();
     if (!service) {
         error = "无法创建PowerPoint服务实例";
-        return false;
+        return nullptr;
     }
 
     // 从模板创建PowerPoint文件
     if (!service->CreateFromTemplate(template_path, output_path)) {
         error = "无法从模板创建PowerPoint文件";
-        return false;
+        return nullptr;
     }
 
     // 应用主题
@@ -965,13 +1091,7 @@ bool PptService::GeneratePptxFile(const std::string& template_path,
         }
     }
 
-    // 保存文件
-    if (!service->Save(output_path)) {
-        error = "无法保存PowerPoint文件";
-        return false;
-    }
-
-    return true;
+    return service;
 }
 
 bool PptService::GetAdminMetrics(const std::string& range, AdminMetrics& out, std::string& error) {
@@ -0,0 +1,137 @@
+#include "services/progress_hub.h"
+
+#include <algorithm>
+
+namespace {
+// Sent on idle streams so proxies and the write path notice dead clients.
+constexpr char kHeartbeat[] = ": ping\n\n";
+
+void EraseFailed(std::vector<std::shared_ptr<BodyStream>>& subscribers, const std::string& frame) {
+  subscribers.erase(std::remove_if(subscribers.begin(),
+                                   subscribers.end(),
+                                   [&frame](const std::shared_ptr<BodyStream>& stream) {
+                                     if (stream->TryWrite(frame)) {
+                                       return false;
+                                     }
+                                     // Gone, or too far behind: end its response so it can reconnect.
+                                     stream->Close();
+                                     return true;
+                                   }),
+                    subscribers.end());
+}
+}  // namespace
+
+ProgressHub::ProgressHub(std::chrono::seconds retention, std::chrono::seconds heartbeat)
+    : retention_(retention), heartbeat_(std::max(heartbeat, std::chrono::seconds(1))) {
+  heartbeat_thread_ = std::thread([this]() { HeartbeatLoop(); });
+}
+
+ProgressHub::~ProgressHub() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+    for (auto& [id, channel] : channels_) {
+      for (auto& stream : channel.subscribers) {
+        stream->Close();
+      }
+    }
+    channels_.clear();
+  }
+  stop_condition_.notify_all();
+  if (heartbeat_thread_.joinable()) {
+    heartbeat_thread_.join();
+  }
+}
+
+void ProgressHub::Begin(std::uint64_t request_id, std::uint64_t user_id) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto& channel = channels_[request_id];
+  channel.user_id = user_id;
+}
+
+void ProgressHub::Publish(std::uint64_t request_id, const std::string& event, const nlohmann::json& data) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = channels_.find(request_id);
+  if (it == channels_.end() || it->second.finished) {
+    return;
+  }
+  Append(it->second, event, data);
+}
+
+void ProgressHub::Finish(std::uint64_t request_id, const std::string& event, const nlohmann::json& data) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = channels_.find(request_id);
+  if (it == channels_.end() || it->second.finished) {
+    return;
+  }
+  auto& channel = it->second;
+  Append(channel, event, data);
+  for (auto& stream : channel.subscribers) {
+    stream->Close();
+  }
+  channel.subscribers.clear();
+  channel.finished = true;
+  channel.finished_at = std::chrono::steady_clock::now();
+}
+
+ProgressHub::SubscribeResult ProgressHub::Subscribe(std::uint64_t request_id,
+                                                    std::uint64_t user_id,
+                                                    bool is_admin,
+                                                    std::uint64_t last_event_id,
+                                                    const std::shared_ptr<BodyStream>& stream) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = channels_.find(request_id);
+  if (it == channels_.end()) {
+    return SubscribeResult::kUnknown;
+  }
+  auto& channel = it->second;
+  if (channel.user_id != user_id && !is_admin) {
+    return SubscribeResult::kForbidden;
+  }
+  // Replay as one write; the stream is fresh, so only its size can refuse it.
+  std::string backlog;
+  for (std::size_t i = std::min<std::uint64_t>(last_event_id, channel.events.size()); i < channel.events.size(); ++i) {
+    backlog += channel.events[i];
+  }
+  if (!backlog.empty() && !stream->TryWrite(backlog)) {
+    stream->Close();
+    return SubscribeResult::kSubscribed;
+  }
+  if (channel.finished) {
+    stream->Close();
+  } else {
+    channel.subscribers.push_back(stream);
+  }
+  return SubscribeResult::kSubscribed;
+}
+
+std::string ProgressHub::FormatEvent(std::uint64_t id, const std::string& event, const nlohmann::json& data) {
+  std::string frame;
+  if (id != 0) {
+    frame += "id: " + std::to_string(id) + "\n";
+  }
+  // dump() escapes newlines, so the payload always fits one data line.
+  frame += "event: " + event + "\ndata: " + data.dump() + "\n\n";
+  return frame;
+}
+
+void ProgressHub::Append(Channel& channel, const std::string& event, const nlohmann::json& data) {
+  channel.events.push_back(FormatEvent(channel.events.size() + 1, event, data));
+  EraseFailed(channel.subscribers, channel.events.back());
+}
+
+void ProgressHub::HeartbeatLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_condition_.wait_for(lock, heartbeat_, [this]() { return stop_; })) {
+    const auto now = std::chrono::steady_clock::now();
+    for (auto it = channels_.begin(); it != channels_.end();) {
+      auto& channel = it->second;
+      if (channel.finished && now - channel.finished_at >= retention_) {
+        it = channels_.erase(it);
+        continue;
+      }
+      EraseFailed(channel.subscribers, kHeartbeat);
+      ++it;
+    }
+  }
+}
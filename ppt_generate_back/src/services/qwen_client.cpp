@@ -8,7 +8,9 @@
 
 #include <nlohmann/json.hpp>
 
+#include "http/async_io.h"
 #include "logger.h"
+#include "utils/metrics.h"
 
 namespace {
 constexpr const char* kQwenEndpoint =
@@ -318,66 +320,187 @@ bool ParseSlidesText(const std::string& slides_text,
   }
 }
 
+// One completion call: the easy handle with its headers and body, and
+// whatever the endpoint answered. The caller performs it, blocking or not.
+class QwenTransfer {
+ public:
+  QwenTransfer(const std::string& api_key, const std::string& prompt) : curl_(curl_easy_init()) {
+    if (!curl_) {
+      return;
+    }
+    nlohmann::json body;
+    body["model"] = "qwen-plus";
+    body["parameters"]["result_format"] = "json";
+    body["input"]["prompt"] = prompt;
+    payload_ = body.dump();
+
+    headers_ = curl_slist_append(headers_, "Content-Type: application/json");
+    const std::string auth_header = "Authorization: Bearer " + api_key;
+    headers_ = curl_slist_append(headers_, auth_header.c_str());
+
+    curl_easy_setopt(curl_, CURLOPT_URL, kQwenEndpoint);
+    curl_easy_setopt(curl_, CURLOPT_HTTPHEADER, headers_);
+    curl_easy_setopt(curl_, CURLOPT_POSTFIELDS, payload_.c_str());
+    curl_easy_setopt(curl_, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(curl_, CURLOPT_WRITEDATA, &response_buffer_);
+  }
+
+  ~QwenTransfer() {
+    curl_slist_free_all(headers_);
+    if (curl_) {
+      curl_easy_cleanup(curl_);
+    }
+  }
+
+  QwenTransfer(const QwenTransfer&) = delete;
+  QwenTransfer& operator=(const QwenTransfer&) = delete;
+
+  CURL* handle() const { return curl_; }
+
+  // Extracts the completion text once the transfer ended with |result|.
+  bool Finish(CURLcode result, std::string& text_out, std::string& error_message) const {
+    if (result != CURLE_OK) {
+      error_message = curl_easy_strerror(result);
+      return false;
+    }
+    try {
+      auto response_json = nlohmann::json::parse(response_buffer_);
+      if (response_json.contains("code") && response_json.contains("message")) {
+        error_message = response_json.value("message", "通义千问调用失败");
+        return false;
+      }
+      const auto text = ExtractTextFromResponse(response_json);
+      if (text.empty()) {
+        error_message = response_json.value("message", "通义千问返回内容为空");
+        return false;
+      }
+      text_out = text;
+      return true;
+    } catch (const std::exception& ex) {
+      error_message = ex.what();
+      return false;
+    }
+  }
+
+ private:
+  CURL* curl_;
+  curl_slist* headers_ = nullptr;
+  std::string payload_;
+  std::string response_buffer_;
+};
+
+struct QwenMetrics {
+  metrics::Histogram& latency;
+  metrics::Counter& succeeded;
+  metrics::Counter& failed;
+};
+
+QwenMetrics& Metrics() {
+  static auto& registry = metrics::Registry::Instance();
+  static QwenMetrics metrics{
+      registry.GetHistogram("llm_request_duration_seconds",
+                            "Round trip of LLM completion calls.",
+                            metrics::FormatLabels({{"provider", "qwen"}})),
+      registry.GetCounter("llm_requests_total",
+                          "LLM completion calls by outcome.",
+                          metrics::FormatLabels({{"provider", "qwen"}, {"outcome", "ok"}})),
+      registry.GetCounter("llm_requests_total",
+                          "LLM completion calls by outcome.",
+                          metrics::FormatLabels({{"provider", "qwen"}, {"outcome", "error"}}))};
+  return metrics;
+}
+
 bool CallQwen(const std::string& api_key,
               const std::string& prompt,
               std::string& text_out,
               std::string& error_message) {
+  auto& metrics = Metrics();
+  metrics::ScopedTimer timer(metrics.latency);
+  QwenTransfer transfer(api_key, prompt);
+  bool ok = false;
   if (api_key.empty()) {
     error_message = "未配置通义千问API密钥";
-    return false;
-  }
-
-  CURL* curl = curl_easy_init();
-  if (!curl) {
+  } else if (!transfer.handle()) {
     error_message = "无法初始化HTTP客户端";
-    return false;
+  } else {
+    ok = transfer.Finish(curl_easy_perform(transfer.handle()), text_out, error_message);
   }
+  (ok ? metrics.succeeded : metrics.failed).Increment();
+  return ok;
+}
 
-  nlohmann::json body;
-  body["model"] = "qwen-plus";
-  body["parameters"]["result_format"] = "json";
-  body["input"]["prompt"] = prompt;
-
-  std::string response_buffer;
-  struct curl_slist* headers = nullptr;
-  headers = curl_slist_append(headers, "Content-Type: application/json");
-  std::string auth_header = "Authorization: Bearer " + api_key;
-  headers = curl_slist_append(headers, auth_header.c_str());
-
-  curl_easy_setopt(curl, CURLOPT_URL, kQwenEndpoint);
-  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-  const auto payload = body.dump();
-  curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload.c_str());
-  curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-  curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_buffer);
-
-  CURLcode res = curl_easy_perform(curl);
-  curl_slist_free_all(headers);
-  curl_easy_cleanup(curl);
-
-  if (res != CURLE_OK) {
-    error_message = curl_easy_strerror(res);
-    return false;
+#if PPT_HAVE_COROUTINES
+Task<bool> CallQwenAsync(const std::string& api_key,
+                         const std::string& prompt,
+                         std::string& text_out,
+                         std::string& error_message) {
+  auto& metrics = Metrics();
+  metrics::ScopedTimer timer(metrics.latency);
+  QwenTransfer transfer(api_key, prompt);
+  bool ok = false;
+  if (api_key.empty()) {
+    error_message = "未配置通义千问API密钥";
+  } else if (!transfer.handle()) {
+    error_message = "无法初始化HTTP客户端";
+  } else {
+    const auto result = co_await async_io::Perform(transfer.handle());
+    ok = transfer.Finish(result, text_out, error_message);
   }
+  (ok ? metrics.succeeded : metrics.failed).Increment();
+  co_return ok;
+}
+#endif
 
+bool ParseOutlineText(const std::string& outline_text,
+                      std::vector<OutlineItem>& out_outline,
+                      std::string& error_message) {
   try {
-    auto response_json = nlohmann::json::parse(response_buffer);
-    if (response_json.contains("code") && response_json.contains("message")) {
-      error_message = response_json.value("message", "通义千问调用失败");
-      return false;
-    }
-    const auto text = ExtractTextFromResponse(response_json);
-    if (text.empty()) {
-      error_message = response_json.value("message", "通义千问返回内容为空");
+    auto outline_json = nlohmann::json::parse(outline_text);
+    if (!ParseOutlineJson(outline_json, out_outline)) {
+      error_message = "大纲解析失败";
       return false;
     }
-    text_out = text;
     return true;
   } catch (const std::exception& ex) {
     error_message = ex.what();
     return false;
   }
 }
+
+std::string BuildDirectSlidesPrompt(const std::string& topic,
+                                    int slide_count,
+                                    const std::string& template_hint,
+                                    bool include_images) {
+  std::ostringstream prompt;
+  prompt << "你是一名资深中文PPT设计专家，请围绕主题【" << topic << "】"
+         << "策划" << slide_count << "页结构化PPT。";
+  if (!template_hint.empty()) {
+    prompt << "模板风格参考：" << template_hint << "。";
+  }
+  if (include_images) {
+    prompt << "每页需要1-2个图片创意描述，突出场景、风格或配色，供后续图片检索使用。";
+  }
+  prompt << "输出严格的JSON数组，数组中每个元素包含字段："
+         << "title（字符串，<=18个汉字），"
+         << "bullets（长度3-5的字符串数组，单条<=40字），"
+         << "image_prompts（字符串数组，描述建议配图主题，若无图片需求则给空数组）。"
+         << "禁止输出除JSON以外的任何字符。";
+  return prompt.str();
+}
+
+// Falls back to one slide holding the raw text if it is not the JSON asked for.
+void ParseDirectSlides(const std::string& slides_text,
+                       const std::string& topic,
+                       bool include_images,
+                       std::vector<SlideContent>& out_slides) {
+  std::string error_message;
+  if (ParseSlidesText(slides_text, topic, include_images, out_slides, error_message)) {
+    return;
+  }
+  Logger::Warn(std::string("解析通义千问JSON失败，将回退文本模式: ") + error_message);
+  out_slides.clear();
+  out_slides.push_back(ParseSlide(slides_text, topic + " 场景", include_images));
+}
 }
 
 QwenClient::QwenClient(std::string api_key) : api_key_(std::move(api_key)) {
@@ -395,17 +518,7 @@ bool QwenClient::GenerateOutline(const std::string& topic,
   if (!CallQwen(api_key_, prompt, outline_text, error_message)) {
     return false;
   }
-  try {
-    auto outline_json = nlohmann::json::parse(outline_text);
-    if (!ParseOutlineJson(outline_json, out_outline)) {
-      error_message = "大纲解析失败";
-      return false;
-    }
-    return true;
-  } catch (const std::exception& ex) {
-    error_message = ex.what();
-    return false;
-  }
+  return ParseOutlineText(outline_text, out_outline, error_message);
 }
 
 bool QwenClient::GenerateSlidesFromOutline(const std::string& topic,
@@ -448,29 +561,76 @@ bool QwenClient::GenerateSlides(const std::string& topic,
     Logger::Warn("通义千问大纲内容生成失败，将回退直出模式: " + slides_error);
   }
 
-  std::ostringstream prompt;
-  prompt << "你是一名资深中文PPT设计专家，请围绕主题【" << topic << "】"
-         << "策划" << slide_count << "页结构化PPT。";
-  if (!template_hint.empty()) {
-    prompt << "模板风格参考：" << template_hint << "。";
+  const auto prompt = BuildDirectSlidesPrompt(topic, slide_count, template_hint, include_images);
+  std::string slides_text;
+  if (!CallQwen(api_key_, prompt, slides_text, error_message)) {
+    return false;
   }
-  if (include_images) {
-    prompt << "每页需要1-2个图片创意描述，突出场景、风格或配色，供后续图片检索使用。";
+  ParseDirectSlides(slides_text, topic, include_images, out_slides);
+  return true;
+}
+
+#if PPT_HAVE_COROUTINES
+Task<bool> QwenClient::GenerateOutlineAsync(const std::string& topic,
+                                            int slide_count,
+                                            const std::string& template_hint,
+                                            std::vector<OutlineItem>& out_outline,
+                                            std::string& error_message) const {
+  slide_count = std::max(1, std::min(slide_count, 10));
+  const auto prompt = BuildOutlinePrompt(topic, slide_count, template_hint);
+  std::string outline_text;
+  if (!co_await CallQwenAsync(api_key_, prompt, outline_text, error_message)) {
+    co_return false;
   }
-  prompt << "输出严格的JSON数组，数组中每个元素包含字段："
-         << "title（字符串，<=18个汉字），"
-         << "bullets（长度3-5的字符串数组，单条<=40字），"
-         << "image_prompts（字符串数组，描述建议配图主题，若无图片需求则给空数组）。"
-         << "禁止输出除JSON以外的任何字符。";
+  co_return ParseOutlineText(outline_text, out_outline, error_message);
+}
+
+Task<bool> QwenClient::GenerateSlidesFromOutlineAsync(const std::string& topic,
+                                                      const std::vector<OutlineItem>& outline,
+                                                      bool include_images,
+                                                      std::vector<SlideContent>& out_slides,
+                                                      std::string& error_message) const {
+  if (outline.empty()) {
+    error_message = "大纲为空";
+    co_return false;
+  }
+  const auto prompt = BuildSlidesPromptFromOutline(topic, outline, include_images);
   std::string slides_text;
-  if (!CallQwen(api_key_, prompt.str(), slides_text, error_message)) {
-    return false;
+  if (!co_await CallQwenAsync(api_key_, prompt, slides_text, error_message)) {
+    co_return false;
   }
-  if (ParseSlidesText(slides_text, topic, include_images, out_slides, error_message)) {
-    return true;
+  co_return ParseSlidesText(slides_text, topic, include_images, out_slides, error_message);
+}
+
+Task<bool> QwenClient::GenerateSlidesAsync(const std::string& topic,
+                                           int slide_count,
+                                           const std::string& template_hint,
+                                           bool include_images,
+                                           std::vector<SlideContent>& out_slides,
+                                           std::string& error_message) const {
+  slide_count = std::max(1, std::min(slide_count, 10));
+
+  std::vector<OutlineItem> outline;
+  std::string outline_error;
+  if (!co_await GenerateOutlineAsync(topic, slide_count, template_hint, outline, outline_error)) {
+    Logger::Warn("通义千问大纲生成失败，将回退直出模式: " + outline_error);
+    outline.clear();
   }
-  Logger::Warn(std::string("解析通义千问JSON失败，将回退文本模式: ") + error_message);
-  out_slides.clear();
-  out_slides.push_back(ParseSlide(slides_text, topic + " 场景", include_images));
-  return true;
+
+  if (!outline.empty()) {
+    std::string slides_error;
+    if (co_await GenerateSlidesFromOutlineAsync(topic, outline, include_images, out_slides, slides_error)) {
+      co_return true;
+    }
+    Logger::Warn("通义千问大纲内容生成失败，将回退直出模式: " + slides_error);
+  }
+
+  const auto prompt = BuildDirectSlidesPrompt(topic, slide_count, template_hint, include_images);
+  std::string slides_text;
+  if (!co_await CallQwenAsync(api_key_, prompt, slides_text, error_message)) {
+    co_return false;
+  }
+  ParseDirectSlides(slides_text, topic, include_images, out_slides);
+  co_return true;
 }
+#endif
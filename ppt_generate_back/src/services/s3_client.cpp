@@ -14,8 +14,19 @@
 #include <openssl/sha.h>
 
 #include "logger.h"
+#include "utils/metrics.h"
 
 namespace {
+metrics::Histogram& RequestLatency(const char* operation) {
+  return metrics::Registry::Instance().GetHistogram(
+      "s3_request_duration_seconds", "Duration of S3 requests by operation.", metrics::FormatLabels({{"operation", operation}}));
+}
+
+metrics::Counter& RequestFailures(const char* operation) {
+  return metrics::Registry::Instance().GetCounter(
+      "s3_request_failures_total", "Failed S3 requests by operation.", metrics::FormatLabels({{"operation", operation}}));
+}
+
 struct ParsedEndpoint {
   std::string scheme = "http";
   std::string host_port;
@@ -278,17 +289,25 @@ bool S3Client::UploadFile(const std::string& local_path,
   curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t>(size));
   curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
 
-  CURLcode res = curl_easy_perform(curl);
+  static auto& latency = RequestLatency("upload");
+  static auto& failures = RequestFailures("upload");
+  CURLcode res = CURLE_OK;
+  {
+    metrics::ScopedTimer timer(latency);
+    res = curl_easy_perform(curl);
+  }
   long response_code = 0;
   curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
   curl_easy_cleanup(curl);
   std::fclose(file);
 
   if (res != CURLE_OK) {
+    failures.Increment();
     error = std::string("Upload failed: ") + curl_easy_strerror(res);
     return false;
   }
   if (response_code < 200 || response_code >= 300) {
+    failures.Increment();
     error = "Upload failed with HTTP status " + std::to_string(response_code);
     return false;
   }
@@ -322,16 +341,24 @@ bool S3Client::DeleteObject(const std::string& object_key,
   curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
   curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
 
-  CURLcode res = curl_easy_perform(curl);
+  static auto& latency = RequestLatency("delete");
+  static auto& failures = RequestFailures("delete");
+  CURLcode res = CURLE_OK;
+  {
+    metrics::ScopedTimer timer(latency);
+    res = curl_easy_perform(curl);
+  }
   long response_code = 0;
   curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
   curl_easy_cleanup(curl);
 
   if (res != CURLE_OK) {
+    failures.Increment();
     error = std::string("Delete failed: ") + curl_easy_strerror(res);
     return false;
   }
   if (response_code < 200 || response_code >= 300) {
+    failures.Increment();
     error = "Delete failed with HTTP status " + std::to_string(response_code);
     return false;
   }
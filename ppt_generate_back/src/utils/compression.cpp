@@ -0,0 +1,152 @@
+#include "utils/compression.h"
+
+#include <zlib.h>
+
+#if __has_include(<brotli/encode.h>)
+#include <brotli/encode.h>
+#define PPT_HAVE_BROTLI 1
+#else
+#define PPT_HAVE_BROTLI 0
+#endif
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+namespace {
+constexpr int kGzipWindowBits = 15 + 16;  // +16 selects the gzip wrapper
+constexpr int kSidecarLevel = 9;
+
+bool GzipCompress(std::string_view input, int level, std::string& output) {
+  z_stream stream{};
+  if (deflateInit2(&stream, std::clamp(level, 1, 9), Z_DEFLATED, kGzipWindowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    return false;
+  }
+  output.resize(deflateBound(&stream, static_cast<uLong>(input.size())));
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+  stream.avail_in = static_cast<uInt>(input.size());
+  stream.next_out = reinterpret_cast<Bytef*>(output.data());
+  stream.avail_out = static_cast<uInt>(output.size());
+  const int result = deflate(&stream, Z_FINISH);
+  output.resize(stream.total_out);
+  deflateEnd(&stream);
+  return result == Z_STREAM_END;
+}
+
+#if PPT_HAVE_BROTLI
+bool BrotliCompress(std::string_view input, int level, std::string& output) {
+  // Spread 1-9 over brotli's 0-11; 9 maps to the maximum.
+  const int quality = std::clamp(level, 1, 9) * BROTLI_MAX_QUALITY / 9;
+  std::size_t encoded_size = BrotliEncoderMaxCompressedSize(input.size());
+  if (encoded_size == 0) {
+    return false;
+  }
+  output.resize(encoded_size);
+  if (!BrotliEncoderCompress(quality,
+                             BROTLI_DEFAULT_WINDOW,
+                             BROTLI_MODE_TEXT,
+                             input.size(),
+                             reinterpret_cast<const std::uint8_t*>(input.data()),
+                             &encoded_size,
+                             reinterpret_cast<std::uint8_t*>(output.data()))) {
+    return false;
+  }
+  output.resize(encoded_size);
+  return true;
+}
+#endif
+
+std::string TemporaryPath(const std::string& target) {
+  return target + ".tmp." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+}
+}  // namespace
+
+namespace compression_utils {
+
+std::string_view EncodingName(Encoding encoding) {
+  switch (encoding) {
+    case Encoding::kGzip:
+      return "gzip";
+    case Encoding::kBrotli:
+      return "br";
+    case Encoding::kIdentity:
+      break;
+  }
+  return {};
+}
+
+bool IsSupported(Encoding encoding) {
+  return encoding != Encoding::kBrotli || PPT_HAVE_BROTLI;
+}
+
+bool Compress(Encoding encoding, std::string_view input, int level, std::string& output) {
+  switch (encoding) {
+    case Encoding::kGzip:
+      return GzipCompress(input, level, output);
+    case Encoding::kBrotli:
+#if PPT_HAVE_BROTLI
+      return BrotliCompress(input, level, output);
+#else
+      return false;
+#endif
+    case Encoding::kIdentity:
+      break;
+  }
+  output.assign(input.data(), input.size());
+  return true;
+}
+
+std::string SidecarPath(const std::string& source, Encoding encoding) {
+  switch (encoding) {
+    case Encoding::kGzip:
+      return source + ".gz";
+    case Encoding::kBrotli:
+      return source + ".br";
+    case Encoding::kIdentity:
+      break;
+  }
+  return source;
+}
+
+bool SidecarIsFresh(const std::string& source, Encoding encoding) {
+  std::error_code source_ec;
+  std::error_code sidecar_ec;
+  const auto source_time = std::filesystem::last_write_time(source, source_ec);
+  const auto sidecar_time = std::filesystem::last_write_time(SidecarPath(source, encoding), sidecar_ec);
+  return !source_ec && !sidecar_ec && sidecar_time >= source_time;
+}
+
+bool WriteSidecars(const std::string& source, std::string_view contents, std::string& error) {
+  for (const auto encoding : {Encoding::kGzip, Encoding::kBrotli}) {
+    if (!IsSupported(encoding)) {
+      continue;
+    }
+    std::string compressed;
+    if (!Compress(encoding, contents, kSidecarLevel, compressed)) {
+      error = "Failed to compress " + source;
+      return false;
+    }
+    const auto target = SidecarPath(source, encoding);
+    const auto temporary = TemporaryPath(target);
+    {
+      std::ofstream output(temporary, std::ios::binary | std::ios::trunc);
+      if (!output.is_open() || !output.write(compressed.data(), static_cast<std::streamsize>(compressed.size()))) {
+        error = "Cannot write " + temporary;
+        return false;
+      }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temporary, target, ec);
+    if (ec) {
+      std::filesystem::remove(temporary, ec);
+      error = "Cannot move " + temporary + " into place";
+      return false;
+    }
+  }
+  return true;
+}
+
+}
@@ -0,0 +1,200 @@
+#include "utils/metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+namespace {
+void AppendSeriesName(std::string& out, const std::string& name, const std::string& labels) {
+  out.append(name);
+  if (!labels.empty()) {
+    out.push_back('{');
+    out.append(labels);
+    out.push_back('}');
+  }
+}
+
+void AppendDouble(std::string& out, double value) {
+  char buffer[32];
+  const int length = std::snprintf(buffer, sizeof(buffer), "%.6g", value);
+  out.append(buffer, static_cast<std::size_t>(std::max(length, 0)));
+}
+
+int HighestBit(std::uint64_t value) {
+  return 63 - __builtin_clzll(value);
+}
+}  // namespace
+
+namespace metrics {
+
+void Counter::Render(std::string& out, const std::string& name, const std::string& labels) const {
+  AppendSeriesName(out, name, labels);
+  out.push_back(' ');
+  out.append(std::to_string(Value()));
+  out.push_back('\n');
+}
+
+void Gauge::Render(std::string& out, const std::string& name, const std::string& labels) const {
+  AppendSeriesName(out, name, labels);
+  out.push_back(' ');
+  out.append(std::to_string(Value()));
+  out.push_back('\n');
+}
+
+std::size_t Histogram::BucketIndex(std::uint64_t micros) {
+  if (micros < kSubBuckets) {
+    return static_cast<std::size_t>(micros);
+  }
+  const int shift = HighestBit(micros) - kSubBucketBits;
+  const auto sub_bucket = static_cast<std::size_t>((micros >> shift) & (kSubBuckets - 1));
+  return std::min(static_cast<std::size_t>(shift + 1) * kSubBuckets + sub_bucket, kBucketCount - 1);
+}
+
+std::uint64_t Histogram::BucketUpperBound(std::size_t index) {
+  if (index < kSubBuckets) {
+    return index;
+  }
+  const auto shift = index / kSubBuckets - 1;
+  const auto sub_bucket = index % kSubBuckets;
+  return ((kSubBuckets + sub_bucket + 1) << shift) - 1;
+}
+
+void Histogram::Record(std::chrono::nanoseconds duration) {
+  RecordMicros(static_cast<std::uint64_t>(
+      std::max<std::int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(duration).count())));
+}
+
+void Histogram::RecordMicros(std::uint64_t micros) {
+  buckets_[BucketIndex(micros)].fetch_add(1, std::memory_order_relaxed);
+  sum_micros_.fetch_add(micros, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::uint64_t Histogram::QuantileMicros(double q) const {
+  // Buckets are read one by one while writers keep going, so use their own
+  // total rather than count_ to stay consistent.
+  std::array<std::uint64_t, kBucketCount> snapshot{};
+  std::uint64_t total = 0;
+  for (std::size_t i = 0; i < kBucketCount; ++i) {
+    snapshot[i] = buckets_[i].load(std::memory_order_relaxed);
+    total += snapshot[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+  const auto rank = static_cast<std::uint64_t>(std::ceil(std::clamp(q, 0.0, 1.0) * static_cast<double>(total)));
+  std::uint64_t seen = 0;
+  for (std::size_t i = 0; i < kBucketCount; ++i) {
+    seen += snapshot[i];
+    if (seen >= std::max<std::uint64_t>(rank, 1)) {
+      // Report the bucket midpoint: at most 6.25% away from any value in it.
+      const auto lower = i == 0 ? 0 : BucketUpperBound(i - 1) + 1;
+      return lower + (BucketUpperBound(i) - lower) / 2;
+    }
+  }
+  return BucketUpperBound(kBucketCount - 1);
+}
+
+void Histogram::Render(std::string& out, const std::string& name, const std::string& labels) const {
+  const std::string prefix = labels.empty() ? std::string() : labels + ",";
+  for (const double q : {0.5, 0.9, 0.99}) {
+    out.append(name);
+    out.append("{");
+    out.append(prefix);
+    out.append("quantile=\"");
+    AppendDouble(out, q);
+    out.append("\"} ");
+    AppendDouble(out, static_cast<double>(QuantileMicros(q)) / 1e6);
+    out.push_back('\n');
+  }
+  AppendSeriesName(out, name + "_sum", labels);
+  out.push_back(' ');
+  AppendDouble(out, static_cast<double>(sum_micros_.load(std::memory_order_relaxed)) / 1e6);
+  out.push_back('\n');
+  AppendSeriesName(out, name + "_count", labels);
+  out.push_back(' ');
+  out.append(std::to_string(Count()));
+  out.push_back('\n');
+}
+
+Registry& Registry::Instance() {
+  static Registry instance;
+  return instance;
+}
+
+template <typename T>
+T& Registry::GetOrCreate(const std::string& name, const std::string& help, const std::string& labels, Type type) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto [family_it, inserted] = families_.try_emplace(name, Family{type, help, {}});
+  auto& family = family_it->second;
+  if (!inserted && family.type != type) {
+    throw std::logic_error("Metric registered with conflicting types: " + name);
+  }
+  auto& slot = family.series[labels];
+  if (!slot) {
+    slot = std::make_unique<T>();
+  }
+  return static_cast<T&>(*slot);
+}
+
+Counter& Registry::GetCounter(const std::string& name, const std::string& help, const std::string& labels) {
+  return GetOrCreate<Counter>(name, help, labels, Type::kCounter);
+}
+
+Gauge& Registry::GetGauge(const std::string& name, const std::string& help, const std::string& labels) {
+  return GetOrCreate<Gauge>(name, help, labels, Type::kGauge);
+}
+
+Histogram& Registry::GetHistogram(const std::string& name, const std::string& help, const std::string& labels) {
+  return GetOrCreate<Histogram>(name, help, labels, Type::kSummary);
+}
+
+std::string Registry::Render() const {
+  std::string out;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (const auto& [name, family] : families_) {
+    out.append("# HELP ").append(name).append(" ").append(family.help).append("\n");
+    out.append("# TYPE ").append(name).append(" ");
+    switch (family.type) {
+      case Type::kCounter:
+        out.append("counter\n");
+        break;
+      case Type::kGauge:
+        out.append("gauge\n");
+        break;
+      case Type::kSummary:
+        out.append("summary\n");
+        break;
+    }
+    for (const auto& [labels, series] : family.series) {
+      series->Render(out, name, labels);
+    }
+  }
+  return out;
+}
+
+std::string FormatLabels(std::initializer_list<std::pair<std::string_view, std::string_view>> labels) {
+  std::string out;
+  for (const auto& [key, value] : labels) {
+    if (!out.empty()) {
+      out.push_back(',');
+    }
+    out.append(key);
+    out.append("=\"");
+    for (const char ch : value) {
+      if (ch == '\\' || ch == '"') {
+        out.push_back('\\');
+        out.push_back(ch);
+      } else if (ch == '\n') {
+        out.append("\\n");
+      } else {
+        out.push_back(ch);
+      }
+    }
+    out.push_back('"');
+  }
+  return out;
+}
+
+}
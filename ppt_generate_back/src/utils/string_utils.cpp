@@ -5,6 +5,42 @@
 
 namespace string_utils {
 
+namespace {
+int HexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// Appends |value| with "%XX" escapes and '+' decoded; works for std::string and std::pmr::string.
+template <typename String>
+void AppendDecoded(std::string_view value, String& out) {
+  out.reserve(out.size() + value.size());
+  for (std::size_t i = 0; i < value.size(); ++i) {
+    if (value[i] == '%' && i + 2 < value.size()) {
+      const int high = HexValue(value[i + 1]);
+      const int low = HexValue(value[i + 2]);
+      if (high >= 0 && low >= 0) {
+        out.push_back(static_cast<char>(high * 16 + low));
+        i += 2;
+        continue;
+      }
+    } else if (value[i] == '+') {
+      out.push_back(' ');
+      continue;
+    }
+    out.push_back(value[i]);
+  }
+}
+}  // namespace
+
 std::string Trim(const std::string& input) {
   const auto begin = input.find_first_not_of(" \t\n\r");
   if (begin == std::string::npos) {
@@ -14,6 +50,15 @@ std::string Trim(const std::string& input) {
   return input.substr(begin, end - begin + 1);
 }
 
+std::string_view TrimView(std::string_view input) {
+  const auto begin = input.find_first_not_of(" \t\n\r");
+  if (begin == std::string_view::npos) {
+    return {};
+  }
+  const auto end = input.find_last_not_of(" \t\n\r");
+  return input.substr(begin, end - begin + 1);
+}
+
 std::string ToLower(std::string value) {
   for (char& ch : value) {
     ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
@@ -21,45 +66,45 @@ std::string ToLower(std::string value) {
   return value;
 }
 
-std::string UrlDecode(const std::string& value) {
-  std::string result;
-  result.reserve(value.size());
-  for (std::size_t i = 0; i < value.size(); ++i) {
-    if (value[i] == '%' && i + 2 < value.size()) {
-      const std::string hex = value.substr(i + 1, 2);
-      char* end = nullptr;
-      const long code = std::strtol(hex.c_str(), &end, 16);
-      if (end != nullptr && *end == '\0') {
-        result.push_back(static_cast<char>(code));
-        i += 2;
-        continue;
-      }
-    } else if (value[i] == '+') {
-      result.push_back(' ');
-      continue;
+bool EqualsIgnoreCase(std::string_view lhs, std::string_view rhs) {
+  if (lhs.size() != rhs.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < lhs.size(); ++i) {
+    if (std::tolower(static_cast<unsigned char>(lhs[i])) !=
+        std::tolower(static_cast<unsigned char>(rhs[i]))) {
+      return false;
     }
-    result.push_back(value[i]);
   }
+  return true;
+}
+
+std::string UrlDecode(std::string_view value) {
+  std::string result;
+  AppendDecoded(value, result);
   return result;
 }
 
-std::unordered_map<std::string, std::string> ParseQuery(const std::string& query_string) {
-  std::unordered_map<std::string, std::string> params;
+QueryMap ParseQuery(std::string_view query_string, std::pmr::memory_resource* resource) {
+  QueryMap params(resource);
   std::size_t start = 0;
   while (start < query_string.size()) {
     auto end = query_string.find('&', start);
     if (end == std::string::npos) {
       end = query_string.size();
     }
-    auto token = query_string.substr(start, end - start);
+    const auto token = query_string.substr(start, end - start);
     if (!token.empty()) {
       auto eq = token.find('=');
       if (eq != std::string::npos) {
-        auto key = UrlDecode(token.substr(0, eq));
-        auto value = UrlDecode(token.substr(eq + 1));
-        params[key] = value;
+        std::pmr::string key(resource);
+        AppendDecoded(token.substr(0, eq), key);
+        auto& value = params[std::move(key)];
+        AppendDecoded(token.substr(eq + 1), value);
       } else {
-        params[UrlDecode(token)] = "";
+        std::pmr::string key(resource);
+        AppendDecoded(token, key);
+        params[std::move(key)].clear();
       }
     }
     start = end + 1;
@@ -67,4 +112,23 @@ std::unordered_map<std::string, std::string> ParseQuery(const std::string& query
   return params;
 }
 
+std::optional<std::string> FindQueryParam(std::string_view query_string, std::string_view key) {
+  std::size_t start = 0;
+  while (start < query_string.size()) {
+    auto end = query_string.find('&', start);
+    if (end == std::string_view::npos) {
+      end = query_string.size();
+    }
+    const auto token = query_string.substr(start, end - start);
+    const auto eq = token.find('=');
+    const auto raw_name = token.substr(0, eq);
+    const bool encoded = raw_name.find_first_of("%+") != std::string_view::npos;
+    if (!token.empty() && (encoded ? UrlDecode(raw_name) == key : raw_name == key)) {
+      return eq == std::string_view::npos ? std::string() : UrlDecode(token.substr(eq + 1));
+    }
+    start = end + 1;
+  }
+  return std::nullopt;
+}
+
 }  // namespace string_utils
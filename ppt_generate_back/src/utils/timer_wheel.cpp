@@ -0,0 +1,169 @@
+#include "utils/timer_wheel.h"
+
+#include <algorithm>
+
+TimerWheel::TimerWheel(std::chrono::milliseconds tick, Clock::time_point now)
+    : tick_(std::max(tick, std::chrono::milliseconds(1))), origin_(now) {
+  for (auto& level : slots_) {
+    level.fill(kNil);
+  }
+}
+
+TimerWheel::TimerId TimerWheel::Schedule(std::chrono::milliseconds delay, Callback callback) {
+  // Round the due time up to a tick boundary so the timer never fires early.
+  const auto due = Clock::now() - origin_ + std::max(delay, std::chrono::milliseconds(0));
+  const auto tick_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(tick_).count();
+  const auto due_ticks = static_cast<std::uint64_t>(
+      (std::chrono::duration_cast<std::chrono::nanoseconds>(due).count() + tick_ns - 1) / tick_ns);
+
+  std::uint32_t index;
+  if (free_.empty()) {
+    index = static_cast<std::uint32_t>(nodes_.size());
+    nodes_.emplace_back();
+    nodes_.back().generation = 1;
+  } else {
+    index = free_.back();
+    free_.pop_back();
+  }
+  auto& node = nodes_[index];
+  node.callback = std::move(callback);
+  node.expires = std::max(due_ticks, current_ + 1);
+  ++active_;
+  Place(index);
+  return (static_cast<TimerId>(node.generation) << 32) | (static_cast<TimerId>(index) + 1);
+}
+
+bool TimerWheel::Cancel(TimerId id) {
+  const auto low = static_cast<std::uint32_t>(id & 0xffffffffu);
+  if (low == 0 || low > nodes_.size()) {
+    return false;
+  }
+  const std::uint32_t index = low - 1;
+  auto& node = nodes_[index];
+  if (node.generation != static_cast<std::uint32_t>(id >> 32) || node.head == nullptr) {
+    return false;
+  }
+  Unlink(index);
+  Release(index);
+  return true;
+}
+
+std::size_t TimerWheel::Advance(Clock::time_point now) {
+  if (now <= origin_) {
+    return 0;
+  }
+  const auto target = static_cast<std::uint64_t>((now - origin_) / tick_);
+  if (active_ == 0) {
+    current_ = std::max(current_, target);
+    return 0;
+  }
+  std::size_t fired = 0;
+  while (current_ < target) {
+    fired += Step();
+    if (active_ == 0) {
+      current_ = target;
+    }
+  }
+  return fired;
+}
+
+std::optional<std::chrono::milliseconds> TimerWheel::TimeUntilNext(Clock::time_point now) const {
+  if (active_ == 0) {
+    return std::nullopt;
+  }
+  // Look ahead through level 0 up to the next cascade, which is the furthest
+  // point we can vouch for without walking the upper levels.
+  std::uint64_t tick = current_ + 1;
+  while ((tick & (kSlots - 1)) != 0 && slots_[0][tick & (kSlots - 1)] == kNil) {
+    ++tick;
+  }
+  const auto due = origin_ + tick_ * tick;
+  if (due <= now) {
+    return std::chrono::milliseconds(0);
+  }
+  return std::chrono::ceil<std::chrono::milliseconds>(due - now);
+}
+
+void TimerWheel::Place(std::uint32_t index) {
+  const auto expires = nodes_[index].expires;
+  const auto delta = expires > current_ ? expires - current_ : 0;
+  for (std::size_t level = 0; level < kLevels; ++level) {
+    const auto shift = kSlotBits * level;
+    if (delta < (std::uint64_t{1} << (shift + kSlotBits))) {
+      Link(index, slots_[level][(expires >> shift) & (kSlots - 1)]);
+      return;
+    }
+  }
+  // Beyond the wheel's range: park in the farthest top-level slot; the
+  // cascade re-places it against its real expiry.
+  constexpr auto kTopShift = kSlotBits * (kLevels - 1);
+  const auto parked = current_ + (std::uint64_t{1} << (kTopShift + kSlotBits)) - 1;
+  Link(index, slots_[kLevels - 1][(parked >> kTopShift) & (kSlots - 1)]);
+}
+
+void TimerWheel::Link(std::uint32_t index, std::uint32_t& head) {
+  auto& node = nodes_[index];
+  node.prev = kNil;
+  node.next = head;
+  if (head != kNil) {
+    nodes_[head].prev = index;
+  }
+  head = index;
+  node.head = &head;
+}
+
+void TimerWheel::Unlink(std::uint32_t index) {
+  auto& node = nodes_[index];
+  if (node.prev != kNil) {
+    nodes_[node.prev].next = node.next;
+  } else {
+    *node.head = node.next;
+  }
+  if (node.next != kNil) {
+    nodes_[node.next].prev = node.prev;
+  }
+  node.prev = kNil;
+  node.next = kNil;
+  node.head = nullptr;
+}
+
+void TimerWheel::Release(std::uint32_t index) {
+  auto& node = nodes_[index];
+  node.callback = nullptr;
+  ++node.generation;
+  free_.push_back(index);
+  --active_;
+}
+
+void TimerWheel::Cascade(std::size_t level) {
+  auto& head = slots_[level][(current_ >> (kSlotBits * level)) & (kSlots - 1)];
+  std::uint32_t index = head;
+  head = kNil;
+  while (index != kNil) {
+    const auto next = nodes_[index].next;
+    Place(index);
+    index = next;
+  }
+}
+
+std::size_t TimerWheel::Step() {
+  ++current_;
+  for (std::size_t level = kLevels - 1; level > 0; --level) {
+    if ((current_ & ((std::uint64_t{1} << (kSlotBits * level)) - 1)) == 0) {
+      Cascade(level);
+    }
+  }
+
+  std::size_t fired = 0;
+  auto& head = slots_[0][current_ & (kSlots - 1)];
+  while (head != kNil) {
+    const auto index = head;
+    Unlink(index);
+    // The callback may schedule timers and grow |nodes_|, so take it out first.
+    auto callback = std::move(nodes_[index].callback);
+    Release(index);
+    callback();
+    ++fired;
+  }
+  return fired;
+}
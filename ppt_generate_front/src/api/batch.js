@@ -0,0 +1,10 @@
+import { apiClient } from './auth'
+
+export default {
+  // 把多个 GET 合并成一次 /api/batch 请求，按 paths 顺序返回 { status, body }
+  get(paths) {
+    return apiClient
+      .post('/batch', { requests: paths.map(path => ({ path })) })
+      .then(response => response.data?.responses || [])
+  }
+}
@@ -8,12 +8,12 @@ export default {
     return apiClient.get('/ppt/history', { params })
   },
   preview(id) {
-    return apiClient.get(`/ppt/preview?id=${encodeURIComponent(id)}`)
+    return apiClient.get(`/ppt/${encodeURIComponent(id)}/preview`)
   },
   outline(payload) {
     return apiClient.post('/ppt/outline', payload)
   },
   remove(id) {
-    return apiClient.delete(`/ppt/history?id=${encodeURIComponent(id)}`)
+    return apiClient.delete(`/ppt/${encodeURIComponent(id)}`)
   }
 }
@@ -4,6 +4,7 @@ import pptAPI from '@/api/ppt'
 import templatesAPI from '@/api/templates'
 import modelsAPI from '@/api/models'
 import adminAPI from '@/api/admin'
+import batchAPI from '@/api/batch'
 
 const savedToken = localStorage.getItem('token') || sessionStorage.getItem('token')
 const savedModel = localStorage.getItem('defaultModel') || 'qwen-turbo'
@@ -14,7 +15,7 @@ if (savedToken) {
 const normalizeRequest = (item = {}) => {
   const id = item.id ?? 0
   const hasFile = Boolean(item.hasFile ?? item.has_file)
-  const downloadUrl = item.downloadUrl ?? item.download_url ?? (hasFile && id ? `/api/ppt/file?id=${id}` : '')
+  const downloadUrl = item.downloadUrl ?? item.download_url ?? (hasFile && id ? `/api/ppt/${id}/file` : '')
   return {
     id,
     userId: item.user_id ?? item.userId ?? 0,
@@ -37,6 +38,13 @@ const normalizeRequest = (item = {}) => {
   }
 }
 
+// 把 batch 中失败的子请求包装成与 axios 相同形状的错误
+const batchError = (part = {}) => {
+  const error = new Error(part.body?.message || `请求失败 (${part.status})`)
+  error.response = { status: part.status, data: part.body }
+  return error
+}
+
 export default createStore({
   state: {
     user: null,
@@ -130,19 +138,55 @@ export default createStore({
         return
       }
       try {
-        if (!state.user) {
-          await dispatch('fetchCurrentUser')
-        }
-        const tasks = [dispatch('fetchPptHistory'), dispatch('fetchTemplates'), dispatch('fetchModels')]
-        if (state.user?.isAdmin) {
-          tasks.push(dispatch('fetchAdminHistory'))
-        }
-        await Promise.all(tasks)
+        await dispatch('loadSessionData', { withUser: !state.user })
       } catch (error) {
         commit('logout')
         throw error
       }
     },
+    // 用户、历史、模板和模型一次取回：一次往返，后端只校验一次 token
+    async loadSessionData({ state, commit, dispatch }, { withUser = false } = {}) {
+      const parts = []
+      if (withUser) {
+        parts.push(['user', '/api/auth/user'])
+      }
+      parts.push(['history', '/api/ppt/history'], ['templates', '/api/templates'])
+      if (!state.models.length) {
+        parts.push(['models', '/api/models'])
+      }
+      parts.forEach(([key]) => commit('setLoading', { key, value: true }))
+      let responses
+      try {
+        responses = await batchAPI.get(parts.map(([, path]) => path))
+      } finally {
+        parts.forEach(([key]) => commit('setLoading', { key, value: false }))
+      }
+      const results = Object.fromEntries(parts.map(([key], index) => [key, responses[index] || {}]))
+      // 先应用成功的部分；用户信息的失败（如 401）优先抛出
+      const failed = Object.values(results).find(part => part.status !== 200)
+      if (results.user?.status === 200) {
+        commit('setUser', results.user.body.user)
+      }
+      if (results.history?.status === 200) {
+        commit('setPptHistory', (results.history.body?.items || []).map(normalizeRequest))
+      }
+      if (results.templates?.status === 200) {
+        commit('setTemplates', results.templates.body?.items || [])
+      }
+      if (results.models?.status === 200) {
+        const items = results.models.body?.items || []
+        commit('setModels', items)
+        if (!state.selectedModel && items.length) {
+          commit('setSelectedModel', items[0].id)
+        }
+      }
+      if (state.user?.isAdmin) {
+        await dispatch('fetchAdminHistory')
+      }
+      if (failed) {
+        throw batchError(failed)
+      }
+    },
     async fetchCurrentUser({ commit, state }) {
       if (!state.token) {
         return null
@@ -283,11 +327,7 @@ export default createStore({
         commit('setToken', { token: response.data.token, remember: rememberMe })
         commit('setUser', response.data.user)
         try {
-          const tasks = [dispatch('fetchPptHistory'), dispatch('fetchTemplates'), dispatch('fetchModels')]
-          if (response.data?.user?.isAdmin) {
-            tasks.push(dispatch('fetchAdminHistory'))
-          }
-          await Promise.all(tasks)
+          await dispatch('loadSessionData')
         } catch (fetchError) {
           console.error('登录后加载数据失败:', fetchError)
         }
@@ -304,11 +344,7 @@ export default createStore({
         commit('setToken', response.data.token)
         commit('setUser', response.data.user)
         try {
-          const tasks = [dispatch('fetchPptHistory'), dispatch('fetchTemplates'), dispatch('fetchModels')]
-          if (response.data?.user?.isAdmin) {
-            tasks.push(dispatch('fetchAdminHistory'))
-          }
-          await Promise.all(tasks)
+          await dispatch('loadSessionData')
         } catch (fetchError) {
           console.error('注册后加载数据失败:', fetchError)
         }